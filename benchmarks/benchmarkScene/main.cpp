@@ -0,0 +1,153 @@
+#include <ituGL/scene/Scene.h>
+#include <ituGL/scene/SceneModel.h>
+#include <ituGL/scene/SceneVisitor.h>
+#include <ituGL/scene/Transform.h>
+#include <ituGL/geometry/Model.h>
+#include <ituGL/geometry/Mesh.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/vector_relational.hpp>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Counts the models, without adding them anywhere
+class CountVisitor : public SceneVisitor
+{
+public:
+    using SceneVisitor::VisitModel;
+    void VisitModel(const SceneModel&) override { ++m_count; }
+
+    unsigned int m_count = 0;
+};
+
+// Average time of the function, in milliseconds
+template<typename F>
+double Measure(int iterations, F&& function)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        function();
+    }
+    std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    return duration.count() / iterations;
+}
+
+void RunBenchmark(unsigned int modelCount)
+{
+    const int iterations = 20;
+
+    // Same density for every count: one unit box every 4 units in a cube
+    float fieldSize = 4.0f * std::cbrt(static_cast<float>(modelCount));
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> positionDistribution(0.0f, fieldSize);
+    std::uniform_real_distribution<float> offsetDistribution(-0.05f, 0.05f);
+
+    // Meshes without submeshes use the unit box as bounds
+    std::shared_ptr<Model> model = std::make_shared<Model>(std::make_shared<Mesh>());
+
+    Scene scene;
+    std::vector<std::shared_ptr<Transform>> transforms;
+    double addTime = Measure(1, [&]()
+        {
+            for (unsigned int modelIndex = 0; modelIndex < modelCount; ++modelIndex)
+            {
+                std::shared_ptr<Transform> transform = std::make_shared<Transform>();
+                transform->SetTranslation(glm::vec3(positionDistribution(generator), positionDistribution(generator), positionDistribution(generator)));
+                transforms.push_back(transform);
+                scene.AddSceneNode(std::make_shared<SceneModel>("model " + std::to_string(modelIndex), model, transform));
+            }
+        });
+
+    double buildTime = Measure(1, [&]() { scene.UpdateBounds(); });
+
+    // 1% of the models move a bit every frame, most of them stay in their fat bounds
+    double refitTime = Measure(iterations, [&]()
+        {
+            for (unsigned int modelIndex = 0; modelIndex < modelCount; modelIndex += 100)
+            {
+                Transform& transform = *transforms[modelIndex];
+                transform.SetTranslation(transform.GetTranslation() + glm::vec3(offsetDistribution(generator), 0.0f, offsetDistribution(generator)));
+            }
+            scene.UpdateBounds();
+        });
+
+    // Camera in the middle of a side of the field, looking inside
+    glm::vec3 cameraPosition(0.5f * fieldSize, 0.5f * fieldSize, 0.0f);
+    glm::mat4 viewMatrix = glm::lookAt(cameraPosition, cameraPosition + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projMatrix = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    glm::mat4 viewProjMatrix = projMatrix * viewMatrix;
+
+    // Linear test of the world bounds of every model, computed beforehand as a lower bound of the brute force cost
+    std::vector<std::pair<glm::vec3, glm::vec3>> worldBounds(modelCount);
+    for (unsigned int modelIndex = 0; modelIndex < modelCount; ++modelIndex)
+    {
+        scene.GetModels()[modelIndex]->GetWorldBounds(worldBounds[modelIndex].first, worldBounds[modelIndex].second);
+    }
+    SceneBvh::FrustumPlanes planes = SceneBvh::GetFrustumPlanes(viewProjMatrix);
+    unsigned int linearCount = 0;
+    double linearTime = Measure(iterations, [&]()
+        {
+            linearCount = 0;
+            for (const auto& bounds : worldBounds)
+            {
+                bool inside = true;
+                for (const glm::vec4& plane : planes)
+                {
+                    glm::vec3 corner = glm::mix(bounds.first, bounds.second, glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.0f)));
+                    inside = inside && glm::dot(glm::vec3(plane), corner) + plane.w >= 0.0f;
+                }
+                linearCount += inside ? 1 : 0;
+            }
+        });
+
+    std::vector<Scene::Handle> handles;
+    handles.reserve(modelCount);
+    double frustumTime = Measure(iterations, [&]()
+        {
+            handles.clear();
+            scene.FindModels(viewProjMatrix, handles);
+        });
+    size_t frustumCount = handles.size();
+
+    double sphereTime = Measure(iterations, [&]()
+        {
+            handles.clear();
+            scene.FindModels(SphereBounds(glm::vec3(0.5f * fieldSize), 10.0f), handles);
+        });
+    size_t sphereCount = handles.size();
+
+    double rayTime = Measure(iterations, [&]()
+        {
+            handles.clear();
+            scene.FindModels(cameraPosition, glm::vec3(0.0f, 0.0f, 1.0f), fieldSize, handles);
+        });
+    size_t rayCount = handles.size();
+
+    // Traversal for the renderer, of all the models or only the ones in the frustum
+    CountVisitor visitor;
+    double visitAllTime = Measure(iterations, [&]() { visitor.m_count = 0; scene.AcceptVisitor(visitor); });
+    double visitFrustumTime = Measure(iterations, [&]() { visitor.m_count = 0; scene.AcceptVisitor(visitor, viewProjMatrix); });
+
+    const SceneBvh& bvh = scene.GetBvh();
+    std::cout << modelCount << " models, BVH height " << bvh.GetHeight() << std::endl;
+    std::cout << "  Add:             " << addTime << " ms" << std::endl;
+    std::cout << "  Build:           " << buildTime << " ms" << std::endl;
+    std::cout << "  Refit 1%:        " << refitTime << " ms" << std::endl;
+    std::cout << "  Frustum linear:  " << linearTime << " ms, " << linearCount << " models" << std::endl;
+    std::cout << "  Frustum BVH:     " << frustumTime << " ms, " << frustumCount << " models" << std::endl;
+    std::cout << "  Sphere BVH:      " << sphereTime << " ms, " << sphereCount << " models" << std::endl;
+    std::cout << "  Ray BVH:         " << rayTime << " ms, " << rayCount << " models" << std::endl;
+    std::cout << "  Visit all:       " << visitAllTime << " ms" << std::endl;
+    std::cout << "  Visit frustum:   " << visitFrustumTime << " ms, " << visitor.m_count << " models" << std::endl;
+}
+
+int main()
+{
+    RunBenchmark(10000);
+    RunBenchmark(100000);
+    return 0;
+}
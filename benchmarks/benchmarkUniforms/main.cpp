@@ -0,0 +1,180 @@
+#include <ituGL/core/DeviceGL.h>
+#include <ituGL/application/Window.h>
+#include <ituGL/shader/Shader.h>
+#include <ituGL/shader/ShaderProgram.h>
+#include <ituGL/shader/ShaderUniformCollection.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+// Every uniform is used, so the linker keeps them all
+const char* vertexShaderSource = R"(
+#version 330 core
+uniform float Float0;
+uniform float Float1;
+uniform float Float2;
+uniform float Float3;
+uniform vec4 Vector0;
+uniform vec4 Vector1;
+uniform vec4 Vector2;
+uniform vec4 Vector3;
+uniform mat4 Matrix0;
+uniform mat4 Matrix1;
+out vec4 Color;
+void main()
+{
+    Color = vec4(Float0 + Float1 + Float2 + Float3) + Vector0 + Vector1 + Vector2 + Vector3;
+    gl_Position = Matrix0 * Matrix1 * vec4(0.0, 0.0, 0.0, 1.0);
+}
+)";
+
+const char* fragmentShaderSource = R"(
+#version 330 core
+in vec4 Color;
+out vec4 FragColor;
+void main()
+{
+    FragColor = Color;
+}
+)";
+
+const std::array<const char*, 4> floatNames = { "Float0", "Float1", "Float2", "Float3" };
+const std::array<const char*, 4> vectorNames = { "Vector0", "Vector1", "Vector2", "Vector3" };
+const std::array<const char*, 2> matrixNames = { "Matrix0", "Matrix1" };
+
+// Average time of the function, in microseconds
+template<typename F>
+double Measure(int iterations, F&& function)
+{
+    glFinish();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        function(i);
+    }
+    glFinish();
+    std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+    return duration.count() / iterations;
+}
+
+int main()
+{
+    // The device initializes GLFW, so it goes before the window
+    DeviceGL device;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    Window window(64, 64, "Uniforms benchmark");
+    if (!window.IsValid())
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        return -1;
+    }
+    device.SetCurrentWindow(window);
+    if (!device.IsReady())
+    {
+        std::cout << "Failed to initialize OpenGL with GLAD" << std::endl;
+        return -2;
+    }
+
+    Shader vertexShader(Shader::VertexShader);
+    vertexShader.SetSource(vertexShaderSource);
+    Shader fragmentShader(Shader::FragmentShader);
+    fragmentShader.SetSource(fragmentShaderSource);
+    std::shared_ptr<ShaderProgram> shaderProgram = std::make_shared<ShaderProgram>();
+    if (!vertexShader.Compile() || !fragmentShader.Compile() || !shaderProgram->Build(vertexShader, fragmentShader))
+    {
+        std::cout << "Failed to build the shader program" << std::endl;
+        return -3;
+    }
+    shaderProgram->Use();
+
+    ShaderUniformCollection uniforms(shaderProgram);
+
+    std::array<UniformHandle<float>, 4> floatHandles;
+    std::array<UniformHandle<glm::vec4>, 4> vectorHandles;
+    std::array<UniformHandle<glm::mat4>, 2> matrixHandles;
+    for (size_t i = 0; i < floatNames.size(); ++i)
+    {
+        floatHandles[i] = uniforms.GetUniformHandle<float>(floatNames[i]);
+    }
+    for (size_t i = 0; i < vectorNames.size(); ++i)
+    {
+        vectorHandles[i] = uniforms.GetUniformHandle<glm::vec4>(vectorNames[i]);
+    }
+    for (size_t i = 0; i < matrixNames.size(); ++i)
+    {
+        matrixHandles[i] = uniforms.GetUniformHandle<glm::mat4>(matrixNames[i]);
+    }
+
+    // The values change every iteration, like per frame uniforms
+    auto setByName = [&](int iteration)
+        {
+            float value = static_cast<float>(iteration);
+            for (const char* name : floatNames)
+            {
+                uniforms.SetUniformValue(name, value);
+            }
+            for (const char* name : vectorNames)
+            {
+                uniforms.SetUniformValue(name, glm::vec4(value));
+            }
+            for (const char* name : matrixNames)
+            {
+                uniforms.SetUniformValue(name, glm::mat4(value));
+            }
+        };
+    auto setByHandle = [&](int iteration)
+        {
+            float value = static_cast<float>(iteration);
+            for (UniformHandle<float> handle : floatHandles)
+            {
+                uniforms.SetUniformValue(handle, value);
+            }
+            for (UniformHandle<glm::vec4> handle : vectorHandles)
+            {
+                uniforms.SetUniformValue(handle, glm::vec4(value));
+            }
+            for (UniformHandle<glm::mat4> handle : matrixHandles)
+            {
+                uniforms.SetUniformValue(handle, glm::mat4(value));
+            }
+        };
+
+    // Asking the driver for the location of each uniform, every time it is uploaded
+    GLuint programHandle = std::as_const(*shaderProgram).GetHandle();
+    auto uploadByDriverName = [&](int iteration)
+        {
+            float value = static_cast<float>(iteration);
+            for (const char* name : floatNames)
+            {
+                glUniform1f(glGetUniformLocation(programHandle, name), value);
+            }
+            for (const char* name : vectorNames)
+            {
+                glm::vec4 vector(value);
+                glUniform4fv(glGetUniformLocation(programHandle, name), 1, glm::value_ptr(vector));
+            }
+            for (const char* name : matrixNames)
+            {
+                glm::mat4 matrix(value);
+                glUniformMatrix4fv(glGetUniformLocation(programHandle, name), 1, GL_FALSE, glm::value_ptr(matrix));
+            }
+        };
+
+    const int iterations = 100000;
+    double setByNameTime = Measure(iterations, setByName);
+    double setByHandleTime = Measure(iterations, setByHandle);
+    double uploadByNameTime = Measure(iterations, [&](int iteration) { setByName(iteration); uniforms.SetUniforms(); });
+    double uploadByHandleTime = Measure(iterations, [&](int iteration) { setByHandle(iteration); uniforms.SetUniforms(); });
+    double uploadByDriverNameTime = Measure(iterations, uploadByDriverName);
+
+    std::cout << "10 uniforms, average of " << iterations << " iterations" << std::endl;
+    std::cout << "  Set by name:              " << setByNameTime << " us" << std::endl;
+    std::cout << "  Set by handle:            " << setByHandleTime << " us" << std::endl;
+    std::cout << "  Set by name and upload:   " << uploadByNameTime << " us" << std::endl;
+    std::cout << "  Set by handle and upload: " << uploadByHandleTime << " us" << std::endl;
+    std::cout << "  Driver location, upload:  " << uploadByDriverNameTime << " us" << std::endl;
+    return 0;
+}
@@ -25,23 +25,85 @@
 
 #include <ituGL/renderer/SkyboxRenderPass.h>
 #include <ituGL/renderer/ForwardRenderPass.h>
-#include <ituGL/scene/RendererSceneVisitor.h>
+#include <ituGL/renderer/SceneCopyRenderPass.h>
+#include <ituGL/renderer/DepthPrepassRenderPass.h>
+#include <ituGL/renderer/GBufferRenderPass.h>
+#include <ituGL/renderer/DeferredRenderPass.h>
+#include <ituGL/renderer/GpuCullingRenderPass.h>
+#include <ituGL/scene/DrawListSceneVisitor.h>
 #include <ituGL/scene/Transform.h>
 #include <ituGL/scene/ImGuiSceneVisitor.h>
+#include <ituGL/utils/AllocationTracker.h>
 #include <imgui.h>
 
 #include <glm/gtx/transform.hpp>  
 
 #include <numbers>
+#include <algorithm>
 #include <iostream>
+#include <chrono>
+#include <random>
+#include <unordered_map>
 #include <glm/gtx/string_cast.hpp>
 
 
 WaterApplication::WaterApplication(unsigned int x, unsigned int y)
 	: Application(1920, 1080, "Water applicaiton")
+	, m_renderFrame(nullptr)
+	, m_reflectionMode(ReflectionModePlanar)
+	, m_lightingMode(LightingModeForward)
+	, m_stressLightCount(0)
+	, m_reflectionColor(RenderGraph::InvalidResource)
+	, m_offscreenWidth(0)
+	, m_offscreenHeight(0)
+	, m_reflectionDivisor(s_qualityLevels[0].reflectionDivisor)
+	, m_reflectionPreviewVisible(false)
+	, m_sceneColor(RenderGraph::InvalidResource)
+	, m_sceneDepth(RenderGraph::InvalidResource)
+	, m_sceneWidth(0)
+	, m_sceneHeight(0)
+	, m_renderScale(s_qualityLevels[0].renderScale)
+	, m_sceneCopyWidth(0)
+	, m_sceneCopyHeight(0)
+	, m_gbufferTextures{ RenderGraph::InvalidResource, RenderGraph::InvalidResource, RenderGraph::InvalidResource }
+	, m_sceneCopyPass(nullptr)
+	, m_depthPrepass(nullptr)
+	, m_depthPrepassMode(0)
+	, m_overdrawEnableThreshold(0.0f)
+	, m_overdrawDisableThreshold(0.0f)
+	, m_gbufferPass(nullptr)
+	, m_gbufferPassIndex(-1)
+	, m_deferredPass(nullptr)
+	, m_lightVolumeStencilTest(false)
+	, m_gpuCullingPass(nullptr)
+	, m_gpuCullingMode(0)
+	, m_instanceCount(10000)
+	, m_hiZValid(false)
+	, m_hiZViewProjMatrix(1.0f)
+	, m_sceneCopyDownsample(1)
+	, m_ssrMaxDistance(50.0f)
+	, m_ssrThickness(0.5f)
+	, m_ssrMaxIterations(64)
+	, m_refractionEnabled(true)
+	, m_refractionStrength(1.0f)
+	, m_waterAbsorption(0.4f, 0.15f, 0.1f)
+	, m_occlusionCullingEnabled(false)
+	, m_gpuTimingEnabled(false)
+	, m_qualityGovernor(static_cast<int>(s_qualityLevels.size()), 8.3f)
+	, m_vsyncEnabled(true)
+	, m_simulation(WaterSimulation{ 0.0f })
+	, m_simulationTime(0.0f)
 	, m_renderer(GetDevice())
-	, m_vertexShaderLoader(Shader::Type::VertexShader)
-	, m_fragmentShaderLoader(Shader::Type::FragmentShader)
+	, m_shaderProgramCache("shader_cache")
+	, m_propsDeferred(false)
+	, m_defaultLightTypeFeature(0)
+	, m_defaultTextureArraysFeature(0)
+	, m_defaultGBufferFeature(0)
+	, m_defaultInstancedFeature(0)
+	, m_waterLightTypeFeature(0)
+	, m_waterOctavesFeature(0)
+	, m_sandCausticsFeature(0)
+	, m_waterLod(0)
 	, m_gridX(x)
 	, m_gridY(y)
 
@@ -68,15 +130,12 @@ WaterApplication::WaterApplication(unsigned int x, unsigned int y)
 	, m_wavePersistence(0.3f)
 	, m_waveLacunarity(2.18f)
 	, m_waveOctaves(8)
+	, m_appliedWaveOctaves(8)
 	, m_waveSpeed(0.5f)
 
 	//underwater caustics
-	, m_causticsColor(1.0f, 1.0f, 1.0f) // white color
-	, m_causticsIntensity(0.2f)
-	, m_causticsOffset(0.75f)
-	, m_causticsScale(1.0f)
-	, m_causticsSpeed(1.0f)
-	, m_causticsThickness(0.4f)
+	, m_causticsEnabled(true)
+	, m_caustics{ glm::vec3(1.0f, 1.0f, 1.0f), 0.2f, 0.75f, 1.0f, 1.0f, 0.4f } // white color
 
 	// clip plane
 	, m_sandBaseHeight(-1.0f)
@@ -84,6 +143,8 @@ WaterApplication::WaterApplication(unsigned int x, unsigned int y)
 	, m_clipPlane(glm::vec4(0.0f, 1.0f, 0.0f, -m_waterBaseHeight))
 
 {
+	// Render records the frames, the render thread replays them
+	SetRenderThreadEnabled(true, MAX_QUEUED_FRAMES);
 }
 
 // Helper function to ensure the offscreen buffer dimensions are a power of two
@@ -104,29 +165,95 @@ void WaterApplication::Initialize()
 {
 	Application::Initialize();
 
+	auto initializeStart = std::chrono::steady_clock::now();
+
 	// Initialize DearImGUI
 	m_imGui.Initialize(GetMainWindow());
 
-	SetupOffScreenBuffer();
+	GetDevice().SetVSyncEnabled(m_vsyncEnabled);
+
+	UpdateRenderTargetSizes();
+	InitializeShaderPermutations();
 	InitializeDefaultMaterial();
 	InitializeWaterMaterial();
 	InitializeSandMaterial();
+	InitializeDeferredMaterial();
+	UpdateUniformHandles();
 	InitializeMeshes();
 	InitializeModels();
 
 	InitializeLights();
+	InitializeStressLights();
 	InitializeCamera();
 	InitializeRenderer();
+	InitializeReflectionPreview();
+
+	// Log every quality change, to analyze the governor decisions
+	m_qualityLog.open("quality_log.csv");
+	m_qualityLog << "time,cpu_ms,gpu_ms,level,reflection_size,render_scale,wave_octaves,water_lod" << std::endl;
+	ApplyQualityLevel(m_qualityGovernor.GetLevel());
+
+	// Compare cold (empty cache) and warm startups
+	std::chrono::duration<float, std::milli> initializeTime = std::chrono::steady_clock::now() - initializeStart;
+	std::cout << "Startup: " << initializeTime.count() << " ms. Shader programs: "
+		<< m_shaderProgramCache.GetLoadedCount() << " loaded from cache, "
+		<< m_shaderProgramCache.GetCompiledCount() << " compiled, "
+		<< m_shaderProgramCache.GetBuildTime() << " ms, parallel compile "
+		<< (GetDevice().IsParallelShaderCompileSupported() ? "supported" : "not supported") << std::endl;
 
 	//depth test
 	GetDevice().EnableFeature(GL_DEPTH_TEST);
 	//GetDevice().SetWireframeEnabled(true);
+
+	// Changes recorded while initializing, by the setters that the GUI also uses. The context is still current here
+	GetFramePacket().Execute();
+
+	// Frames should not allocate memory once the caches, arenas and queues have grown
+	AllocationTracker::GetInstance().StartSteadyState();
+}
+
+void WaterApplication::FixedUpdate()
+{
+	Application::FixedUpdate();
+
+	// Only the simulation state is used here, as it can run in the job system
+	WaterSimulation& simulation = m_simulation.BeginStep();
+	simulation.time += GetFixedTimeStep();
+}
+
+void WaterApplication::PublishSimulation()
+{
+	Application::PublishSimulation();
+
+	m_simulation.Publish();
+	m_simulationTime = glm::mix(m_simulation.GetPrevious().time, m_simulation.GetCurrent().time, GetFixedAlpha());
 }
 
 void WaterApplication::Update()
 {
 	Application::Update();
 
+	// Results of the last frame that the render thread finished
+	{
+		std::lock_guard<std::mutex> lock(m_renderResultsMutex);
+		m_renderResults = m_publishedRenderResults;
+	}
+
+	// Choose the quality for this frame based on the previous frame times
+	UpdateQuality();
+
+	// Keep the stats of the job system workers in the previous frame, to show them
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	m_workerStats.resize(jobSystem.GetWorkerCount());
+	for (unsigned int workerIndex = 0; workerIndex < jobSystem.GetWorkerCount(); ++workerIndex)
+	{
+		m_workerStats[workerIndex] = jobSystem.GetWorkerStats(workerIndex);
+	}
+	jobSystem.ResetStats();
+
+	// Allocations of the previous frame, including the ones in the job system and the render thread
+	AllocationTracker::GetInstance().EndFrame();
+
 	const Window& window = GetMainWindow();
 	
 	window.GetDimensions(m_width, m_height);
@@ -145,78 +272,419 @@ void WaterApplication::Update()
 	{
 		glm::vec3 sandWorldPos = glm::vec3(m_sandTransform->GetTransformMatrix()[3]);
 		m_sandBaseHeight = sandWorldPos.y;
-		m_waterMaterial->SetUniformValue("SandBaseHeight", m_sandBaseHeight);
 	}
 
 	if (m_waterTransform)
 	{
 		glm::vec3 waterWorldPos = glm::vec3(m_waterTransform->GetTransformMatrix()[3]);
 		m_waterBaseHeight = waterWorldPos.y;
-		m_waterMaterial->SetUniformValue("WaterBaseHeight", m_waterBaseHeight);
 
 		m_clipPlane = glm::vec4(0.0f, 1.0f, 0.0f, -m_waterBaseHeight);
-		m_sandMaterial->SetUniformValue("ClipPlane", m_clipPlane);
 	}
 
-	// Add the scene nodes to the renderer
-	RendererSceneVisitor rendererSceneVisitor(m_renderer);
-	m_opaqueScene.AcceptVisitor(rendererSceneVisitor);
-	m_transparentScene.AcceptVisitor(rendererSceneVisitor);
-
+	// Targets sizes for the current window and quality level
+	UpdateRenderTargetSizes();
 }
 
 void WaterApplication::Render()
 {
 	Application::Render();
 
-	m_offscreenFBO->Bind();
-	GetDevice().Clear(true, Color(0.0f, 0.0f, 0.0f, 1.0f), true, 1.0f);
+	// The GUI goes first, so its changes are recorded before the frame and the frame has the new settings
+	DrawGUI();
+
+	FrameData& frame = m_frames[GetFramePacket().GetFrameIndex() % m_frames.size()];
+	RecordFrame(frame);
+
+	GetFramePacket().Record([this, &frame]() { RenderFrame(frame); });
+	m_imGui.EndFrame(GetFramePacket());
+	GetFramePacket().Record([this]() { EndRenderFrame(); });
+}
+
+void WaterApplication::RecordFrame(FrameData& frame)
+{
+	frame.width = m_width;
+	frame.height = m_height;
+	frame.reflectionSize = m_offscreenWidth;
+	frame.sceneWidth = m_sceneWidth;
+	frame.sceneHeight = m_sceneHeight;
+
+	const Camera& camera = *m_cameraController.GetCamera()->GetCamera();
+	frame.camera = camera;
+
+	// this flips the camera so it becomes mirrored across the water plane
+	frame.reflectionCamera = camera;
+	glm::vec3 originalPosition;
+	SetOffScreenCamera(frame.reflectionCamera, originalPosition);
+
+	// Depth linearization in the water shader needs the planes of the camera that renders it
+	camera.ExtractNearFar(frame.cameraNearFar.x, frame.cameraNearFar.y);
+
+	// The BVH of each scene finds the models in the frustum of each view. The occlusion culler tests the main view in the render thread
+	frame.mainDrawList.Clear();
+	DrawListSceneVisitor mainVisitor(frame.mainDrawList);
+	m_opaqueScene.AcceptVisitor(mainVisitor, camera.GetViewProjectionMatrix());
+	m_transparentScene.AcceptVisitor(mainVisitor, camera.GetViewProjectionMatrix());
+
+	frame.reflectionDrawList.Clear();
+	DrawListSceneVisitor reflectionVisitor(frame.reflectionDrawList);
+	m_opaqueScene.AcceptVisitor(reflectionVisitor, frame.reflectionCamera.GetViewProjectionMatrix());
+
+	frame.sandMatrix = m_sandTransform->GetTransformMatrix();
+
+	frame.simulationTime = m_simulationTime;
+	frame.clipPlane = m_clipPlane;
+	frame.sandBaseHeight = m_sandBaseHeight;
+	frame.waterBaseHeight = m_waterBaseHeight;
+
+	frame.reflectionMode = m_reflectionMode;
+	frame.deferredLighting = m_lightingMode == LightingModeDeferred;
+	frame.useSceneCopy = UsesSceneCopy();
+	frame.useSceneBuffer = UsesSceneBuffer();
+	frame.stressLightCount = m_stressLightCount;
+	frame.reflectionPreview = m_reflectionPreviewVisible && m_reflectionMode == ReflectionModePlanar;
+
+	frame.defaultFeatureMask = GetDefaultFeatureMask();
+	frame.gbufferFeatureMask = GetGBufferFeatureMask();
+	frame.instancedFeatureMask = GetInstancedFeatureMask();
+	frame.waterFeatureMask = GetWaterFeatureMask();
+	frame.sandFeatureMask = GetSandFeatureMask();
+	frame.caustics = m_caustics;
+}
+
+template<typename T>
+void WaterApplication::RecordUniformValue(Material& material, const char* name, const T& value)
+{
+	GetFramePacket().Record([&material, name, value]() { material.SetUniformValue(name, value); });
+}
+
+void WaterApplication::RecordPrebuild(ShaderPermutations& permutations, ShaderPermutations::FeatureMask featureMask)
+{
+	// Compiling needs the context
+	GetFramePacket().Record([&permutations, featureMask]() { permutations.Prebuild(featureMask); });
+}
+
+void WaterApplication::RenderFrame(const FrameData& frame)
+{
+	m_renderFrame = &frame;
+	m_viewCamera = frame.camera;
+	m_reflectionCamera = frame.reflectionCamera;
+
+	UpdateShaderPermutations(frame);
+
+	// Transient renderer data of this frame goes to the next frame arena
+	m_renderer.BeginFrame();
+
+	m_profiler.BeginFrame();
+
+	m_waterMaterial->SetUniformValue(m_cameraNearFarUniform, frame.cameraNearFar);
+	m_waterMaterial->SetUniformValue(m_sandBaseHeightUniform, frame.sandBaseHeight);
+	m_waterMaterial->SetUniformValue(m_waterBaseHeightUniform, frame.waterBaseHeight);
+	m_sandMaterial->SetUniformValue(m_sandClipPlaneUniform, frame.clipPlane);
+	m_depthPrepass->SetClipPlane(frame.clipPlane);
+
+	// Only the main view uses the deferred passes, the reflection disables them while it renders
+	m_gbufferPass->SetEnabled(frame.deferredLighting);
+	m_deferredPass->SetEnabled(frame.deferredLighting);
+
+	// Targets are taken from the pool with the size of the frame
+	ResizeSceneCopy(frame);
+
+	BuildRenderGraph(frame);
+	m_renderGraph.Compile();
+	m_renderGraph.Execute();
+
+	// Closed in EndRenderFrame, after the GUI draw data of the packet
+	m_profiler.BeginSection("GUI");
+}
+
+void WaterApplication::EndRenderFrame()
+{
+	m_profiler.EndSection();
+	m_profiler.EndFrame();
+
+	PublishRenderResults();
+	m_renderFrame = nullptr;
+}
+
+void WaterApplication::PublishRenderResults()
+{
+	std::lock_guard<std::mutex> lock(m_renderResultsMutex);
+	RenderResults& results = m_publishedRenderResults;
+
+	m_profiler.GetResults(results.profiler);
+	m_renderGraph.GetResults(results.renderGraph);
+
+	// The counters start again in the next frame
+	RenderStateTracker& renderStateTracker = m_renderer.GetRenderStateTracker();
+	results.renderStateTransitions = renderStateTracker.GetTransitionCount();
+	results.renderStateCalls = renderStateTracker.GetStateCallCount();
+	results.textureBindCalls = renderStateTracker.GetTextureBindCount();
+	results.renderStateBlockCount = RenderState::GetBlockCount();
+	renderStateTracker.ResetCounters();
+
+	results.commandListStats = m_renderer.GetCommandListStats();
+	m_renderer.ResetCommandListStats();
+	results.frameArenaStats = m_renderer.GetFrameArenaStats();
+
+	results.opaqueOverdraw = m_depthPrepass->GetOverdraw();
+	results.depthPrepassActive = m_depthPrepass->IsActive();
+	results.occlusionStats = m_occlusionCuller.GetStats();
+	results.deferredStats = m_deferredPass->GetStats();
+	results.gpuCullingStats = m_gpuCullingPass->GetStats();
+	results.hiZValid = m_hiZValid;
+
+	results.propsDeferred = m_propsDeferred;
+	results.waterPermutationCount = m_waterPermutations->GetShaderProgramCount();
+	results.pendingWaterPermutationCount = m_waterPermutations->GetPendingShaderProgramCount();
+	results.causticsUniformsFound = m_sandMaterial->GetUniformLocation("CausticsColor") >= 0;
+}
+
+void WaterApplication::BuildRenderGraph(const FrameData& frame)
+{
+	m_renderGraph.Reset(frame.width, frame.height);
+
+	bool planarReflection = frame.reflectionMode == ReflectionModePlanar;
+	bool useSceneBuffer = frame.useSceneBuffer;
+	bool deferredLighting = frame.deferredLighting;
+	int sceneWidth = frame.sceneWidth;
+	int sceneHeight = frame.sceneHeight;
+
+	// Culled when the water does not read it. Screen space reflections reuse the main pass instead
+	{
+		RenderGraph::PassBuilder builder = m_renderGraph.AddPass("Reflection", [this, &frame](RenderGraph& renderGraph) { RenderReflection(renderGraph, frame); });
+
+		int size = static_cast<int>(frame.reflectionSize);
+		m_reflectionColor = builder.CreateTexture("ReflectionColor", RenderGraph::TextureDesc{ size, size, TextureObject::FormatRGBA, TextureObject::InternalFormatRGBA8 });
+		builder.WriteColor(m_reflectionColor, true);
+		builder.WriteDepth(builder.CreateTexture("ReflectionDepth", RenderGraph::TextureDesc{ size, size, TextureObject::FormatDepth, TextureObject::InternalFormatDepth24 }), true);
+	}
+
+	// The debug window shows the reflection with a texture outside of the graph, so the pass is never culled
+	if (frame.reflectionPreview)
+	{
+		RenderGraph::PassBuilder builder = m_renderGraph.AddPass("ReflectionPreview", [this](RenderGraph& renderGraph) { CopyReflectionPreview(renderGraph); });
+		builder.Read(m_reflectionColor);
+
+		RenderGraph::TextureDesc previewDesc{ REFLECTION_PREVIEW_SIZE, REFLECTION_PREVIEW_SIZE, TextureObject::FormatRGBA, TextureObject::InternalFormatRGBA8 };
+		builder.WriteColor(m_renderGraph.ImportTexture("ReflectionPreview", m_reflectionPreviewTexture, previewDesc));
+	}
+
+	// G-buffer of the props, sharing the scene depth with the main pass
+	if (deferredLighting)
+	{
+		assert(useSceneBuffer);
+		RenderGraph::PassBuilder builder = m_renderGraph.AddPass("GBuffer", [this, &frame](RenderGraph& renderGraph) { RenderGBuffer(renderGraph, frame); });
+
+		m_gbufferTextures[0] = builder.CreateTexture("GBufferAlbedo", RenderGraph::TextureDesc{ sceneWidth, sceneHeight, TextureObject::FormatRGBA, TextureObject::InternalFormatSRGBA8 });
+		m_gbufferTextures[1] = builder.CreateTexture("GBufferNormal", RenderGraph::TextureDesc{ sceneWidth, sceneHeight, TextureObject::FormatRG, TextureObject::InternalFormatRG16F });
+		m_gbufferTextures[2] = builder.CreateTexture("GBufferOthers", RenderGraph::TextureDesc{ sceneWidth, sceneHeight, TextureObject::FormatRGBA, TextureObject::InternalFormatRGBA8 });
+		for (RenderGraph::ResourceHandle gbufferTexture : m_gbufferTextures)
+		{
+			builder.WriteColor(gbufferTexture, true, Color(0.0f, 0.0f, 0.0f, 0.0f));
+		}
+
+		// The deferred lighting marks the pixels inside the light volumes in the stencil
+		m_sceneDepth = builder.CreateTexture("SceneDepth", RenderGraph::TextureDesc{ sceneWidth, sceneHeight, TextureObject::FormatDepthStencil, TextureObject::InternalFormatDepth24Stencil8 });
+		builder.WriteDepth(m_sceneDepth, true);
+	}
+	else
+	{
+		m_gbufferTextures.fill(RenderGraph::InvalidResource);
+	}
+
+	// Render the main pass to the scene buffer when it needs to be upscaled or copied, and blit it to the window later
+	{
+		RenderGraph::PassBuilder builder = m_renderGraph.AddPass("Main", [this, &frame](RenderGraph& renderGraph) { RenderMain(renderGraph, frame); });
+
+		if (planarReflection)
+		{
+			builder.Read(m_reflectionColor);
+		}
+
+		if (useSceneBuffer)
+		{
+			// sRGB color, so the blit to the window keeps the same encoding as rendering directly to it
+			m_sceneColor = builder.CreateTexture("SceneColor", RenderGraph::TextureDesc{ sceneWidth, sceneHeight, TextureObject::FormatRGBA, TextureObject::InternalFormatSRGBA8 });
+			builder.WriteColor(m_sceneColor, true);
+
+			// Already written by the G-buffer pass in deferred mode, so it is not cleared again
+			if (!deferredLighting)
+			{
+				m_sceneDepth = builder.CreateTexture("SceneDepth", RenderGraph::TextureDesc{ sceneWidth, sceneHeight, TextureObject::FormatDepth, TextureObject::InternalFormatDepth24 });
+			}
+			builder.WriteDepth(m_sceneDepth, true);
+		}
+		else
+		{
+			m_sceneColor = RenderGraph::InvalidResource;
+			m_sceneDepth = RenderGraph::InvalidResource;
+			builder.WriteBackbuffer(true, true);
+		}
+
+		// Lit into the scene color by the deferred pass
+		if (deferredLighting)
+		{
+			for (RenderGraph::ResourceHandle gbufferTexture : m_gbufferTextures)
+			{
+				builder.Read(gbufferTexture);
+			}
+		}
+	}
+
+	if (useSceneBuffer)
+	{
+		RenderGraph::PassBuilder builder = m_renderGraph.AddPass("Present", [this, &frame](RenderGraph& renderGraph) { PresentScene(renderGraph, frame); });
+		builder.Read(m_sceneColor);
+		builder.WriteBackbuffer();
+	}
+
+	// The window stays bound after the last pass, for the GUI draw data of the frame packet
+}
 
+void WaterApplication::RenderReflection(RenderGraph& renderGraph, const FrameData& frame)
+{
 	// enable clip distance for the reflection pass
 	GetDevice().EnableFeature(GL_CLIP_DISTANCE0);
 
-	glViewport(0, 0, m_offscreenWidth, m_offscreenHeight);
+	// Only the main pass copies the scene and draws the instances, that are under the water
+	m_sceneCopyPass->SetEnabled(false);
+	m_gpuCullingPass->SetEnabled(false);
 
+	// The reflection view is always lit forward, the G-buffer textures have the size and the camera of the main view
+	m_gbufferPass->SetEnabled(false);
+	m_deferredPass->SetEnabled(false);
+
+	// Only the models in the frustum of the reflection camera, found by the main thread
+	// The drawcalls keep the material, so the props can go back to the G-buffer materials once they are added
 	m_renderer.Reset(); 
-	RendererSceneVisitor offVis(m_renderer);
-	m_opaqueScene.AcceptVisitor(offVis);
+	if (m_propsDeferred)
+	{
+		SetPropMaterials(false);
+	}
+	frame.reflectionDrawList.Submit(m_renderer);
+	if (m_propsDeferred)
+	{
+		SetPropMaterials(true);
+	}
 
-	// Get the current camera
-	std::shared_ptr<SceneCamera> sceneCamera = m_cameraController.GetCamera();
-	Camera& camera = *sceneCamera->GetCamera();
+	// Set the reflection cam, mirrored across the water plane
+	m_renderer.SetCurrentCamera(m_reflectionCamera);
 
-	// copy the camera to a new one to modify it for the reflection pass
-	std::shared_ptr<Camera> reflectionCam = std::make_shared<Camera>(camera); 
+	// first render pass for the offscreen framebuffer, bound by the graph
+	m_renderer.SyncCurrentFramebuffer(renderGraph.GetCurrentFramebuffer());
+	m_renderer.Render();
 
-	// Set the reflection cam
-	m_renderer.SetCurrentCamera(*reflectionCam);
-	glm::vec3 originalPosition;
+	m_gbufferPass->SetEnabled(frame.deferredLighting);
+	m_deferredPass->SetEnabled(frame.deferredLighting);
 
-	// this flips the camera so it becomes mirrored across the water plane, by offseting the height and inverting the pitch
-	SetOffScreenCamera(*reflectionCam, originalPosition);
+	GetDevice().DisableFeature(GL_CLIP_DISTANCE0);
+}
 
-	// first render pass for the offscreen framebuffer
-	m_renderer.Render();
+void WaterApplication::CopyReflectionPreview(RenderGraph& renderGraph)
+{
+	const RenderGraph::TextureDesc& reflectionDesc = renderGraph.GetTextureDesc(m_reflectionColor);
+	renderGraph.GetFramebuffer(m_reflectionColor, RenderGraph::InvalidResource)->Bind(FramebufferObject::Target::Read);
+	glBlitFramebuffer(0, 0, reflectionDesc.width, reflectionDesc.height, 0, 0, REFLECTION_PREVIEW_SIZE, REFLECTION_PREVIEW_SIZE, GL_COLOR_BUFFER_BIT, GL_LINEAR);
 
+	renderGraph.GetCurrentFramebuffer()->Bind();
+}
 
-	m_renderer.SetCurrentCamera(camera); // reset to original camera
+void WaterApplication::RenderGBuffer(RenderGraph& renderGraph, const FrameData& frame)
+{
+	// The scene is added once for both graph passes, the main pass renders the rest of the renderer passes
+	AddMainView(frame);
 
-	GetDevice().DisableFeature(GL_CLIP_DISTANCE0);
-	FramebufferObject::Unbind();
-	glViewport(0, 0, m_width, m_height);
+	m_gbufferPass->SetTargetFramebuffer(renderGraph.GetCurrentFramebuffer());
+	m_renderer.SyncCurrentFramebuffer(renderGraph.GetCurrentFramebuffer());
+	m_renderer.RenderSinglePass(m_gbufferPassIndex);
+}
 
-	GetDevice().Clear(true, Color(0.0f, 0.0f, 0.0f, 1.0f), true, 1.0f);
+void WaterApplication::RenderMain(RenderGraph& renderGraph, const FrameData& frame)
+{
+	// The reflection texture is assigned by the graph every frame
+	if (frame.reflectionMode == ReflectionModePlanar)
+	{
+		m_waterMaterial->SetUniformValue(m_reflectionTextureUniform, renderGraph.GetTexture(m_reflectionColor));
+	}
 
-	m_renderer.Reset(); 
-	RendererSceneVisitor onVis(m_renderer);
-	m_opaqueScene.AcceptVisitor(onVis);
-	m_transparentScene.AcceptVisitor(onVis);
+	// The scene copy always renders to the scene buffer
+	bool useSceneCopy = frame.useSceneCopy;
+	m_sceneCopyPass->SetEnabled(useSceneCopy);
+	if (useSceneCopy)
+	{
+		m_sceneCopyPass->SetSource(renderGraph.GetFramebuffer(m_sceneColor, m_sceneDepth), renderGraph.GetTexture(m_sceneDepth));
+	}
+
+	// The depth pyramid still has the previous frame, it is built after the instances are drawn
+	m_gpuCullingPass->SetEnabled(true);
+	m_gpuCullingPass->SetHiZ(m_hiZValid ? m_sceneCopyPass->GetDepthPyramidTexture() : nullptr, m_sceneCopyPass->GetDepthPyramidLevelCount(), m_hiZViewProjMatrix);
+
+	// The props in the G-buffer textures are lit into the scene color
+	bool deferredLighting = frame.deferredLighting;
+	if (deferredLighting)
+	{
+		m_deferredPass->SetTargetFramebuffer(renderGraph.GetCurrentFramebuffer());
+
+		m_deferredMaterial->SetUniformValue(m_deferredDepthTextureUniform, renderGraph.GetTexture(m_sceneDepth));
+		for (size_t gbufferIndex = 0; gbufferIndex < m_gbufferTextures.size(); ++gbufferIndex)
+		{
+			m_deferredMaterial->SetUniformValue(m_gbufferTextureUniforms[gbufferIndex], renderGraph.GetTexture(m_gbufferTextures[gbufferIndex]));
+		}
+	}
+
+	// The G-buffer pass already added the scene
+	if (!deferredLighting)
+	{
+		AddMainView(frame);
+	}
 
 	// rerender scene for on screen framebuffer
-	m_renderer.Render(); 
+	m_renderer.SyncCurrentFramebuffer(renderGraph.GetCurrentFramebuffer());
+	m_renderer.Render(deferredLighting ? m_gbufferPassIndex + 1 : 0);
 
-	// Render the debug user interface  
-	RenderGUI();
+	// Used to cull the instances of the next frame
+	m_hiZValid = useSceneCopy;
+	m_hiZViewProjMatrix = m_viewCamera.GetViewProjectionMatrix();
+
+	// Leave the framebuffer of the pass bound for the graph
+	m_renderer.SetCurrentFramebuffer(renderGraph.GetCurrentFramebuffer());
+}
+
+void WaterApplication::AddMainView(const FrameData& frame)
+{
+	// Rasterize the occluders of this view before the scene is added to the renderer
+	{
+		Profiler::Scope occlusionScope(m_profiler, "Occlusion");
+		m_occlusionCuller.Begin(m_viewCamera.GetViewProjectionMatrix());
+		m_occlusionCuller.AddOccluder(m_sandOccluder, frame.sandMatrix);
+		m_occlusionCuller.Rasterize();
+	}
+
+	m_renderer.Reset(); 
+	m_renderer.SetCurrentCamera(m_viewCamera);
+	m_renderer.SetOcclusionCuller(&m_occlusionCuller);
+	// The models in the frustum were found by the main thread, the occlusion culler tests their submeshes
+	frame.mainDrawList.Submit(m_renderer);
+
+	// Only in the main view, the reflection keeps the scene lights
+	for (int lightIndex = 0; lightIndex < frame.stressLightCount; ++lightIndex)
+	{
+		m_renderer.AddLight(*m_stressLights[lightIndex]);
+	}
+
+	// The occluders were rasterized for this view only. The reflection view, for example, clips the sand
+	m_renderer.SetOcclusionCuller(nullptr);
+}
+
+void WaterApplication::PresentScene(RenderGraph& renderGraph, const FrameData& frame)
+{
+	// The window is already bound for drawing
+	renderGraph.GetFramebuffer(m_sceneColor, m_sceneDepth)->Bind(FramebufferObject::Target::Read);
+	glBlitFramebuffer(0, 0, frame.sceneWidth, frame.sceneHeight, 0, 0, frame.width, frame.height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	// Keep the window bound for the next passes
+	renderGraph.GetCurrentFramebuffer()->Bind();
 }
 
 void WaterApplication::Cleanup()
@@ -259,45 +727,195 @@ void WaterApplication::InitializeLights()
 	//pointLight->SetDistanceAttenuation(glm::vec2(5.0f, 10.0f));
 	//m_scene.AddSceneNode(std::make_shared<SceneLight>("point light", pointLight));
 }
-void WaterApplication::InitializeDefaultMaterial()
+
+void WaterApplication::InitializeStressLights()
 {
-	// Load and build shader
-	std::vector<const char*> vertexShaderPaths;
-	vertexShaderPaths.push_back("shaders/version330.glsl");
-	vertexShaderPaths.push_back("shaders/default.vert");
-	Shader vertexShader = ShaderLoader(Shader::VertexShader).Load(vertexShaderPaths);
+	// Same lights on every run, so the timings of both lighting modes can be compared
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> xDistribution(4.0f, 16.0f);
+	std::uniform_real_distribution<float> zDistribution(2.0f, 16.0f);
+	std::uniform_real_distribution<float> heightDistribution(0.2f, 1.5f);
+	std::uniform_real_distribution<float> hueDistribution(0.0f, 1.0f);
+
+	// Above the props, that are placed on the water surface
+	float height = m_waterBaseHeight + 1.0f;
 
-	std::vector<const char*> fragmentShaderPaths;
-	fragmentShaderPaths.push_back("shaders/version330.glsl");
-	fragmentShaderPaths.push_back("shaders/utils.glsl");
-	fragmentShaderPaths.push_back("shaders/lambert-ggx.glsl");
-	fragmentShaderPaths.push_back("shaders/lighting.glsl");
-	fragmentShaderPaths.push_back("shaders/default_pbr.frag");
-	Shader fragmentShader = ShaderLoader(Shader::FragmentShader).Load(fragmentShaderPaths);
+	m_stressLights.reserve(MAX_STRESS_LIGHTS);
+	for (int lightIndex = 0; lightIndex < MAX_STRESS_LIGHTS; ++lightIndex)
+	{
+		float x = xDistribution(generator);
+		float z = zDistribution(generator);
+		float y = height + heightDistribution(generator);
+
+		// Saturated color from the hue
+		float hue = hueDistribution(generator);
+		glm::vec3 color = glm::clamp(glm::abs(glm::fract(glm::vec3(hue) + glm::vec3(1.0f, 2.0f / 3.0f, 1.0f / 3.0f)) * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+
+		std::shared_ptr<PointLight> pointLight = std::make_shared<PointLight>();
+		pointLight->SetPosition(glm::vec3(x, y, z));
+		pointLight->SetDistanceAttenuation(glm::vec2(0.5f, 2.5f));
+		pointLight->SetColor(color);
+		pointLight->SetIntensity(0.5f);
+		m_stressLights.push_back(pointLight);
+	}
+}
 
-	std::shared_ptr<ShaderProgram> shaderProgramPtr = std::make_shared<ShaderProgram>();
-	shaderProgramPtr->Build(vertexShader, fragmentShader);
+// The water and the sand are only lit by the first light, the directional light of the scene
+// The stress lights are only for the props, otherwise both lighting modes would draw the water once per light
+static Renderer::UpdateLightsFunction GetFirstLightFunction(Renderer::UpdateLightsFunction updateLightsFunction)
+{
+	return [=](const ShaderProgram& shaderProgram, std::span<const Light* const> lights, unsigned int& lightIndex)
+		{
+			return updateLightsFunction(shaderProgram, lights.first(std::min<size_t>(lights.size(), 1)), lightIndex);
+		};
+}
 
-	// Get transform related uniform locations
-	ShaderProgram::Location cameraPositionLocation = shaderProgramPtr->GetUniformLocation("CameraPosition");
-	ShaderProgram::Location worldMatrixLocation = shaderProgramPtr->GetUniformLocation("WorldMatrix");
-	ShaderProgram::Location viewProjMatrixLocation = shaderProgramPtr->GetUniformLocation("ViewProjMatrix");
-	ShaderProgram::Location clipPlaneLocation = shaderProgramPtr->GetUniformLocation("ClipPlane");
+void WaterApplication::InitializeShaderPermutations()
+{
+	{
+		// Default material shaders
+		std::vector<const char*> vertexShaderPaths;
+		vertexShaderPaths.push_back("shaders/version330.glsl");
+		vertexShaderPaths.push_back("shaders/default.vert");
+
+		std::vector<const char*> fragmentShaderPaths;
+		fragmentShaderPaths.push_back("shaders/version330.glsl");
+		fragmentShaderPaths.push_back("shaders/utils.glsl");
+		fragmentShaderPaths.push_back("shaders/lambert-ggx.glsl");
+		fragmentShaderPaths.push_back("shaders/lighting.glsl");
+		fragmentShaderPaths.push_back("shaders/default_pbr.frag");
+
+		m_defaultPermutations = std::make_shared<ShaderPermutations>(vertexShaderPaths, fragmentShaderPaths);
+		m_defaultPermutations->SetShaderProgramCache(&m_shaderProgramCache);
+		m_defaultLightTypeFeature = m_defaultPermutations->AddFeature("LIGHT_TYPE", 2);
+		m_defaultTextureArraysFeature = m_defaultPermutations->AddFeature("TEXTURE_ARRAYS");
+		m_defaultGBufferFeature = m_defaultPermutations->AddFeature("GBUFFER");
+		m_defaultInstancedFeature = m_defaultPermutations->AddFeature("INSTANCED");
+
+		// Register each permutation with the renderer when it is built
+		m_defaultPermutations->SetBuildFunction([=](std::shared_ptr<ShaderProgram> shaderProgramPtr, ShaderPermutations::FeatureMask /*featureMask*/)
+			{
+				// Get transform related uniform locations
+				ShaderProgram::Location cameraPositionLocation = shaderProgramPtr->GetUniformLocation("CameraPosition");
+				ShaderProgram::Location worldMatrixLocation = shaderProgramPtr->GetUniformLocation("WorldMatrix");
+				ShaderProgram::Location viewProjMatrixLocation = shaderProgramPtr->GetUniformLocation("ViewProjMatrix");
+				ShaderProgram::Location clipPlaneLocation = shaderProgramPtr->GetUniformLocation("ClipPlane");
+
+				m_renderer.RegisterShaderProgram(shaderProgramPtr,
+					[=](const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, const Camera& camera, bool cameraChanged)
+					{
+						if (cameraChanged)
+						{
+							shaderProgram.SetUniform(cameraPositionLocation, camera.ExtractTranslation());
+							shaderProgram.SetUniform(viewProjMatrixLocation, camera.GetViewProjectionMatrix());
+						}
+						shaderProgram.SetUniform(worldMatrixLocation, worldMatrix);
+						shaderProgram.SetUniform(clipPlaneLocation, m_renderFrame->clipPlane);
+					},
+					m_renderer.GetDefaultUpdateLightsFunction(*shaderProgramPtr)
+				);
+			});
+	}
 
-	// Register shader with renderer
-	m_renderer.RegisterShaderProgram(shaderProgramPtr,
-		[=](const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, const Camera& camera, bool cameraChanged)
-		{
-			if (cameraChanged)
+	{
+		// Water material shaders
+		std::vector<const char*> vertexShaderPaths;
+		vertexShaderPaths.push_back("shaders/version330.glsl");
+		vertexShaderPaths.push_back("shaders/water.vert");
+
+		std::vector<const char*> fragmentShaderPaths;
+		fragmentShaderPaths.push_back("shaders/version330.glsl");
+		fragmentShaderPaths.push_back("shaders/utils.glsl");
+		fragmentShaderPaths.push_back("shaders/lambert-ggx.glsl");
+		fragmentShaderPaths.push_back("shaders/lighting.glsl");
+		fragmentShaderPaths.push_back("shaders/ssr.glsl");
+		fragmentShaderPaths.push_back("shaders/water.frag");
+
+		// The octave count is a constant in each permutation, so the noise loop is unrolled
+		m_waterPermutations = std::make_shared<ShaderPermutations>(vertexShaderPaths, fragmentShaderPaths);
+		m_waterPermutations->SetShaderProgramCache(&m_shaderProgramCache);
+		m_waterOctavesFeature = m_waterPermutations->AddFeature("WAVE_OCTAVES", 4);
+		m_waterLightTypeFeature = m_waterPermutations->AddFeature("LIGHT_TYPE", 2);
+
+		m_waterPermutations->SetBuildFunction([=](std::shared_ptr<ShaderProgram> waterShaderProgram, ShaderPermutations::FeatureMask /*featureMask*/)
 			{
-				shaderProgram.SetUniform(cameraPositionLocation, camera.ExtractTranslation());
-				shaderProgram.SetUniform(viewProjMatrixLocation, camera.GetViewProjectionMatrix());
-			}
-			shaderProgram.SetUniform(worldMatrixLocation, worldMatrix);
-			shaderProgram.SetUniform(clipPlaneLocation, m_clipPlane);
-		},
-		m_renderer.GetDefaultUpdateLightsFunction(*shaderProgramPtr)
-	);
+				ShaderProgram::Location cameraPositionLocation = waterShaderProgram->GetUniformLocation("CameraPosition");
+				ShaderProgram::Location worldMatrixLocation = waterShaderProgram->GetUniformLocation("WorldMatrix");
+				ShaderProgram::Location viewProjMatrixLocation = waterShaderProgram->GetUniformLocation("ViewProjMatrix");
+				ShaderProgram::Location timeLocation = waterShaderProgram->GetUniformLocation("Time");
+
+				m_renderer.RegisterShaderProgram(waterShaderProgram,
+					[=](const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, const Camera& camera, bool cameraChanged)
+					{
+						if (cameraChanged)
+						{
+							shaderProgram.SetUniform(cameraPositionLocation, camera.ExtractTranslation());
+							shaderProgram.SetUniform(viewProjMatrixLocation, camera.GetViewProjectionMatrix());
+						}
+						shaderProgram.SetUniform(worldMatrixLocation, worldMatrix);
+						shaderProgram.SetUniform(timeLocation, m_renderFrame->simulationTime); // Pass the time to the shader
+					},
+					GetFirstLightFunction(m_renderer.GetDefaultUpdateLightsFunction(*waterShaderProgram))
+				);
+			});
+	}
+
+	{
+		// Sand material shaders
+		std::vector<const char*> vertexShaderPaths;
+		vertexShaderPaths.push_back("shaders/version330.glsl");
+		vertexShaderPaths.push_back("shaders/sand.vert");
+
+		std::vector<const char*> fragmentShaderPaths;
+		fragmentShaderPaths.push_back("shaders/version330.glsl");
+		fragmentShaderPaths.push_back("shaders/sand.frag");
+
+		// Without caustics, the sand shader is a single texture fetch
+		m_sandPermutations = std::make_shared<ShaderPermutations>(vertexShaderPaths, fragmentShaderPaths);
+		m_sandPermutations->SetShaderProgramCache(&m_shaderProgramCache);
+		m_sandCausticsFeature = m_sandPermutations->AddFeature("CAUSTICS");
+
+		m_sandPermutations->SetBuildFunction([=](std::shared_ptr<ShaderProgram> sandShaderProgram, ShaderPermutations::FeatureMask /*featureMask*/)
+			{
+				ShaderProgram::Location worldMatrixLocation = sandShaderProgram->GetUniformLocation("WorldMatrix");
+				ShaderProgram::Location viewProjMatrixLocation = sandShaderProgram->GetUniformLocation("ViewProjMatrix");
+				ShaderProgram::Location timeLocation = sandShaderProgram->GetUniformLocation("Time");
+
+				m_renderer.RegisterShaderProgram(sandShaderProgram,
+					[=](const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, const Camera& camera, bool /*cameraChanged*/)
+					{
+						shaderProgram.SetUniform(worldMatrixLocation, worldMatrix);
+						shaderProgram.SetUniform(viewProjMatrixLocation, camera.GetViewProjectionMatrix());
+						shaderProgram.SetUniform(timeLocation, m_renderFrame->simulationTime); // Pass the time to the shader 
+					},
+
+					GetFirstLightFunction(m_renderer.GetDefaultUpdateLightsFunction(*sandShaderProgram))
+				);
+			});
+	}
+
+	// Submit all the programs needed to start, so the driver can compile them in parallel
+	// Materials wait for them when they are created, but only the first one stalls for the compile
+	m_defaultPermutations->Prebuild(GetDefaultFeatureMask());
+	m_defaultPermutations->Prebuild(GetInstancedFeatureMask());
+	m_waterPermutations->Prebuild(GetWaterFeatureMask());
+	m_sandPermutations->Prebuild(GetSandFeatureMask());
+
+	// If the driver compiles in its own threads, also prepare the octave counts of the quality levels, so changing level doesn't stall
+	if (GetDevice().IsParallelShaderCompileSupported())
+	{
+		for (const QualitySettings& settings : s_qualityLevels)
+		{
+			int waveOctaves = std::min(m_waveOctaves, settings.waveOctaves);
+			ShaderPermutations::FeatureMask featureMask = m_waterPermutations->SetFeatureValue(0, m_waterOctavesFeature, waveOctaves);
+			m_waterPermutations->Prebuild(m_waterPermutations->SetFeatureValue(featureMask, m_waterLightTypeFeature, LightTypeDirectional));
+		}
+	}
+}
+
+void WaterApplication::InitializeDefaultMaterial()
+{
+	std::shared_ptr<ShaderProgram> shaderProgramPtr = m_defaultPermutations->GetShaderProgram(GetDefaultFeatureMask());
 
 	// Filter out uniforms that are not material properties
 	ShaderUniformCollection::NameSet filteredUniforms;
@@ -315,49 +933,13 @@ void WaterApplication::InitializeDefaultMaterial()
 	assert(shaderProgramPtr);
 	m_defaultMaterial = std::make_shared<Material>(shaderProgramPtr, filteredUniforms);
 
+	// The prop materials change permutation with the lighting mode
+	m_defaultFilteredUniforms = filteredUniforms;
 }
 
 void WaterApplication::InitializeWaterMaterial()
 {
-
-	std::vector<const char*> vertexShaderPaths;
-	vertexShaderPaths.push_back("shaders/version330.glsl");
-	vertexShaderPaths.push_back("shaders/water.vert");
-
-	Shader waterVS = ShaderLoader(Shader::VertexShader).Load(vertexShaderPaths);
-
-	std::vector<const char*> fragmentShaderPaths;
-	fragmentShaderPaths.push_back("shaders/version330.glsl");
-	fragmentShaderPaths.push_back("shaders/utils.glsl");
-	fragmentShaderPaths.push_back("shaders/lambert-ggx.glsl");
-	fragmentShaderPaths.push_back("shaders/lighting.glsl");
-	fragmentShaderPaths.push_back("shaders/water.frag");
-
-	Shader waterFS = ShaderLoader(Shader::FragmentShader).Load(fragmentShaderPaths);
-
-	std::shared_ptr<ShaderProgram> waterShaderProgram = std::make_shared<ShaderProgram>();
-	waterShaderProgram->Build(waterVS, waterFS);
-
-
-	ShaderProgram::Location cameraPositionLocation = waterShaderProgram->GetUniformLocation("CameraPosition");
-	ShaderProgram::Location worldMatrixLocation = waterShaderProgram->GetUniformLocation("WorldMatrix");
-	ShaderProgram::Location viewProjMatrixLocation = waterShaderProgram->GetUniformLocation("ViewProjMatrix");
-	ShaderProgram::Location timeLocation = waterShaderProgram->GetUniformLocation("Time");
-
-	m_renderer.RegisterShaderProgram(waterShaderProgram,
-		[=](const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, const Camera& camera, bool cameraChanged)
-		{
-			if (cameraChanged)
-			{
-				shaderProgram.SetUniform(cameraPositionLocation, camera.ExtractTranslation());
-				shaderProgram.SetUniform(viewProjMatrixLocation, camera.GetViewProjectionMatrix());
-			}
-			shaderProgram.SetUniform(worldMatrixLocation, worldMatrix);
-			shaderProgram.SetUniform(timeLocation, static_cast<float>(GetTime())); // Pass the time to the shader
-		},
-		m_renderer.GetDefaultUpdateLightsFunction(*waterShaderProgram)
-	);
-
+	std::shared_ptr<ShaderProgram> waterShaderProgram = m_waterPermutations->GetShaderProgram(GetWaterFeatureMask());
 
 	m_waterMaterial = std::make_shared<Material>(waterShaderProgram);
 
@@ -380,41 +962,34 @@ void WaterApplication::InitializeWaterMaterial()
 	m_waterMaterial->SetUniformValue("WaveFrequency", m_waveFrequency);
 	m_waterMaterial->SetUniformValue("WavePersistence", m_wavePersistence);
 	m_waterMaterial->SetUniformValue("WaveLacunarity", m_waveLacunarity);
-	m_waterMaterial->SetUniformValue("WaveOctaves", m_waveOctaves);
 	m_waterMaterial->SetUniformValue("WaveSpeed", m_waveSpeed);
 
 	m_waterMaterial->SetUniformValue("SandBaseHeight", m_sandBaseHeight);
 	m_waterMaterial->SetUniformValue("WaterBaseHeight", m_waterBaseHeight);
 
-	m_waterMaterial->SetUniformValue("ReflectionTexture", m_offscreenColorTex);
+	// Screen space reflection uniforms. Scene copy and skybox textures are set once they are created
+	m_waterMaterial->SetUniformValue("ReflectionMode", m_reflectionMode);
+	m_waterMaterial->SetUniformValue("SsrMaxDistance", m_ssrMaxDistance);
+	m_waterMaterial->SetUniformValue("SsrThickness", m_ssrThickness);
+	m_waterMaterial->SetUniformValue("SsrMaxIterations", m_ssrMaxIterations);
+
+	// Screen space refraction uniforms
+	m_waterMaterial->SetUniformValue("RefractionEnabled", m_refractionEnabled ? 1 : 0);
+	m_waterMaterial->SetUniformValue("RefractionStrength", m_refractionStrength);
+	m_waterMaterial->SetUniformValue("AbsorptionCoefficients", m_waterAbsorption);
 
 	m_waterMaterial->SetBlendEquation(Material::BlendEquation::Add);
 	m_waterMaterial->SetBlendParams(Material::BlendParam::SourceAlpha, Material::BlendParam::OneMinusSourceAlpha);
 	m_waterMaterial->SetBlendEquation(Material::BlendEquation::Add);
 	//m_waterMaterial->SetDepthWrite(false);
+
+	// Blended, so only drawn in the transparent pass
+	m_waterMaterial->SetPassMask(Material::PassTransparent);
 }
 
 void WaterApplication::InitializeSandMaterial()
 {
-	Shader sandVS = m_vertexShaderLoader.Load("shaders/sand.vert");
-	Shader sandFS = m_fragmentShaderLoader.Load("shaders/sand.frag");
-	std::shared_ptr<ShaderProgram> sandShaderProgram = std::make_shared<ShaderProgram>();
-	sandShaderProgram->Build(sandVS, sandFS);
-
-	ShaderProgram::Location worldMatrixLocation = sandShaderProgram->GetUniformLocation("WorldMatrix");
-	ShaderProgram::Location viewProjMatrixLocation = sandShaderProgram->GetUniformLocation("ViewProjMatrix");
-	ShaderProgram::Location timeLocation = sandShaderProgram->GetUniformLocation("Time");
-
-	m_renderer.RegisterShaderProgram(sandShaderProgram,
-		[=](const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, const Camera& camera, bool /*cameraChanged*/)
-		{
-			shaderProgram.SetUniform(worldMatrixLocation, worldMatrix);
-			shaderProgram.SetUniform(viewProjMatrixLocation, camera.GetViewProjectionMatrix());
-			shaderProgram.SetUniform(timeLocation, static_cast<float>(GetTime())); // Pass the time to the shader 
-		},
-
-		m_renderer.GetDefaultUpdateLightsFunction(*sandShaderProgram)
-	);
+	std::shared_ptr<ShaderProgram> sandShaderProgram = m_sandPermutations->GetShaderProgram(GetSandFeatureMask());
 
 	std::shared_ptr<Texture2DObject> sandTexture = Texture2DLoader::LoadTextureShared(
 		"textures/sandTexture.jpg",
@@ -433,13 +1008,52 @@ void WaterApplication::InitializeSandMaterial()
 
 	m_sandMaterial->SetUniformValue("ColorTextureScale", sandTextureScale);
 	m_sandMaterial->SetUniformValue("ClipPlane", m_clipPlane);
-	m_sandMaterial->SetUniformValue("CausticsColor", m_causticsColor);
-	m_sandMaterial->SetUniformValue("CausticsIntensity", m_causticsIntensity);
-	m_sandMaterial->SetUniformValue("CausticsOffset", m_causticsOffset);
-	m_sandMaterial->SetUniformValue("CausticsScale", m_causticsScale);
-	m_sandMaterial->SetUniformValue("CausticsSpeed", m_causticsSpeed);
-	m_sandMaterial->SetUniformValue("CausticsThickness", m_causticsThickness);
+	ApplyCaustics(GetSandFeatureMask(), m_caustics);
+}
+
+void WaterApplication::InitializeDeferredMaterial()
+{
+	// Lights are read from the instance attributes of the light volumes
+	std::vector<const char*> vertexShaderPaths;
+	vertexShaderPaths.push_back("shaders/version330.glsl");
+	vertexShaderPaths.push_back("shaders/deferred.vert");
+	Shader vertexShader = ShaderLoader(Shader::VertexShader).Load(vertexShaderPaths);
 
+	std::vector<const char*> fragmentShaderPaths;
+	fragmentShaderPaths.push_back("shaders/version330.glsl");
+	fragmentShaderPaths.push_back("shaders/utils.glsl");
+	fragmentShaderPaths.push_back("shaders/lambert-ggx.glsl");
+	fragmentShaderPaths.push_back("shaders/lighting.glsl");
+	fragmentShaderPaths.push_back("shaders/deferred.frag");
+	Shader fragmentShader = ShaderLoader(Shader::FragmentShader).Load(fragmentShaderPaths, "#define LIGHT_INSTANCED\n");
+
+	std::shared_ptr<ShaderProgram> deferredShaderProgram = std::make_shared<ShaderProgram>();
+	deferredShaderProgram->Build(vertexShader, fragmentShader);
+
+	ShaderProgram::Location cameraPositionLocation = deferredShaderProgram->GetUniformLocation("CameraPosition");
+	ShaderProgram::Location viewProjMatrixLocation = deferredShaderProgram->GetUniformLocation("ViewProjMatrix");
+	ShaderProgram::Location invViewProjMatrixLocation = deferredShaderProgram->GetUniformLocation("InvViewProjMatrix");
+
+	// The deferred pass sets the lights, there is no world matrix
+	m_renderer.RegisterShaderProgram(deferredShaderProgram,
+		[=](const ShaderProgram& shaderProgram, const glm::mat4& /*worldMatrix*/, const Camera& camera, bool cameraChanged)
+		{
+			if (cameraChanged)
+			{
+				shaderProgram.SetUniform(cameraPositionLocation, camera.ExtractTranslation());
+				shaderProgram.SetUniform(viewProjMatrixLocation, camera.GetViewProjectionMatrix());
+				shaderProgram.SetUniform(invViewProjMatrixLocation, glm::inverse(camera.GetViewProjectionMatrix()));
+			}
+		},
+		nullptr);
+
+	ShaderUniformCollection::NameSet filteredUniforms;
+	filteredUniforms.insert("CameraPosition");
+	filteredUniforms.insert("ViewProjMatrix");
+	filteredUniforms.insert("InvViewProjMatrix");
+
+	// G-buffer textures are assigned by the render graph every frame
+	m_deferredMaterial = std::make_shared<Material>(deferredShaderProgram, filteredUniforms);
 }
 
 void WaterApplication::InitializeMeshes()
@@ -447,6 +1061,21 @@ void WaterApplication::InitializeMeshes()
 	m_planeMesh = std::make_shared<Mesh>();
 	CreatePlaneMesh(*m_planeMesh, m_gridX, m_gridY);
 	std::cout << "Water mesh submeshes: " << m_planeMesh->GetSubmeshCount() << std::endl;
+
+	// Lower resolution water grids, halving the number of quads on each LOD
+	m_waterLodMeshes[0] = m_planeMesh;
+	for (unsigned int lod = 1; lod < WATER_LOD_COUNT; ++lod)
+	{
+		unsigned int gridX = std::max(2u, ((m_gridX - 1) >> lod) + 1);
+		unsigned int gridY = std::max(2u, ((m_gridY - 1) >> lod) + 1);
+		m_waterLodMeshes[lod] = std::make_shared<Mesh>();
+		CreatePlaneMesh(*m_waterLodMeshes[lod], gridX, gridY);
+	}
+
+	// The sand is flat, so its occluder only needs the 2 triangles of the plane, with the same winding
+	m_sandOccluder = std::make_shared<OcclusionCuller::Occluder>();
+	m_sandOccluder->vertices = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 1.0f) };
+	m_sandOccluder->indices = { 2, 1, 0, 1, 2, 3 };
 }
 
 
@@ -466,12 +1095,23 @@ void WaterApplication::InitializeModels()
 	m_defaultMaterial->SetUniformValue("EnvironmentMaxLod", maxLod);
 	m_defaultMaterial->SetUniformValue("Color", glm::vec3(1.0f));
 
+	// The water falls back to the skybox where the screen space reflection has no information
+	m_waterMaterial->SetUniformValue("EnvironmentTexture", m_skyboxTexture);
+	m_waterMaterial->SetUniformValue("EnvironmentMaxLod", maxLod);
+
+	// Indirect lighting of the props in deferred mode
+	m_deferredMaterial->SetUniformValue("EnvironmentTexture", m_skyboxTexture);
+	m_deferredMaterial->SetUniformValue("EnvironmentMaxLod", maxLod);
+
 	// Configure loader
 	ModelLoader loader(m_defaultMaterial);
 
 	// Create a new material copy for each submaterial
 	loader.SetCreateMaterials(true);
 
+	// Pack textures with the same size and format in arrays, shared by all the models
+	loader.SetUseTextureArrays(true);
+
 	// Flip vertically textures loaded by the model loader
 	loader.GetTexture2DLoader().SetFlipVertical(true);
 
@@ -481,6 +1121,7 @@ void WaterApplication::InitializeModels()
 	loader.SetMaterialAttribute(VertexAttribute::Semantic::Tangent, "VertexTangent");
 	loader.SetMaterialAttribute(VertexAttribute::Semantic::Bitangent, "VertexBitangent");
 	loader.SetMaterialAttribute(VertexAttribute::Semantic::TexCoord0, "VertexTexCoord");
+	loader.SetMaterialAttribute(VertexAttribute::Semantic::TextureLayers, "VertexTextureLayers");
 
 	// Link material properties to uniforms
 	loader.SetMaterialProperty(ModelLoader::MaterialProperty::DiffuseColor, "Color");
@@ -519,6 +1160,33 @@ void WaterApplication::InitializeModels()
 	clockTransform->SetTranslation(glm::vec3(10.0f, height, 6.0f));
 	m_opaqueScene.AddSceneNode(std::make_shared<SceneModel>("alarm clock", clockModel, clockTransform));
 
+	// Shares the texture arrays of the props
+	InitializeInstances(loader);
+
+	// Upload the textures of all the models
+	loader.BuildTextureArrays();
+
+	// The prop submeshes switch between forward and G-buffer materials with the lighting mode
+	// Submeshes that share a loader material, also in different props, keep sharing the copies
+	std::unordered_map<const Material*, size_t> propMaterialIndices;
+	for (const std::shared_ptr<Model>& propModel : { chestModel, cameraModel, teaSetModel, clockModel })
+	{
+		for (unsigned int materialIndex = 0; materialIndex < propModel->GetMaterialCount(); ++materialIndex)
+		{
+			std::shared_ptr<const Material> loaderMaterial = propModel->GetSharedMaterial(materialIndex);
+			auto itPropMaterial = propMaterialIndices.find(loaderMaterial.get());
+			if (itPropMaterial == propMaterialIndices.end())
+			{
+				itPropMaterial = propMaterialIndices.emplace(loaderMaterial.get(), m_propMaterials.size()).first;
+				m_propMaterials.push_back(PropMaterial{ std::make_shared<Material>(loaderMaterial), nullptr, {} });
+			}
+
+			PropMaterial& propMaterial = m_propMaterials[itPropMaterial->second];
+			propModel->SetMaterial(materialIndex, propMaterial.forwardMaterial);
+			propMaterial.submeshes.emplace_back(propModel, materialIndex);
+		}
+	}
+
 	// Sand plane
 	std::shared_ptr<Model> sandModel = std::make_shared<Model>(m_planeMesh);
 
@@ -531,87 +1199,434 @@ void WaterApplication::InitializeModels()
 
 	// Load transparent models
 
-	// Water plane
-	std::shared_ptr<Model> waterModel = std::make_shared<Model>(m_planeMesh);
+	// Water plane, with a model for each LOD mesh
+	for (unsigned int lod = 0; lod < WATER_LOD_COUNT; ++lod)
+	{
+		m_waterLodModels[lod] = std::make_shared<Model>(m_waterLodMeshes[lod]);
+		m_waterLodModels[lod]->AddMaterial(m_waterMaterial);
+	}
 
 	m_waterTransform = std::make_shared<Transform>();
 	m_waterTransform->SetScale(m_waterScale);
 	m_waterTransform->SetTranslation(glm::vec3(0.0f, m_waterBaseHeight, 0.0f)); 
-	
-	waterModel->AddMaterial(m_waterMaterial);
 
-	m_transparentScene.AddSceneNode(std::make_shared<SceneModel>("water plane", waterModel, m_waterTransform));
+	m_waterSceneModel = std::make_shared<SceneModel>("water plane", m_waterLodModels[m_waterLod], m_waterTransform);
+	m_transparentScene.AddSceneNode(m_waterSceneModel);
+
+}
 
+void WaterApplication::InitializeInstances(ModelLoader& loader)
+{
+	// Separate copy of the chest, its vertex arrays get the instance attributes of the culling pass
+	// Not LoadShared, that would return the chest prop loaded from the same path
+	m_instancedModel = std::make_shared<Model>(loader.Load("models/treasure_chest/treasure_chest.obj"));
+
+	// The world matrix is read from the instance attributes. Waits for the permutation, as the default material does
+	// The loader shares the materials with the chest prop, so the instances change the shader of their own copies
+	std::shared_ptr<ShaderProgram> instancedShaderProgram = m_defaultPermutations->GetShaderProgram(GetInstancedFeatureMask());
+	std::unordered_map<const Material*, std::shared_ptr<Material>> instancedMaterials;
+	for (unsigned int materialIndex = 0; materialIndex < m_instancedModel->GetMaterialCount(); ++materialIndex)
+	{
+		std::shared_ptr<const Material> loaderMaterial = m_instancedModel->GetSharedMaterial(materialIndex);
+		std::shared_ptr<Material>& instancedMaterial = instancedMaterials[loaderMaterial.get()];
+		if (!instancedMaterial)
+		{
+			instancedMaterial = std::make_shared<Material>(loaderMaterial);
+			instancedMaterial->ChangeShader(instancedShaderProgram, m_defaultFilteredUniforms, true);
+		}
+		m_instancedModel->SetMaterial(materialIndex, instancedMaterial);
+	}
 }
 
 void WaterApplication::InitializeRenderer()
 {
-	m_renderer.AddRenderPass(std::make_unique<ForwardRenderPass>());
+	// Opaque drawcalls go to the default collection, blended drawcalls are drawn after the scene copy
+	m_renderer.SetDrawcallCollectionPassMask(0, Material::PassOpaque);
+	unsigned int depthPrepassCollection = m_renderer.AddDrawcallCollection(Material::PassDepthPrepass);
+	unsigned int transparentCollection = m_renderer.AddDrawcallCollection(Material::PassTransparent);
+	unsigned int gbufferCollection = m_renderer.AddDrawcallCollection(Material::PassGBuffer);
+
+	// Deferred lighting of the props, before the forward opaque pass draws the sand on the same depth
+	// The G-buffer pass goes first, it is rendered by its own graph pass. The targets are framebuffers of the render graph, assigned every frame
+	std::unique_ptr<GBufferRenderPass> gbufferPass = std::make_unique<GBufferRenderPass>(nullptr, gbufferCollection);
+	m_gbufferPass = gbufferPass.get();
+	m_gbufferPassIndex = m_renderer.AddRenderPass(std::move(gbufferPass));
+
+	// Depth pre-pass, enabled for each view when the opaque overdraw is high
+	std::unique_ptr<DepthPrepassRenderPass> depthPrepass = std::make_unique<DepthPrepassRenderPass>(depthPrepassCollection);
+	m_depthPrepass = depthPrepass.get();
+	m_depthPrepass->SetClipPlane(m_clipPlane);
+	m_depthPrepassMode = static_cast<int>(m_depthPrepass->GetMode());
+	m_depthPrepass->GetOverdrawThresholds(m_overdrawEnableThreshold, m_overdrawDisableThreshold);
+	m_renderer.AddRenderPass(std::move(depthPrepass));
+
+	std::unique_ptr<DeferredRenderPass> deferredPass = std::make_unique<DeferredRenderPass>(m_deferredMaterial);
+	m_deferredPass = deferredPass.get();
+	m_lightVolumeStencilTest = m_deferredPass->IsStencilTestEnabled();
+	m_renderer.AddRenderPass(std::move(deferredPass));
+
+	std::unique_ptr<ForwardRenderPass> opaquePass = std::make_unique<ForwardRenderPass>(0, m_depthPrepass);
+	opaquePass->SetName("Opaque");
+	m_renderer.AddRenderPass(std::move(opaquePass));
+
+	// Instances on the sand, with the opaque scene so they are in the scene copy
+	// Compute shaders need GL 4.3, the window may have a lower version
+	GpuCullingRenderPass::Mode gpuCullingMode = GetDevice().IsComputeSupported() ? GpuCullingRenderPass::Mode::Gpu : GpuCullingRenderPass::Mode::Cpu;
+	std::unique_ptr<GpuCullingRenderPass> gpuCullingPass = std::make_unique<GpuCullingRenderPass>(m_instancedModel, gpuCullingMode);
+	gpuCullingPass->SetName("Instances");
+	m_gpuCullingPass = gpuCullingPass.get();
+	m_gpuCullingMode = static_cast<int>(gpuCullingMode);
+	m_renderer.AddRenderPass(std::move(gpuCullingPass));
+	SetInstanceCount(m_instanceCount);
+
 	m_renderer.AddRenderPass(std::make_unique<SkyboxRenderPass>(m_skyboxTexture));
 
+	// Single copy of the opaque scene, shared by the refraction and the screen space reflections
+	std::unique_ptr<SceneCopyRenderPass> sceneCopyPass = std::make_unique<SceneCopyRenderPass>(m_sceneCopyDownsample);
+	m_sceneCopyPass = sceneCopyPass.get();
+	m_sceneCopyPass->Resize(m_sceneWidth, m_sceneHeight);
+	m_sceneCopyWidth = m_sceneWidth;
+	m_sceneCopyHeight = m_sceneHeight;
+	m_renderer.AddRenderPass(std::move(sceneCopyPass));
+
+	std::unique_ptr<ForwardRenderPass> transparentPass = std::make_unique<ForwardRenderPass>(transparentCollection);
+	transparentPass->SetName("Transparent");
+	m_renderer.AddRenderPass(std::move(transparentPass));
+
+	m_waterMaterial->SetUniformValue("SceneColorTexture", m_sceneCopyPass->GetColorTexture());
+	m_waterMaterial->SetUniformValue("HiZTexture", m_sceneCopyPass->GetDepthPyramidTexture());
+	m_waterMaterial->SetUniformValue("HiZLevelCount", m_sceneCopyPass->GetDepthPyramidLevelCount());
+
+	// Replaced every frame by the planar reflection texture of the render graph
+	m_waterMaterial->SetUniformValue("ReflectionTexture", m_sceneCopyPass->GetColorTexture());
+
+	SetReflectionMode(m_reflectionMode);
+	SetLightingMode(m_lightingMode);
+
+	// Time each render pass, and each pass of the render graph
+	m_renderer.SetProfiler(&m_profiler);
+	m_renderGraph.SetProfiler(&m_profiler);
+
+	// Changed from the GUI, in the main thread
+	m_occlusionCullingEnabled = m_occlusionCuller.IsEnabled();
+	m_gpuTimingEnabled = m_profiler.IsGpuTimingEnabled();
 }
 
-void WaterApplication::SetupOffScreenBuffer()
+void WaterApplication::InitializeReflectionPreview()
+{
+	// Created here, with the context, so the GUI knows its handle when it is recorded in the main thread
+	m_reflectionPreviewTexture = std::make_shared<Texture2DObject>();
+	m_reflectionPreviewTexture->Bind();
+	m_reflectionPreviewTexture->SetImage(0, REFLECTION_PREVIEW_SIZE, REFLECTION_PREVIEW_SIZE, TextureObject::FormatRGBA, TextureObject::InternalFormatRGBA8);
+	m_reflectionPreviewTexture->SetParameter(TextureObject::ParameterEnum::MinFilter, GL_LINEAR);
+	m_reflectionPreviewTexture->SetParameter(TextureObject::ParameterEnum::MagFilter, GL_LINEAR);
+	Texture2DObject::Unbind();
+}
+
+void WaterApplication::UpdateRenderTargetSizes()
 {
 	int winW, winH;
 	GetMainWindow().GetDimensions(winW, winH);
-	m_offscreenWidth = winW / 2; // lower res for offscreen rendering 
-	m_offscreenHeight = winW / 2;
 
-	m_offscreenWidth = NextPowerOfTwo(m_offscreenWidth);
-	m_offscreenHeight = NextPowerOfTwo(m_offscreenHeight);
+	// lower res for offscreen rendering, square and power of two
+	unsigned int size = NextPowerOfTwo(std::max(winW, 1) / m_reflectionDivisor);
+	m_offscreenWidth = size;
+	m_offscreenHeight = size;
 
+	m_sceneWidth = std::max(1, static_cast<int>(winW * m_renderScale));
+	m_sceneHeight = std::max(1, static_cast<int>(winH * m_renderScale));
+}
 
-	// 2) color texture
-	m_offscreenColorTex = std::make_shared<Texture2DObject>();
-	m_offscreenColorTex->Bind();
+void WaterApplication::ResizeSceneCopy(const FrameData& frame)
+{
+	if (frame.sceneWidth == m_sceneCopyWidth && frame.sceneHeight == m_sceneCopyHeight)
+	{
+		return;
+	}
 
-	m_offscreenColorTex->SetParameter(TextureObject::ParameterEnum::MinFilter, GL_LINEAR);
-	m_offscreenColorTex->SetParameter(TextureObject::ParameterEnum::MagFilter, GL_LINEAR);
+	m_sceneCopyWidth = frame.sceneWidth;
+	m_sceneCopyHeight = frame.sceneHeight;
 
-	m_offscreenColorTex->SetImage(
-		0,
-		m_offscreenWidth,
-		m_offscreenHeight,
-		TextureObject::Format::FormatRGBA,
-		TextureObject::InternalFormat::InternalFormatRGBA8);
+	// The textures of the new size are taken from the render graph pool, the copies are reallocated here
+	m_sceneCopyPass->Resize(m_sceneCopyWidth, m_sceneCopyHeight);
+	m_waterMaterial->SetUniformValue("HiZLevelCount", m_sceneCopyPass->GetDepthPyramidLevelCount());
+	m_hiZValid = false;
+}
 
-	Texture2DObject::Unbind();
+bool WaterApplication::UsesSceneCopy() const
+{
+	return m_refractionEnabled || m_reflectionMode == ReflectionModeScreenSpace;
+}
 
-	// 3) depth texture
-	m_offscreenDepthTex = std::make_shared<Texture2DObject>();
-	m_offscreenDepthTex->Bind();
+bool WaterApplication::UsesSceneBuffer() const
+{
+	// The deferred passes render to textures of the graph
+	return m_renderScale < 1.0f || UsesSceneCopy() || m_lightingMode == LightingModeDeferred;
+}
 
-	m_offscreenDepthTex->SetImage(
-		0,
-		m_offscreenWidth,
-		m_offscreenHeight,
-		TextureObject::Format::FormatDepth,
-		TextureObject::InternalFormat::InternalFormatDepth24);
+void WaterApplication::SetReflectionMode(int reflectionMode)
+{
+	m_reflectionMode = reflectionMode;
+	RecordUniformValue(*m_waterMaterial, "ReflectionMode", m_reflectionMode);
+}
 
-	Texture2DObject::Unbind();
+void WaterApplication::SetLightingMode(int lightingMode)
+{
+	m_lightingMode = lightingMode;
+
+	// The deferred passes are enabled by each frame
+	if (m_lightingMode == LightingModeDeferred)
+	{
+		RecordPrebuild(*m_defaultPermutations, GetGBufferFeatureMask());
+	}
+}
+
+void WaterApplication::SetStressLightCount(int stressLightCount)
+{
+	m_stressLightCount = stressLightCount;
+
+	// Forward lighting needs the permutation for any light type with the point lights
+	RecordPrebuild(*m_defaultPermutations, GetDefaultFeatureMask());
+	RecordPrebuild(*m_defaultPermutations, GetInstancedFeatureMask());
+}
+
+void WaterApplication::SetInstanceCount(int instanceCount)
+{
+	m_instanceCount = instanceCount;
+
+	// Same field on every run, so the culling modes can be compared
+	std::mt19937 generator(5678);
+	std::uniform_real_distribution<float> positionDistribution(0.5f, 19.5f);
+	std::uniform_real_distribution<float> angleDistribution(0.0f, 2.0f * std::numbers::pi_v<float>);
+	std::uniform_real_distribution<float> scaleDistribution(0.05f, 0.15f);
+
+	std::vector<glm::mat4> worldMatrices;
+	worldMatrices.reserve(m_instanceCount);
+	for (int instanceIndex = 0; instanceIndex < m_instanceCount; ++instanceIndex)
+	{
+		glm::vec3 position(positionDistribution(generator), m_sandBaseHeight, positionDistribution(generator));
+		float angle = angleDistribution(generator);
+		float scale = scaleDistribution(generator);
+		worldMatrices.push_back(glm::translate(position) * glm::rotate(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(scale)));
+	}
+	GetFramePacket().Record([this, worldMatrices = std::move(worldMatrices)]() { m_gpuCullingPass->SetInstances(worldMatrices); });
+}
+
+void WaterApplication::UpdateQuality()
+{
+	// Either thread can be the bottleneck, so the CPU time is the longest of the main thread and the render thread frames
+	const Profiler::Results& profilerResults = m_renderResults.profiler;
+	float cpuTime = std::max(GetMainThreadFrameTime(), profilerResults.GetFrameCpuTime());
+	if (m_qualityGovernor.Update(cpuTime, profilerResults.GetFrameGpuTime()))
+	{
+		ApplyQualityLevel(m_qualityGovernor.GetLevel());
+	}
+}
+
+void WaterApplication::ApplyQualityLevel(int level)
+{
+	const QualitySettings& settings = s_qualityLevels[level];
+
+	m_reflectionDivisor = settings.reflectionDivisor;
+	m_renderScale = settings.renderScale;
+	ApplyWaveOctaves();
+	SetWaterLod(settings.waterLod);
+
+	UpdateRenderTargetSizes();
+
+	// New render targets and shader permutations are expected to allocate
+	AllocationTracker::GetInstance().StartSteadyState();
+
+	float cpuTime = std::max(GetMainThreadFrameTime(), m_renderResults.profiler.GetFrameCpuTime());
+	float gpuTime = m_renderResults.profiler.GetFrameGpuTime();
+
+	std::cout << "Quality level " << level << ": reflection " << m_offscreenWidth << "x" << m_offscreenHeight
+		<< ", render scale " << m_renderScale << ", octaves " << m_appliedWaveOctaves << ", water LOD " << m_waterLod
+		<< " (frame " << cpuTime << " ms CPU, " << gpuTime << " ms GPU)" << std::endl;
+
+	if (m_qualityLog.is_open())
+	{
+		m_qualityLog << GetCurrentTime() << "," << cpuTime << "," << gpuTime << "," << level << ","
+			<< m_offscreenWidth << "," << m_renderScale << "," << m_appliedWaveOctaves << "," << m_waterLod << std::endl;
+	}
+}
+
+void WaterApplication::ApplyWaveOctaves()
+{
+	// The quality level limits the octaves chosen in the GUI
+	int waveOctaves = std::min(m_waveOctaves, s_qualityLevels[m_qualityGovernor.GetLevel()].waveOctaves);
+	if (waveOctaves != m_appliedWaveOctaves)
+	{
+		m_appliedWaveOctaves = waveOctaves;
+
+		// Start building the permutation with this octave count. The material switches to it when it is ready
+		RecordPrebuild(*m_waterPermutations, GetWaterFeatureMask());
+	}
+}
 
-	// 4) make the FBO and attach
-	m_offscreenFBO = std::make_shared<FramebufferObject>();
-	m_offscreenFBO->Bind();
+ShaderPermutations::FeatureMask WaterApplication::GetDefaultFeatureMask() const
+{
+	// Without the stress lights the scene only has a directional light, so the lighting is specialized for it
+	// Model textures are packed in arrays, so the props share their textures
+	int lightType = m_stressLightCount > 0 ? LightTypeAny : LightTypeDirectional;
+	ShaderPermutations::FeatureMask featureMask = m_defaultPermutations->SetFeatureValue(0, m_defaultLightTypeFeature, lightType);
+	return m_defaultPermutations->SetFeatureValue(featureMask, m_defaultTextureArraysFeature, 1);
+}
 
-	// attach color
-	m_offscreenFBO->SetTexture(
-		FramebufferObject::Target::Both,
-		FramebufferObject::Attachment::Color0,
-		*m_offscreenColorTex, 0);
+ShaderPermutations::FeatureMask WaterApplication::GetGBufferFeatureMask() const
+{
+	// Only writes the surface data, the lighting is done by the deferred pass
+	ShaderPermutations::FeatureMask featureMask = m_defaultPermutations->SetFeatureValue(0, m_defaultTextureArraysFeature, 1);
+	return m_defaultPermutations->SetFeatureValue(featureMask, m_defaultGBufferFeature, 1);
+}
 
-	// attach depth
-	m_offscreenFBO->SetTexture(
-		FramebufferObject::Target::Both,
-		FramebufferObject::Attachment::Depth,
-		*m_offscreenDepthTex, 0);
+ShaderPermutations::FeatureMask WaterApplication::GetInstancedFeatureMask() const
+{
+	// Same lighting as the props, with the world matrix of each instance as attribute
+	return m_defaultPermutations->SetFeatureValue(GetDefaultFeatureMask(), m_defaultInstancedFeature, 1);
+}
 
-	// set the draw buffers
-	std::array<FramebufferObject::Attachment, 1> drawBuffers = { FramebufferObject::Attachment::Color0 };
-	m_offscreenFBO->SetDrawBuffers(drawBuffers);
+ShaderPermutations::FeatureMask WaterApplication::GetWaterFeatureMask() const
+{
+	ShaderPermutations::FeatureMask featureMask = m_waterPermutations->SetFeatureValue(0, m_waterOctavesFeature, m_appliedWaveOctaves);
+	return m_waterPermutations->SetFeatureValue(featureMask, m_waterLightTypeFeature, LightTypeDirectional);
+}
 
-	FramebufferObject::Unbind();
+ShaderPermutations::FeatureMask WaterApplication::GetSandFeatureMask() const
+{
+	return m_sandPermutations->SetFeatureValue(0, m_sandCausticsFeature, m_causticsEnabled ? 1 : 0);
+}
+
+void WaterApplication::UpdateShaderPermutations(const FrameData& frame)
+{
+	// Until the new permutation is built, materials keep rendering with the previous one
+	if (m_waterPermutations->IsShaderProgramReady(frame.waterFeatureMask))
+	{
+		std::shared_ptr<ShaderProgram> waterShaderProgram = m_waterPermutations->GetShaderProgram(frame.waterFeatureMask);
+		if (waterShaderProgram != m_waterMaterial->GetShaderProgram())
+		{
+			// Keep the material values
+			m_waterMaterial->ChangeShader(waterShaderProgram, ShaderUniformCollection::NameSet(), true);
+			UpdateUniformHandles();
+		}
+	}
+
+	if (m_sandPermutations->IsShaderProgramReady(frame.sandFeatureMask) &&
+		m_sandPermutations->GetShaderProgram(frame.sandFeatureMask) != m_sandMaterial->GetShaderProgram())
+	{
+		ApplyCaustics(frame.sandFeatureMask, frame.caustics);
+	}
+
+	UpdatePropMaterials(frame);
+}
+
+void WaterApplication::UpdatePropMaterials(const FrameData& frame)
+{
+	if (m_defaultPermutations->IsShaderProgramReady(frame.defaultFeatureMask))
+	{
+		std::shared_ptr<ShaderProgram> defaultShaderProgram = m_defaultPermutations->GetShaderProgram(frame.defaultFeatureMask);
+		for (PropMaterial& propMaterial : m_propMaterials)
+		{
+			if (propMaterial.forwardMaterial->GetShaderProgram() != defaultShaderProgram)
+			{
+				propMaterial.forwardMaterial->ChangeShader(defaultShaderProgram, m_defaultFilteredUniforms, true);
+			}
+		}
+	}
+
+	// The instances are always lit forward
+	if (m_defaultPermutations->IsShaderProgramReady(frame.instancedFeatureMask))
+	{
+		std::shared_ptr<ShaderProgram> instancedShaderProgram = m_defaultPermutations->GetShaderProgram(frame.instancedFeatureMask);
+		for (unsigned int materialIndex = 0; materialIndex < m_instancedModel->GetMaterialCount(); ++materialIndex)
+		{
+			Material& material = m_instancedModel->GetMaterial(materialIndex);
+			if (material.GetShaderProgram() != instancedShaderProgram)
+			{
+				material.ChangeShader(instancedShaderProgram, m_defaultFilteredUniforms, true);
+			}
+		}
+	}
+
+	// The props keep their forward materials until the G-buffer permutation is built
+	bool propsDeferred = frame.deferredLighting && m_defaultPermutations->IsShaderProgramReady(frame.gbufferFeatureMask);
+	if (propsDeferred == m_propsDeferred)
+	{
+		return;
+	}
+	m_propsDeferred = propsDeferred;
+
+	std::shared_ptr<ShaderProgram> gbufferShaderProgram = propsDeferred ? m_defaultPermutations->GetShaderProgram(frame.gbufferFeatureMask) : nullptr;
+	for (PropMaterial& propMaterial : m_propMaterials)
+	{
+		// Separate copy, changing the shader back and forth would lose the uniforms that only exist in the forward permutation
+		if (propsDeferred && !propMaterial.gbufferMaterial)
+		{
+			propMaterial.gbufferMaterial = std::make_shared<Material>(propMaterial.forwardMaterial);
+			propMaterial.gbufferMaterial->ChangeShader(gbufferShaderProgram, m_defaultFilteredUniforms, true);
+			propMaterial.gbufferMaterial->SetPassMask(Material::PassGBuffer | Material::PassShadow | Material::PassReflection);
+		}
+	}
+	SetPropMaterials(propsDeferred);
+}
+
+void WaterApplication::SetPropMaterials(bool gbuffer)
+{
+	for (PropMaterial& propMaterial : m_propMaterials)
+	{
+		for (const auto& [propModel, materialIndex] : propMaterial.submeshes)
+		{
+			propModel->SetMaterial(materialIndex, gbuffer ? propMaterial.gbufferMaterial : propMaterial.forwardMaterial);
+		}
+	}
+}
+
+void WaterApplication::UpdateUniformHandles()
+{
+	// Locations can be different in each permutation
+	m_sandBaseHeightUniform = m_waterMaterial->GetUniformHandle<float>("SandBaseHeight");
+	m_waterBaseHeightUniform = m_waterMaterial->GetUniformHandle<float>("WaterBaseHeight");
+	m_cameraNearFarUniform = m_waterMaterial->GetUniformHandle<glm::vec2>("CameraNearFar");
+	m_sandClipPlaneUniform = m_sandMaterial->GetUniformHandle<glm::vec4>("ClipPlane");
+	m_reflectionTextureUniform = m_waterMaterial->GetUniformHandle<std::shared_ptr<Texture2DObject>>("ReflectionTexture");
+
+	// Same order as the G-buffer textures of the render graph
+	m_deferredDepthTextureUniform = m_deferredMaterial->GetUniformHandle<std::shared_ptr<Texture2DObject>>("DepthTexture");
+	m_gbufferTextureUniforms[0] = m_deferredMaterial->GetUniformHandle<std::shared_ptr<Texture2DObject>>("AlbedoTexture");
+	m_gbufferTextureUniforms[1] = m_deferredMaterial->GetUniformHandle<std::shared_ptr<Texture2DObject>>("NormalTexture");
+	m_gbufferTextureUniforms[2] = m_deferredMaterial->GetUniformHandle<std::shared_ptr<Texture2DObject>>("OthersTexture");
+}
+
+void WaterApplication::ApplyCaustics(ShaderPermutations::FeatureMask sandFeatureMask, const CausticsSettings& caustics)
+{
+	std::shared_ptr<ShaderProgram> sandShaderProgram = m_sandPermutations->GetShaderProgram(sandFeatureMask);
+	if (sandShaderProgram != m_sandMaterial->GetShaderProgram())
+	{
+		m_sandMaterial->ChangeShader(sandShaderProgram, ShaderUniformCollection::NameSet(), true);
+		UpdateUniformHandles();
+	}
+
+	// The caustics uniforms only exist in the permutation with caustics, so they are set again when enabled
+	m_sandMaterial->SetUniformValue("CausticsColor", caustics.color);
+	m_sandMaterial->SetUniformValue("CausticsIntensity", caustics.intensity);
+	m_sandMaterial->SetUniformValue("CausticsOffset", caustics.offset);
+	m_sandMaterial->SetUniformValue("CausticsScale", caustics.scale);
+	m_sandMaterial->SetUniformValue("CausticsSpeed", caustics.speed);
+	m_sandMaterial->SetUniformValue("CausticsThickness", caustics.thickness);
+}
+
+void WaterApplication::SetWaterLod(unsigned int lod)
+{
+	assert(lod < WATER_LOD_COUNT);
+	if (lod == m_waterLod)
+	{
+		return;
+	}
+
+	m_waterLod = lod;
+
+	// Frames already recorded keep drawing the previous model
+	m_waterSceneModel->SetModel(m_waterLodModels[m_waterLod]);
 }
 
 void WaterApplication::SetOffScreenCamera(Camera& camera, glm::vec3& originalPosition)
@@ -700,37 +1715,272 @@ void WaterApplication::CreatePlaneMesh(Mesh& mesh, unsigned int gridX, unsigned
 
 	mesh.AddSubmesh<Vertex, unsigned int, VertexFormat::LayoutIterator>(Drawcall::Primitive::Triangles, vertices, indices,
 		vertexFormat.LayoutBegin(static_cast<int>(vertices.size()), true), vertexFormat.LayoutEnd());
+
+	// Bounds for the occlusion culling, with some height for the displacement of the waves
+	mesh.SetSubmeshBounds(mesh.GetSubmeshCount() - 1, glm::vec3(0.0f, -2.0f, 0.0f), glm::vec3(1.0f, 2.0f, 1.0f));
 }
 
-void WaterApplication::RenderGUI()
+void WaterApplication::DrawGUI()
 {
+	AllocationTracker::Scope allocationScope("GUI");
+
 	m_imGui.BeginFrame();
 
+	// Set again if the debug window is open
+	m_reflectionPreviewVisible = false;
+
 	// Draw GUI for scene nodes, using the visitor pattern
-	ImGuiSceneVisitor imGuiVisitor(m_imGui, "Scene");
+	{
+		AllocationTracker::Scope visitorAllocationScope("ImGuiSceneVisitor");
+		ImGuiSceneVisitor imGuiVisitor(m_imGui, "Scene");
 
-	m_opaqueScene.AcceptVisitor(imGuiVisitor);
-	m_transparentScene.AcceptVisitor(imGuiVisitor);
+		m_opaqueScene.AcceptVisitor(imGuiVisitor);
+		m_transparentScene.AcceptVisitor(imGuiVisitor);
+	}
 	m_cameraController.DrawGUI(m_imGui);
 
+	// Results of the last frame rendered. Changes for the profiler are recorded for the render thread
+	if (Profiler::DrawGUI(m_imGui, m_renderResults.profiler, m_gpuTimingEnabled))
+	{
+		GetFramePacket().Record([this, enabled = m_gpuTimingEnabled]() { m_profiler.SetGpuTimingEnabled(enabled); });
+	}
+	RenderGraph::DrawGUI(m_imGui, m_renderResults.renderGraph);
+	m_qualityGovernor.DrawGUI(m_imGui);
+	AllocationTracker::GetInstance().DrawGUI(m_imGui);
+
 	if (auto window = m_imGui.UseWindow("Debug"))
 	{
-		m_offscreenColorTex->Bind();
+		// The render thread copies the planar reflection to the preview texture in the frames that show it
+		m_reflectionPreviewVisible = true;
+		if (m_reflectionMode == ReflectionModePlanar)
+		{
+			// cast to ImGuis ImTextureID and draw
+			const Texture2DObject& previewTexture = *m_reflectionPreviewTexture;
+			ImTextureID texID = reinterpret_cast<ImTextureID>(static_cast<intptr_t>(previewTexture.GetHandle()));
+			ImGui::Text("Scene preview:");
+
+			ImVec2 size(REFLECTION_PREVIEW_SIZE, REFLECTION_PREVIEW_SIZE);
+			ImVec2 uv0(0, 0);
+			ImVec2 uv1(1, 1);
+			ImGui::Image(texID, size, uv0, uv1);
+		}
 
-		// retrieve its GLuint handle
-		GLint texHandle = 0;
-		glGetIntegerv(GL_TEXTURE_BINDING_2D, &texHandle);
+		if (ImGui::CollapsingHeader("Performance"))
+		{
+			// The swap interval belongs to the context, in the render thread
+			if (ImGui::Checkbox("VSync", &m_vsyncEnabled))
+			{
+				GetFramePacket().Record([this, enabled = m_vsyncEnabled]() { GetDevice().SetVSyncEnabled(enabled); });
+			}
 
-		Texture2DObject::Unbind();
+			// Frames recorded ahead of the one being presented, and time from the start of the recording until it is presented
+			RenderThread::Stats renderThreadStats = GetRenderThreadStats();
+			ImGui::Text("Render thread: %s, pipeline depth: %u / %u", IsRenderThreadEnabled() ? "on" : "off",
+				renderThreadStats.pipelineDepth, IsRenderThreadEnabled() ? MAX_QUEUED_FRAMES + 1 : 1);
+			ImGui::Text("Frame latency: %.2f ms, replay: %.2f ms, submit wait: %.2f ms", renderThreadStats.latency,
+				renderThreadStats.replayTime, renderThreadStats.submitWaitTime);
+			ImGui::Text("Presented frames: %u", renderThreadStats.presentedFrameCount);
+			ImGui::Text("Main thread: %.2f ms, render thread: %.2f ms", GetMainThreadFrameTime(), m_renderResults.profiler.GetFrameCpuTime());
+
+			bool fixedUpdateThreaded = IsFixedUpdateThreaded();
+			if (ImGui::Checkbox("Threaded Simulation", &fixedUpdateThreaded))
+			{
+				SetFixedUpdateThreaded(fixedUpdateThreaded);
+			}
+			const FixedUpdateStats& fixedUpdateStats = GetFixedUpdateStats();
+			ImGui::Text("Fixed steps: %u (%.3f ms), dropped: %u", fixedUpdateStats.stepCount, fixedUpdateStats.stepTime, fixedUpdateStats.droppedStepCount);
 
-		// cast to ImGuis ImTextureID and draw
-		ImTextureID texID = reinterpret_cast<ImTextureID>(static_cast<intptr_t>(texHandle));
-		ImGui::Text("Scene preview:");
-		
-		ImVec2 size(m_offscreenWidth / 2, m_offscreenHeight / 2);
-		ImVec2 uv0(0, 0);
-		ImVec2 uv1(1, 1);
-		ImGui::Image(texID, size, uv0, uv1);
+			// Manual quality level, only when the governor is not choosing it
+			int qualityLevel = m_qualityGovernor.GetLevel();
+			ImGui::BeginDisabled(m_qualityGovernor.IsEnabled());
+			if (ImGui::SliderInt("Quality Level", &qualityLevel, 0, m_qualityGovernor.GetLevelCount() - 1))
+			{
+				m_qualityGovernor.SetLevel(qualityLevel);
+				ApplyQualityLevel(m_qualityGovernor.GetLevel());
+			}
+			ImGui::EndDisabled();
+
+			ImGui::Text("Reflection: %ux%u", m_offscreenWidth, m_offscreenHeight);
+			ImGui::Text("Render scale: %.2f", m_renderScale);
+			ImGui::Text("Wave octaves: %d", m_appliedWaveOctaves);
+			ImGui::Text("Water shader permutations: %u (%u building)", m_renderResults.waterPermutationCount,
+				m_renderResults.pendingWaterPermutationCount);
+			ImGui::Text("Water LOD: %u", m_waterLod);
+			ImGui::Text("Render state transitions: %u (%u state calls, %u blocks)", m_renderResults.renderStateTransitions,
+				m_renderResults.renderStateCalls, m_renderResults.renderStateBlockCount);
+			ImGui::Text("Material texture bind calls: %u", m_renderResults.textureBindCalls);
+			for (unsigned int workerIndex = 0; workerIndex < m_workerStats.size(); ++workerIndex)
+			{
+				const JobSystem::WorkerStats& stats = m_workerStats[workerIndex];
+				ImGui::Text("Worker %u: %.0f%% busy, %u jobs (%u stolen)", workerIndex, stats.utilization * 100.0f, stats.jobCount, stats.stealCount);
+			}
+			const Renderer::CommandListStats& commandListStats = m_renderResults.commandListStats;
+			const FrameArena::Stats& frameArenaStats = m_renderResults.frameArenaStats;
+			ImGui::Text("Command lists: %u (%u commands)", commandListStats.listCount, commandListStats.commandCount);
+			ImGui::Text("Frame arena: %.1f / %.1f KB, %u allocations, %u heap allocations", frameArenaStats.usedSize / 1024.0f,
+				frameArenaStats.capacity / 1024.0f, frameArenaStats.allocationCount, frameArenaStats.heapAllocationCount);
+			for (unsigned int workerIndex = 0; workerIndex < commandListStats.recordTimes.size(); ++workerIndex)
+			{
+				ImGui::Text("Worker %u recording: %.3f ms", workerIndex, commandListStats.recordTimes[workerIndex]);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Depth Pre-pass"))
+		{
+			const char* depthPrepassModes[] = { "Off", "On", "Auto" };
+			if (ImGui::Combo("Depth Pre-pass", &m_depthPrepassMode, depthPrepassModes, IM_ARRAYSIZE(depthPrepassModes)))
+			{
+				GetFramePacket().Record([this, mode = static_cast<DepthPrepassRenderPass::Mode>(m_depthPrepassMode)]() { m_depthPrepass->SetMode(mode); });
+			}
+
+			ImGui::BeginDisabled(static_cast<DepthPrepassRenderPass::Mode>(m_depthPrepassMode) != DepthPrepassRenderPass::Mode::Auto);
+			if (ImGui::DragFloatRange2("Overdraw Thresholds", &m_overdrawDisableThreshold, &m_overdrawEnableThreshold, 0.05f, 1.0f, 10.0f))
+			{
+				GetFramePacket().Record([this, enableThreshold = m_overdrawEnableThreshold, disableThreshold = m_overdrawDisableThreshold]()
+					{
+						m_depthPrepass->SetOverdrawThresholds(enableThreshold, disableThreshold);
+					});
+			}
+			ImGui::EndDisabled();
+
+			// Values of the last view rendered, the main view
+			ImGui::Text("Opaque overdraw: %.2f", m_renderResults.opaqueOverdraw);
+			ImGui::Text("Pre-pass active: %s", m_renderResults.depthPrepassActive ? "yes" : "no");
+		}
+
+		if (ImGui::CollapsingHeader("Occlusion Culling"))
+		{
+			if (ImGui::Checkbox("Occlusion Culling", &m_occlusionCullingEnabled))
+			{
+				GetFramePacket().Record([this, enabled = m_occlusionCullingEnabled]() { m_occlusionCuller.SetEnabled(enabled); });
+			}
+
+			// Results of the main view
+			const OcclusionCuller::Stats& stats = m_renderResults.occlusionStats;
+			unsigned int rejectedCount = stats.frustumRejectedCount + stats.occlusionRejectedCount;
+			float rejectedFraction = stats.testedCount > 0 ? static_cast<float>(rejectedCount) / stats.testedCount : 0.0f;
+			ImGui::Text("Rejected: %u / %u (%.1f%%)", rejectedCount, stats.testedCount, rejectedFraction * 100.0f);
+			ImGui::Text("Frustum: %u, Occluded: %u", stats.frustumRejectedCount, stats.occlusionRejectedCount);
+			ImGui::Text("Accepted in front of the occluders: %u", stats.trivialAcceptedCount);
+			ImGui::Text("Cost: %.3f ms (rasterize %.3f ms, tests %.3f ms)", stats.rasterizeTime + stats.testTime, stats.rasterizeTime, stats.testTime);
+		}
+
+		if (ImGui::CollapsingHeader("Lighting"))
+		{
+			const char* lightingModes[] = { "Forward", "Deferred" };
+			int lightingMode = m_lightingMode;
+			if (ImGui::Combo("Lighting Mode", &lightingMode, lightingModes, IM_ARRAYSIZE(lightingModes)))
+			{
+				SetLightingMode(lightingMode);
+			}
+
+			int stressLightCount = m_stressLightCount;
+			if (ImGui::SliderInt("Point Lights", &stressLightCount, 0, MAX_STRESS_LIGHTS))
+			{
+				SetStressLightCount(stressLightCount);
+			}
+
+			if (ImGui::Checkbox("Light Volume Stencil Test", &m_lightVolumeStencilTest))
+			{
+				GetFramePacket().Record([this, enabled = m_lightVolumeStencilTest]() { m_deferredPass->SetStencilTestEnabled(enabled); });
+			}
+
+			// Compare the "Opaque" section of the profiler in forward mode with "GBuffer" and "Deferred" in deferred mode
+			const DeferredRenderPass::Stats& stats = m_renderResults.deferredStats;
+			ImGui::Text("Light volumes: %u fullscreen, %u spheres, %u cones", stats.instanceCounts[0], stats.instanceCounts[1], stats.instanceCounts[2]);
+			ImGui::Text("Light volume draws: %u", stats.drawCount);
+			ImGui::Text("Props: %s", m_renderResults.propsDeferred ? "deferred" : "forward");
+		}
+
+		if (ImGui::CollapsingHeader("GPU Culling"))
+		{
+			// The GPU modes need compute shaders, GL 4.3
+			bool computeSupported = GetDevice().IsComputeSupported();
+			const char* gpuCullingModes[] = { "CPU", "GPU", "GPU + Validation" };
+			ImGui::BeginDisabled(!computeSupported);
+			if (ImGui::Combo("Culling Mode", &m_gpuCullingMode, gpuCullingModes, IM_ARRAYSIZE(gpuCullingModes)))
+			{
+				GetFramePacket().Record([this, mode = static_cast<GpuCullingRenderPass::Mode>(m_gpuCullingMode)]() { m_gpuCullingPass->SetMode(mode); });
+			}
+			ImGui::EndDisabled();
+			if (!computeSupported)
+			{
+				ImGui::Text("Compute shaders not supported, culling on the CPU");
+			}
+
+			int instanceCount = m_instanceCount;
+			if (ImGui::SliderInt("Instances", &instanceCount, 0, MAX_INSTANCES))
+			{
+				SetInstanceCount(instanceCount);
+			}
+
+			// The visible count is only read back in validation mode. The occlusion test uses the previous frame of the scene copy
+			const GpuCullingRenderPass::Stats& stats = m_renderResults.gpuCullingStats;
+			ImGui::Text("Instances: %u, draws: %u", stats.instanceCount, stats.drawCount);
+			ImGui::Text("Visible: %u, occluded: %u", stats.visibleCount, stats.occludedCount);
+			ImGui::Text("Culling CPU time: %.3f ms", stats.cpuTime);
+			ImGui::Text("Hi-Z: %s, validation errors: %u", m_renderResults.hiZValid ? "on" : "off", stats.validationErrorCount);
+		}
+
+		if (ImGui::CollapsingHeader("Reflections"))
+		{
+			const char* reflectionModes[] = { "Planar", "Screen Space" };
+			int reflectionMode = m_reflectionMode;
+			if (ImGui::Combo("Mode", &reflectionMode, reflectionModes, IM_ARRAYSIZE(reflectionModes)))
+			{
+				SetReflectionMode(reflectionMode);
+			}
+
+			ImGui::BeginDisabled(m_reflectionMode != ReflectionModeScreenSpace);
+			if (ImGui::SliderFloat("Max Distance", &m_ssrMaxDistance, 1.0f, 100.0f))
+			{
+				RecordUniformValue(*m_waterMaterial, "SsrMaxDistance", m_ssrMaxDistance);
+			}
+			if (ImGui::SliderFloat("Thickness", &m_ssrThickness, 0.01f, 5.0f))
+			{
+				RecordUniformValue(*m_waterMaterial, "SsrThickness", m_ssrThickness);
+			}
+			if (ImGui::SliderInt("Max Iterations", &m_ssrMaxIterations, 8, 256))
+			{
+				RecordUniformValue(*m_waterMaterial, "SsrMaxIterations", m_ssrMaxIterations);
+			}
+			ImGui::EndDisabled();
+		}
+
+		if (ImGui::CollapsingHeader("Refraction"))
+		{
+			if (ImGui::Checkbox("Enabled", &m_refractionEnabled))
+			{
+				RecordUniformValue(*m_waterMaterial, "RefractionEnabled", m_refractionEnabled ? 1 : 0);
+			}
+
+			ImGui::BeginDisabled(!m_refractionEnabled);
+			if (ImGui::SliderFloat("Strength", &m_refractionStrength, 0.0f, 5.0f))
+			{
+				RecordUniformValue(*m_waterMaterial, "RefractionStrength", m_refractionStrength);
+			}
+			if (ImGui::SliderFloat3("Absorption", &m_waterAbsorption[0], 0.0f, 2.0f))
+			{
+				RecordUniformValue(*m_waterMaterial, "AbsorptionCoefficients", m_waterAbsorption);
+			}
+			ImGui::EndDisabled();
+		}
+
+		// Shared by the refraction and the screen space reflections
+		ImGui::BeginDisabled(!UsesSceneCopy());
+		const char* downsampleNames[] = { "Full", "Half", "Quarter" };
+		int downsampleIndex = m_sceneCopyDownsample == 1 ? 0 : (m_sceneCopyDownsample == 2 ? 1 : 2);
+		if (ImGui::Combo("Scene Copy Size", &downsampleIndex, downsampleNames, IM_ARRAYSIZE(downsampleNames)))
+		{
+			m_sceneCopyDownsample = 1 << downsampleIndex;
+			GetFramePacket().Record([this, downsample = m_sceneCopyDownsample]()
+				{
+					m_sceneCopyPass->SetDownsample(downsample);
+					m_waterMaterial->SetUniformValue("HiZLevelCount", m_sceneCopyPass->GetDepthPyramidLevelCount());
+					m_hiZValid = false;
+				});
+		}
+		ImGui::EndDisabled();
 	}
 
 	if (auto window = m_imGui.UseWindow("Water window"))
@@ -739,36 +1989,36 @@ void WaterApplication::RenderGUI()
 		{
 			if (ImGui::SliderFloat("Water Opacity", &m_waterOpacity, 0.0f, 1.0f))
 			{
-				m_waterMaterial->SetUniformValue("Opacity", m_waterOpacity);
+				RecordUniformValue(*m_waterMaterial, "Opacity", m_waterOpacity);
 			}
 			if (ImGui::ColorEdit3("Water Trough Color", &m_waterTroughColor[0]))
 			{
-				m_waterMaterial->SetUniformValue("TroughColor", m_waterTroughColor);
+				RecordUniformValue(*m_waterMaterial, "TroughColor", m_waterTroughColor);
 			}
 			if (ImGui::ColorEdit3("Water Surface Color", &m_waterSurfaceColor[0]))
 			{
-				m_waterMaterial->SetUniformValue("SurfaceColor", m_waterSurfaceColor);
+				RecordUniformValue(*m_waterMaterial, "SurfaceColor", m_waterSurfaceColor);
 			}
 			if (ImGui::ColorEdit3("Water Peak Color", &m_waterPeakColor[0]))
 			{
-				m_waterMaterial->SetUniformValue("PeakColor", m_waterPeakColor);
+				RecordUniformValue(*m_waterMaterial, "PeakColor", m_waterPeakColor);
 			}
 
 			ImGui::Separator();
 
 			if (ImGui::SliderFloat("Trough Level", &m_troughLevel, 0.001f, 1.0f))
-				m_waterMaterial->SetUniformValue("TroughLevel", m_troughLevel);
+				RecordUniformValue(*m_waterMaterial, "TroughLevel", m_troughLevel);
 
 			if (ImGui::SliderFloat("Peak Level", &m_peakLevel, 0.001f, 1.0f))
-				m_waterMaterial->SetUniformValue("PeakLevel", m_peakLevel);
+				RecordUniformValue(*m_waterMaterial, "PeakLevel", m_peakLevel);
 
 			ImGui::Separator();
 
 			if (ImGui::SliderFloat("Trough Blend", &m_troughBlend, 0.001f, 0.5f))
-				m_waterMaterial->SetUniformValue("TroughBlend", m_troughBlend);
+				RecordUniformValue(*m_waterMaterial, "TroughBlend", m_troughBlend);
 
 			if (ImGui::SliderFloat("Peak Blend", &m_peakBlend, 0.001f, 0.5f))
-				m_waterMaterial->SetUniformValue("PeakBlend", m_peakBlend);
+				RecordUniformValue(*m_waterMaterial, "PeakBlend", m_peakBlend);
 
 		}
 
@@ -780,11 +2030,11 @@ void WaterApplication::RenderGUI()
 
 			if (ImGui::SliderFloat("Fresnel Power", &m_fresnelPower, 0.0f, 10.0f))
 			{
-				m_waterMaterial->SetUniformValue("FresnelPower", m_fresnelPower);
+				RecordUniformValue(*m_waterMaterial, "FresnelPower", m_fresnelPower);
 			}
 			if (ImGui::SliderFloat("Fresnel Strength", &m_fresnelStrength, 0.0f, 1.0f))
 			{
-				m_waterMaterial->SetUniformValue("FresnelStrength", m_fresnelStrength);
+				RecordUniformValue(*m_waterMaterial, "FresnelStrength", m_fresnelStrength);
 			}
 		}
 
@@ -794,30 +2044,30 @@ void WaterApplication::RenderGUI()
 		{
 			if (ImGui::SliderFloat("Wave Amplitude", &m_waveAmplitude, 0.0f, 1.0f))
 			{
-				m_waterMaterial->SetUniformValue("WaveAmplitude", m_waveAmplitude);
+				RecordUniformValue(*m_waterMaterial, "WaveAmplitude", m_waveAmplitude);
 			}
 			if (ImGui::SliderFloat("Wave Frequency", &m_waveFrequency, 0.1f, 2.0f))
 			{
-				m_waterMaterial->SetUniformValue("WaveFrequency", m_waveFrequency);
+				RecordUniformValue(*m_waterMaterial, "WaveFrequency", m_waveFrequency);
 			}
 			if (ImGui::SliderFloat("Wave Persistence", &m_wavePersistence, 0.0f, 1.0f))
 			{
-				m_waterMaterial->SetUniformValue("WavePersistence", m_wavePersistence);
+				RecordUniformValue(*m_waterMaterial, "WavePersistence", m_wavePersistence);
 			}
 			if (ImGui::SliderFloat("Wave Lacunarity", &m_waveLacunarity, 1.0f, 3.0f))
 			{
-				m_waterMaterial->SetUniformValue("WaveLacunarity", m_waveLacunarity);
+				RecordUniformValue(*m_waterMaterial, "WaveLacunarity", m_waveLacunarity);
 			}
 			if (ImGui::SliderInt("Wave Octaves", &m_waveOctaves, 1, 15))
 			{
-				m_waterMaterial->SetUniformValue("WaveOctaves", m_waveOctaves);
+				ApplyWaveOctaves();
 			}
 
 			ImGui::Separator();
 
 			if (ImGui::SliderFloat("Wave Speed", &m_waveSpeed, 0.0f, 10.0f))
 			{
-				m_waterMaterial->SetUniformValue("WaveSpeed", m_waveSpeed);
+				RecordUniformValue(*m_waterMaterial, "WaveSpeed", m_waveSpeed);
 			}
 
 		}
@@ -825,36 +2075,38 @@ void WaterApplication::RenderGUI()
 
 		if (ImGui::CollapsingHeader("Light Caustics Parameters"))
 		{
-			if (ImGui::ColorEdit3("Caustics Color", &m_causticsColor[0]))
+			// The sand material switches permutation once it is built, in UpdateShaderPermutations
+			ImGui::Checkbox("Caustics Enabled", &m_causticsEnabled);
+			ImGui::BeginDisabled(!m_causticsEnabled || !m_renderResults.causticsUniformsFound);
+			if (ImGui::ColorEdit3("Caustics Color", &m_caustics.color[0]))
 			{
-				m_sandMaterial->SetUniformValue("CausticsColor", m_causticsColor);
+				RecordUniformValue(*m_sandMaterial, "CausticsColor", m_caustics.color);
 			}
-			if (ImGui::SliderFloat("Caustics Intensity", &m_causticsIntensity, 0.0f, 1.0f))
+			if (ImGui::SliderFloat("Caustics Intensity", &m_caustics.intensity, 0.0f, 1.0f))
 			{
-				m_sandMaterial->SetUniformValue("CausticsIntensity", m_causticsIntensity);
+				RecordUniformValue(*m_sandMaterial, "CausticsIntensity", m_caustics.intensity);
 			}
-			if (ImGui::SliderFloat("Caustics Offset", &m_causticsOffset, 0.0f, 1.0f))
+			if (ImGui::SliderFloat("Caustics Offset", &m_caustics.offset, 0.0f, 1.0f))
 			{
-				m_sandMaterial->SetUniformValue("CausticsOffset", m_causticsOffset);
+				RecordUniformValue(*m_sandMaterial, "CausticsOffset", m_caustics.offset);
 			}
-			if (ImGui::SliderFloat("Caustics Scale", &m_causticsScale, 0.0f, 5.0f))
+			if (ImGui::SliderFloat("Caustics Scale", &m_caustics.scale, 0.0f, 5.0f))
 			{
-				m_sandMaterial->SetUniformValue("CausticsScale", m_causticsScale);
+				RecordUniformValue(*m_sandMaterial, "CausticsScale", m_caustics.scale);
 			}
-			if (ImGui::SliderFloat("Caustics Speed", &m_causticsSpeed, 0.0f, 5.0f))
+			if (ImGui::SliderFloat("Caustics Speed", &m_caustics.speed, 0.0f, 5.0f))
 			{
-				m_sandMaterial->SetUniformValue("CausticsSpeed", m_causticsSpeed);
+				RecordUniformValue(*m_sandMaterial, "CausticsSpeed", m_caustics.speed);
 			}
-			if (ImGui::SliderFloat("Caustics Thickness", &m_causticsThickness, 0.0f, 1.0f))
+			if (ImGui::SliderFloat("Caustics Thickness", &m_caustics.thickness, 0.0f, 1.0f))
 			{
-				m_sandMaterial->SetUniformValue("CausticsThickness", m_causticsThickness);
+				RecordUniformValue(*m_sandMaterial, "CausticsThickness", m_caustics.thickness);
 			}
+			ImGui::EndDisabled();
 
 		}
 
 	}
-
-	m_imGui.EndFrame();
 }
 
 
@@ -1,30 +1,140 @@
 #pragma once
 
 #include <ituGL/application/Application.h>
+#include <ituGL/application/SimulationState.h>
 
 #include <ituGL/scene/Scene.h>
 #include <ituGL/asset/ShaderLoader.h>
 #include <ituGL/geometry/Mesh.h>
 #include <ituGL/renderer/Renderer.h>
+#include <ituGL/renderer/RenderGraph.h>
+#include <ituGL/renderer/OcclusionCuller.h>
+#include <ituGL/renderer/DrawList.h>
+#include <ituGL/renderer/DeferredRenderPass.h>
+#include <ituGL/renderer/GpuCullingRenderPass.h>
 #include <ituGL/camera/CameraController.h>
+#include <ituGL/camera/Camera.h>
 #include <ituGL/utils/DearImGui.h>
+#include <ituGL/utils/Profiler.h>
+#include <ituGL/utils/QualityGovernor.h>
+#include <ituGL/core/JobSystem.h>
 #include <ituGL/shader/Material.h>
-#include <ituGL/scene/transform.h>
+#include <ituGL/shader/ShaderPermutations.h>
+#include <ituGL/asset/ShaderProgramCache.h>
+#include <ituGL/scene/Transform.h>
 
 #include <ituGL/geometry/VertexFormat.h>
 #include <ituGL/texture/Texture2DObject.h>
 #include <ituGL/texture/FramebufferObject.h>
 
+#include <array>
+#include <fstream>
+#include <mutex>
+
 class TextureCubemapObject;
 class Material;
+class Model;
+class ModelLoader;
+class SceneCopyRenderPass;
+class DepthPrepassRenderPass;
+class GBufferRenderPass;
+class PointLight;
+class SceneModel;
 
 class WaterApplication : public Application
 {
 public:
 	WaterApplication(unsigned int x, unsigned int y);
 
+private:
+    // Caustics on the sand, set again when the sand material changes permutation
+    struct CausticsSettings
+    {
+        glm::vec3 color;
+        float intensity;
+        float offset;
+        float scale;
+        float speed;
+        float thickness;
+    };
+
+    // Values of one frame, recorded by the main thread in Render and read by the render thread when the frame packet is replayed
+    // The render thread only reads the frames, never the scenes or the settings that the main thread keeps changing
+    struct FrameData
+    {
+        // Window and render target sizes
+        int width, height;
+        unsigned int reflectionSize;
+        int sceneWidth, sceneHeight;
+
+        Camera camera;
+        Camera reflectionCamera;
+
+        // Models and lights in the frustum of each view
+        DrawList mainDrawList;
+        DrawList reflectionDrawList;
+        // World matrix of the sand, the occluder of the main view
+        glm::mat4 sandMatrix;
+
+        // Uniforms set every frame
+        float simulationTime;
+        glm::vec4 clipPlane;
+        float sandBaseHeight;
+        float waterBaseHeight;
+        glm::vec2 cameraNearFar;
+
+        int reflectionMode;
+        bool deferredLighting;
+        bool useSceneCopy;
+        bool useSceneBuffer;
+        int stressLightCount;
+        // The debug window shows the planar reflection
+        bool reflectionPreview;
+
+        // Permutations selected by the settings. The materials switch to them once they are built
+        ShaderPermutations::FeatureMask defaultFeatureMask;
+        ShaderPermutations::FeatureMask gbufferFeatureMask;
+        ShaderPermutations::FeatureMask instancedFeatureMask;
+        ShaderPermutations::FeatureMask waterFeatureMask;
+        ShaderPermutations::FeatureMask sandFeatureMask;
+        CausticsSettings caustics;
+    };
+
+    // Results of the last frame rendered, published by the render thread and shown in the GUI
+    struct RenderResults
+    {
+        Profiler::Results profiler;
+        RenderGraph::Results renderGraph;
+
+        // Render state changes, to check that draws with the same states are batched
+        unsigned int renderStateTransitions = 0;
+        unsigned int renderStateCalls = 0;
+        unsigned int textureBindCalls = 0;
+        unsigned int renderStateBlockCount = 0;
+
+        Renderer::CommandListStats commandListStats;
+        FrameArena::Stats frameArenaStats;
+
+        // Values of the last view rendered, the main view
+        float opaqueOverdraw = 0.0f;
+        bool depthPrepassActive = false;
+        OcclusionCuller::Stats occlusionStats;
+
+        DeferredRenderPass::Stats deferredStats;
+        GpuCullingRenderPass::Stats gpuCullingStats;
+        bool hiZValid = false;
+
+        bool propsDeferred = false;
+        unsigned int waterPermutationCount = 0;
+        unsigned int pendingWaterPermutationCount = 0;
+        // The caustics uniforms only exist once the sand uses the permutation with caustics
+        bool causticsUniformsFound = false;
+    };
+
 protected:
     void Initialize() override;
+    void FixedUpdate() override;
+    void PublishSimulation() override;
     void Update() override;
     void Render() override;
     void Cleanup() override;
@@ -32,28 +142,226 @@ protected:
 private:
     void InitializeCamera();
     void InitializeLights();
+    void InitializeStressLights();
+    void InitializeShaderPermutations();
     void InitializeDefaultMaterial();
     void InitializeWaterMaterial();
     void InitializeSandMaterial();
-	void SetupOffScreenBuffer();
+    void InitializeDeferredMaterial();
+    void InitializeInstances(ModelLoader& loader);
+    void InitializeReflectionPreview();
+    void UpdateRenderTargetSizes();
     void SetOffScreenCamera(Camera& camera, glm::vec3& originalPosition);
 
 	void InitializeMeshes();
     void InitializeModels();
     void InitializeRenderer();
 
-    void RenderGUI();
+    void UpdateQuality();
+    void ApplyQualityLevel(int level);
+    void ApplyWaveOctaves();
+    ShaderPermutations::FeatureMask GetDefaultFeatureMask() const;
+    ShaderPermutations::FeatureMask GetGBufferFeatureMask() const;
+    ShaderPermutations::FeatureMask GetInstancedFeatureMask() const;
+    ShaderPermutations::FeatureMask GetWaterFeatureMask() const;
+    ShaderPermutations::FeatureMask GetSandFeatureMask() const;
+    void ApplyCaustics(ShaderPermutations::FeatureMask sandFeatureMask, const CausticsSettings& caustics);
+    // Switch the materials to the permutations selected in the frame, once they finish building
+    void UpdateShaderPermutations(const FrameData& frame);
+    void UpdatePropMaterials(const FrameData& frame);
+    // Assign the G-buffer or the forward materials to the prop submeshes
+    void SetPropMaterials(bool gbuffer);
+    void UpdateUniformHandles();
+    void SetWaterLod(unsigned int lod);
+
+    void SetReflectionMode(int reflectionMode);
+    void SetLightingMode(int lightingMode);
+    void SetStressLightCount(int stressLightCount);
+    void SetInstanceCount(int instanceCount);
+    bool UsesSceneCopy() const;
+    bool UsesSceneBuffer() const;
+
+    // Main thread. Copy the views and the settings of the frame
+    void RecordFrame(FrameData& frame);
+
+    // Changes of the objects owned by the render thread, recorded in the frame packet by the main thread
+    // They run in the render thread before the frame is rendered. While initializing, they run at the end of Initialize
+    template<typename T>
+    void RecordUniformValue(Material& material, const char* name, const T& value);
+    void RecordPrebuild(ShaderPermutations& permutations, ShaderPermutations::FeatureMask featureMask);
+
+    // Render thread. The GUI draw data is replayed between both
+    void RenderFrame(const FrameData& frame);
+    void EndRenderFrame();
+    void ResizeSceneCopy(const FrameData& frame);
+    void PublishRenderResults();
+
+    // Passes of the render graph
+    void BuildRenderGraph(const FrameData& frame);
+    void RenderReflection(RenderGraph& renderGraph, const FrameData& frame);
+    void CopyReflectionPreview(RenderGraph& renderGraph);
+    void RenderGBuffer(RenderGraph& renderGraph, const FrameData& frame);
+    void RenderMain(RenderGraph& renderGraph, const FrameData& frame);
+    void AddMainView(const FrameData& frame);
+    void PresentScene(RenderGraph& renderGraph, const FrameData& frame);
+
+    // Main thread. Shows the settings and the results of the last frame rendered
+    void DrawGUI();
     void CreatePlaneMesh(Mesh& mesh, unsigned int gridX, unsigned int gridY);
 
 private:
-
+    // Settings changed by the quality governor, from highest to lowest quality
+    struct QualitySettings
+    {
+        // Reflection texture size is the window width divided by this value
+        unsigned int reflectionDivisor;
+        // Main pass resolution, relative to the window
+        float renderScale;
+        // Max noise octaves in the water vertex shader
+        int waveOctaves;
+        // Water grid is divided by 2^waterLod in each direction
+        unsigned int waterLod;
+    };
+    static constexpr std::array<QualitySettings, 7> s_qualityLevels = { {
+        { 2, 1.00f, 8, 0 },
+        { 2, 1.00f, 6, 0 },
+        { 4, 1.00f, 6, 1 },
+        { 4, 0.85f, 5, 1 },
+        { 4, 0.75f, 4, 2 },
+        { 8, 0.60f, 3, 2 },
+        { 8, 0.50f, 2, 3 },
+    } };
+    static constexpr unsigned int WATER_LOD_COUNT = 4;
 
     static constexpr int REFLECTION_TEX_UNIT = 0; 
-	// Offscreen framebuffer for rendering to texture
-    std::shared_ptr<Texture2DObject>   m_offscreenColorTex;
-    std::shared_ptr<Texture2DObject>   m_offscreenDepthTex;
-    std::shared_ptr<FramebufferObject>  m_offscreenFBO;
+
+    // The render thread owns the context and replays the frame packets, while the main thread records the next frames
+    // Submit returns when fewer than MAX_QUEUED_FRAMES frames are queued. When the main thread records frame N,
+    // frame N - MAX_QUEUED_FRAMES - 2 was already presented, and its data can be reused
+    static constexpr unsigned int MAX_QUEUED_FRAMES = 2;
+    std::array<FrameData, MAX_QUEUED_FRAMES + 2> m_frames;
+
+    // Frame being rendered, read by the uniform functions of the shader programs. Render thread only
+    const FrameData* m_renderFrame;
+
+    // Published at the end of each frame by the render thread, and copied by the main thread in Update
+    std::mutex m_renderResultsMutex;
+    RenderResults m_publishedRenderResults;
+    RenderResults m_renderResults;
+
+    // How the water reflection is computed. Values match ReflectionMode in water.frag
+    enum ReflectionMode
+    {
+        ReflectionModePlanar = 0,
+        ReflectionModeScreenSpace = 1,
+    };
+    int m_reflectionMode;
+
+    // Light type of the lighting permutations. Values match LIGHT_TYPE in lighting.glsl
+    enum LightType
+    {
+        LightTypeAny = 0,
+        LightTypeDirectional = 1,
+        LightTypePoint = 2,
+        LightTypeSpot = 3,
+    };
+
+    // How the props are lit. The water and the sand are always forward
+    enum LightingMode
+    {
+        LightingModeForward = 0,
+        LightingModeDeferred = 1,
+    };
+    int m_lightingMode;
+
+    // Point lights added around the props, to compare the cost of the lighting modes with many lights
+    static constexpr int MAX_STRESS_LIGHTS = 1000;
+    std::vector<std::shared_ptr<PointLight>> m_stressLights;
+    int m_stressLightCount;
+
+    // Passes of the frame. Render targets are taken from its pool, and reallocated when their size changes
+    RenderGraph m_renderGraph;
+
+	// Offscreen texture for rendering the planar reflection
+    RenderGraph::ResourceHandle m_reflectionColor;
     unsigned int  m_offscreenWidth, m_offscreenHeight;
+    unsigned int  m_reflectionDivisor;
+
+    // Copy of the planar reflection shown in the debug window. The GUI needs a texture that exists when it is recorded
+    static constexpr int REFLECTION_PREVIEW_SIZE = 256;
+    std::shared_ptr<Texture2DObject> m_reflectionPreviewTexture;
+    bool m_reflectionPreviewVisible;
+
+    // Targets of the main pass, when rendering below window resolution or when the scene is copied for SSR
+    RenderGraph::ResourceHandle m_sceneColor;
+    RenderGraph::ResourceHandle m_sceneDepth;
+    int  m_sceneWidth, m_sceneHeight;
+    float m_renderScale;
+    // Size of the scene copy textures, reallocated by the render thread when the frame has a different size
+    int m_sceneCopyWidth, m_sceneCopyHeight;
+
+    // Albedo, normal and others textures of the props, in deferred mode
+    std::array<RenderGraph::ResourceHandle, 3> m_gbufferTextures;
+
+    // Copy of the opaque scene color and depth pyramid, used by the refraction and the screen space reflections. Owned by the renderer
+    SceneCopyRenderPass* m_sceneCopyPass;
+
+    // Depth-only pass over the opaque geometry, so the PBR shading runs once per pixel. Owned by the renderer
+    DepthPrepassRenderPass* m_depthPrepass;
+    // Settings of the pass shown in the GUI
+    int m_depthPrepassMode;
+    float m_overdrawEnableThreshold, m_overdrawDisableThreshold;
+
+    // Passes of the deferred mode. The G-buffer pass is the first one of the renderer, rendered by its own graph pass. Owned by the renderer
+    GBufferRenderPass* m_gbufferPass;
+    int m_gbufferPassIndex;
+    DeferredRenderPass* m_deferredPass;
+    bool m_lightVolumeStencilTest;
+
+    // Field of instances of a prop on the sand, culled on the GPU when compute shaders are supported. Owned by the renderer
+    static constexpr int MAX_INSTANCES = 100000;
+    GpuCullingRenderPass* m_gpuCullingPass;
+    int m_gpuCullingMode;
+    std::shared_ptr<Model> m_instancedModel;
+    int m_instanceCount;
+
+    // The instances are tested against the depth pyramid of the previous frame, if it was built with the same size
+    bool m_hiZValid;
+    glm::mat4 m_hiZViewProjMatrix;
+    int m_sceneCopyDownsample;
+
+    // Screen space reflection parameters
+    float m_ssrMaxDistance;
+    float m_ssrThickness;
+    int m_ssrMaxIterations;
+
+    // Screen space refraction parameters
+    bool m_refractionEnabled;
+    float m_refractionStrength;
+    glm::vec3 m_waterAbsorption;
+
+    // Occlusion culling of the main view, with the sand plane as occluder
+    OcclusionCuller m_occlusionCuller;
+    std::shared_ptr<OcclusionCuller::Occluder> m_sandOccluder;
+    bool m_occlusionCullingEnabled;
+
+    // CPU and GPU timings of the frame, in the render thread
+    Profiler m_profiler;
+    bool m_gpuTimingEnabled;
+
+    // Adjusts the quality settings to keep the frame time on budget
+    QualityGovernor m_qualityGovernor;
+    std::ofstream m_qualityLog;
+    bool m_vsyncEnabled;
+
+    // Values advanced in fixed steps, so the waves don't depend on the frame rate
+    struct WaterSimulation
+    {
+        float time;
+    };
+    SimulationState<WaterSimulation> m_simulation;
+    // Simulation time interpolated to the current frame, copied to the frame for the shaders
+    float m_simulationTime;
 
     // Helper object for debug GUI
     DearImGui m_imGui;
@@ -61,6 +369,11 @@ private:
     // Camera controller
     CameraController m_cameraController;
 
+    // Cameras of the frame being rendered, copied from the frame by the render thread
+    // The same objects every frame, so the passes that keep state for each camera find it again
+    Camera m_viewCamera;
+    Camera m_reflectionCamera;
+
 	// Scene for opaque objects
     Scene m_opaqueScene;
 	// Scene for transparent objects
@@ -69,6 +382,12 @@ private:
     // Renderer
     Renderer m_renderer;
 
+    // Stats of the job system workers in the previous frame
+    std::vector<JobSystem::WorkerStats> m_workerStats;
+
+    // Linked shader binaries from previous runs, to avoid compiling the permutations at startup
+    ShaderProgramCache m_shaderProgramCache;
+
     // Skybox texture
     std::shared_ptr<TextureCubemapObject> m_skyboxTexture;
 
@@ -79,15 +398,58 @@ private:
     std::shared_ptr<Material> m_defaultMaterial;
     std::shared_ptr<Material> m_waterMaterial;
     std::shared_ptr<Material> m_sandMaterial;
-
-    ShaderLoader m_vertexShaderLoader;
-    ShaderLoader m_fragmentShaderLoader;
+    // Lights the G-buffer with the light volumes of the deferred pass
+    std::shared_ptr<Material> m_deferredMaterial;
+
+    // Uniforms of the default material set by the renderer, kept when the props change permutation
+    ShaderUniformCollection::NameSet m_defaultFilteredUniforms;
+
+    // Materials of the prop submeshes for the forward and deferred modes. The G-buffer one is created when first used
+    struct PropMaterial
+    {
+        std::shared_ptr<Material> forwardMaterial;
+        std::shared_ptr<Material> gbufferMaterial;
+        // Model and material index of the submeshes that use them
+        std::vector<std::pair<std::shared_ptr<Model>, unsigned int>> submeshes;
+    };
+    std::vector<PropMaterial> m_propMaterials;
+    // If the props currently use their G-buffer materials
+    bool m_propsDeferred;
+
+    // Specialized versions of the material shaders, built when first used
+    std::shared_ptr<ShaderPermutations> m_defaultPermutations;
+    std::shared_ptr<ShaderPermutations> m_waterPermutations;
+    std::shared_ptr<ShaderPermutations> m_sandPermutations;
+    ShaderPermutations::Feature m_defaultLightTypeFeature;
+    ShaderPermutations::Feature m_defaultTextureArraysFeature;
+    ShaderPermutations::Feature m_defaultGBufferFeature;
+    ShaderPermutations::Feature m_defaultInstancedFeature;
+    ShaderPermutations::Feature m_waterLightTypeFeature;
+    ShaderPermutations::Feature m_waterOctavesFeature;
+    ShaderPermutations::Feature m_sandCausticsFeature;
 
     // mesh used for both water and sand planes
     std::shared_ptr<Mesh> m_planeMesh;
 
+    // water plane meshes with decreasing grid resolution. LOD 0 is m_planeMesh
+    // Each LOD has its own model, so changing LOD only changes the model of the scene node, and not a model being rendered
+    std::array<std::shared_ptr<Mesh>, WATER_LOD_COUNT> m_waterLodMeshes;
+    std::array<std::shared_ptr<Model>, WATER_LOD_COUNT> m_waterLodModels;
+    std::shared_ptr<SceneModel> m_waterSceneModel;
+    unsigned int m_waterLod;
+
     glm::vec4 m_clipPlane;
 
+    // Uniforms set every frame. Found again when the materials change permutation
+    UniformHandle<float> m_sandBaseHeightUniform;
+    UniformHandle<float> m_waterBaseHeightUniform;
+    UniformHandle<glm::vec2> m_cameraNearFarUniform;
+    UniformHandle<glm::vec4> m_sandClipPlaneUniform;
+    // Textures of the render graph, assigned every frame
+    UniformHandle<std::shared_ptr<Texture2DObject>> m_reflectionTextureUniform;
+    std::array<UniformHandle<std::shared_ptr<Texture2DObject>>, 3> m_gbufferTextureUniforms;
+    UniformHandle<std::shared_ptr<Texture2DObject>> m_deferredDepthTextureUniform;
+
 	// window dimensions
 	int m_width, m_height;
 
@@ -116,16 +478,14 @@ private:
     float m_waveLacunarity;
 	float m_wavePersistence; 
 	int m_waveOctaves;
+	// octaves sent to the shader, limited by the quality level
+	int m_appliedWaveOctaves;
 	float m_waveSpeed;
 
 	float m_sandBaseHeight;
 	float m_waterBaseHeight;
 
-    glm::vec3 m_causticsColor;
-    float m_causticsIntensity;
-    float m_causticsOffset;
-    float m_causticsScale;
-    float m_causticsSpeed;
-    float m_causticsThickness;
+    bool m_causticsEnabled;
+    CausticsSettings m_caustics;
 
 };
\ No newline at end of file
@@ -5,18 +5,37 @@ layout (location = 2) in vec3 VertexTangent;
 layout (location = 3) in vec3 VertexBitangent;
 layout (location = 4) in vec2 VertexTexCoord;
 
+#ifdef INSTANCED
+// World matrix of each instance, one column per location. See GpuCullingRenderPass
+layout (location = 5) in mat4 InstanceWorldMatrix;
+#define WorldMatrix InstanceWorldMatrix
+#endif
+
+#ifdef TEXTURE_ARRAYS
+// Layers of the color, normal and specular textures, the same for the whole submesh. See ModelLoader
+layout (location = 9) in vec3 VertexTextureLayers;
+#endif
+
 //Outputs
 out vec3 WorldPosition;
 out vec3 WorldNormal;
 out vec3 WorldTangent;
 out vec3 WorldBitangent;
 out vec2 TexCoord;
+#ifdef TEXTURE_ARRAYS
+flat out vec3 TextureLayers;
+#endif
 
 //Uniforms
+#ifndef INSTANCED
 uniform mat4 WorldMatrix;
+#endif
 uniform mat4 ViewProjMatrix;
 uniform vec4 ClipPlane;        // (A,B,C,D) in world space
 
+// Must match the depth pre-pass exactly
+invariant gl_Position;
+
 void main()
 {
 	vec4 worldPos   = WorldMatrix * vec4(VertexPosition,1.0);
@@ -35,6 +54,9 @@ void main()
 
 	// texture coordinates
 	TexCoord = VertexTexCoord;
+#ifdef TEXTURE_ARRAYS
+	TextureLayers = VertexTextureLayers;
+#endif
 
 	// final vertex position (for opengl rendering, not for lighting)
 	gl_Position = ViewProjMatrix * vec4(WorldPosition, 1.0);
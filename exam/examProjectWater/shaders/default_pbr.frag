@@ -4,30 +4,58 @@ in vec3 WorldNormal;
 in vec3 WorldTangent;
 in vec3 WorldBitangent;
 in vec2 TexCoord;
+#ifdef TEXTURE_ARRAYS
+flat in vec3 TextureLayers;
+#endif
 
 //Outputs
+#ifdef GBUFFER
+// Surface data for the deferred lighting, in the attachments of the G-buffer
+layout (location = 0) out vec4 GBufferAlbedo;
+layout (location = 1) out vec2 GBufferNormal;
+layout (location = 2) out vec4 GBufferOthers;
+#else
 out vec4 FragColor;
+#endif
 
 //Uniforms
 uniform vec3 Color;
+#ifdef TEXTURE_ARRAYS
+// Textures are shared with other materials, each submesh reads its own layers
+uniform sampler2DArray ColorTexture;
+uniform sampler2DArray NormalTexture;
+uniform sampler2DArray SpecularTexture;
+#define ColorTextureLayer TextureLayers.x
+#define NormalTextureLayer TextureLayers.y
+#define SpecularTextureLayer TextureLayers.z
+#define TEXCOORD(layer) vec3(TexCoord, layer)
+#else
 uniform sampler2D ColorTexture;
 uniform sampler2D NormalTexture;
 uniform sampler2D SpecularTexture;
+#define TEXCOORD(layer) TexCoord
+#endif
 
 uniform vec3 CameraPosition;
 
 void main()
 {
 	SurfaceData data;
-	data.normal = SampleNormalMap(NormalTexture, TexCoord, normalize(WorldNormal), normalize(WorldTangent), normalize(WorldBitangent));
-	data.albedo = Color * texture(ColorTexture, TexCoord).rgb;
-	vec3 arm = texture(SpecularTexture, TexCoord).rgb;
+	data.normal = SampleNormalMap(NormalTexture, TEXCOORD(NormalTextureLayer), normalize(WorldNormal), normalize(WorldTangent), normalize(WorldBitangent));
+	data.albedo = Color * texture(ColorTexture, TEXCOORD(ColorTextureLayer)).rgb;
+	vec3 arm = texture(SpecularTexture, TEXCOORD(SpecularTextureLayer)).rgb;
 	data.ambientOcclusion = arm.x;
 	data.roughness = arm.y;
 	data.metalness = arm.z;
 
+#ifdef GBUFFER
+	GBufferAlbedo = vec4(data.albedo, data.ambientOcclusion);
+	GBufferNormal = EncodeNormal(data.normal);
+	GBufferOthers = vec4(data.roughness, data.metalness, 0.0f, 1.0f);
+#else
 	vec3 position = WorldPosition;
 	vec3 viewDir = GetDirection(position, CameraPosition);
 	vec3 color = ComputeLighting(position, data, viewDir, true);
 	FragColor = vec4(color.rgb, 1);
+#endif
 }
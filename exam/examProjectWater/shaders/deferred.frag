@@ -0,0 +1,41 @@
+//Outputs
+out vec4 FragColor;
+
+//Uniforms
+// G-buffer of the scene, written by the GBUFFER permutation of the default material
+uniform sampler2D DepthTexture;
+uniform sampler2D AlbedoTexture;
+uniform sampler2D NormalTexture;
+uniform sampler2D OthersTexture;
+
+uniform mat4 InvViewProjMatrix;
+uniform vec3 CameraPosition;
+
+void main()
+{
+	ivec2 coords = ivec2(gl_FragCoord.xy);
+
+	// Background is drawn later by the skybox
+	float depth = texelFetch(DepthTexture, coords, 0).r;
+	if (depth >= 1.0f)
+	{
+		discard;
+	}
+
+	// World position from the depth
+	vec2 texCoord = gl_FragCoord.xy / vec2(textureSize(DepthTexture, 0));
+	vec4 position = InvViewProjMatrix * vec4(vec3(texCoord, depth) * 2.0f - vec3(1.0f), 1.0f);
+	position.xyz /= position.w;
+
+	SurfaceData data;
+	vec4 albedo = texelFetch(AlbedoTexture, coords, 0);
+	data.albedo = albedo.rgb;
+	data.ambientOcclusion = albedo.a;
+	data.normal = DecodeNormal(texelFetch(NormalTexture, coords, 0).xy);
+	vec4 others = texelFetch(OthersTexture, coords, 0);
+	data.roughness = others.x;
+	data.metalness = others.y;
+
+	vec3 viewDir = GetDirection(position.xyz, CameraPosition);
+	FragColor = vec4(ComputeLighting(position.xyz, data, viewDir, true), 0.0f);
+}
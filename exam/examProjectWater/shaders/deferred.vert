@@ -0,0 +1,30 @@
+//Inputs
+layout (location = 0) in vec3 VertexPosition;
+// Light of each volume instance, see DeferredRenderPass::LightInstance
+layout (location = 1) in mat4 VolumeMatrix;
+layout (location = 5) in vec4 InstanceColor;
+layout (location = 6) in vec3 InstancePosition;
+layout (location = 7) in vec3 InstanceDirection;
+layout (location = 8) in vec4 InstanceAttenuation;
+
+//Outputs
+flat out int LightIndirectInstance;
+flat out vec3 LightColor;
+flat out vec3 LightPosition;
+flat out vec3 LightDirection;
+flat out vec4 LightAttenuation;
+
+//Uniforms
+uniform mat4 ViewProjMatrix;
+
+void main()
+{
+	LightIndirectInstance = InstanceColor.a > 0.0f ? 1 : 0;
+	LightColor = InstanceColor.rgb;
+	LightPosition = InstancePosition;
+	LightDirection = InstanceDirection;
+	LightAttenuation = InstanceAttenuation;
+
+	// Fullscreen instances cancel the view projection, so the triangle stays in clip space
+	gl_Position = ViewProjMatrix * (VolumeMatrix * vec4(VertexPosition, 1.0f));
+}
@@ -1,9 +1,28 @@
 
+// LIGHT_TYPE can be defined to specialize the lighting for a single type of light
+#define LIGHT_TYPE_ANY 0
+#define LIGHT_TYPE_DIRECTIONAL 1
+#define LIGHT_TYPE_POINT 2
+#define LIGHT_TYPE_SPOT 3
+#ifndef LIGHT_TYPE
+#define LIGHT_TYPE LIGHT_TYPE_ANY
+#endif
+
+#ifdef LIGHT_INSTANCED
+// Deferred lighting draws many lights at once, each instance passes its light from the vertex shader
+flat in int LightIndirectInstance;
+flat in vec3 LightColor;
+flat in vec3 LightPosition;
+flat in vec3 LightDirection;
+flat in vec4 LightAttenuation;
+#define LightIndirect (LightIndirectInstance != 0)
+#else
 uniform bool LightIndirect;
 uniform vec3 LightColor;
 uniform vec3 LightPosition;
 uniform vec3 LightDirection;
 uniform vec4 LightAttenuation;
+#endif
 
 float ComputeDistanceAttenuation(vec3 position)
 {
@@ -13,13 +32,21 @@ float ComputeDistanceAttenuation(vec3 position)
 
 float ComputeAngularAttenuation(vec3 lightDir)
 {
-	float angle = acos(dot(LightDirection, lightDir));
+	// lightDir points to the light, LightDirection away from it
+	float angle = acos(dot(-LightDirection, lightDir));
 	vec2 attAngle = LightAttenuation.zw;
 	return smoothstep(attAngle.y, attAngle.x, angle);
 }
 
 float ComputeAttenuation(vec3 position, vec3 lightDir)
 {
+#if LIGHT_TYPE == LIGHT_TYPE_DIRECTIONAL
+	return 1.0f;
+#elif LIGHT_TYPE == LIGHT_TYPE_POINT
+	return ComputeDistanceAttenuation(position);
+#elif LIGHT_TYPE == LIGHT_TYPE_SPOT
+	return ComputeDistanceAttenuation(position) * ComputeAngularAttenuation(lightDir);
+#else
 	float attenuation = 1.0f;
 	if (LightAttenuation.y > 0)
 	{
@@ -30,11 +57,18 @@ float ComputeAttenuation(vec3 position, vec3 lightDir)
 		attenuation *= ComputeAngularAttenuation(lightDir);
 	}
 	return attenuation;
+#endif
 }
 
 vec3 ComputeLightDirection(vec3 position)
 {
+#if LIGHT_TYPE == LIGHT_TYPE_DIRECTIONAL
+	return -LightDirection;
+#elif LIGHT_TYPE == LIGHT_TYPE_ANY
 	return LightAttenuation.y >= 0 ? GetDirection(position, LightPosition) : -LightDirection;
+#else
+	return GetDirection(position, LightPosition);
+#endif
 }
 
 vec3 ComputeLight(SurfaceData data, vec3 viewDir, vec3 position)
@@ -0,0 +1,29 @@
+#version 330 core
+
+//Outputs
+// Closest and farthest depth
+out vec2 FragDepth;
+
+//Uniforms
+uniform sampler2D SourceTexture;
+uniform int Downsample;
+
+void main()
+{
+	ivec2 maxCoord = textureSize(SourceTexture, 0) - 1;
+	ivec2 baseCoord = ivec2(gl_FragCoord.xy) * Downsample;
+
+	// Keep the closest and farthest depth of all the source texels covered by this texel
+	vec2 depth = vec2(1.0f, 0.0f);
+	for (int y = 0; y < Downsample; ++y)
+	{
+		for (int x = 0; x < Downsample; ++x)
+		{
+			ivec2 coord = min(baseCoord + ivec2(x, y), maxCoord);
+			float sourceDepth = texelFetch(SourceTexture, coord, 0).r;
+			depth = vec2(min(depth.x, sourceDepth), max(depth.y, sourceDepth));
+		}
+	}
+
+	FragDepth = depth;
+}
@@ -0,0 +1,20 @@
+#version 330 core
+
+//Inputs
+layout (location = 0) in vec3 VertexPosition;
+
+//Uniforms
+uniform mat4 WorldMatrix;
+uniform mat4 ViewProjMatrix;
+uniform vec4 ClipPlane;
+
+// Must produce exactly the same depth as the color pass, that uses GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+	// Same operations as the material vertex shaders
+	vec4 worldPos = WorldMatrix * vec4(VertexPosition, 1.0);
+	gl_ClipDistance[0] = dot(worldPos, ClipPlane);
+	gl_Position = ViewProjMatrix * vec4(worldPos.xyz, 1.0);
+}
@@ -0,0 +1,46 @@
+#version 330 core
+
+//Outputs
+// Closest and farthest depth
+out vec2 FragDepth;
+
+//Uniforms
+uniform sampler2D SourceTexture; // Base level is the previous level of the pyramid
+
+vec2 Combine(vec2 depth, vec2 sourceDepth)
+{
+	return vec2(min(depth.x, sourceDepth.x), max(depth.y, sourceDepth.y));
+}
+
+void main()
+{
+	ivec2 sourceSize = textureSize(SourceTexture, 0);
+	ivec2 maxCoord = sourceSize - 1;
+	ivec2 coord = ivec2(gl_FragCoord.xy) * 2;
+
+	// Closest and farthest depth of the 2x2 texels below this one
+	vec2 depth = texelFetch(SourceTexture, min(coord, maxCoord), 0).rg;
+	depth = Combine(depth, texelFetch(SourceTexture, min(coord + ivec2(1, 0), maxCoord), 0).rg);
+	depth = Combine(depth, texelFetch(SourceTexture, min(coord + ivec2(0, 1), maxCoord), 0).rg);
+	depth = Combine(depth, texelFetch(SourceTexture, min(coord + ivec2(1, 1), maxCoord), 0).rg);
+
+	// With odd sizes, the last texel of the row or column is covered by the previous texel of this level
+	bool extraColumn = (sourceSize.x & 1) != 0 && coord.x + 2 == maxCoord.x;
+	bool extraRow = (sourceSize.y & 1) != 0 && coord.y + 2 == maxCoord.y;
+	if (extraColumn)
+	{
+		depth = Combine(depth, texelFetch(SourceTexture, min(coord + ivec2(2, 0), maxCoord), 0).rg);
+		depth = Combine(depth, texelFetch(SourceTexture, min(coord + ivec2(2, 1), maxCoord), 0).rg);
+	}
+	if (extraRow)
+	{
+		depth = Combine(depth, texelFetch(SourceTexture, min(coord + ivec2(0, 2), maxCoord), 0).rg);
+		depth = Combine(depth, texelFetch(SourceTexture, min(coord + ivec2(1, 2), maxCoord), 0).rg);
+	}
+	if (extraColumn && extraRow)
+	{
+		depth = Combine(depth, texelFetch(SourceTexture, maxCoord, 0).rg);
+	}
+
+	FragDepth = depth;
+}
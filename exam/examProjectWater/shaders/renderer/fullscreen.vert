@@ -0,0 +1,10 @@
+#version 330 core
+
+//Inputs
+layout (location = 0) in vec3 VertexPosition;
+
+void main()
+{
+	// Fullscreen triangle is already in clip space
+	gl_Position = vec4(VertexPosition.xy, 0.0f, 1.0f);
+}
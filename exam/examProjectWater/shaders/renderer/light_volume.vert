@@ -0,0 +1,14 @@
+#version 330 core
+
+//Inputs
+layout (location = 0) in vec3 VertexPosition;
+layout (location = 1) in mat4 VolumeMatrix;
+
+//Uniforms
+uniform mat4 ViewProjMatrix;
+
+void main()
+{
+	// Same transform as the deferred lighting, the stencil is tested with its fragments
+	gl_Position = ViewProjMatrix * (VolumeMatrix * vec4(VertexPosition, 1.0f));
+}
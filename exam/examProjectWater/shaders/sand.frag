@@ -1,4 +1,4 @@
-#version 330 core
+//#version 330 core
 
 in vec3 WorldPosition;
 in vec3 WorldNormal;
@@ -11,6 +11,8 @@ uniform sampler2D ColorTexture;
 uniform vec2 ColorTextureScale;
 uniform float Time;
 
+// Caustics are only computed when CAUSTICS is defined
+#ifdef CAUSTICS
 uniform vec3 CausticsColor;
 uniform float CausticsIntensity;
 uniform float CausticsOffset;
@@ -92,13 +94,16 @@ float snoise(vec3 v) {
   m = m * m;
   return 42.0 * dot(m * m, vec4(dot(p0, x0), dot(p1, x1), dot(p2, x2), dot(p3, x3)));
 }
+#endif // CAUSTICS
 
 
 void main()
 {
     vec2 Uv = TexCoord * ColorTextureScale; 
     vec4 texColor = texture(ColorTexture, Uv);
-    
+    vec3 finalColor = texColor.rgb;
+
+#ifdef CAUSTICS
     float caustics = 0.0;
 
     // Layer multiple caustic patterns
@@ -108,7 +113,8 @@ void main()
     // Smooth the caustics pattern to create a more natural look
     caustics = smoothstep(0.5 - CausticsThickness, 0.5 + CausticsThickness, caustics);
 
-    vec3 finalColor = texColor.rgb + caustics * CausticsColor;
+    finalColor += caustics * CausticsColor;
+#endif
 
 	FragColor = vec4(finalColor, 1.0);
 }
@@ -1,4 +1,4 @@
-#version 330 core
+//#version 330 core
 
 layout (location = 0) in vec3 VertexPosition;
 layout (location = 1) in vec3 VertexNormal;
@@ -12,6 +12,9 @@ uniform mat4 WorldMatrix;
 uniform mat4 ViewProjMatrix;
 uniform vec4 ClipPlane;        // (A,B,C,D) in world space
 
+// Must match the depth pre-pass exactly
+invariant gl_Position;
+
 void main()
 {
 	vec4 worldPos   = WorldMatrix * vec4(VertexPosition,1.0);
@@ -0,0 +1,139 @@
+
+// Screen space reflections, ray marching a hierarchical Z pyramid
+// HiZTexture: each level stores the closest depth of the 2x2 texels of the previous level in red
+
+uniform sampler2D HiZTexture;
+uniform int HiZLevelCount;
+// Near and far planes of the camera, also used by the refraction
+uniform vec2 CameraNearFar;
+uniform float SsrMaxDistance;
+uniform float SsrThickness;
+uniform int SsrMaxIterations;
+
+// Projects a clip space position to screen space: xy in [0, 1] texture coordinates, z in [0, 1] depth
+vec3 ProjectToScreen(vec4 clipPosition)
+{
+	return (clipPosition.xyz / clipPosition.w) * 0.5f + 0.5f;
+}
+
+// Traces a ray in screen space, from origin to origin + direction, with t in [0, 1]
+// Depth is linear in screen space, so the whole ray is a straight line in (uv, depth)
+// Returns true and the texture coordinates of the hit if it found an intersection
+bool TraceHiZ(vec3 origin, vec3 direction, out vec2 hitTexCoord)
+{
+	hitTexCoord = vec2(0.0f);
+
+	int maxLevel = HiZLevelCount - 1;
+	vec2 baseSize = vec2(textureSize(HiZTexture, 0));
+
+	// Avoid divisions by 0 for axis aligned rays
+	vec2 safeDirection = vec2(abs(direction.x) < 1e-6f ? 1e-6f : direction.x, abs(direction.y) < 1e-6f ? 1e-6f : direction.y);
+	vec2 invDirection = 1.0f / safeDirection;
+	vec2 crossStep = step(0.0f, safeDirection);
+
+	// Small step in t that moves the ray half a texel of level 0, to cross cell boundaries
+	float epsilon = 0.5f / max(length(direction.xy * baseSize), 1.0f);
+
+	// Start one texel away from the origin, to avoid intersecting the surface itself
+	float t = 2.0f * epsilon;
+	int level = 0;
+
+	for (int i = 0; i < SsrMaxIterations; ++i)
+	{
+		if (t > 1.0f)
+		{
+			return false;
+		}
+
+		vec3 position = origin + direction * t;
+		if (any(lessThan(position.xy, vec2(0.0f))) || any(greaterThan(position.xy, vec2(1.0f))))
+		{
+			return false;
+		}
+
+		vec2 levelSize = vec2(textureSize(HiZTexture, level));
+		vec2 cell = floor(position.xy * levelSize);
+		float cellDepth = texelFetch(HiZTexture, ivec2(cell), level).r;
+
+		// t where the ray leaves this cell
+		vec2 boundary = (cell + crossStep) / levelSize;
+		vec2 tBoundary = (boundary - origin.xy) * invDirection;
+		float tCellExit = min(tBoundary.x, tBoundary.y);
+
+		// t where the ray reaches the closest depth of the cell
+		float tDepth;
+		if (position.z >= cellDepth)
+		{
+			tDepth = t;
+		}
+		else if (direction.z > 0.0f)
+		{
+			tDepth = (cellDepth - origin.z) / direction.z;
+		}
+		else
+		{
+			// Moving towards the camera, in front of everything in this cell
+			tDepth = 2.0f;
+		}
+
+		if (tDepth > tCellExit)
+		{
+			// The ray crosses the cell in front of all the geometry: skip it and try a coarser level
+			t = tCellExit + epsilon;
+			level = min(level + 1, maxLevel);
+		}
+		else if (level > 0)
+		{
+			// Possible intersection: move to the depth and refine
+			t = max(t, tDepth);
+			--level;
+		}
+		else
+		{
+			t = max(t, tDepth);
+			vec3 hit = origin + direction * t;
+
+			// Only accept the hit if the ray did not go too far behind the surface
+			if (LinearizeDepth(hit.z, CameraNearFar.x, CameraNearFar.y) - LinearizeDepth(cellDepth, CameraNearFar.x, CameraNearFar.y) < SsrThickness)
+			{
+				hitTexCoord = hit.xy;
+				return true;
+			}
+
+			// The ray passes behind the object, continue after this cell
+			t = tCellExit + epsilon;
+		}
+	}
+
+	return false;
+}
+
+// Computes the screen space reflection of a world space ray. Alpha is the confidence of the hit
+vec4 ScreenSpaceReflection(sampler2D sceneColorTexture, mat4 viewProjMatrix, vec3 worldPosition, vec3 reflectDirection)
+{
+	vec4 startClip = viewProjMatrix * vec4(worldPosition, 1.0f);
+	vec4 endClip = viewProjMatrix * vec4(worldPosition + reflectDirection * SsrMaxDistance, 1.0f);
+
+	// Clip the ray before it goes behind the camera
+	float minW = CameraNearFar.x;
+	if (endClip.w < minW)
+	{
+		float clipT = (startClip.w - minW) / (startClip.w - endClip.w);
+		endClip = mix(startClip, endClip, clipT);
+	}
+
+	vec3 origin = ProjectToScreen(startClip);
+	vec3 end = ProjectToScreen(endClip);
+
+	vec2 hitTexCoord;
+	if (!TraceHiZ(origin, end - origin, hitTexCoord))
+	{
+		return vec4(0.0f);
+	}
+
+	// Fade out close to the borders of the screen, where the information is missing
+	vec2 borderDistance = min(hitTexCoord, 1.0f - hitTexCoord);
+	float confidence = smoothstep(0.0f, 0.1f, min(borderDistance.x, borderDistance.y));
+
+	return vec4(texture(sceneColorTexture, hitTexCoord).rgb, confidence);
+}
@@ -48,6 +48,15 @@ vec3 SampleNormalMap(sampler2D normalTexture, vec2 texCoord, vec3 normal, vec3 t
 	return normalize(tangentMatrix * normalTangentSpace);
 }
 
+// Same, reading the normal map from a layer of a texture array
+vec3 SampleNormalMap(sampler2DArray normalTexture, vec3 texCoord, vec3 normal, vec3 tangent, vec3 bitangent)
+{
+	vec2 normalMap = texture(normalTexture, texCoord).xy * 2 - vec2(1);
+	vec3 normalTangentSpace = GetImplicitNormal(normalMap);
+	mat3 tangentMatrix = mat3(tangent, bitangent, normal);
+	return normalize(tangentMatrix * normalTangentSpace);
+}
+
 // Sample texture map in tangent space and converts to the same space of the provided normal and tangent 
 vec3 SampleNormalMap(sampler2D normalTexture, vec2 texCoord, vec3 normal, vec3 tangent)
 {
@@ -59,6 +68,29 @@ vec3 SampleNormalMap(sampler2D normalTexture, vec2 texCoord, vec3 normal, vec3 t
 	return SampleNormalMap(normalTexture, texCoord, normal, tangent, bitangent);
 }
 
+// Packs a unit normal in 2 components, with an octahedral mapping
+vec2 EncodeNormal(vec3 normal)
+{
+	normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+	vec2 encoded = normal.xy;
+	if (normal.z < 0.0f)
+	{
+		encoded = (1.0f - abs(normal.yx)) * vec2(normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return encoded;
+}
+
+// Unpacks a normal packed with EncodeNormal
+vec3 DecodeNormal(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	if (normal.z < 0.0f)
+	{
+		normal.xy = (1.0f - abs(normal.yx)) * vec2(normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return normalize(normal);
+}
+
 // Obtains a position in view space using the depth buffer and the inverse projection matrix
 vec3 ReconstructViewPosition(sampler2D depthTexture, vec2 texCoord, mat4 invProjMatrix)
 {
@@ -68,3 +100,10 @@ vec3 ReconstructViewPosition(sampler2D depthTexture, vec2 texCoord, mat4 invProj
 	vec4 viewPosition = invProjMatrix * vec4(clipPosition, 1.0f);
 	return viewPosition.xyz / viewPosition.w;
 }
+
+// Converts a depth buffer value into view distance, for a perspective projection with the given near and far planes
+float LinearizeDepth(float depth, float near, float far)
+{
+	float ndcDepth = depth * 2.0f - 1.0f;
+	return 2.0f * near * far / (far + near - ndcDepth * (far - near));
+}
@@ -26,6 +26,17 @@ uniform float PeakBlend;
 
 uniform sampler2D ReflectionTexture;
 
+// 0: planar reflection from ReflectionTexture, 1: screen space reflection with skybox fallback
+uniform int ReflectionMode;
+uniform sampler2D SceneColorTexture;
+uniform mat4 ViewProjMatrix;
+
+// Refraction of the opaque scene copied before the water. HiZTexture level 0 contains its depth
+uniform int RefractionEnabled;
+uniform float RefractionStrength;
+// Fraction of light absorbed per unit of distance travelled through the water, for each color channel
+uniform vec3 AbsorptionCoefficients;
+
 uniform float WaveFrequency;
 uniform float WaveAmplitude;
 uniform float WaveSpeed;
@@ -106,16 +117,55 @@ void main()
     // Clamp to avoid sampling outside texture
     reflectTextCoords = clamp(reflectTextCoords, vec2(0.001), vec2(0.999));
 
-    vec4 reflectionColor = texture(ReflectionTexture, reflectTextCoords);
+    vec4 reflectionColor;
+    if (ReflectionMode == 1)
+    {
+        // Cubemap coordinates are left-handed, same flip as the skybox
+        vec3 environmentColor = textureLod(EnvironmentTexture, vec3(reflectDirection.xy, -reflectDirection.z), 0).rgb;
+
+        // Use the skybox where the ray leaves the screen or does not hit anything
+        vec4 screenSpaceColor = ScreenSpaceReflection(SceneColorTexture, ViewProjMatrix, WorldPosition, reflectDirection);
+        reflectionColor = vec4(mix(environmentColor, screenSpaceColor.rgb, screenSpaceColor.a), 1.0);
+    }
+    else
+    {
+        reflectionColor = texture(ReflectionTexture, reflectTextCoords);
+    }
 
     float fresnel = FresnelStrength * pow(1.0 - clamp(dot(viewDirection, vertexNormal), 0.0, 1.0), FresnelPower);
 
     vec3 color = CalculateWaterColor(WaveHeight);
+    float alpha = Opacity;
+
+    if (RefractionEnabled != 0)
+    {
+        float waterDistance = LinearizeDepth(gl_FragCoord.z, CameraNearFar.x, CameraNearFar.y);
+
+        vec2 refractTexCoords = clamp(ndc + distortion * RefractionStrength, vec2(0.001), vec2(0.999));
+        float sceneDistance = LinearizeDepth(textureLod(HiZTexture, refractTexCoords, 0).r, CameraNearFar.x, CameraNearFar.y);
+
+        // Objects in front of the water can't be refracted, use the undistorted position instead
+        if (sceneDistance < waterDistance)
+        {
+            refractTexCoords = ndc;
+            sceneDistance = LinearizeDepth(textureLod(HiZTexture, refractTexCoords, 0).r, CameraNearFar.x, CameraNearFar.y);
+        }
+
+        vec3 refractionColor = textureLod(SceneColorTexture, refractTexCoords, 0).rgb;
+
+        // Light is absorbed along the path through the water. Opacity works as the density of the water
+        float thickness = max(sceneDistance - waterDistance, 0.0);
+        vec3 transmittance = exp(-AbsorptionCoefficients * Opacity * thickness);
+        color = mix(color, refractionColor, transmittance);
+
+        // The scene behind is already included, so the water replaces it
+        alpha = 1.0;
+    }
 
     // Blend reflection color with water color
     color = mix(color, reflectionColor.xyz, fresnel);
     
-    FragColor = vec4(color, Opacity);
+    FragColor = vec4(color, alpha);
 }
 
 
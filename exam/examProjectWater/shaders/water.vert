@@ -62,7 +62,14 @@ float calculateWaveHeight(float x, float y)
     float amplitude = 1.0;
     float frequency = WaveFrequency;
 
-    for(int i = 0; i < WaveOctaves; i++)
+    // A constant octave count from the permutation lets the compiler unroll the loop
+#ifdef WAVE_OCTAVES
+    const int octaveCount = WAVE_OCTAVES;
+#else
+    int octaveCount = WaveOctaves;
+#endif
+
+    for(int i = 0; i < octaveCount; i++)
     {
         float noise = snoise( frequency * position + WaveSpeed*Time);
 
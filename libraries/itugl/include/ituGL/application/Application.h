@@ -2,10 +2,25 @@
 
 #include <ituGL/core/DeviceGL.h>
 #include <ituGL/application/Window.h>
+#include <ituGL/application/FramePacket.h>
+#include <ituGL/application/RenderThread.h>
+#include <ituGL/core/JobSystem.h>
+#include <memory>
 #include <string>
 
 class Application
 {
+public:
+    // Fixed steps of the last frame
+    struct FixedUpdateStats
+    {
+        unsigned int stepCount = 0;
+        // Time running the steps, in milliseconds
+        float stepTime = 0.0f;
+        // Steps skipped since the start because the frame was too long to catch up
+        unsigned int droppedStepCount = 0;
+    };
+
 public:
     // Construct the application specifying the dimensions of the window and its title
     Application(int width, int height, const char* title);
@@ -35,6 +50,38 @@ protected:
     // Get time in seconds of the current frame
     float GetDeltaTime() const { return m_deltaTime; }
 
+    // Duration in seconds of each fixed step
+    inline float GetFixedTimeStep() const { return m_fixedTimeStep; }
+    inline void SetFixedTimeStep(float fixedTimeStep) { m_fixedTimeStep = fixedTimeStep; }
+
+    // Maximum number of steps in one frame. Beyond that, the simulation runs slower than real time
+    inline unsigned int GetMaxFixedSteps() const { return m_maxFixedSteps; }
+    inline void SetMaxFixedSteps(unsigned int maxFixedSteps) { m_maxFixedSteps = maxFixedSteps; }
+
+    // Run the fixed steps in the job system, at the same time as Update and Render. The published state is one frame behind
+    inline bool IsFixedUpdateThreaded() const { return m_fixedUpdateThreaded; }
+    void SetFixedUpdateThreaded(bool threaded);
+
+    // Fraction of a step between the two published states, to interpolate them when rendering
+    inline float GetFixedAlpha() const { return m_fixedAlpha; }
+
+    inline const FixedUpdateStats& GetFixedUpdateStats() const { return m_fixedUpdateStats; }
+
+    // Present the frames from a render thread that owns the context, while the main thread prepares the next ones
+    // Set before Run. Render must then record all the OpenGL calls in the frame packet. Initialize and Cleanup keep the context
+    inline bool IsRenderThreadEnabled() const { return m_renderThreadEnabled; }
+    void SetRenderThreadEnabled(bool enabled, unsigned int maxQueuedFrames = 2);
+
+    // Commands of the current frame, executed after Render. In the render thread, if enabled
+    inline FramePacket& GetFramePacket() { return m_renderThread ? m_renderThread->GetRecordingPacket() : m_framePacket; }
+
+    // Stats of the presented frames. Without render thread, frames are replayed in the main thread and the depth is 1
+    RenderThread::Stats GetRenderThreadStats() const;
+
+    // Time the main thread spent on the previous frame, from the fixed steps until Render returned, in milliseconds
+    // Waiting for the render thread is not included
+    inline float GetMainThreadFrameTime() const { return m_mainThreadFrameTime; }
+
     // Test if the application is currently running
     bool IsRunning() const;
 
@@ -44,6 +91,12 @@ protected:
     // Load initial resources and initialize data before the main loop
     virtual void Initialize();
 
+    // Advance the simulation one step of GetFixedTimeStep seconds. If threaded, it must only use the simulation state
+    virtual void FixedUpdate();
+
+    // Make the simulated state visible to Update and Render. Called every frame, while no fixed step is running
+    virtual void PublishSimulation();
+
     // Update the application logic for the current frame
     virtual void Update();
 
@@ -62,6 +115,14 @@ private:
     // Set the new current time and compute the delta since the last time
     void UpdateTime(float newCurrentTime);
 
+    // Run the fixed steps that fit in the time of the frame, and publish the simulation
+    void RunFixedSteps();
+
+    // Wait for the steps running in the job system
+    void WaitFixedSteps();
+
+    void RunFixedSteps(unsigned int stepCount);
+
 private:
     // OpenGL device
     DeviceGL m_device;
@@ -74,6 +135,33 @@ private:
     // Time in seconds of the current frame
     float m_deltaTime;
 
+    // Time not simulated yet, less than one step after running the steps
+    float m_fixedAccumulator;
+    float m_fixedTimeStep;
+    unsigned int m_maxFixedSteps;
+    float m_fixedAlpha;
+    // Alpha of the steps running in the job system, used when they are published
+    float m_pendingFixedAlpha;
+
+    bool m_fixedUpdateThreaded;
+    JobSystem::Counter m_fixedUpdateCounter;
+
+    FixedUpdateStats m_fixedUpdateStats;
+    // Written while running the steps, and copied to the stats when they are published
+    FixedUpdateStats m_runningFixedUpdateStats;
+
+    bool m_renderThreadEnabled;
+    unsigned int m_maxQueuedFrames;
+    std::unique_ptr<RenderThread> m_renderThread;
+    // Stats of the frames replayed in the main thread, to compare with the render thread
+    RenderThread::Stats m_inlineFrameStats;
+
+    // Without render thread, which has its own packets
+    FramePacket m_framePacket;
+    unsigned int m_frameIndex;
+
+    float m_mainThreadFrameTime;
+
     // Exit code
     int m_exitCode;
     // Error message to display on exit
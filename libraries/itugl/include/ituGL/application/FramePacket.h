@@ -0,0 +1,94 @@
+#pragma once
+
+#include <ituGL/core/FrameArena.h>
+#include <chrono>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Commands recorded for one frame, replayed later in the thread that owns the OpenGL context
+// Commands must own the data they use (views, draw lists, uniform values...), as the recording thread continues with the next frame
+// Commands and their data live in the arena of the packet, so once it is big enough, recording does not allocate heap memory
+class FramePacket
+{
+public:
+    FramePacket();
+    ~FramePacket();
+
+    FramePacket(const FramePacket&) = delete;
+    FramePacket& operator = (const FramePacket&) = delete;
+
+    // Clear the commands and start recording a new frame
+    void Begin(unsigned int frameIndex);
+
+    // Add a command at the end of the frame. Any callable without arguments
+    template<typename F>
+    void Record(F&& function);
+
+    // Run the commands in the order they were recorded
+    void Execute() const;
+
+    inline unsigned int GetFrameIndex() const { return m_frameIndex; }
+    inline unsigned int GetCommandCount() const { return m_commandCount; }
+
+    // Memory for the data of the commands, released when the next frame begins
+    inline FrameArena& GetArena() { return m_arena; }
+
+    // When the recording started, to measure the latency until the frame is presented
+    inline std::chrono::steady_clock::time_point GetBeginTime() const { return m_beginTime; }
+
+private:
+    // Header of the commands in the arena, followed by the callable. Linked in recording order
+    struct Command
+    {
+        void (*execute)(Command& command);
+        // Null if the callable is trivially destructible
+        void (*destroy)(Command& command);
+        Command* next;
+    };
+
+    template<typename F>
+    struct CallableCommand : Command
+    {
+        F function;
+    };
+
+    // Destroy the commands and release the arena
+    void Clear();
+
+private:
+    FrameArena m_arena;
+
+    Command* m_firstCommand;
+    Command* m_lastCommand;
+    unsigned int m_commandCount;
+
+    unsigned int m_frameIndex;
+    std::chrono::steady_clock::time_point m_beginTime;
+};
+
+template<typename F>
+void FramePacket::Record(F&& function)
+{
+    using Callable = CallableCommand<std::decay_t<F>>;
+
+    Callable* command = new (m_arena.Allocate(sizeof(Callable), alignof(Callable))) Callable{ {}, std::forward<F>(function) };
+    command->execute = [](Command& command) { static_cast<Callable&>(command).function(); };
+    command->destroy = nullptr;
+    if constexpr (!std::is_trivially_destructible_v<Callable>)
+    {
+        command->destroy = [](Command& command) { static_cast<Callable&>(command).~Callable(); };
+    }
+    command->next = nullptr;
+
+    if (m_lastCommand)
+    {
+        m_lastCommand->next = command;
+    }
+    else
+    {
+        m_firstCommand = command;
+    }
+    m_lastCommand = command;
+    ++m_commandCount;
+}
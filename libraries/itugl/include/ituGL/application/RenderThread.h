@@ -0,0 +1,78 @@
+#pragma once
+
+#include <ituGL/application/FramePacket.h>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Window;
+
+// Thread that owns the OpenGL context of the window, and replays the frame packets submitted by the main thread
+// The queue is bounded, so the main thread prepares at most maxQueuedFrames frames ahead of the one being presented
+class RenderThread
+{
+public:
+    struct Stats
+    {
+        // Frames queued or being replayed, when the last frame was submitted
+        unsigned int pipelineDepth = 0;
+        // Time from the start of the recording until the frame was presented, in milliseconds
+        float latency = 0.0f;
+        // Time replaying the last frame, including the buffer swap, in milliseconds
+        float replayTime = 0.0f;
+        // Time the main thread waited in the last submit for space in the queue for the next frame, in milliseconds
+        float submitWaitTime = 0.0f;
+        unsigned int presentedFrameCount = 0;
+    };
+
+public:
+    // The context must not be current in any thread. The render thread makes it current until it stops
+    RenderThread(Window& window, unsigned int maxQueuedFrames = 2);
+    // Replay the frames in the queue and release the context
+    ~RenderThread();
+
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator = (const RenderThread&) = delete;
+
+    // Packet where the main thread records the next frame
+    inline FramePacket& GetRecordingPacket() { return *m_packets[m_submittedCount % m_packets.size()]; }
+
+    // Queue the recording packet, and wait until there is space for the next one, which becomes the recording packet
+    void Submit();
+
+    // Wait until all the submitted frames are presented
+    void Flush();
+
+    Stats GetStats() const;
+
+private:
+    void ThreadLoop();
+
+private:
+    Window& m_window;
+
+    unsigned int m_maxQueuedFrames;
+
+    mutable std::mutex m_mutex;
+    // Signaled when a packet is queued, or when stopping
+    std::condition_variable m_submitCondition;
+    // Signaled when a frame is presented
+    std::condition_variable m_presentCondition;
+
+    // Packets are reused in order: recorded, queued, replayed, and recorded again
+    // One per queued frame, plus the ones being replayed and recorded, so they are allocated once
+    std::vector<std::unique_ptr<FramePacket>> m_packets;
+    // Frames submitted, and taken from the queue by the render thread. The difference is the queue size
+    std::uint64_t m_submittedCount;
+    std::uint64_t m_takenCount;
+    // A packet was taken from the queue and is being replayed
+    bool m_replaying;
+    bool m_stop;
+
+    Stats m_stats;
+
+    std::thread m_thread;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+// Double buffered state of a fixed step simulation
+// The simulation writes its own previous and current states, and Publish copies them to the ones read when rendering
+// Rendering interpolates between the published states, so the simulation can run on another thread in the meantime
+template<typename T>
+class SimulationState
+{
+public:
+    SimulationState() = default;
+    SimulationState(const T& state) : m_simulationPrevious(state), m_simulationCurrent(state), m_renderPrevious(state), m_renderCurrent(state) {}
+
+    // Start a new step: the current state becomes the previous one, and the returned state is the one to advance
+    inline T& BeginStep() { m_simulationPrevious = m_simulationCurrent; return m_simulationCurrent; }
+
+    // Latest simulated state, only for the simulation
+    inline const T& GetSimulationState() const { return m_simulationCurrent; }
+
+    // Make the last two simulated states visible to rendering. Not while the simulation is running
+    inline void Publish() { m_renderPrevious = m_simulationPrevious; m_renderCurrent = m_simulationCurrent; }
+
+    // Published states, to interpolate with the fixed step alpha
+    inline const T& GetPrevious() const { return m_renderPrevious; }
+    inline const T& GetCurrent() const { return m_renderCurrent; }
+
+private:
+    T m_simulationPrevious;
+    T m_simulationCurrent;
+
+    T m_renderPrevious;
+    T m_renderCurrent;
+};
@@ -5,7 +5,11 @@
 #include <ituGL/geometry/Model.h>
 #include <ituGL/geometry/Mesh.h>
 #include <ituGL/asset/Texture2DLoader.h>
+#include <ituGL/texture/Texture2DArrayObject.h>
+#include <glm/vec3.hpp>
 #include <vector>
+#include <map>
+#include <tuple>
 
 struct aiMesh;
 struct aiMaterial;
@@ -24,12 +28,23 @@ public:
     std::shared_ptr<Material> GetReferenceMaterial() const;
     void SetReferenceMaterial(std::shared_ptr<Material> referenceMaterial);
 
+    // Create a material for each material of the file, instead of using the reference material
+    // Submeshes with the same material values share one material, also in different models
     bool GetCreateMaterials() const;
     void SetCreateMaterials(bool createMaterials);
 
     Texture2DLoader& GetTexture2DLoader();
     const Texture2DLoader& GetTexture2DLoader() const;
 
+    // Pack the textures of the created materials in texture arrays, one for each size and format
+    // The layers of the diffuse, normal and specular textures are stored in the TextureLayers vertex attribute, if it is mapped,
+    // so the materials of different models only differ in their colors
+    bool GetUseTextureArrays() const;
+    void SetUseTextureArrays(bool useTextureArrays);
+
+    // Upload the textures packed in arrays. Must be called after loading the models, before rendering them
+    void BuildTextureArrays();
+
     // Load the model from the path
     Model Load(const char* path) override;
 
@@ -40,18 +55,24 @@ public:
     bool SetMaterialProperty(MaterialProperty materialProperty, const char* uniformName);
 
 private:
-    // Generate a submesh from the loaded mesh data
-    void GenerateSubmesh(Mesh& mesh, const aiMesh& meshData);
+    // Generate a submesh from the loaded mesh data. If textureLayers is not null, it is added to all the vertices
+    void GenerateSubmesh(Mesh& mesh, const aiMesh& meshData, const glm::vec3* textureLayers);
+
+    // Generate a material from the loaded material data, or reuse a generated one with the same values
+    // With texture arrays, the layers of the diffuse, normal and specular textures are returned in textureLayers
+    std::shared_ptr<Material> GenerateMaterial(const aiMaterial& materialData, glm::vec3& textureLayers);
 
-    // Generate a material from the loaded material data
-    std::shared_ptr<Material> GenerateMaterial(const aiMaterial& materialData);
+    // Load the texture of the specific type, if the material has one. With texture arrays, also returns its layer
+    std::shared_ptr<const TextureObject> LoadTexture(const aiMaterial& materialData, int textureType,
+        TextureObject::Format format, TextureObject::InternalFormat internalFormat, float& layer);
 
-    // Load a texture of the specific type in the location
-    void LoadTexture(const aiMaterial& materialData, int textureType, Material& material, ShaderProgram::Location location,
-        TextureObject::Format format, TextureObject::InternalFormat internalFormat) const;
+    // Find a layer for the texture in an array with the same size and format, adding it if needed
+    // The same texture loaded with a different format goes to a different array
+    std::shared_ptr<Texture2DArrayObject> AddTextureArrayLayer(const std::string& path,
+        TextureObject::Format format, TextureObject::InternalFormat internalFormat, int& layer);
 
-    // Build the vertex data from the mesh data
-    static std::vector<GLubyte> CollectVertexData(const aiMesh& meshData, VertexFormat& vertexFormat, bool interleaved);
+    // Build the vertex data from the mesh data, adding textureLayers to all the vertices if it is not null
+    static std::vector<GLubyte> CollectVertexData(const aiMesh& meshData, VertexFormat& vertexFormat, bool interleaved, const glm::vec3* textureLayers);
 
     // Build the element data from the mesh data
     static std::vector<GLubyte> CollectElementData(const aiMesh& meshData, Data::Type& elementType,
@@ -66,6 +87,30 @@ private:
     // Get the type of primitive depending on the number of elements
     static Drawcall::Primitive GetPrimitiveType(int elementCount);
 
+private:
+    // Texture array with the paths of the textures in each layer
+    struct TextureArray
+    {
+        std::shared_ptr<Texture2DArrayObject> texture;
+        GLsizei width;
+        GLsizei height;
+        TextureObject::Format format;
+        TextureObject::InternalFormat internalFormat;
+        std::vector<std::string> layerPaths;
+        // Number of layers uploaded by the last build
+        GLsizei builtLayerCount;
+    };
+
+    // Values read from a material of the file, with the location of their uniforms
+    struct MaterialValues
+    {
+        std::vector<std::pair<ShaderProgram::Location, glm::vec3>> vectorValues;
+        std::vector<std::pair<ShaderProgram::Location, float>> floatValues;
+        std::vector<std::pair<ShaderProgram::Location, std::shared_ptr<const TextureObject>>> textureValues;
+
+        bool operator == (const MaterialValues& other) const = default;
+    };
+
 private:
     // Path to the base folder where we are loading the current model
     std::string m_baseFolder;
@@ -84,6 +129,21 @@ private:
 
     // Texture loader to cache already loaded shared textures
     mutable Texture2DLoader m_textureLoader;
+
+    // Should pack the textures in texture arrays instead of loading separate textures
+    bool m_useTextureArrays;
+
+    // Texture arrays packed so far, shared by all the models loaded
+    std::vector<TextureArray> m_textureArrays;
+
+    // Array index and layer of each texture already packed, by path and format
+    std::map<std::tuple<std::string, TextureObject::Format, TextureObject::InternalFormat>, std::pair<size_t, int>> m_textureArrayLayers;
+
+    // Materials generated so far, shared by the submeshes with the same values, also in different models
+    std::vector<std::pair<MaterialValues, std::shared_ptr<Material>>> m_generatedMaterials;
+
+    // Maximum number of layers in one array, queried the first time
+    GLint m_maxTextureArrayLayers;
 };
 
 enum class ModelLoader::MaterialProperty
@@ -3,6 +3,8 @@
 #include <ituGL/asset/AssetLoader.h>
 #include <ituGL/shader/Shader.h>
 #include <span>
+#include <string>
+#include <vector>
 
 class ShaderLoader : AssetLoader<Shader>
 {
@@ -17,12 +19,24 @@ public:
     using AssetLoader<Shader>::LoadInto;
 
     Shader Load(std::span<const char*> paths);
+    // Load with extra source code, such as #define lines, inserted after the first file
+    // The first file must contain the #version directive, and nothing else that depends on the defines
+    Shader Load(std::span<const char*> paths, const char* injectedSource);
     Shader* LoadNew(std::span<const char*> paths);
     bool LoadInto(Shader& shader, std::span<const char*> paths);
 
+    // Create and compile a shader from source code that is already in memory
+    // If async, the compile status is not checked, and errors are only reported by the program that links it
+    Shader LoadFromSources(std::span<const std::string> sources, bool async = false);
+
     static Shader Load(Shader::Type type, const char* path);
 
+    // Read the source code of the files, without compiling. Injected source goes after the first file
+    static std::vector<std::string> ReadSources(std::span<const char*> paths, const char* injectedSource = nullptr);
+
 private:
+    static std::string ReadFile(const char* path);
+
     void Compile(Shader& shader);
 
     Shader::Type m_type;
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ShaderProgram;
+
+// Builds shader programs from source files, storing the linked binaries in a directory to skip compiling them next time
+// Binaries are identified by a hash of the final source code and the driver, so a change in any of them builds again
+class ShaderProgramCache
+{
+public:
+    // An empty directory disables the cache, and programs are always built from source
+    ShaderProgramCache(const char* directory);
+
+    inline bool IsEnabled() const { return !m_directory.empty(); }
+
+    // Build the program from the files, or load it from the cache. Injected source goes after the first file of each list
+    bool Build(ShaderProgram& shaderProgram, std::span<const char*> vertexShaderPaths, std::span<const char*> fragmentShaderPaths,
+        const char* injectedSource = nullptr);
+
+    // Like Build, but a program that is not in the cache is only submitted to the driver, without waiting for it
+    // Once the program IsBuildComplete, call CompleteBuild to store its binary
+    void BuildAsync(ShaderProgram& shaderProgram, std::span<const char*> vertexShaderPaths, std::span<const char*> fragmentShaderPaths,
+        const char* injectedSource = nullptr);
+
+    // Finish an asynchronous build. Returns if the program linked
+    bool CompleteBuild(ShaderProgram& shaderProgram);
+
+    // Programs loaded from the cache and built from source since the cache was created
+    inline unsigned int GetLoadedCount() const { return m_loadedCount; }
+    inline unsigned int GetCompiledCount() const { return m_compiledCount; }
+
+    // Total time spent in Build, in milliseconds
+    inline float GetBuildTime() const { return m_buildTime; }
+
+private:
+    // Identifies the driver, since binaries are not valid for a different one
+    void InitializeDriver();
+
+    std::uint64_t ComputeKey(std::span<const std::string> vertexSources, std::span<const std::string> fragmentSources) const;
+    std::string GetPath(std::uint64_t key) const;
+
+    bool LoadBinary(ShaderProgram& shaderProgram, std::uint64_t key) const;
+    void StoreBinary(const ShaderProgram& shaderProgram, std::uint64_t key) const;
+
+    // Shared by Build and BuildAsync. Returns true if the program was loaded from the cache
+    bool BeginBuild(ShaderProgram& shaderProgram, std::span<const char*> vertexShaderPaths, std::span<const char*> fragmentShaderPaths,
+        const char* injectedSource, bool async, std::uint64_t& key);
+
+private:
+    std::string m_directory;
+
+    bool m_driverInitialized;
+    std::string m_driver;
+    // Some drivers don't support any binary format
+    bool m_binariesSupported;
+
+    // Keys of the programs submitted with BuildAsync that are not complete yet
+    std::unordered_map<const ShaderProgram*, std::uint64_t> m_pendingKeys;
+
+    unsigned int m_loadedCount;
+    unsigned int m_compiledCount;
+    float m_buildTime;
+};
@@ -42,6 +42,8 @@ class TextureLoaderUtils
 public:
     static std::span<const std::byte> LoadTexture2DData(const char* path, int& width, int& height, Data::Type& dataType, TextureObject::Format format, TextureObject::InternalFormat internalFormat, bool flipVertical);
     static void FreeTexture2DData(std::span<const std::byte> data);
+    // Read only the size of the image, without loading the data
+    static bool GetTexture2DSize(const char* path, int& width, int& height);
 private:
     static bool IsHDR(TextureObject::InternalFormat internalFormat);
 };
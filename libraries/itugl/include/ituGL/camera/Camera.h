@@ -37,6 +37,9 @@ public:
     // Extract the basis vectors from the view matrix
     void ExtractVectors(glm::vec3& right, glm::vec3& up, glm::vec3& forward) const;
 
+    // Extract the near and far plane distances from a perspective projection matrix
+    void ExtractNearFar(float& near, float& far) const;
+
 
 private:
     // The view matrix (from world space to view space)
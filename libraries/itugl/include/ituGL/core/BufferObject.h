@@ -13,6 +13,10 @@ public:
         ArrayBuffer = GL_ARRAY_BUFFER,
         // Element Buffer Object
         ElementArrayBuffer = GL_ELEMENT_ARRAY_BUFFER,
+        // Shader Storage Buffer Object, read and written by shaders. Requires GL 4.3
+        ShaderStorageBuffer = GL_SHADER_STORAGE_BUFFER,
+        // Parameters of indirect drawcalls. Requires GL 4.0, multi draw requires GL 4.3
+        DrawIndirectBuffer = GL_DRAW_INDIRECT_BUFFER,
         // TODO: There are more types, add them when they are supported
     };
 
@@ -58,6 +62,13 @@ public:
     // Modify the contents of the buffer, starting at offset
     void UpdateData(std::span<const std::byte> data, size_t offset = 0);
 
+    // Read the contents of the buffer back, starting at offset. Waits for the GPU to finish writing them
+    void GetData(std::span<std::byte> data, size_t offset = 0) const;
+
+    // Bind the buffer to the binding point index of an indexed target, such as the shader storage blocks
+    // Any buffer can be bound, for example a VBO written by a compute shader
+    void BindBase(Target indexedTarget, GLuint index) const;
+
 protected:
     // Bind the specific target. Used by the Bind() method in derived classes
     void Bind(Target target) const;
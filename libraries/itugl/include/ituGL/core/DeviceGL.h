@@ -2,6 +2,16 @@
 
 #include <ituGL/core/Color.h>
 #include <glad/glad.h>
+#include <atomic>
+#include <thread>
+
+// KHR_parallel_shader_compile is not part of the loaded GL version, so its enums are defined here
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 class Window;
 struct GLFWwindow;
@@ -26,6 +36,11 @@ public:
     // Set the window that OpenGL will use for rendering
     void SetCurrentWindow(Window &window);
 
+    // Make the context of the window current in the calling thread, after it was released in another one
+    void MakeContextCurrent(Window& window);
+    // Release the context from the calling thread, so another thread can use it
+    void ReleaseContext();
+
     // Set the dimensions of the viewport
     void SetViewport(GLint x, GLint y, GLsizei width, GLsizei height);
 
@@ -52,10 +67,33 @@ public:
     // enable / disable v-sync
     void SetVSyncEnabled(bool enabled);
 
+    // Check if the context supports an extension
+    bool IsExtensionSupported(const char* name) const;
+
+    // Check if shaders can compile in driver threads, and their completion can be polled without blocking
+    inline bool IsParallelShaderCompileSupported() const { return m_parallelShaderCompileSupported; }
+
+    // Check if compute shaders, shader storage buffers and indirect multi draws can be used (GL 4.3)
+    // The window asks for GL 4.1, drivers that support a newer core version usually create it instead
+    inline bool IsComputeSupported() const { return m_computeSupported; }
+
+private:
+    // Let the driver use as many threads as it wants to compile shaders, if supported
+    void InitializeParallelShaderCompile();
+
 private:
     // Has a context been loaded? We use the context of the current window
     bool m_contextLoaded;
 
+    // KHR_parallel_shader_compile (or the ARB version) is available
+    bool m_parallelShaderCompileSupported;
+
+    // The context version is at least 4.3
+    bool m_computeSupported;
+
+    // Thread where the context is current. The resize callback only uses the context from that thread
+    std::atomic<std::thread::id> m_contextThread;
+
 private:
     // Singleton instance
     static DeviceGL* m_instance;
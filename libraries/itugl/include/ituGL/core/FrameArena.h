@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that only lives during a frame
+// Allocations move an offset forward in a memory block, and are all released together with Reset
+// If a frame needs more memory, new blocks are added, and Reset merges them in a single block for the next frames,
+// so once the arena is big enough, frames do not allocate heap memory
+class FrameArena
+{
+public:
+    // STL allocator that takes the memory from an arena. Without arena, it uses the heap
+    template<typename T>
+    class Allocator
+    {
+    public:
+        using value_type = T;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        Allocator(FrameArena* arena = nullptr) noexcept : m_arena(arena) {}
+        template<typename U>
+        Allocator(const Allocator<U>& other) noexcept : m_arena(other.GetArena()) {}
+
+        T* allocate(size_t count);
+        // Memory of the arena is only released by Reset
+        void deallocate(T* pointer, size_t count) noexcept;
+
+        inline FrameArena* GetArena() const { return m_arena; }
+
+        template<typename U>
+        bool operator == (const Allocator<U>& other) const { return m_arena == other.GetArena(); }
+
+    private:
+        FrameArena* m_arena;
+    };
+
+    // Vector that allocates from an arena. It must be recreated, or cleared and shrunk, when the arena is reset
+    template<typename T>
+    using Vector = std::vector<T, Allocator<T>>;
+
+    // Usage since the last Reset
+    struct Stats
+    {
+        size_t usedSize = 0;
+        // Size of all the blocks
+        size_t capacity = 0;
+        unsigned int allocationCount = 0;
+        // Blocks allocated from the heap. Should be 0 in steady state
+        unsigned int heapAllocationCount = 0;
+    };
+
+public:
+    FrameArena(size_t initialCapacity = 64 * 1024);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator = (const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Release all the allocations. Pointers to the memory of the arena are no longer valid
+    void Reset();
+
+    inline const Stats& GetStats() const { return m_stats; }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    void AddBlock(size_t size);
+
+private:
+    std::vector<Block> m_blocks;
+
+    // Block where the next allocation is placed, and offset in it
+    size_t m_currentBlock;
+    size_t m_offset;
+
+    Stats m_stats;
+};
+
+template<typename T>
+T* FrameArena::Allocator<T>::allocate(size_t count)
+{
+    if (m_arena)
+    {
+        return static_cast<T*>(m_arena->Allocate(count * sizeof(T), alignof(T)));
+    }
+    return static_cast<T*>(::operator new(count * sizeof(T)));
+}
+
+template<typename T>
+void FrameArena::Allocator<T>::deallocate(T* pointer, size_t) noexcept
+{
+    if (!m_arena)
+    {
+        ::operator delete(pointer);
+    }
+}
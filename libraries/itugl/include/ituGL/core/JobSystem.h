@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job scheduler. Each worker has its own queue: it takes the last job it pushed, and when empty it steals
+// the oldest job from the other workers. Threads outside the system only run jobs while waiting, and only the ones in their
+// own queue, so a thread never ends up running the work of another one. They share worker 0, unless they register
+class JobSystem
+{
+public:
+    using Function = std::function<void()>;
+
+    // Number of jobs that have not finished yet. Used to wait for them, and as dependency of other jobs
+    // It must stay alive until the jobs finish, and Wait returns
+    class Counter
+    {
+    public:
+        Counter() : m_count(0) {}
+
+        Counter(const Counter&) = delete;
+        Counter& operator = (const Counter&) = delete;
+
+        inline bool IsDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+        inline unsigned int GetCount() const { return m_count.load(std::memory_order_acquire); }
+
+    private:
+        friend class JobSystem;
+
+        std::atomic<unsigned int> m_count;
+
+        // Protects the decrement to zero and the continuations, so the counter is not used after Wait returns
+        std::mutex m_mutex;
+
+        // Jobs that start when the count gets to zero, and the counter of each one
+        std::vector<std::pair<Function, Counter*>> m_continuations;
+    };
+
+    struct WorkerStats
+    {
+        unsigned int jobCount = 0;
+        // Jobs taken from the queue of another worker
+        unsigned int stealCount = 0;
+        // Time running jobs, in milliseconds
+        float busyTime = 0.0f;
+        // Busy time over the time since the last reset, in [0, 1]
+        float utilization = 0.0f;
+    };
+
+public:
+    // Threads outside the system that can have a worker of their own, besides worker 0
+    static constexpr unsigned int MAX_REGISTERED_THREADS = 4;
+
+public:
+    // Creates workerCount - 1 threads. With 0, one worker for each hardware thread, and at least one thread
+    JobSystem(unsigned int workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator = (const JobSystem&) = delete;
+
+    // The system shared by the library, created the first time it is used
+    static JobSystem& GetInstance();
+
+    // Number of workers: worker 0, the threads of the system and the ones for registered threads
+    inline unsigned int GetWorkerCount() const { return static_cast<unsigned int>(m_workers.size()); }
+
+    // Give the calling thread a worker of its own, so its jobs and stats are not mixed with the ones of worker 0
+    // Call UnregisterThread before the thread exits
+    void RegisterThread();
+    void UnregisterThread();
+
+    // Queue a job. If there is a counter, it is incremented now and decremented when the job finishes
+    void Run(Function function, Counter* counter = nullptr);
+
+    // Queue a job after all the jobs of the dependency finish
+    void Run(Function function, Counter& dependency, Counter* counter = nullptr);
+
+    // Run queued jobs until the counter gets to zero
+    void Wait(Counter& counter);
+
+    // Call function(rangeBegin, rangeEnd) for ranges of grainSize elements, and wait for all of them
+    // The calling thread takes the first range. With grainSize 0, the range is split in a few ranges for each worker
+    template<typename F>
+    void ParallelFor(size_t begin, size_t end, size_t grainSize, F&& function);
+
+    // Index of the worker running in this thread. Threads outside the system that are not registered use worker 0
+    unsigned int GetCurrentWorkerIndex() const;
+
+    WorkerStats GetWorkerStats(unsigned int workerIndex) const;
+    void ResetStats();
+
+private:
+    struct Job
+    {
+        Function function;
+        Counter* counter;
+    };
+
+    // Jobs in a ring that only grows, so once it is big enough, queuing does not allocate memory
+    class JobQueue
+    {
+    public:
+        inline bool IsEmpty() const { return m_count == 0; }
+
+        void PushBack(Job job);
+        Job PopBack();
+        Job PopFront();
+
+    private:
+        std::vector<Job> m_jobs;
+        size_t m_first = 0;
+        size_t m_count = 0;
+    };
+
+    struct Worker
+    {
+        // Owner pushes and pops at the back, thieves take from the front
+        std::mutex mutex;
+        JobQueue jobs;
+
+        std::atomic<unsigned int> jobCount;
+        std::atomic<unsigned int> stealCount;
+        std::atomic<std::uint64_t> busyNanoseconds;
+
+        // Worker of a registered thread, taken by a thread now
+        std::atomic<bool> registered;
+    };
+
+private:
+    void WorkerLoop(unsigned int workerIndex);
+
+    void Push(Job job);
+
+    // Run one job from the queue of the worker, or stolen from another one if the worker is a thread of the system
+    // Returns false if there were none
+    bool TryRunJob(unsigned int workerIndex);
+
+    inline bool IsSystemThread(unsigned int workerIndex) const { return workerIndex >= 1 && workerIndex <= m_threadCount; }
+
+    // Decrement the counter, and queue its continuations if it gets to zero
+    void FinishJob(Counter& counter);
+
+private:
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    // Set before the threads start, they read it
+    unsigned int m_threadCount;
+
+    // Jobs in all the queues, so idle workers know when to wake up
+    std::atomic<int> m_queuedJobCount;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeCondition;
+    bool m_stop;
+
+    // Time of the last reset, read by any thread
+    std::atomic<std::chrono::steady_clock::rep> m_statsStart;
+};
+
+template<typename F>
+void JobSystem::ParallelFor(size_t begin, size_t end, size_t grainSize, F&& function)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    // The calling thread and the threads of the system
+    size_t threadCount = m_threadCount + 1;
+
+    size_t count = end - begin;
+    if (grainSize == 0)
+    {
+        grainSize = std::max<size_t>(count / (4 * threadCount), 1);
+    }
+
+    // Not worth splitting
+    if (count <= grainSize || threadCount == 1)
+    {
+        function(begin, end);
+        return;
+    }
+
+    // The jobs capture 16 bytes, so std::function keeps them inline instead of allocating them
+    struct Range
+    {
+        std::remove_reference_t<F>& function;
+        size_t grainSize;
+        size_t end;
+    };
+    Range range{ function, grainSize, end };
+
+    Counter counter;
+    for (size_t rangeBegin = begin + grainSize; rangeBegin < end; rangeBegin += grainSize)
+    {
+        Run([&range, rangeBegin]() { range.function(rangeBegin, std::min(rangeBegin + range.grainSize, range.end)); }, &counter);
+    }
+    function(begin, begin + grainSize);
+    Wait(counter);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <ituGL/core/Object.h>
+
+// Query object, used to ask the GPU about timings or rendered samples asynchronously
+class QueryObject : public Object
+{
+public:
+    // Query target: What the query will measure
+    enum class Target : GLenum
+    {
+        // Time in nanoseconds between Begin and End
+        TimeElapsed = GL_TIME_ELAPSED,
+        // GPU timestamp in nanoseconds, recorded with QueryCounter
+        Timestamp = GL_TIMESTAMP,
+        // Number of samples that passed the depth test between Begin and End
+        SamplesPassed = GL_SAMPLES_PASSED,
+        // If any sample passed the depth test between Begin and End
+        AnySamplesPassed = GL_ANY_SAMPLES_PASSED,
+        // Number of primitives generated between Begin and End
+        PrimitivesGenerated = GL_PRIMITIVES_GENERATED,
+    };
+
+public:
+    QueryObject(Target target);
+    virtual ~QueryObject();
+
+    // Move semantics
+    QueryObject(QueryObject&& queryObject) noexcept;
+    QueryObject& operator = (QueryObject&& queryObject) noexcept;
+
+    inline Target GetTarget() const { return m_target; }
+
+    // Queries are not bound, they are active between Begin and End. Bind is the same as Begin
+    void Bind() const override;
+
+    // Start the query on its target. Not valid for Timestamp queries
+    void Begin() const;
+    // Stop the active query on this target
+    void End() const;
+
+    // Record the current GPU time in this query. Only valid for Timestamp queries
+    void QueryCounter() const;
+
+    // Check if the result can be read without stalling
+    bool IsResultAvailable() const;
+
+    // Get the result of the query. It will stall until the result is available
+    GLuint64 GetResult() const;
+
+    // Check if a query of this target is active (between Begin and End)
+    static bool IsAnyActive(Target target);
+
+private:
+    Target m_target;
+};
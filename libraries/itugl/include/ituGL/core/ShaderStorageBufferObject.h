@@ -0,0 +1,58 @@
+#pragma once
+
+#include <ituGL/core/BufferObject.h>
+#include <ituGL/core/Data.h>
+
+// Shader Storage Buffer Object (SSBO) is a BufferObject that shaders can read and write, bound to the storage blocks of the program
+// Requires GL 4.3, check DeviceGL::IsComputeSupported before creating one
+class ShaderStorageBufferObject : public BufferObjectBase<BufferObject::ShaderStorageBuffer>
+{
+public:
+    ShaderStorageBufferObject();
+
+    // Bind to the storage block with this binding index. It does not need to be bound to the target
+    using BufferObject::BindBase;
+    inline void BindBase(GLuint index) const { BindBase(ShaderStorageBuffer, index); }
+
+    // Use the same AllocateData and UpdateData methods from the base class
+    using BufferObject::AllocateData;
+    using BufferObject::UpdateData;
+    using BufferObject::GetData;
+
+    // AllocateData template method for any type of data span
+    template<typename T>
+    void AllocateData(std::span<const T> data, Usage usage = Usage::StaticDraw);
+    template<typename T>
+    inline void AllocateData(std::span<T> data, Usage usage = Usage::StaticDraw) { AllocateData(std::span<const T>(data), usage); }
+
+    // UpdateData template method for any type of data span
+    template<typename T>
+    void UpdateData(std::span<const T> data, size_t offsetBytes = 0);
+    template<typename T>
+    inline void UpdateData(std::span<T> data, size_t offsetBytes = 0) { UpdateData(std::span<const T>(data), offsetBytes); }
+
+    // GetData template method for any type of data span
+    template<typename T>
+    void GetData(std::span<T> data, size_t offsetBytes = 0) const;
+};
+
+// Call the base implementation with the span converted to bytes
+template<typename T>
+void ShaderStorageBufferObject::AllocateData(std::span<const T> data, Usage usage)
+{
+    AllocateData(Data::GetBytes(data), usage);
+}
+
+// Call the base implementation with the span converted to bytes
+template<typename T>
+void ShaderStorageBufferObject::UpdateData(std::span<const T> data, size_t offsetBytes)
+{
+    UpdateData(Data::GetBytes(data), offsetBytes);
+}
+
+// Call the base implementation with the span converted to bytes
+template<typename T>
+void ShaderStorageBufferObject::GetData(std::span<T> data, size_t offsetBytes) const
+{
+    GetData(Data::GetBytes(data), offsetBytes);
+}
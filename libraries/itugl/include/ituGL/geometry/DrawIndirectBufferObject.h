@@ -0,0 +1,36 @@
+#pragma once
+
+#include <ituGL/core/BufferObject.h>
+#include <ituGL/core/Data.h>
+
+// Draw Indirect Buffer Object stores the parameters of drawcalls, so they can be written by the GPU
+// Executed with Drawcall::MultiDrawIndirect while bound
+class DrawIndirectBufferObject : public BufferObjectBase<BufferObject::DrawIndirectBuffer>
+{
+public:
+    // Parameters of each indexed drawcall, with the layout expected by glMultiDrawElementsIndirect
+    struct ElementsCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        // In elements, not bytes
+        GLuint firstIndex;
+        GLint baseVertex;
+        // Offset of the attributes with a divisor. Requires GL 4.2
+        GLuint baseInstance;
+    };
+
+public:
+    DrawIndirectBufferObject();
+
+    // Use the same methods from the base class
+    using BufferObject::AllocateData;
+    using BufferObject::UpdateData;
+    using BufferObject::GetData;
+
+    // Allocate the buffer with the commands
+    void AllocateData(std::span<const ElementsCommand> commands, Usage usage = Usage::StaticDraw);
+
+    // Read the commands back, for example to validate the ones written by the GPU
+    void GetData(std::span<ElementsCommand> commands, size_t offsetBytes = 0) const;
+};
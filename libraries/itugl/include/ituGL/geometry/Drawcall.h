@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ituGL/core/Data.h>
+#include <ituGL/geometry/DrawIndirectBufferObject.h>
 
 // Helper class to store the parameters of a drawcall
 class Drawcall
@@ -34,6 +35,16 @@ public:
     // Execute the drawcall
     void Draw() const;
 
+    // Execute the drawcall instanceCount times, for the attributes with a divisor
+    void DrawInstanced(GLsizei instanceCount) const;
+
+    // Parameters of this drawcall for an indirect buffer. Only for drawcalls with an EBO
+    DrawIndirectBufferObject::ElementsCommand GetElementsCommand(GLuint instanceCount, GLuint baseInstance) const;
+
+    // Execute drawCount commands of the bound indirect buffer, starting at offset bytes, with the primitive and EBO type of this drawcall
+    // Only for drawcalls with an EBO. Requires GL 4.3
+    void MultiDrawIndirect(GLintptr offset, GLsizei drawCount) const;
+
 private:
     // Type of primitive to be rendered
     Primitive m_primitive;
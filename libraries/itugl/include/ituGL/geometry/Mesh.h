@@ -6,6 +6,7 @@
 #include <ituGL/geometry/VertexAttribute.h>
 #include <ituGL/geometry/Drawcall.h>
 #include <ituGL/shader/ShaderProgram.h>
+#include <glm/vec3.hpp>
 #include <vector>
 #include <unordered_map>
 
@@ -111,8 +112,15 @@ public:
 
     inline unsigned int GetSubmeshCount() const { return static_cast<unsigned int>(m_submeshes.size()); }
     inline const VertexArrayObject& GetSubmeshVertexArray(unsigned int submeshIndex) const { return m_vaos[m_submeshes[submeshIndex].vaoIndex]; }
+    // Non-const version, to add attributes to the VAO, such as instance attributes
+    inline VertexArrayObject& GetSubmeshVertexArray(unsigned int submeshIndex) { return m_vaos[m_submeshes[submeshIndex].vaoIndex]; }
     inline const Drawcall& GetSubmeshDrawcall(unsigned int submeshIndex) const { return m_submeshes[submeshIndex].drawcall; }
 
+    // Axis aligned bounding box of a submesh in local space, used for culling
+    // Returns false if the bounds were never set
+    bool GetSubmeshBounds(unsigned int submeshIndex, glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+    void SetSubmeshBounds(unsigned int submeshIndex, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
     // Draws a submesh
     void DrawSubmesh(int submeshIndex) const;
 
@@ -123,6 +131,10 @@ private:
     {
         unsigned int vaoIndex;
         Drawcall drawcall;
+        // Local space bounding box, only valid if hasBounds is true
+        bool hasBounds;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
     };
 
 private:
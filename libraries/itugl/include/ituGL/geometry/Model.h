@@ -23,6 +23,8 @@ public:
 
     Material& GetMaterial(unsigned int index);
     const Material& GetMaterial(unsigned int index) const;
+    // Same material, for the ones that keep it as parent
+    std::shared_ptr<const Material> GetSharedMaterial(unsigned int index) const;
 
     void SetMaterial(unsigned int index, std::shared_ptr<Material> material);
 
@@ -27,6 +27,9 @@ public:
     // stride: how far each element is from the previous one. Default value 0 will use the attribute size
     void SetAttribute(GLuint location, const VertexAttribute& attribute, GLint offset, GLsizei stride = 0);
 
+    // Advance the attribute in location once every divisor instances, instead of once per vertex. 0 goes back to per vertex
+    void SetAttributeDivisor(GLuint location, GLuint divisor);
+
 #ifndef NDEBUG
     // Check if there is any VertexArrayObject currently bound
     inline static bool IsAnyBound() { return s_boundHandle != Object::NullHandle; }
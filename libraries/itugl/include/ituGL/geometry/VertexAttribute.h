@@ -20,6 +20,8 @@ public:
         Bitangent,
         TexCoord0, TexCoord1, TexCoord2, TexCoord3, TexCoord4, TexCoord5, TexCoord6, TexCoord7,
         Color0, Color1, Color2, Color3, Color4, Color5, Color6, Color7,
+        // Layers of the textures in their arrays, the same for all the vertices of a submesh
+        TextureLayers,
     };
 
 public:
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <ituGL/shader/Material.h>
+#include <ituGL/shader/ShaderProgram.h>
+#include <vector>
+
+class Renderer;
+class VertexArrayObject;
+class Drawcall;
+
+// Compact list of draw commands, recorded in any thread and executed later in the thread that owns the OpenGL context
+// Commands only keep pointers and indices, so materials, meshes and the renderer data must not change until executed
+class CommandList
+{
+public:
+    enum class CommandType : unsigned char
+    {
+        // Use the shader program and render states of the material, and set its uniforms
+        UseMaterial,
+        // Call the transforms function of the material program, with a world matrix of the renderer
+        UpdateTransforms,
+        // Set a mat4 uniform of the current program with a world matrix of the renderer
+        SetWorldMatrix,
+        BindVertexArray,
+        Draw,
+        // Draw once per light pass, while the lights function of the current material program returns true
+        // The function decides how many lights each pass consumes, so the number of passes is only known when executed
+        DrawLightPasses
+    };
+
+    struct Command
+    {
+        CommandType type;
+        // Material override flags
+        unsigned char flags;
+        // World matrix index
+        unsigned int index;
+        union
+        {
+            const Material* material;
+            const VertexArrayObject* vao;
+            const Drawcall* drawcall;
+            ShaderProgram::Location location;
+        };
+    };
+
+public:
+    CommandList();
+
+    void UseMaterial(const Material& material, Material::OverrideFlags overrideFlags = Material::NoOverride);
+    void UpdateTransforms(const Material& material, unsigned int worldMatrixIndex);
+    void SetWorldMatrix(ShaderProgram::Location location, unsigned int worldMatrixIndex);
+    // Skipped if the previous VAO bound in the list is the same
+    void BindVertexArray(const VertexArrayObject& vao);
+    void Draw(const Drawcall& drawcall);
+    // Needs a material used before in the list
+    void DrawLightPasses(const Drawcall& drawcall);
+
+    // Run the commands in the order they were recorded. Only in the thread that owns the context
+    void Execute(Renderer& renderer) const;
+
+    // Remove the commands, keeping the memory for the next recording
+    void Clear();
+
+    inline unsigned int GetCommandCount() const { return static_cast<unsigned int>(m_commands.size()); }
+
+private:
+    std::vector<Command> m_commands;
+
+    const VertexArrayObject* m_lastVAO;
+};
@@ -3,22 +3,104 @@
 #include <ituGL/renderer/RenderPass.h>
 
 #include <ituGL/shader/ShaderProgram.h>
-#include <ituGL/geometry/Mesh.h>
+#include <ituGL/geometry/VertexArrayObject.h>
+#include <ituGL/geometry/VertexBufferObject.h>
+#include <ituGL/geometry/ElementBufferObject.h>
+#include <ituGL/geometry/Drawcall.h>
+#include <glm/mat4x4.hpp>
+#include <array>
 #include <memory>
+#include <span>
+#include <vector>
 
-class Texture2DObject;
 class Material;
+class Light;
 
-class DeferredRenderPass: public RenderPass
+// Adds the scene lights to the target, shading the surfaces stored in the G-buffer textures of the material
+// Each light is drawn as a volume that covers the pixels it can reach: a sphere for point lights, a cone for spot lights,
+// and a fullscreen triangle for directional lights and lights without range. All the lights of a volume are drawn in one instanced draw
+// The material shader reads the light of each instance from the vertex attributes of LightInstance, instead of uniforms
+// The target needs the depth stencil texture of the G-buffer attached, and must be cleared before the pass
+class DeferredRenderPass : public RenderPass
 {
+public:
+    enum class Volume
+    {
+        Fullscreen,
+        Sphere,
+        Cone,
+    };
+    static constexpr unsigned int VolumeCount = 3;
+
+    // Attributes of each instance, in locations 1 to 8. Location 0 is the position of the volume vertex
+    struct LightInstance
+    {
+        // Transforms the unit volume to world space. One location per column, 1 to 4
+        glm::mat4 volumeMatrix;
+        // Color multiplied by the intensity. w is 1 if the instance also adds the indirect light. Location 5
+        glm::vec4 color;
+        // Location 6
+        glm::vec4 position;
+        // Location 7
+        glm::vec4 direction;
+        // Same values as Light::GetAttenuation. Location 8
+        glm::vec4 attenuation;
+    };
+
+    // Results of the last frame
+    struct Stats
+    {
+        std::array<unsigned int, VolumeCount> instanceCounts{};
+        // Instanced draws, including the ones that only mark the stencil
+        unsigned int drawCount = 0;
+    };
+
 public:
     DeferredRenderPass(std::shared_ptr<Material> material, std::shared_ptr<const FramebufferObject> targetFramebuffer = nullptr);
 
     void Render() override;
 
+    // With the stencil test, sphere and cone volumes only shade the pixels whose surface is inside any volume of the same type
+    // Without it, they shade the pixels in front of their back faces, so the surfaces between the camera and the light are also shaded
+    inline bool IsStencilTestEnabled() const { return m_stencilTestEnabled; }
+    inline void SetStencilTestEnabled(bool enabled) { m_stencilTestEnabled = enabled; }
+
+    inline const Stats& GetStats() const { return m_stats; }
+
 private:
+    struct VolumeBatch
+    {
+        VertexArrayObject vao;
+        VertexBufferObject vbo;
+        ElementBufferObject ebo;
+        Drawcall drawcall;
+
+        // Instances of the current frame, uploaded to their own buffer
+        VertexBufferObject instanceVbo;
+        std::vector<LightInstance> instances;
+    };
+
     void InitializeMeshes();
+    void InitializeVolume(Volume volume, std::span<const glm::vec3> vertices, std::span<const unsigned short> indices);
+
+    inline VolumeBatch& GetVolumeBatch(Volume volume) { return m_volumeBatches[static_cast<unsigned int>(volume)]; }
+
+    // Fill the instances of each volume and upload them
+    void AddLightInstances(std::span<const Light* const> lights, const glm::mat4& fullscreenMatrix);
+    void AddLightInstance(Volume volume, const glm::mat4& volumeMatrix, const Light* light, bool indirect);
+
+    void DrawVolume(Volume volume, const glm::mat4& viewProjMatrix);
 
 private:
     std::shared_ptr<Material> m_material;
+
+    std::array<VolumeBatch, VolumeCount> m_volumeBatches;
+
+    // Draws the volumes without color, to mark the stencil
+    ShaderProgram m_stencilShaderProgram;
+    ShaderProgram::Location m_stencilViewProjMatrixLocation;
+
+    bool m_stencilTestEnabled;
+
+    Stats m_stats;
 };
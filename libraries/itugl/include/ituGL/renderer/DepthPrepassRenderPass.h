@@ -0,0 +1,105 @@
+#pragma once
+
+#include <ituGL/renderer/RenderPass.h>
+
+#include <ituGL/shader/ShaderProgram.h>
+#include <ituGL/core/QueryObject.h>
+#include <glm/vec4.hpp>
+#include <array>
+#include <unordered_map>
+
+class Camera;
+
+// Renders only the depth of a drawcall collection, with a minimal position-only shader
+// The color pass that follows can then use GL_EQUAL without depth writes, so each pixel is shaded only once
+// In Auto mode, the pre-pass is enabled for each view (camera of the renderer) when the measured overdraw is high
+class DepthPrepassRenderPass : public RenderPass
+{
+public:
+    enum class Mode
+    {
+        Off,
+        On,
+        Auto,
+    };
+
+public:
+    // The measurements of views not rendered for maxUnusedFrames are destroyed
+    DepthPrepassRenderPass(int drawcallCollectionIndex = 0, unsigned int maxUnusedFrames = 60);
+
+    inline Mode GetMode() const { return m_mode; }
+    inline void SetMode(Mode mode) { m_mode = mode; }
+
+    // In Auto mode, enable the pre-pass above the first value, disable it below the second one
+    // Overdraw is the number of shaded fragments per pixel of the viewport
+    void GetOverdrawThresholds(float& enableThreshold, float& disableThreshold) const;
+    void SetOverdrawThresholds(float enableThreshold, float disableThreshold);
+
+    // Plane used to clip the geometry, same as the materials. Only used when GL_CLIP_DISTANCE0 is enabled
+    inline const glm::vec4& GetClipPlane() const { return m_clipPlane; }
+    inline void SetClipPlane(const glm::vec4& clipPlane) { m_clipPlane = clipPlane; }
+
+    // If the pre-pass was rendered for the current view. Valid after Render
+    inline bool IsActive() const { return m_active; }
+
+    // Last overdraw measured for the current view
+    float GetOverdraw() const;
+
+    void Render() override;
+
+    // Must be called by the color pass around its drawcalls
+    // Sets the depth states if the pre-pass was rendered, and measures the overdraw
+    void BeginColorPass();
+    void EndColorPass();
+
+private:
+    // Measurements and decision for one view
+    struct ViewState
+    {
+        ViewState();
+
+        bool enabled;
+        float overdraw;
+
+        // Samples passed, with a few frames of latency to avoid stalls
+        std::array<QueryObject, 3> queries;
+        std::array<bool, 3> pendingQueries;
+        std::array<float, 3> queryPixelCounts;
+        unsigned int currentQuery;
+        // If the current query was started. It is skipped if the GPU has not finished the previous use
+        bool queryActive;
+
+        unsigned int lastUsedFrame;
+    };
+
+    ViewState& GetCurrentView();
+
+    // Destroy the views not rendered for maxUnusedFrames
+    void RemoveUnusedViews();
+
+    void BeginQuery(ViewState& view);
+    void EndQuery(ViewState& view);
+    void ReadQueries(ViewState& view);
+
+private:
+    int m_drawcallCollectionIndex;
+
+    Mode m_mode;
+    float m_enableThreshold;
+    float m_disableThreshold;
+
+    glm::vec4 m_clipPlane;
+
+    bool m_active;
+
+    // Views are identified by their camera, that stays the same when the render targets are allocated again
+    std::unordered_map<const Camera*, ViewState> m_views;
+    ViewState* m_currentView;
+    unsigned int m_maxUnusedFrames;
+    unsigned int m_lastRemoveFrame;
+
+    ShaderProgram m_shaderProgram;
+    ShaderProgram::Location m_worldMatrixLocation;
+    ShaderProgram::Location m_viewProjMatrixLocation;
+    ShaderProgram::Location m_clipPlaneLocation;
+};
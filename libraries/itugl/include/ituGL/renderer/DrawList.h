@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ituGL/lighting/DirectionalLight.h>
+#include <ituGL/lighting/PointLight.h>
+#include <ituGL/lighting/SpotLight.h>
+#include <glm/mat4x4.hpp>
+#include <memory>
+#include <vector>
+
+class Model;
+class Renderer;
+
+// Models and lights of a view, recorded by the thread that owns the scene and added to the renderer later, in the thread that renders it
+// Keeps its own copies of the world matrices and the lights, so the scene can change while the view is rendered
+// Reusing the same list keeps the memory of the previous frames
+class DrawList
+{
+public:
+    // Remove the models and lights, keeping the memory
+    void Clear();
+
+    void AddModel(std::shared_ptr<const Model> model, const glm::mat4& worldMatrix);
+    void AddLight(const Light& light);
+
+    inline unsigned int GetModelCount() const { return static_cast<unsigned int>(m_models.size()); }
+    unsigned int GetLightCount() const;
+
+    // Add the lights and the models to the renderer. The list must not change until the renderer is reset
+    void Submit(Renderer& renderer) const;
+
+private:
+    struct ModelEntry
+    {
+        std::shared_ptr<const Model> model;
+        glm::mat4 worldMatrix;
+    };
+
+    std::vector<ModelEntry> m_models;
+
+    // Copies of the lights, by type
+    std::vector<DirectionalLight> m_directionalLights;
+    std::vector<PointLight> m_pointLights;
+    std::vector<SpotLight> m_spotLights;
+};
@@ -2,14 +2,20 @@
 
 #include <ituGL/renderer/RenderPass.h>
 
+class DepthPrepassRenderPass;
+
 class ForwardRenderPass : public RenderPass
 {
 public:
     ForwardRenderPass();
     ForwardRenderPass(int drawcallCollectionIndex);
+    // If depthPrepass is set, it must render the same collection before this pass
+    ForwardRenderPass(int drawcallCollectionIndex, DepthPrepassRenderPass* depthPrepass);
 
     void Render() override;
 
 private:
     int m_drawcallCollectionIndex;
+
+    DepthPrepassRenderPass* m_depthPrepass;
 };
@@ -8,6 +8,9 @@ class GBufferRenderPass : public RenderPass
 {
 public:
     GBufferRenderPass(int width, int height, int drawcallCollectionIndex = 0);
+    // Render to the attachments of an external framebuffer: albedo, normal and others, and a depth stencil texture
+    // The owner of the framebuffer clears it, and the texture getters return null
+    GBufferRenderPass(std::shared_ptr<const FramebufferObject> targetFramebuffer, int drawcallCollectionIndex = 0);
 
     void Render() override;
 
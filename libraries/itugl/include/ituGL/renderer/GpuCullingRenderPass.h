@@ -0,0 +1,134 @@
+#pragma once
+
+#include <ituGL/renderer/RenderPass.h>
+
+#include <ituGL/shader/ShaderProgram.h>
+#include <ituGL/core/ShaderStorageBufferObject.h>
+#include <ituGL/geometry/VertexBufferObject.h>
+#include <ituGL/geometry/DrawIndirectBufferObject.h>
+#include <ituGL/scene/SceneBvh.h>
+#include <glm/mat4x4.hpp>
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+
+class Model;
+class Texture2DObject;
+
+// Draws many instances of a model, culling them against the view frustum and a hierarchical Z pyramid
+// In GPU mode, a compute shader tests the bounds of each instance, stored in a shader storage buffer,
+// and writes the visible ones and the instance counts of an indirect buffer. Each submesh is drawn with one glMultiDrawElementsIndirect,
+// so the CPU cost doesn't depend on the number of instances
+// Instances are split in chunks, one per work group and one draw command per chunk, so the visible instances are compacted without global atomics
+// The materials of the model need a vertex shader that reads the world matrix from the instance attributes, in locations 5 to 8
+// CPU mode tests the frustum on the CPU and uploads the visible instances. GPU mode requires GL 4.3, see DeviceGL::IsComputeSupported
+class GpuCullingRenderPass : public RenderPass
+{
+public:
+    enum class Mode
+    {
+        Cpu,
+        Gpu,
+        // GPU culling, read back and compared with the CPU results every frame. Stalls until the GPU finishes
+        GpuValidation,
+    };
+
+    // Instances tested by each work group of the compute shader
+    static constexpr unsigned int ChunkSize = 64;
+
+    // Results of the last frame
+    struct Stats
+    {
+        unsigned int instanceCount = 0;
+        // Only known on the CPU in CPU and validation modes
+        unsigned int visibleCount = 0;
+        unsigned int drawCount = 0;
+        // Time spent culling and uploading on the CPU, in milliseconds
+        float cpuTime = 0.0f;
+        // In validation mode, chunks where the GPU kept more instances than the CPU, or a different count without Hi-Z test
+        unsigned int validationErrorCount = 0;
+        // In validation mode, instances inside the frustum rejected by the Hi-Z test
+        unsigned int occludedCount = 0;
+    };
+
+public:
+    GpuCullingRenderPass(std::shared_ptr<Model> model, Mode mode = Mode::Cpu);
+
+    inline Mode GetMode() const { return m_mode; }
+    void SetMode(Mode mode);
+
+    // Replace the instances. Their world space bounds are computed from the submesh bounds of the model
+    void SetInstances(std::span<const glm::mat4> worldMatrices);
+    inline unsigned int GetInstanceCount() const { return static_cast<unsigned int>(m_instances.size()); }
+
+    // Depth pyramid of a previous frame, with the farthest depth in green, and the view projection matrix used to render it
+    // Null disables the occlusion test. Only used in GPU modes
+    void SetHiZ(std::shared_ptr<const Texture2DObject> hiZTexture, int levelCount, const glm::mat4& viewProjMatrix);
+
+    inline const Stats& GetStats() const { return m_stats; }
+
+    void Render() override;
+
+private:
+    // Layout of the instance buffer, std430
+    struct Instance
+    {
+        glm::mat4 worldMatrix;
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+    };
+
+    // Same planes and box test as the queries of the scene BVH
+    using FrustumPlanes = SceneBvh::FrustumPlanes;
+
+    void InitializeVertexArrays();
+    void InitializeComputeShader();
+    void InitializeBuffers();
+
+    // Frustum culling on the CPU, writing the visible matrices. Returns the visible count of each chunk
+    void CullInstances(const FrustumPlanes& frustumPlanes, std::vector<glm::mat4>& visibleMatrices, std::vector<unsigned int>& chunkVisibleCounts) const;
+    void DispatchCulling(const FrustumPlanes& frustumPlanes);
+    void ValidateCulling(const FrustumPlanes& frustumPlanes);
+
+    void DrawSubmeshes(bool indirect);
+
+    unsigned int GetChunkCount() const;
+
+
+private:
+    std::shared_ptr<Model> m_model;
+
+    Mode m_mode;
+
+    std::vector<Instance> m_instances;
+    bool m_buffersDirty;
+
+    // World matrices of the visible instances, read as instance attributes. Chunks are ChunkSize apart in GPU modes
+    VertexBufferObject m_visibleBuffer;
+
+    // Only created in GPU modes
+    std::unique_ptr<ShaderStorageBufferObject> m_instanceBuffer;
+    // One command per chunk for each submesh, grouped by submesh
+    std::unique_ptr<DrawIndirectBufferObject> m_commandBuffer;
+
+    ShaderProgram m_cullingProgram;
+    ShaderProgram::Location m_instanceCountLocation;
+    ShaderProgram::Location m_submeshCountLocation;
+    ShaderProgram::Location m_chunkCountLocation;
+    ShaderProgram::Location m_frustumPlanesLocation;
+    ShaderProgram::Location m_hiZEnabledLocation;
+    ShaderProgram::Location m_hiZTextureLocation;
+    ShaderProgram::Location m_hiZLevelCountLocation;
+    ShaderProgram::Location m_hiZViewProjMatrixLocation;
+
+    std::shared_ptr<const Texture2DObject> m_hiZTexture;
+    int m_hiZLevelCount;
+    glm::mat4 m_hiZViewProjMatrix;
+
+    // Reused every frame by the CPU paths
+    std::vector<glm::mat4> m_visibleMatrices;
+    std::vector<unsigned int> m_chunkVisibleCounts;
+
+    Stats m_stats;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Occlusion culling on the CPU
+// A few simple occluder meshes are rasterized into a small depth buffer, split in tiles that are rasterized in parallel
+// Then pyramids keeping the farthest and the closest depth of each region are built, and bounding boxes are tested against them
+// A box in front of the closest depth of a coarse region is accepted at once, the others are tested against the farthest depths
+class OcclusionCuller
+{
+public:
+    // Triangle mesh used as occluder. Must be inside the real geometry, so it never hides visible objects
+    struct Occluder
+    {
+        std::vector<glm::vec3> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    // Results of the tests since the last Begin
+    struct Stats
+    {
+        unsigned int testedCount = 0;
+        // Outside of the view frustum
+        unsigned int frustumRejectedCount = 0;
+        // Hidden behind the occluders
+        unsigned int occlusionRejectedCount = 0;
+        // In front of all the occluders around it, accepted without testing the farthest depths
+        unsigned int trivialAcceptedCount = 0;
+        // Time to rasterize the occluders and build the pyramid, in milliseconds
+        float rasterizeTime = 0.0f;
+        // Time spent in the visibility tests, in milliseconds
+        float testTime = 0.0f;
+    };
+
+public:
+    // Depth buffer size. Width must be a multiple of 4
+    OcclusionCuller(int width = 256, int height = 128, int tileWidth = 64, int tileHeight = 32);
+
+    inline int GetWidth() const { return m_width; }
+    inline int GetHeight() const { return m_height; }
+
+    inline bool IsEnabled() const { return m_enabled; }
+    inline void SetEnabled(bool enabled) { m_enabled = enabled; }
+
+    // Start a new view. All occluders must be added before Rasterize
+    void Begin(const glm::mat4& viewProjMatrix);
+    void AddOccluder(std::shared_ptr<const Occluder> occluder, const glm::mat4& worldMatrix);
+
+    // Rasterize the occluders and build the depth pyramid
+    void Rasterize();
+
+    // Returns false if the bounding box, in local space, is outside the view or completely hidden by the occluders
+    bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& worldMatrix);
+
+    inline const Stats& GetStats() const { return m_stats; }
+
+    // Depth of the closest occluder of each pixel, in [0, 1]. Level 0 of the pyramid
+    inline std::span<const float> GetDepthBuffer() const { return m_levels[0]; }
+
+private:
+    // Triangle in screen space: x and y in pixels, z is the depth in [0, 1]. Counter-clockwise
+    struct Triangle
+    {
+        glm::vec3 vertices[3];
+    };
+
+    struct OccluderInstance
+    {
+        std::shared_ptr<const Occluder> occluder;
+        glm::mat4 worldMatrix;
+    };
+
+    void SetupTriangles();
+    void AddClippedTriangle(const glm::vec4 clipVertices[3]);
+    void BinTriangle(unsigned int triangleIndex);
+
+    void RasterizeTile(int tileIndex);
+    void RasterizeTriangle(const Triangle& triangle, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY);
+
+    void BuildPyramid();
+
+private:
+    int m_width, m_height;
+    int m_tileWidth, m_tileHeight;
+    int m_tileCountX, m_tileCountY;
+
+    bool m_enabled;
+
+    glm::mat4 m_viewProjMatrix;
+
+    std::vector<OccluderInstance> m_occluders;
+
+    std::vector<Triangle> m_triangles;
+    // Vertices of the occluder being set up, kept to reuse the memory
+    std::vector<glm::vec4> m_clipVertices;
+
+    // Indices of the triangles that overlap each tile
+    std::vector<std::vector<unsigned int>> m_tileTriangles;
+
+    // Level 0 is the depth buffer, each level keeps the farthest depth of 2x2 texels of the previous one
+    std::vector<std::vector<float>> m_levels;
+    // Same, with the closest depth. Level 0 is empty, it would be the same depth buffer
+    std::vector<std::vector<float>> m_closestLevels;
+    std::vector<glm::ivec2> m_levelSizes;
+
+    bool m_rasterized;
+
+    Stats m_stats;
+};
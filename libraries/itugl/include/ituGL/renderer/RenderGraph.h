@@ -0,0 +1,202 @@
+#pragma once
+
+#include <ituGL/renderer/RenderTargetPool.h>
+#include <ituGL/core/Color.h>
+#include <array>
+#include <functional>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+class Profiler;
+class DearImGui;
+
+// Frame described as a list of passes, each one declaring the textures it reads and writes
+// Compile removes the passes whose results are never used, and takes the textures from a pool,
+// so textures that are not needed at the same time share the same memory
+// Execute binds the framebuffer of each pass only if it changed, and clears each texture only the first time it is written
+// The graph is built again every frame. The pool keeps the textures between frames
+class RenderGraph
+{
+public:
+    using TextureDesc = RenderTargetPool::TextureDesc;
+
+    // Index of a texture in the graph
+    using ResourceHandle = int;
+    static constexpr ResourceHandle InvalidResource = -1;
+
+    static constexpr unsigned int MaxPassReads = 8;
+
+    // Declares the resources of a pass. Only valid until the next pass is added
+    class PassBuilder
+    {
+    public:
+        // Texture that only lives during this frame
+        ResourceHandle CreateTexture(const char* name, const TextureDesc& desc);
+
+        // Sample the texture during the pass
+        void Read(ResourceHandle resource);
+
+        // Render to the texture. If clear is set, the texture is cleared before the pass, unless it was already written this frame
+        // Otherwise the pass keeps the previous contents, so it depends on the passes that wrote them
+        void WriteColor(ResourceHandle resource, bool clear = false, const Color& clearColor = Color(0.0f, 0.0f, 0.0f, 1.0f));
+        // Textures with a depth stencil format are attached to both, and the stencil is cleared to 0 with the depth
+        void WriteDepth(ResourceHandle resource, bool clear = false, float clearDepth = 1.0f);
+
+        // Render to the window. Passes writing to the window are never culled
+        void WriteBackbuffer(bool clearColor = false, bool clearDepth = false, const Color& color = Color(0.0f, 0.0f, 0.0f, 1.0f), float depth = 1.0f);
+
+        // The pass is never culled, for example because it has results outside of the graph
+        void SetSideEffect();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& renderGraph, unsigned int passIndex);
+
+    private:
+        RenderGraph& m_renderGraph;
+        unsigned int m_passIndex;
+    };
+
+    // Called when the pass is executed, with its framebuffer bound and the viewport set
+    // Passes that bind other framebuffers must bind the framebuffer of the pass again before returning
+    using ExecuteFunction = std::function<void(RenderGraph&)>;
+
+    // Results of the last frame
+    struct Stats
+    {
+        unsigned int passCount = 0;
+        unsigned int culledPassCount = 0;
+        // Textures created by the graph, and textures of the pool they were assigned to
+        unsigned int textureCount = 0;
+        unsigned int pooledTextureCount = 0;
+        unsigned int framebufferBindCount = 0;
+        unsigned int clearCount = 0;
+    };
+
+    // Stats and passes of the last frame, copied to show them in a thread that doesn't own the graph
+    struct Results
+    {
+        Stats stats;
+        RenderTargetPool::Stats poolStats;
+        // Name of each pass, and if it was culled
+        std::vector<std::pair<const char*, bool>> passes;
+    };
+
+public:
+    RenderGraph();
+
+    // Start a new frame. The backbuffer has the size of the window
+    void Reset(int backbufferWidth, int backbufferHeight);
+
+    // Texture owned outside of the graph. Passes writing to it are never culled
+    ResourceHandle ImportTexture(const char* name, std::shared_ptr<Texture2DObject> texture, const TextureDesc& desc);
+
+    // Add a pass at the end of the frame. Use the builder to declare its resources before adding the next pass
+    PassBuilder AddPass(const char* name, ExecuteFunction execute);
+
+    // Cull the passes, assign the textures and create the framebuffers
+    void Compile();
+
+    // Execute the passes that were not culled, in the order they were added
+    void Execute();
+
+    // Texture assigned to the resource. Valid from Compile until the end of the frame
+    std::shared_ptr<Texture2DObject> GetTexture(ResourceHandle resource) const;
+    const TextureDesc& GetTextureDesc(ResourceHandle resource) const;
+
+    // Framebuffer with the textures of these resources attached, for example to blit from them. depthResource can be invalid
+    std::shared_ptr<const FramebufferObject> GetFramebuffer(ResourceHandle colorResource, ResourceHandle depthResource);
+    // Same with several color attachments, in order, for passes that render to a subset of the textures of the graph pass
+    std::shared_ptr<const FramebufferObject> GetFramebuffer(std::span<const ResourceHandle> colorResources, ResourceHandle depthResource);
+
+    // Framebuffer of the pass being executed
+    inline std::shared_ptr<const FramebufferObject> GetCurrentFramebuffer() const { return m_currentFramebuffer; }
+
+    // Passes are timed in sections with their name if there is a profiler
+    inline Profiler* GetProfiler() const { return m_profiler; }
+    inline void SetProfiler(Profiler* profiler) { m_profiler = profiler; }
+
+    inline const Stats& GetStats() const { return m_stats; }
+    inline const RenderTargetPool& GetPool() const { return m_pool; }
+
+    // Copy the results of the last frame, reusing the memory of the results
+    void GetResults(Results& results) const;
+
+    // Show the passes of the frame, and if they were culled
+    void DrawGUI(DearImGui& imGui) const;
+    static void DrawGUI(DearImGui& imGui, const Results& results);
+
+private:
+    struct Attachment
+    {
+        ResourceHandle resource = InvalidResource;
+        bool clear = false;
+        Color clearColor;
+        float clearDepth = 1.0f;
+    };
+
+    struct Pass
+    {
+        const char* name;
+        ExecuteFunction execute;
+
+        std::array<ResourceHandle, MaxPassReads> reads;
+        unsigned int readCount;
+
+        std::array<Attachment, RenderTargetPool::MaxColorAttachments> colorAttachments;
+        unsigned int colorAttachmentCount;
+        Attachment depthAttachment;
+
+        bool backbuffer;
+        bool clearBackbufferColor, clearBackbufferDepth;
+        Color backbufferClearColor;
+        float backbufferClearDepth;
+
+        bool sideEffect;
+        bool culled;
+
+        // Assigned in Compile
+        std::shared_ptr<const FramebufferObject> framebuffer;
+        int width, height;
+    };
+
+    struct Resource
+    {
+        const char* name;
+        TextureDesc desc;
+        std::shared_ptr<Texture2DObject> texture;
+        bool imported;
+
+        // Used while compiling, if a later pass needs the current contents
+        bool needed;
+        // First and last passes that use the resource, -1 if none
+        int firstPass, lastPass;
+
+        // Used while executing, the texture was already written this frame
+        bool written;
+    };
+
+    template<typename F>
+    void ForEachAttachment(const Pass& pass, F function) const;
+
+    bool IsDepthStencil(ResourceHandle resource) const;
+
+    // Clear the attachments that are written for the first time this frame
+    void ClearAttachments(Pass& pass);
+
+private:
+    std::vector<Pass> m_passes;
+    std::vector<Resource> m_resources;
+
+    int m_backbufferWidth, m_backbufferHeight;
+
+    std::shared_ptr<const FramebufferObject> m_currentFramebuffer;
+
+    RenderTargetPool m_pool;
+
+    Profiler* m_profiler;
+
+    Stats m_stats;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 class Renderer;
 class FramebufferObject;
@@ -12,6 +13,16 @@ public:
     virtual ~RenderPass();
 
     std::shared_ptr<const FramebufferObject> GetTargetFramebuffer() const;
+    // Change the target, for example to a framebuffer taken from a pool every frame
+    inline void SetTargetFramebuffer(std::shared_ptr<const FramebufferObject> targetFramebuffer) { m_targetFramebuffer = targetFramebuffer; }
+
+    // Name used to identify the pass, for example in the profiler
+    inline const char* GetName() const { return m_name.c_str(); }
+    inline void SetName(const char* name) { m_name = name; }
+
+    // Disabled passes are skipped by the renderer
+    inline bool IsEnabled() const { return m_enabled; }
+    inline void SetEnabled(bool enabled) { m_enabled = enabled; }
 
     virtual void Render() = 0;
 
@@ -28,4 +39,8 @@ private:
 
 private:
     Renderer* m_renderer;
+
+    std::string m_name;
+
+    bool m_enabled;
 };
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <ituGL/texture/TextureObject.h>
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+
+class Texture2DObject;
+class FramebufferObject;
+
+// Keeps the render targets between frames, so they are reused instead of created every frame
+// Textures are matched by their description. A texture released during the frame can be acquired again by a later pass,
+// so targets that are never used at the same time share the same memory
+// Framebuffers are cached by their attachments
+class RenderTargetPool
+{
+public:
+    struct TextureDesc
+    {
+        int width = 0;
+        int height = 0;
+        TextureObject::Format format = TextureObject::FormatRGBA;
+        TextureObject::InternalFormat internalFormat = TextureObject::InternalFormatRGBA8;
+
+        bool operator == (const TextureDesc& other) const = default;
+    };
+
+    static constexpr unsigned int MaxColorAttachments = 4;
+
+    struct Stats
+    {
+        unsigned int textureCount = 0;
+        // Textures created since the last EndFrame. Should be 0 in steady state
+        unsigned int createdTextureCount = 0;
+        unsigned int framebufferCount = 0;
+    };
+
+public:
+    // Textures and framebuffers not used for maxUnusedFrames are destroyed
+    RenderTargetPool(unsigned int maxUnusedFrames = 2);
+
+    // Texture that is not given to anyone else until it is released. Created if none is free
+    // Color textures are filtered linearly and depth textures with the nearest texel, both clamped to the edge
+    std::shared_ptr<Texture2DObject> AcquireTexture(const TextureDesc& desc);
+    // Return the texture to the pool. The contents are kept until the texture is acquired again
+    void ReleaseTexture(const Texture2DObject& texture);
+
+    // Framebuffer with the textures attached in order, and the depth texture if not null
+    // If depthStencil is set, the depth texture has a stencil format and is attached to both
+    std::shared_ptr<const FramebufferObject> GetFramebuffer(std::span<const Texture2DObject* const> colorTextures, const Texture2DObject* depthTexture, bool depthStencil = false);
+
+    // Destroy the textures and framebuffers not used in the last frames, for example the targets of the old size after a resize
+    void EndFrame();
+
+    // Destroy all the textures and framebuffers. Acquired textures stay alive while they are referenced
+    void Clear();
+
+    inline const Stats& GetStats() const { return m_stats; }
+
+private:
+    struct PooledTexture
+    {
+        std::shared_ptr<Texture2DObject> texture;
+        TextureDesc desc;
+        bool acquired;
+        unsigned int lastUsedFrame;
+    };
+
+    struct PooledFramebuffer
+    {
+        std::shared_ptr<FramebufferObject> framebuffer;
+        std::array<const Texture2DObject*, MaxColorAttachments> colorTextures;
+        unsigned int colorTextureCount;
+        const Texture2DObject* depthTexture;
+        unsigned int lastUsedFrame;
+    };
+
+    static bool IsDepthFormat(TextureObject::Format format);
+
+    bool IsExpired(unsigned int lastUsedFrame) const;
+
+    // Remove the framebuffers that have the texture attached
+    void RemoveFramebuffers(const Texture2DObject* texture);
+
+private:
+    std::vector<PooledTexture> m_textures;
+    std::vector<PooledFramebuffer> m_framebuffers;
+
+    unsigned int m_frameIndex;
+    unsigned int m_maxUnusedFrames;
+
+    Stats m_stats;
+};
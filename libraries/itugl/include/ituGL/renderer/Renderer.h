@@ -2,15 +2,22 @@
 
 #include <ituGL/core/DeviceGL.h>
 #include <ituGL/renderer/RenderPass.h>
+#include <ituGL/renderer/CommandList.h>
+#include <ituGL/core/JobSystem.h>
+#include <ituGL/core/FrameArena.h>
+#include <ituGL/utils/AllocationTracker.h>
 #include <ituGL/geometry/Drawcall.h>
 #include <ituGL/geometry/Mesh.h>
 #include <ituGL/shader/Material.h>
+#include <ituGL/shader/RenderStateTracker.h>
 #include <glm/mat4x4.hpp>
+#include <chrono>
 #include <vector>
-#include <unordered_map>
 #include <memory>
 #include <span>
 #include <functional>
+#include <algorithm>
+#include <cassert>
 
 class Camera;
 class Light;
@@ -20,6 +27,8 @@ class VertexArrayObject;
 class Drawcall;
 class Model;
 class FramebufferObject;
+class Profiler;
+class OcclusionCuller;
 
 class Renderer
 {
@@ -41,14 +50,16 @@ public:
         std::reference_wrapper<const Drawcall> m_drawcall;
     };
 
-    using DrawcallSupportedFunction = std::function<bool(const DrawcallInfo& drawcallInfo)>;
+    // Drawcalls of the materials that have any of the passes of the collection
     class DrawcallCollection
     {
     public:
-        DrawcallCollection(const DrawcallSupportedFunction &isSupported = nullptr);
+        DrawcallCollection(Material::PassMask passMask = Material::AllPasses);
 
-        bool IsSupported(const DrawcallInfo& drawcallInfo) const;
-        void SetSupportedFunction(const DrawcallSupportedFunction& isSupported);
+        inline bool IsSupported(const DrawcallInfo& drawcallInfo) const { return drawcallInfo.GetMaterial().HasPass(m_passMask); }
+
+        inline Material::PassMask GetPassMask() const { return m_passMask; }
+        inline void SetPassMask(Material::PassMask passMask) { m_passMask = passMask; }
 
         std::span<DrawcallInfo> GetDrawcalls() { return m_drawcallInfos; }
         std::span<const DrawcallInfo> GetDrawcalls() const { return m_drawcallInfos; }
@@ -56,22 +67,48 @@ public:
         void AddDrawcall(const DrawcallInfo& drawcallInfo);
         void Clear();
 
+        // Move the drawcalls to a new arena, with the same capacity. The drawcalls are removed
+        void SetArena(FrameArena& arena);
+
     private:
-        DrawcallSupportedFunction m_isSupported;
-        std::vector<DrawcallInfo> m_drawcallInfos;
+        Material::PassMask m_passMask;
+        FrameArena::Vector<DrawcallInfo> m_drawcallInfos;
     };
 
     using DrawcallSortFunction = std::function<bool(const DrawcallInfo&, const DrawcallInfo&)>;
 
     using UpdateTransformsFunction = std::function<void(const ShaderProgram&, const glm::mat4&, const Camera&, bool)>;
+    // Sets the uniforms of the next light pass, starting at lightIndex, and advances it past the lights used
+    // Returns false when there are no more passes. A pass can use any number of lights
     using UpdateLightsFunction = std::function<bool(const ShaderProgram&, std::span<const Light* const>, unsigned int&)>;
 
+    // Command lists recorded since the last reset
+    struct CommandListStats
+    {
+        unsigned int listCount = 0;
+        unsigned int commandCount = 0;
+        // Time recording commands in each worker of the job system, in milliseconds
+        std::vector<float> recordTimes;
+    };
+
 public:
     Renderer(DeviceGL& device);
 
     const DeviceGL& GetDevice() const { return m_device; }
     DeviceGL& GetDevice() { return m_device; }
 
+    // Optional profiler, to measure each render pass. Can be nullptr
+    inline Profiler* GetProfiler() const { return m_profiler; }
+    inline void SetProfiler(Profiler* profiler) { m_profiler = profiler; }
+
+    // Optional occlusion culler, to skip the submeshes it hides in AddModel. Can be nullptr
+    inline OcclusionCuller* GetOcclusionCuller() const { return m_occlusionCuller; }
+    inline void SetOcclusionCuller(OcclusionCuller* occlusionCuller) { m_occlusionCuller = occlusionCuller; }
+
+    // Render states currently set. Passes that change states directly must use it, or they are invalidated after the pass
+    inline RenderStateTracker& GetRenderStateTracker() { return m_renderStateTracker; }
+    inline const RenderStateTracker& GetRenderStateTracker() const { return m_renderStateTracker; }
+
     int AddRenderPass(std::unique_ptr<RenderPass> renderPass);
 
     bool HasCamera() const;
@@ -81,6 +118,8 @@ public:
     std::shared_ptr<const FramebufferObject> GetDefaultFramebuffer() const;
     std::shared_ptr<const FramebufferObject> GetCurrentFramebuffer() const;
     void SetCurrentFramebuffer(std::shared_ptr<const FramebufferObject> framebuffer);
+    // The framebuffer was bound outside of the renderer. Keep it as the current one without binding it again
+    void SyncCurrentFramebuffer(std::shared_ptr<const FramebufferObject> framebuffer);
 
     std::span<const Light* const> GetLights() const;
     void AddLight(const Light& light);
@@ -88,8 +127,9 @@ public:
     std::span<const DrawcallInfo> GetDrawcalls(unsigned int collectionIndex) const;
     void AddModel(const Model& model, const glm::mat4& worldMatrix);
 
-    unsigned int AddDrawcallCollection(const DrawcallSupportedFunction &drawcallSupportedFunction);
-    void SetDrawcallCollectionSupportedFunction(unsigned int index, const DrawcallSupportedFunction& drawcallSupportedFunction);
+    // Collection 0 exists by default, with all the passes
+    unsigned int AddDrawcallCollection(Material::PassMask passMask);
+    void SetDrawcallCollectionPassMask(unsigned int index, Material::PassMask passMask);
 
     void SortDrawcallCollection(unsigned int index, const DrawcallSortFunction& drawcallSortFunction);
     bool IsBackToFront(const DrawcallInfo& a, const DrawcallInfo& b) const;
@@ -97,29 +137,74 @@ public:
 
     const Mesh& GetFullscreenMesh() const;
 
+    const glm::mat4& GetWorldMatrix(const DrawcallInfo& drawcallInfo) const;
+    const glm::mat4& GetWorldMatrix(unsigned int worldMatrixIndex) const;
+
     void RegisterShaderProgram(std::shared_ptr<const ShaderProgram> shaderProgramPtr,
         const UpdateTransformsFunction& updateTransformFunction,
         const UpdateLightsFunction& updateLightsFunction);
 
-    void UpdateTransforms(std::shared_ptr<const ShaderProgram> shaderProgramPtr, const glm::mat4& worldMatrix, bool cameraChanged = true) const;
-    void UpdateTransforms(std::shared_ptr<const ShaderProgram> shaderProgramPtr, unsigned int worldMatrixIndex, bool cameraChanged = true) const;
+    void UpdateTransforms(const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, bool cameraChanged = true) const;
+    void UpdateTransforms(const ShaderProgram& shaderProgram, unsigned int worldMatrixIndex, bool cameraChanged = true) const;
 
     UpdateLightsFunction GetDefaultUpdateLightsFunction(const ShaderProgram& shaderProgram);
-    bool UpdateLights(std::shared_ptr<const ShaderProgram> shaderProgramPtr, std::span<const Light* const> lights, unsigned int& lightIndex) const;
+    bool UpdateLights(const ShaderProgram& shaderProgram, std::span<const Light* const> lights, unsigned int& lightIndex) const;
+    bool HasUpdateLightsFunction(const ShaderProgram& shaderProgram) const;
 
     void PrepareDrawcall(const DrawcallInfo& drawcallInfo, Material::OverrideFlags materialOverride = Material::NoOverride);
 
     void SetLightingRenderStates(bool firstPass);
 
-    void Render();
+    // Record the drawcalls in command lists of up to GetCommandListSize() drawcalls, in parallel with the job system,
+    // and execute the lists in order. recordDrawcall(commandList, drawcallInfo) is called from several threads
+    template<typename F>
+    void RecordCommandLists(std::span<const DrawcallInfo> drawcalls, F&& recordDrawcall);
+
+    inline unsigned int GetCommandListSize() const { return m_commandListSize; }
+    inline void SetCommandListSize(unsigned int drawcallCount) { m_commandListSize = drawcallCount; }
+
+    inline const CommandListStats& GetCommandListStats() const { return m_commandListStats; }
+    void ResetCommandListStats();
+
+    // Start a new frame, releasing the transient data of the previous one from the frame arena
+    void BeginFrame();
+    // Number of frames started
+    inline unsigned int GetFrameIndex() const { return m_frameIndex; }
+
+    // Render the enabled passes from firstPassIndex, and reset the drawcalls and lights
+    void Render(int firstPassIndex = 0);
+    // Render a single pass if it is enabled, keeping the drawcalls and lights for the next ones
+    void RenderSinglePass(int passIndex);
     void Reset();
 
+    // Usage of the arena of the current frame
+    inline const FrameArena::Stats& GetFrameArenaStats() const { return m_frameArena.GetStats(); }
+
 private:
-    
+    // Functions registered for a shader program
+    struct ShaderProgramFunctions
+    {
+        std::shared_ptr<const ShaderProgram> shaderProgram;
+        UpdateTransformsFunction updateTransforms;
+        UpdateLightsFunction updateLights;
+    };
+
+    struct RecordedCommandList
+    {
+        CommandList commandList;
+        unsigned int workerIndex = 0;
+        float recordTime = 0.0f;
+    };
 
+private:
     void InitializeFullscreenMesh();
 
-    const glm::mat4& GetWorldMatrix(const DrawcallInfo& drawcallInfo) const;
+    // Functions of the program, or nullptr if it was not registered
+    const ShaderProgramFunctions* FindShaderProgramFunctions(const ShaderProgram& shaderProgram) const;
+
+    // Clear the first listCount lists, creating them if needed
+    void PrepareCommandLists(size_t listCount);
+    void ExecuteCommandLists(size_t listCount);
 
 private:
     DeviceGL& m_device;
@@ -131,16 +216,61 @@ private:
     std::shared_ptr<const FramebufferObject> m_defaultFramebuffer;
     std::shared_ptr<const FramebufferObject> m_currentFramebuffer;
 
-    std::vector<const Light*> m_lights;
+    // Transient data of the frame: lights, world matrices and drawcalls
+    FrameArena m_frameArena;
+    unsigned int m_frameIndex;
 
-    std::vector<glm::mat4> m_worldMatrices;
+    FrameArena::Vector<const Light*> m_lights;
+
+    FrameArena::Vector<glm::mat4> m_worldMatrices;
 
     std::vector<DrawcallCollection> m_drawcallCollections;
 
-    std::unordered_map<std::shared_ptr<const ShaderProgram>, UpdateTransformsFunction> m_updateTransformsFunctions;
-    std::unordered_map<std::shared_ptr<const ShaderProgram>, UpdateLightsFunction> m_updateLightsFunctions;
+    // Indexed by the id of the shader program
+    std::vector<ShaderProgramFunctions> m_shaderProgramFunctions;
 
     Mesh m_fullscreenMesh;
 
     std::vector<std::unique_ptr<RenderPass>> m_passes;
+
+    Profiler* m_profiler;
+
+    OcclusionCuller* m_occlusionCuller;
+
+    RenderStateTracker m_renderStateTracker;
+
+    // Reused every frame, so the commands do not allocate memory once they have grown enough
+    std::vector<RecordedCommandList> m_commandLists;
+    unsigned int m_commandListSize;
+    CommandListStats m_commandListStats;
 };
+
+template<typename F>
+void Renderer::RecordCommandLists(std::span<const DrawcallInfo> drawcalls, F&& recordDrawcall)
+{
+    assert(m_commandListSize > 0);
+    size_t listCount = (drawcalls.size() + m_commandListSize - 1) / m_commandListSize;
+    PrepareCommandLists(listCount);
+
+    JobSystem& jobSystem = JobSystem::GetInstance();
+    jobSystem.ParallelFor(0, listCount, 1, [&](size_t listBegin, size_t listEnd)
+        {
+            AllocationTracker::Scope allocationScope("Renderer::RecordCommandLists");
+            for (size_t listIndex = listBegin; listIndex < listEnd; ++listIndex)
+            {
+                auto start = std::chrono::steady_clock::now();
+
+                RecordedCommandList& recordedList = m_commandLists[listIndex];
+                size_t drawcallEnd = std::min((listIndex + 1) * m_commandListSize, drawcalls.size());
+                for (size_t drawcallIndex = listIndex * m_commandListSize; drawcallIndex < drawcallEnd; ++drawcallIndex)
+                {
+                    recordDrawcall(recordedList.commandList, drawcalls[drawcallIndex]);
+                }
+
+                recordedList.workerIndex = jobSystem.GetCurrentWorkerIndex();
+                recordedList.recordTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+        });
+
+    ExecuteCommandLists(listCount);
+}
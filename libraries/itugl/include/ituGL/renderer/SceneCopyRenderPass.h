@@ -0,0 +1,69 @@
+#pragma once
+
+#include <ituGL/renderer/RenderPass.h>
+
+#include <ituGL/shader/ShaderProgram.h>
+#include <memory>
+#include <vector>
+
+class Texture2DObject;
+
+// Copies the color and depth rendered so far into textures that later passes can sample
+// Depth is stored in a hierarchical Z pyramid: each mip level keeps the closest (red) and farthest (green) depth of the 2x2 texels below it
+// The closest depth is used to trace rays, the farthest one to test if bounding boxes are occluded
+// Typically placed after the opaque geometry and before the transparent geometry
+class SceneCopyRenderPass : public RenderPass
+{
+public:
+    // downsample reduces the resolution of the copies (1 = same size, 2 = half size, ...)
+    SceneCopyRenderPass(int downsample = 1);
+
+    // Targets where the scene is being rendered. Must be set before rendering, they can change every frame
+    void SetSource(std::shared_ptr<const FramebufferObject> sourceFramebuffer, std::shared_ptr<const Texture2DObject> sourceDepthTexture);
+
+    // Must be called when the source framebuffer changes size
+    void Resize(int sourceWidth, int sourceHeight);
+
+    inline int GetDownsample() const { return m_downsample; }
+    void SetDownsample(int downsample);
+
+    // Color of the scene
+    inline std::shared_ptr<const Texture2DObject> GetColorTexture() const { return m_colorTexture; }
+
+    // Hierarchical Z pyramid. Level 0 contains the scene depth
+    inline std::shared_ptr<const Texture2DObject> GetDepthPyramidTexture() const { return m_depthPyramidTexture; }
+    inline int GetDepthPyramidLevelCount() const { return static_cast<int>(m_depthPyramidFramebuffers.size()); }
+
+    void Render() override;
+
+private:
+    void InitializeTextures();
+    void InitializeShaders();
+
+    void CopyColor();
+    void BuildDepthPyramid();
+
+private:
+    std::shared_ptr<const FramebufferObject> m_sourceFramebuffer;
+    std::shared_ptr<const Texture2DObject> m_sourceDepthTexture;
+    int m_sourceWidth, m_sourceHeight;
+
+    int m_downsample;
+    int m_width, m_height;
+
+    std::shared_ptr<Texture2DObject> m_colorTexture;
+    std::shared_ptr<FramebufferObject> m_colorFramebuffer;
+
+    std::shared_ptr<Texture2DObject> m_depthPyramidTexture;
+    // One framebuffer per mip level of the pyramid
+    std::vector<std::shared_ptr<FramebufferObject>> m_depthPyramidFramebuffers;
+
+    // Copies the source depth into level 0, keeping the closest depth when downsampling
+    ShaderProgram m_depthCopyProgram;
+    ShaderProgram::Location m_depthCopySourceLocation;
+    ShaderProgram::Location m_depthCopyDownsampleLocation;
+
+    // Computes each level from the previous one
+    ShaderProgram m_depthReduceProgram;
+    ShaderProgram::Location m_depthReduceSourceLocation;
+};
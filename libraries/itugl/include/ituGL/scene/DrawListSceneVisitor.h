@@ -0,0 +1,20 @@
+#pragma once
+
+#include <ituGL/scene/SceneVisitor.h>
+
+class DrawList;
+
+// Records the models and lights of the scene in a draw list, instead of adding them to the renderer
+// Cameras are ignored, the view that renders the list sets its own
+class DrawListSceneVisitor : public SceneVisitor
+{
+public:
+    DrawListSceneVisitor(DrawList& drawList);
+
+    void VisitLight(SceneLight& sceneLight) override;
+
+    void VisitModel(SceneModel& sceneModel) override;
+
+private:
+    DrawList& m_drawList;
+};
@@ -1,28 +1,150 @@
 #pragma once
 
+#include <ituGL/scene/SceneBvh.h>
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <vector>
 
 class SceneNode;
+class SceneModel;
+class SceneLight;
+class SceneCamera;
 class SceneVisitor;
+class SphereBounds;
 
+// Nodes are kept in dense arrays, one for each type, and addressed by handles that stay valid while the node is in the scene
+// Names are a secondary index to the handles. The bounds of the models are kept in a BVH for spatial queries
 class Scene
 {
+public:
+    // Slot of the node, and generation of the slot. Removing the node changes the generation, so old handles become invalid
+    struct Handle
+    {
+        unsigned int index;
+        unsigned int generation;
+
+        bool operator == (const Handle& other) const = default;
+    };
+
+    static constexpr Handle InvalidHandle = { ~0u, 0 };
+
 public:
     Scene();
     ~Scene();
 
     std::shared_ptr<SceneNode> GetSceneNode(const std::string& name) const;
+    std::shared_ptr<SceneNode> GetSceneNode(Handle handle) const;
 
-    bool AddSceneNode(std::shared_ptr<SceneNode> node);
+    Handle GetHandle(const std::string& name) const;
+    bool IsValid(Handle handle) const;
+
+    Handle AddSceneNode(std::shared_ptr<SceneNode> node);
 
     bool RemoveSceneNode(std::shared_ptr<SceneNode> node);
     bool RemoveSceneNode(const std::string& name);
+    bool RemoveSceneNode(Handle handle);
+
+    inline const std::vector<std::shared_ptr<SceneModel>>& GetModels() const { return m_models; }
+    inline const std::vector<std::shared_ptr<SceneLight>>& GetLights() const { return m_lights; }
+    inline const std::vector<std::shared_ptr<SceneCamera>>& GetCameras() const { return m_cameras; }
 
     void AcceptVisitor(SceneVisitor& visitor);
     void AcceptVisitor(SceneVisitor& visitor) const;
+    // Same, but only the models whose bounds are in the frustum of the view projection matrix, found with the BVH
+    void AcceptVisitor(SceneVisitor& visitor, const glm::mat4& viewProjMatrix);
+
+    // Refit the BVH with the models whose transform changed since the last update. Queries call it first
+    // The changed transforms come from the change log of the TransformStore, so the cost depends on the models that moved
+    void UpdateBounds();
+
+    // Add to the list the handles of the models whose bounds pass the test. Bounds are conservative, so there can be false positives
+    void FindModels(const glm::mat4& viewProjMatrix, std::vector<Handle>& handles);
+    void FindModels(const SphereBounds& sphere, std::vector<Handle>& handles);
+    // Models along the ray, sorted by the distance where the ray enters their bounds
+    void FindModels(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<Handle>& handles);
+
+    inline const SceneBvh& GetBvh() const { return m_bvh; }
+
+private:
+    enum class NodeType : unsigned char
+    {
+        Model,
+        Light,
+        Camera,
+        Other
+    };
+
+    struct Slot
+    {
+        unsigned int generation;
+        NodeType type;
+        // Position in the array of its type
+        unsigned int denseIndex;
+    };
+
+    // BVH leaf of a model, and the transform version used to compute its bounds
+    struct ModelBounds
+    {
+        SceneBvh::Proxy proxy;
+        unsigned int transformIndex;
+        unsigned int transformVersion;
+        // Set when the model or the transform object changed
+        bool invalid;
+    };
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<SceneNode>> m_nodes;
+    friend class SceneNode;
+
+    // Change the name of a node in the index, keeping its handle
+    void RenameSceneNode(const std::string& oldName, const std::string& newName);
+
+    // Compute the bounds of the node again in the next update
+    void InvalidateBounds(const SceneNode& node);
+
+    // Compute the bounds of the model if its transform changed, or it is invalid
+    void RefitModel(unsigned int denseIndex);
+
+    // Remove the model from the list of its transform
+    void RemoveTransformModel(unsigned int transformIndex, unsigned int slotIndex);
+
+    // Handle from the slot index used as user data in the BVH
+    inline Handle GetSlotHandle(unsigned int slotIndex) const { return Handle{ slotIndex, m_slots[slotIndex].generation }; }
+
+    template<typename T>
+    void RemoveDense(std::vector<std::shared_ptr<T>>& nodes, std::vector<unsigned int>& slotIndices, unsigned int denseIndex);
+
+private:
+    std::vector<Slot> m_slots;
+    std::vector<unsigned int> m_freeSlots;
+
+    // Nodes of each type, and their slot
+    std::vector<std::shared_ptr<SceneModel>> m_models;
+    std::vector<unsigned int> m_modelSlots;
+    std::vector<ModelBounds> m_modelBounds;
+
+    std::vector<std::shared_ptr<SceneLight>> m_lights;
+    std::vector<unsigned int> m_lightSlots;
+
+    std::vector<std::shared_ptr<SceneCamera>> m_cameras;
+    std::vector<unsigned int> m_cameraSlots;
+
+    std::vector<std::shared_ptr<SceneNode>> m_otherNodes;
+    std::vector<unsigned int> m_otherSlots;
+
+    std::unordered_map<std::string, Handle> m_names;
+
+    SceneBvh m_bvh;
+
+    // Position in the change log of the transform store read by the last update
+    size_t m_changeLogPosition;
+
+    // Slots of the models with invalid bounds. Can have removed models, they are skipped
+    std::vector<unsigned int> m_invalidModels;
+
+    // Slots of the models in the BVH, for each transform index
+    std::vector<std::vector<unsigned int>> m_transformModels;
+
+    // The BVH is compacted when more than this fraction of the leaves were inserted after the last compaction
+    float m_bvhCompactRatio;
 };
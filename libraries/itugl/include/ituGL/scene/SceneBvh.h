@@ -0,0 +1,317 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+// Dynamic bounding volume hierarchy of axis aligned boxes
+// Leaves keep enlarged ("fat") bounds, so small movements don't change the tree. When the bounds of a leaf leave
+// its fat bounds, the leaf is removed and inserted again, and the tree is rebalanced with rotations on the way up
+// Nodes are allocated in the order they are inserted, so a traversal jumps around in memory. Compact stores them in
+// depth first order again. Without it, a frustum query that keeps a big part of the leaves costs about the same as
+// testing the bounds of every leaf in a packed array
+class SceneBvh
+{
+public:
+    // Index of a leaf. It stays the same when the nodes are moved in memory
+    using Proxy = int;
+
+    // Value for empty links
+    static constexpr Proxy NullProxy = -1;
+
+    // Clip space planes, with the normals pointing inside: left, right, bottom, top, near, far
+    using FrustumPlanes = std::array<glm::vec4, 6>;
+
+public:
+    SceneBvh();
+
+    // Add a leaf with these bounds, and the user value returned by the queries
+    Proxy CreateProxy(const glm::vec3& boundsMin, const glm::vec3& boundsMax, unsigned int userData);
+    void DestroyProxy(Proxy proxy);
+
+    // Update the bounds of a leaf. Returns true if the leaf had to be inserted again
+    bool MoveProxy(Proxy proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    inline unsigned int GetUserData(Proxy proxy) const { return m_nodes[m_proxyNodes[proxy]].userData; }
+    inline const glm::vec3& GetFatBoundsMin(Proxy proxy) const { return m_nodes[m_proxyNodes[proxy]].boundsMin; }
+    inline const glm::vec3& GetFatBoundsMax(Proxy proxy) const { return m_nodes[m_proxyNodes[proxy]].boundsMax; }
+
+    // Distance added to each side of the bounds of the leaves
+    inline float GetMargin() const { return m_margin; }
+    inline void SetMargin(float margin) { m_margin = margin; }
+
+    // Number of leaves, and height of the tree (0 for a single leaf)
+    inline unsigned int GetProxyCount() const { return m_proxyCount; }
+    int GetHeight() const;
+
+    // Store the nodes in depth first order, so the queries read them mostly in memory order. The proxies stay valid
+    void Compact();
+    // Leaves inserted since the last compaction, placed wherever a node was free
+    inline unsigned int GetUnorderedCount() const { return m_unorderedCount; }
+
+    // Call the callback with the user value of every leaf whose fat bounds pass the test
+    template<typename F>
+    void QueryAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax, F&& callback) const;
+    template<typename F>
+    void QuerySphere(const glm::vec3& center, float radius, F&& callback) const;
+    template<typename F>
+    void QueryFrustum(const FrustumPlanes& planes, F&& callback) const;
+    // The callback gets also the distance where the ray enters the bounds
+    template<typename F>
+    void QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F&& callback) const;
+
+    // Planes of the frustum of a view projection matrix
+    static FrustumPlanes GetFrustumPlanes(const glm::mat4& viewProjMatrix);
+
+    // The box is outside the plane if its corner furthest along the normal is behind it, and inside if the nearest one is in front
+    static bool IsOutsidePlane(const glm::vec4& plane, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    static bool IsInsidePlane(const glm::vec4& plane, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    // Box against all the planes. Conservative, boxes near the corners of the frustum can pass. Same test as the GPU culling shader
+    static bool IsInFrustum(const FrustumPlanes& planes, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+private:
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        // Parent, or next free node while unused
+        Proxy parent;
+        // Both null for leaves
+        Proxy child1;
+        Proxy child2;
+        // Height of the subtree, 0 for leaves, -1 if free
+        int height;
+        unsigned int userData;
+        // Proxy of the leaves
+        Proxy proxy;
+
+        inline bool IsLeaf() const { return child1 == NullProxy; }
+    };
+
+private:
+    Proxy AllocateNode();
+    void FreeNode(Proxy node);
+
+    void InsertLeaf(Proxy leaf);
+    void RemoveLeaf(Proxy leaf);
+
+    // Rotate the subtree if the children heights differ by more than one. Returns the new root of the subtree
+    Proxy Balance(Proxy node);
+
+    // Update the bounds and height of the node from its children
+    void UpdateNode(Proxy node);
+
+    // Call the callback for every leaf under the nodes where the test passes
+    template<typename T, typename F>
+    void Traverse(T&& test, F&& callback) const;
+
+    // Call the callback for every leaf under the node, without testing them
+    template<typename F>
+    void ReportLeaves(Proxy root, F&& callback) const;
+
+    static float GetSurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    // Traversals are depth first, so they keep at most one pending node per level, and the tree is balanced
+    // The stack is a fixed array, so queries don't allocate memory
+    static constexpr int MaxTraversalDepth = 64;
+
+private:
+    std::vector<Node> m_nodes;
+
+    Proxy m_root;
+    Proxy m_freeList;
+
+    // Node of each proxy, and the proxies that can be reused
+    std::vector<Proxy> m_proxyNodes;
+    std::vector<Proxy> m_freeProxies;
+
+    unsigned int m_proxyCount;
+    unsigned int m_unorderedCount;
+
+    float m_margin;
+};
+
+inline bool SceneBvh::IsOutsidePlane(const glm::vec4& plane, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 farCorner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x, plane.y >= 0.0f ? boundsMax.y : boundsMin.y, plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+    return glm::dot(glm::vec3(plane), farCorner) + plane.w < 0.0f;
+}
+
+inline bool SceneBvh::IsInsidePlane(const glm::vec4& plane, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 nearCorner(plane.x >= 0.0f ? boundsMin.x : boundsMax.x, plane.y >= 0.0f ? boundsMin.y : boundsMax.y, plane.z >= 0.0f ? boundsMin.z : boundsMax.z);
+    return glm::dot(glm::vec3(plane), nearCorner) + plane.w >= 0.0f;
+}
+
+inline bool SceneBvh::IsInFrustum(const FrustumPlanes& planes, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    for (const glm::vec4& plane : planes)
+    {
+        if (IsOutsidePlane(plane, boundsMin, boundsMax))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T, typename F>
+void SceneBvh::Traverse(T&& test, F&& callback) const
+{
+    if (m_root == NullProxy)
+    {
+        return;
+    }
+
+    assert(m_nodes[m_root].height < MaxTraversalDepth);
+    std::array<Proxy, MaxTraversalDepth> stack;
+    int stackSize = 0;
+    stack[stackSize++] = m_root;
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+
+        if (!test(node.boundsMin, node.boundsMax))
+        {
+            continue;
+        }
+
+        if (node.IsLeaf())
+        {
+            callback(node.userData);
+        }
+        else
+        {
+            stack[stackSize++] = node.child1;
+            stack[stackSize++] = node.child2;
+        }
+    }
+}
+
+template<typename F>
+void SceneBvh::QueryAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax, F&& callback) const
+{
+    Traverse([&](const glm::vec3& nodeMin, const glm::vec3& nodeMax)
+        {
+            return nodeMin.x <= boundsMax.x && nodeMin.y <= boundsMax.y && nodeMin.z <= boundsMax.z
+                && boundsMin.x <= nodeMax.x && boundsMin.y <= nodeMax.y && boundsMin.z <= nodeMax.z;
+        }, callback);
+}
+
+template<typename F>
+void SceneBvh::QuerySphere(const glm::vec3& center, float radius, F&& callback) const
+{
+    float radiusSquared = radius * radius;
+    Traverse([&](const glm::vec3& nodeMin, const glm::vec3& nodeMax)
+        {
+            glm::vec3 offset = glm::clamp(center, nodeMin, nodeMax) - center;
+            return glm::dot(offset, offset) <= radiusSquared;
+        }, callback);
+}
+
+template<typename F>
+void SceneBvh::QueryFrustum(const FrustumPlanes& planes, F&& callback) const
+{
+    if (m_root == NullProxy)
+    {
+        return;
+    }
+
+    // Each node keeps the mask of the planes that cut its parent. Children of a node inside all the planes are not tested
+    assert(m_nodes[m_root].height < MaxTraversalDepth);
+    std::array<std::pair<Proxy, unsigned int>, MaxTraversalDepth> stack;
+    int stackSize = 0;
+    stack[stackSize++] = std::make_pair(m_root, (1u << planes.size()) - 1);
+    while (stackSize > 0)
+    {
+        auto [proxy, planeMask] = stack[--stackSize];
+        const Node& node = m_nodes[proxy];
+
+        bool outside = false;
+        for (unsigned int planeIndex = 0; planeIndex < planes.size() && !outside; ++planeIndex)
+        {
+            unsigned int planeBit = 1u << planeIndex;
+            if ((planeMask & planeBit) == 0)
+            {
+                continue;
+            }
+
+            const glm::vec4& plane = planes[planeIndex];
+            if (IsOutsidePlane(plane, node.boundsMin, node.boundsMax))
+            {
+                outside = true;
+            }
+            else if (IsInsidePlane(plane, node.boundsMin, node.boundsMax))
+            {
+                planeMask &= ~planeBit;
+            }
+        }
+        if (outside)
+        {
+            continue;
+        }
+
+        if (node.IsLeaf())
+        {
+            callback(node.userData);
+        }
+        else if (planeMask == 0)
+        {
+            // Inside all the planes, every leaf below is in the frustum
+            ReportLeaves(proxy, callback);
+        }
+        else
+        {
+            stack[stackSize++] = std::make_pair(node.child1, planeMask);
+            stack[stackSize++] = std::make_pair(node.child2, planeMask);
+        }
+    }
+}
+
+template<typename F>
+void SceneBvh::ReportLeaves(Proxy root, F&& callback) const
+{
+    std::array<Proxy, MaxTraversalDepth> stack;
+    int stackSize = 0;
+    stack[stackSize++] = root;
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if (node.IsLeaf())
+        {
+            callback(node.userData);
+        }
+        else
+        {
+            stack[stackSize++] = node.child1;
+            stack[stackSize++] = node.child2;
+        }
+    }
+}
+
+template<typename F>
+void SceneBvh::QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F&& callback) const
+{
+    // Slab test. Divisions by zero give infinities, that compare correctly
+    glm::vec3 inverseDirection = 1.0f / direction;
+    float distance = 0.0f;
+    Traverse([&](const glm::vec3& nodeMin, const glm::vec3& nodeMax)
+        {
+            glm::vec3 t1 = (nodeMin - origin) * inverseDirection;
+            glm::vec3 t2 = (nodeMax - origin) * inverseDirection;
+            glm::vec3 tNear = glm::min(t1, t2);
+            glm::vec3 tFar = glm::max(t1, t2);
+            float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+            float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+            distance = enter;
+            return enter <= exit;
+        }, [&](unsigned int userData) { callback(userData, distance); });
+}
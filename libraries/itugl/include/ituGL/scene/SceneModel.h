@@ -22,6 +22,9 @@ public:
     AabbBounds GetAabbBounds() const override;
     BoxBounds GetBoxBounds() const override;
 
+    // World space box containing the bounds of all the submeshes. Submeshes without bounds use the unit box from -1 to 1
+    void GetWorldBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+
     void AcceptVisitor(SceneVisitor& visitor) override;
     void AcceptVisitor(SceneVisitor& visitor) const override;
 
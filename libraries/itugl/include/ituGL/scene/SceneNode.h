@@ -39,6 +39,9 @@ private:
     Scene* m_scene;
 
 protected:
+    // The bounds of the node changed without moving its transform, the owner scene must compute them again
+    void InvalidateSceneBounds();
+
     std::string m_name;
     std::shared_ptr<Transform> m_transform;
 };
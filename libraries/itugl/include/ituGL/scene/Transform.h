@@ -1,42 +1,54 @@
 #pragma once
 
+#include <ituGL/scene/TransformStore.h>
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <memory>
 
+// Handle to the values of a transform in the TransformStore
 class Transform
 {
 public:
     Transform();
+    ~Transform();
 
-    inline glm::vec3 GetTranslation() const { return m_translation; }
-    inline void SetTranslation(const glm::vec3& translation) { m_translation = translation; m_dirty = true; }
+    // A copy gets its own values in the store, with the same parent
+    Transform(const Transform& transform);
+    Transform& operator = (const Transform& transform);
 
-    inline glm::vec3 GetRotation() const { return m_rotation; }
-    inline void SetRotation(const glm::vec3& rotation) { m_rotation = rotation; m_dirty = true; }
+    inline glm::vec3 GetTranslation() const { return GetStore().GetTranslation(m_index); }
+    inline void SetTranslation(const glm::vec3& translation) { GetStore().SetTranslation(m_index, translation); }
 
-    inline glm::vec3 GetScale() const { return m_scale; }
-    inline void SetScale(const glm::vec3& scale) { m_scale = scale; m_dirty = true; }
+    inline glm::vec3 GetRotation() const { return GetStore().GetRotation(m_index); }
+    inline void SetRotation(const glm::vec3& rotation) { GetStore().SetRotation(m_index, rotation); }
+
+    inline glm::vec3 GetScale() const { return GetStore().GetScale(m_index); }
+    inline void SetScale(const glm::vec3& scale) { GetStore().SetScale(m_index, scale); }
 
     inline std::shared_ptr<Transform> GetParent() const { return m_parent; }
-    inline void SetParent(std::shared_ptr<Transform> parent) { m_parent = parent; m_dirty = true; }
+    void SetParent(std::shared_ptr<Transform> parent);
 
     glm::mat4 GetTranslationMatrix() const;
     glm::mat4 GetRotationMatrix() const;
     glm::mat4 GetScaleMatrix() const;
 
+    // World matrix, including the parents. Computed in the store together with the other transforms that changed
     glm::mat4 GetTransformMatrix() const;
 
     bool IsDirty() const;
 
+    // Changes every time the world matrix is computed again
+    inline unsigned int GetVersion() const { return GetStore().GetVersion(m_index); }
+
+    // Index of the values in the store
+    inline TransformStore::Index GetIndex() const { return m_index; }
+
 private:
-    glm::vec3 m_translation;
-    glm::vec3 m_rotation;
-    glm::vec3 m_scale;
+    inline static TransformStore& GetStore() { return TransformStore::GetInstance(); }
 
-    std::shared_ptr<Transform> m_parent;
+private:
+    TransformStore::Index m_index;
 
-    // Cached matrix
-    mutable glm::mat4 m_matrix;
-    mutable bool m_dirty;
+    // Keeps the parent, and its index in the store, alive while this transform uses it
+    std::shared_ptr<Transform> m_parent;
 };
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+// Storage for the values of all the transforms, one array for each value (structure of arrays)
+// Transform objects are handles to an index in the store
+// World matrices are updated in one pass over the transforms sorted by depth, so parents are always computed before their children
+class TransformStore
+{
+public:
+    // Index of a transform in the store
+    using Index = unsigned int;
+
+    // Value for transforms without parent
+    static constexpr Index NoParent = ~0u;
+
+public:
+    TransformStore();
+
+    // The store used by the Transform objects
+    static TransformStore& GetInstance();
+
+    // Add a transform with identity values, reusing free indices
+    Index Add();
+    // Free the index of a transform. Its children must have been removed or reparented before
+    void Remove(Index index);
+
+    inline const glm::vec3& GetTranslation(Index index) const { return m_translations[index]; }
+    void SetTranslation(Index index, const glm::vec3& translation);
+
+    inline const glm::vec3& GetRotation(Index index) const { return m_rotations[index]; }
+    void SetRotation(Index index, const glm::vec3& rotation);
+
+    inline const glm::vec3& GetScale(Index index) const { return m_scales[index]; }
+    void SetScale(Index index, const glm::vec3& scale);
+
+    inline Index GetParent(Index index) const { return m_parents[index]; }
+    void SetParent(Index index, Index parent);
+
+    // If the world matrix of the transform, or of any of its parents, changed since the last update
+    // The flags of the parents are copied to their children first, if any changed since the last call
+    inline bool IsDirty(Index index)
+    {
+        if (!m_dirtyPropagated)
+        {
+            PropagateDirtyFlags();
+        }
+        return m_dirty[index];
+    }
+
+    // Get the world matrix, updating the matrices of all the transforms first if any changed
+    const glm::mat4& GetWorldMatrix(Index index);
+
+    // Counter that changes every time the world matrix is computed, or the index is reused. Updates the matrices first if any changed
+    unsigned int GetVersion(Index index);
+
+    // Counter that changes every time any world matrix is computed. Updates the matrices first if any changed
+    unsigned int GetUpdateCount();
+
+    // Position after the last transform in the change log, where the updates add the transforms they computed
+    // Updates the matrices first if any changed
+    size_t GetChangeLogEnd();
+
+    // Call the callback with the index of each transform computed from the position of the log until the end
+    // The same index can be repeated. Returns false if the log was trimmed after the position, the caller must check all its transforms then
+    template<typename F>
+    bool ReadChangeLog(size_t position, F&& callback);
+
+    // Compute the world matrices of the transforms that changed, and of their children
+    void UpdateWorldMatrices();
+
+    // Levels with at least this number of transforms are split between the workers of the JobSystem
+    inline unsigned int GetParallelThreshold() const { return m_parallelThreshold; }
+    inline void SetParallelThreshold(unsigned int parallelThreshold) { m_parallelThreshold = parallelThreshold; }
+
+    // Number of transforms in use
+    inline unsigned int GetCount() const { return static_cast<unsigned int>(m_used.size() - m_freeIndices.size()); }
+
+    // Build the local matrix: translation * rotation (Y, X, Z) * scale
+    static glm::mat4 ComposeMatrix(const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale);
+
+private:
+    // Sort the transforms in use by depth, after the hierarchy changes
+    void SortByDepth();
+
+    // Set the dirty flag of the children of dirty transforms, going down in the sorted order
+    void PropagateDirtyFlags();
+
+    // Compute the world matrices of a range of transforms in the sorted order. All of them have their parents computed
+    void UpdateWorldMatrices(size_t begin, size_t end);
+
+private:
+    // Local values
+    std::vector<glm::vec3> m_translations;
+    std::vector<glm::vec3> m_rotations;
+    std::vector<glm::vec3> m_scales;
+
+    // Index of the parent, or NoParent
+    std::vector<Index> m_parents;
+
+    // Computed world matrices
+    std::vector<glm::mat4> m_worldMatrices;
+
+    // Incremented when the world matrix is computed
+    std::vector<unsigned int> m_versions;
+
+    // If the local values changed since the last update. Set also for the children when propagated, or while updating
+    std::vector<unsigned char> m_dirty;
+
+    // If the index is used by a transform
+    std::vector<unsigned char> m_used;
+
+    // Indices that can be reused by new transforms
+    std::vector<Index> m_freeIndices;
+
+    // Indices in use, sorted by depth, and the first position of each depth in the list
+    std::vector<Index> m_order;
+    std::vector<size_t> m_levelOffsets;
+
+    // If the hierarchy changed, so the order must be sorted again
+    bool m_orderDirty;
+
+    // If any transform is dirty
+    bool m_anyDirty;
+
+    // Incremented by the updates with dirty transforms
+    unsigned int m_updateCount;
+
+    // Transforms computed by the last updates, and the position of the first one. Trimmed when longer than the transforms in use
+    std::vector<Index> m_changeLog;
+    size_t m_changeLogBase;
+
+    // If the children of dirty transforms are flagged too
+    bool m_dirtyPropagated;
+
+    unsigned int m_parallelThreshold;
+};
+
+template<typename F>
+bool TransformStore::ReadChangeLog(size_t position, F&& callback)
+{
+    size_t end = GetChangeLogEnd();
+    if (position < m_changeLogBase)
+    {
+        return false;
+    }
+
+    for (; position < end; ++position)
+    {
+        callback(m_changeLog[position - m_changeLogBase]);
+    }
+    return true;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <ituGL/shader/ShaderUniformCollection.h>
+#include <ituGL/shader/RenderState.h>
 
 #include <ituGL/core/Color.h>
 #include <functional>
 #include <array>
+#include <vector>
+
+class RenderStateTracker;
 
 // Class to group all the properties that may affect the look of a rendered geometry
 class Material : public ShaderUniformCollection
@@ -19,6 +23,20 @@ public:
         OverrideStencilTest = 1 << 2
     };
 
+    // Flags of the passes that draw the material. Drawcall collections take the drawcalls with any of their passes
+    enum PassFlags
+    {
+        NoPass = 0,
+        PassOpaque = 1 << 0,
+        PassTransparent = 1 << 1,
+        PassShadow = 1 << 2,
+        PassReflection = 1 << 3,
+        PassDepthPrepass = 1 << 4,
+        PassGBuffer = 1 << 5,
+        AllPasses = PassOpaque | PassTransparent | PassShadow | PassReflection | PassDepthPrepass | PassGBuffer
+    };
+    using PassMask = unsigned int;
+
     // Different conditions for depth and stencil tests
     enum class TestFunction : GLenum;
 
@@ -39,12 +57,23 @@ public:
     Material();
     // Initialize with the shader program, will extract all the properties. Skip the names in filtered uniforms
     Material(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms = NameSet());
+    // Initialize as a copy of the parent, reading its uniform values. Only the uniforms modified later are stored again
+    explicit Material(std::shared_ptr<const Material> parent);
+
+    // Materials this one was created from, starting with the parent. For debugging
+    std::vector<std::shared_ptr<const Material>> GetParentChain() const;
 
 
     // The function that will be executed for additional shader program setup
     void SetShaderSetupFunction(ShaderSetupFunction shaderSetupFunction);
 
 
+    // Passes that draw the material. Default: opaque, shadow, reflection and depth pre-pass
+    inline PassMask GetPassMask() const { return m_passMask; }
+    inline void SetPassMask(PassMask passMask) { m_passMask = passMask; }
+    inline bool HasPass(PassMask passMask) const { return (m_passMask & passMask) != 0; }
+
+
     // The test function for the depth test, if depth test is enabled
     TestFunction GetDepthTestFunction() const;
     void SetDepthTestFunction(TestFunction function);
@@ -122,24 +151,23 @@ public:
     void SetBlendColor(Color blendColor);
 
 
+    // Get the shared block with the depth, stencil and blend properties. Created again after they change
+    const RenderState& GetRenderState() const;
+
     // Use the shader program, set all uniforms, set depth properties, stencil properties, and blending
     // You can skip depth, stencil or blending using the override flags
     void Use(OverrideFlags overrideFlags = OverrideFlags::NoOverride) const;
 
-private:
-    // Set all the properties relative to depth
-    void UseDepthTest() const;
-
-    // Set all the properties relative to stencil
-    void UseStencilTest() const;
-
-    // Set all the properties relative to blending
-    void UseBlend() const;
+    // Same, but only the render states that differ from the ones in the tracker are set
+    void Use(RenderStateTracker& renderStateTracker, OverrideFlags overrideFlags = OverrideFlags::NoOverride) const;
 
 private:
     // Function pointer to prepare the shader used by the material
     ShaderSetupFunction m_shaderSetupFunction;
 
+    // Passes that draw the material
+    PassMask m_passMask;
+
     // Test function for depth. Default: Less
     TestFunction m_depthTestFunction;
 
@@ -173,6 +201,12 @@ private:
 
     // Blend color to use with ConstantColor or ConstantAlpha parameters. Default: white
     Color m_blendColor;
+
+    // Block with the properties above, created when first needed. Null after they change
+    mutable const RenderState* m_renderState;
+
+    // Material this one was created from, if any
+    std::shared_ptr<const Material> m_parent;
 };
 
 // Different conditions for depth and stencil tests
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <cstddef>
+
+// Immutable block with the depth, stencil and blend states used to draw
+// Blocks are shared: Get returns the same block for equal states, so two blocks can be compared by address
+class RenderState
+{
+public:
+    struct DepthState
+    {
+        // Test function, if depth test is enabled
+        GLenum function;
+        // If the geometry writes to the depth buffer
+        bool write;
+
+        bool operator == (const DepthState& other) const = default;
+    };
+
+    // Front and back faces in each array
+    struct StencilState
+    {
+        std::array<GLenum, 2> functions;
+        std::array<GLint, 2> refValues;
+        std::array<GLuint, 2> masks;
+        std::array<GLenum, 2> stencilFail;
+        std::array<GLenum, 2> depthFail;
+        std::array<GLenum, 2> depthPass;
+
+        bool operator == (const StencilState& other) const = default;
+    };
+
+    // Values are the ones sent to OpenGL. A disabled channel is already replaced with (Source * 1 + Dest * 0)
+    struct BlendState
+    {
+        bool enabled;
+        // Color and alpha
+        std::array<GLenum, 2> equations;
+        // Source color, destination color, source alpha and destination alpha
+        std::array<GLenum, 4> params;
+        // Only used if a param is ConstantColor or ConstantAlpha
+        std::array<float, 4> color;
+
+        bool UsesColor() const;
+
+        bool operator == (const BlendState& other) const = default;
+    };
+
+public:
+    // Get the shared block with these states, creating it the first time
+    static const RenderState& Get(const DepthState& depth, const StencilState& stencil, const BlendState& blend);
+
+    // Number of different blocks created so far
+    static unsigned int GetBlockCount();
+
+    inline const DepthState& GetDepth() const { return m_depth; }
+    inline const StencilState& GetStencil() const { return m_stencil; }
+    inline const BlendState& GetBlend() const { return m_blend; }
+
+    inline std::size_t GetHash() const { return m_hash; }
+
+private:
+    RenderState(const DepthState& depth, const StencilState& stencil, const BlendState& blend, std::size_t hash);
+
+    static std::size_t ComputeHash(const DepthState& depth, const StencilState& stencil, const BlendState& blend);
+
+private:
+    DepthState m_depth;
+    StencilState m_stencil;
+    BlendState m_blend;
+
+    std::size_t m_hash;
+};
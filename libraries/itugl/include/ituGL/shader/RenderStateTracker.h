@@ -0,0 +1,82 @@
+#pragma once
+
+#include <ituGL/shader/RenderState.h>
+#include <ituGL/shader/Material.h>
+#include <ituGL/texture/TextureObject.h>
+#include <vector>
+
+// Keeps the render states currently set in OpenGL, to only set the values that change between blocks
+// Consecutive draws with the same block don't make any state call. Textures bound to each unit are tracked the same way
+class RenderStateTracker
+{
+public:
+    RenderStateTracker();
+    ~RenderStateTracker();
+
+    RenderStateTracker(const RenderStateTracker&) = delete;
+    RenderStateTracker& operator = (const RenderStateTracker&) = delete;
+
+    // Apply the states of the block that are not overridden, calling OpenGL only for the values that differ
+    void Apply(const RenderState& renderState, Material::OverrideFlags overrideFlags = Material::NoOverride);
+
+    // Apply a single group of states, for passes that change them on top of the material
+    void ApplyDepth(const RenderState::DepthState& depth);
+    void ApplyStencil(const RenderState::StencilState& stencil);
+    void ApplyBlend(const RenderState::BlendState& blend);
+
+    // Bind the texture to the unit, skipping the calls if it is already bound there
+    void BindTexture(GLint textureUnit, const TextureObject& texture);
+
+    // Remove the texture from the units of all the trackers, when it is deleted. OpenGL can give the handle to a new texture
+    // Trackers and textures are only created and deleted in the thread that owns the context
+    static void ForgetTexture(Object::Handle handle);
+
+    // Current depth states. Only valid after they have been applied
+    const RenderState::DepthState& GetDepth() const;
+
+    // Forget the current states, after they are changed without the tracker. The next Apply sets all of them
+    void Invalidate();
+
+    // Number of applied blocks that changed any state, and number of OpenGL calls made, since the last reset
+    inline unsigned int GetTransitionCount() const { return m_transitionCount; }
+    inline unsigned int GetStateCallCount() const { return m_stateCallCount; }
+    // Number of glActiveTexture and glBindTexture calls made since the last reset
+    inline unsigned int GetTextureBindCount() const { return m_textureBindCount; }
+    void ResetCounters();
+
+private:
+    struct BoundTexture
+    {
+        GLenum target;
+        Object::Handle handle;
+    };
+
+private:
+    // Last block applied. Null if states were applied separately or invalidated
+    const RenderState* m_currentRenderState;
+
+    RenderState::DepthState m_depth;
+    RenderState::StencilState m_stencil;
+    RenderState::BlendState m_blend;
+
+    // If the values above match OpenGL
+    bool m_depthValid;
+    bool m_stencilValid;
+    bool m_blendValid;
+    // Equations, params and color are kept by OpenGL while blending is disabled, so they have their own flag
+    bool m_blendValuesValid;
+
+    // Active texture unit, -1 if unknown
+    GLint m_activeTextureUnit;
+    // Texture bound to each unit. Units beyond the end, or with a 0 handle, are unknown
+    std::vector<BoundTexture> m_boundTextures;
+
+    unsigned int m_transitionCount;
+    unsigned int m_stateCallCount;
+    unsigned int m_textureBindCount;
+
+    // Trackers alive, linked so the deleted textures can be removed from all of them
+    static RenderStateTracker* s_firstTracker;
+    RenderStateTracker* m_previousTracker;
+    RenderStateTracker* m_nextTracker;
+};
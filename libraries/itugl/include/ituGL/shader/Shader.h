@@ -47,6 +47,10 @@ public:
     // Compile the shader source code
     bool Compile();
 
+    // Start compiling the shader source code, without waiting for the result
+    // The status is checked later, usually through the program that links it
+    void CompileAsync();
+
     // Check if the shader has been successfully compiled
     bool IsCompiled() const;
 
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ShaderProgram;
+class ShaderProgramCache;
+
+// Set of shader programs built from the same source files, specialized with different #define blocks
+// Each permutation is identified by a mask with the value of every feature, and it is built the first time it is used
+class ShaderPermutations
+{
+public:
+    // Values of all the features, packed in bits
+    using FeatureMask = unsigned int;
+
+    // Index of a feature, returned by AddFeature
+    using Feature = int;
+
+    // Called when a permutation is built, for example to register it in the renderer
+    using BuildFunction = std::function<void(std::shared_ptr<ShaderProgram> shaderProgram, FeatureMask featureMask)>;
+
+public:
+    // The first file of each list must contain only the #version directive. Defines are inserted after it
+    ShaderPermutations(const std::vector<const char*>& vertexShaderPaths, const std::vector<const char*>& fragmentShaderPaths);
+
+    // Add a feature that uses bitCount bits of the mask
+    // With 1 bit, "#define name" is added when the bit is set. With more, "#define name value" is always added
+    Feature AddFeature(const char* name, unsigned int bitCount = 1);
+
+    // Get or set the value of a feature in a mask
+    unsigned int GetFeatureValue(FeatureMask featureMask, Feature feature) const;
+    FeatureMask SetFeatureValue(FeatureMask featureMask, Feature feature, unsigned int value) const;
+
+    void SetBuildFunction(const BuildFunction& buildFunction);
+
+    // Build the permutations through a binary cache, instead of always compiling them
+    inline void SetShaderProgramCache(ShaderProgramCache* shaderProgramCache) { m_shaderProgramCache = shaderProgramCache; }
+
+    // Get the program of a permutation, building it if it is the first time
+    // If the permutation is still building asynchronously, it waits for it
+    std::shared_ptr<ShaderProgram> GetShaderProgram(FeatureMask featureMask);
+
+    // Start building a permutation in the background, so it is ready when needed. Does nothing if already built
+    void Prebuild(FeatureMask featureMask);
+
+    // Check, without blocking, if the program of a permutation can be used. Starts building it if needed
+    bool IsShaderProgramReady(FeatureMask featureMask);
+
+    // Number of permutations built so far
+    inline unsigned int GetShaderProgramCount() const { return static_cast<unsigned int>(m_shaderPrograms.size()); }
+
+    // Number of permutations still building in the background
+    inline unsigned int GetPendingShaderProgramCount() const { return static_cast<unsigned int>(m_pendingShaderPrograms.size()); }
+
+private:
+    // Source code with the defines of a permutation
+    std::string GetDefines(FeatureMask featureMask) const;
+
+    std::shared_ptr<ShaderProgram> BuildShaderProgram(FeatureMask featureMask) const;
+    std::shared_ptr<ShaderProgram> BuildShaderProgramAsync(FeatureMask featureMask) const;
+
+    // Move a permutation that finished building to the built ones, and call the build function
+    std::shared_ptr<ShaderProgram> CompleteShaderProgram(FeatureMask featureMask, std::shared_ptr<ShaderProgram> shaderProgram);
+
+private:
+    struct FeatureInfo
+    {
+        std::string name;
+        unsigned int bitOffset;
+        unsigned int bitCount;
+    };
+
+    std::vector<const char*> m_vertexShaderPaths;
+    std::vector<const char*> m_fragmentShaderPaths;
+
+    std::vector<FeatureInfo> m_features;
+
+    // Bits used by all the features
+    unsigned int m_bitCount;
+
+    BuildFunction m_buildFunction;
+
+    ShaderProgramCache* m_shaderProgramCache;
+
+    std::unordered_map<FeatureMask, std::shared_ptr<ShaderProgram>> m_shaderPrograms;
+
+    // Permutations submitted with Prebuild that are still building
+    std::unordered_map<FeatureMask, std::shared_ptr<ShaderProgram>> m_pendingShaderPrograms;
+};
@@ -17,6 +17,7 @@
 #include <glm/mat4x4.hpp>
 
 #include <span>
+#include <vector>
 
 class Shader;
 class TextureObject;
@@ -41,6 +42,11 @@ public:
     // Implements the Bind required by Object. Shaders and shader programs don't use Bind()
     void Bind() const override;
 
+    // Small number that identifies the program, to index tables of data per program
+    // Ids of destroyed programs are reused, so they stay close to the number of programs
+    inline unsigned int GetId() const { return m_id; }
+    static constexpr unsigned int InvalidId = ~0u;
+
     // Build (Attach and link) a shader program with a compute shader
     bool Build(const Shader& computeShader);
 
@@ -71,6 +77,14 @@ public:
         return Build(vertexShader, fragmentShader, tesselationControlShader, &tesselationEvaluationShader, &geometryShader);
     }
 
+    // Start building a shader program with vertex and fragment shaders, without waiting for the result
+    // Shaders can still be compiling. Use IsBuildComplete to know when IsLinked can be called without stalling
+    void BuildAsync(const Shader& vertexShader, const Shader& fragmentShader);
+
+    // Check if compiling and linking have finished, without blocking
+    // If parallel shader compile is not supported, it is always true, and IsLinked waits for the build
+    bool IsBuildComplete() const;
+
     // Check if shaders have been linked to create a valid program
     bool IsLinked() const;
 
@@ -78,6 +92,15 @@ public:
     // The max length of the string returned is determined by the capacity of the span
     void GetLinkingErrors(std::span<char> errors) const;
 
+    // Request the driver to keep the binary of the program. Must be set before linking
+    void SetBinaryRetrievableHint(bool retrievable);
+
+    // Get the binary of a linked program, to be stored and loaded later. Returns false if not available
+    bool GetBinary(GLenum& format, std::vector<char>& binary) const;
+
+    // Load a binary obtained with GetBinary. Returns false if the driver rejects it, then the program must be built again
+    bool LoadBinary(GLenum format, std::span<const char> binary);
+
     // Find an attribute location by name
     Location GetAttributeLocation(const char* name) const;
 
@@ -113,6 +136,9 @@ public:
     // Set texture value for a texture uniform
     void SetTexture(Location location, GLint textureUnit, const TextureObject& texture) const;
 
+    // Set the unit read by a texture uniform, without using the program. The program keeps it until it is linked again
+    void SetTextureUnit(Location location, GLint textureUnit) const;
+
     // Set the shader program as the active one to be used for rendering
     void Use() const;
 
@@ -138,7 +164,12 @@ private:
     template<typename T, int C, int R>
     void SetUniforms(Location location, const T* values, GLsizei count) const;
 
+    static unsigned int AcquireId();
+    static void ReleaseId(unsigned int id);
+
 private:
+    unsigned int m_id;
+
 #ifndef NDEBUG
     inline bool IsUsed() const { return s_usedHandle == GetHandle(); }
     static Handle s_usedHandle;
@@ -9,7 +9,30 @@
 #include <string>
 #include <cstring>
 #include <memory>
+#include <algorithm>
 
+class RenderStateTracker;
+
+// Typed reference to a uniform of a ShaderUniformCollection, found once by name
+// Setting values with it doesn't search the name again. It must be found again after the shader changes
+template<typename T>
+class UniformHandle
+{
+public:
+    UniformHandle() : m_location(-1) {}
+    explicit UniformHandle(ShaderProgram::Location location) : m_location(location) {}
+
+    // False if the uniform was not found, then setting values does nothing
+    inline bool IsValid() const { return m_location >= 0; }
+
+    inline ShaderProgram::Location GetLocation() const { return m_location; }
+
+private:
+    ShaderProgram::Location m_location;
+};
+
+// Copies of a collection share the uniform list and the values. When a copy modifies a uniform, only that uniform is
+// stored again in the copy, the others are still read from the shared values
 class ShaderUniformCollection
 {
 public:
@@ -24,16 +47,24 @@ public:
     // Get the shader program
     std::shared_ptr<ShaderProgram> GetShaderProgram();
     std::shared_ptr<const ShaderProgram> GetShaderProgram() const;
+    // Without copying the pointer, for the code that runs for each drawcall. The collection must have a shader program
+    inline const ShaderProgram& GetShaderProgramReference() const { return *m_shaderProgram; }
 
     // Reset the material with a different shader
-    void ChangeShader(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms = NameSet());
+    // If keepValues is true, uniforms with the same name, type and size keep their current values
+    void ChangeShader(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms = NameSet(), bool keepValues = false);
 
     // Get the vertex attribute location by name
     ShaderProgram::Location GetAttributeLocation(const char* name) const;
 
     // Get the shader uniform location by name
+    // Names of the active uniforms are found in a table, other names (like array elements) ask the shader program
     ShaderProgram::Location GetUniformLocation(const char* name) const;
 
+    // Get a handle to set the value of a uniform without searching its name
+    template<typename T>
+    UniformHandle<T> GetUniformHandle(const char* name) const;
+
     // Get uniform value for different types, using the name or the uniform location
     template<typename T>
     T GetUniformValue(const char* name) const;
@@ -62,14 +93,26 @@ public:
     template<typename T>
     void SetUniformValues(ShaderProgram::Location location, std::span<const T> value);
 
+    // Get or set a uniform value with a handle. Invalid handles are skipped when setting
+    template<typename T>
+    T GetUniformValue(UniformHandle<T> handle) const;
+    template<typename T>
+    void SetUniformValue(UniformHandle<T> handle, const T& value);
+
     // Get the pointer to the uniform data
     template<typename T>
     T* GetDataUniformPointer(const char* name);
     template<typename T>
     T* GetDataUniformPointer(ShaderProgram::Location location);
 
+    // If the collection has no values of its own, because none was modified since it was copied
+    bool HasSharedValues() const;
+
     // Set all the properties to the shader. Requires the shader program to be in use
     void SetUniforms() const;
+    // Same, but textures are bound with the tracker, skipping the ones already bound to their unit
+    // Each texture uses the unit of its index in the collection, so it stays the same for each shader program
+    void SetUniforms(RenderStateTracker& renderStateTracker) const;
 
 private:
     // Different dimensions of the properties
@@ -106,22 +149,102 @@ private:
         ShaderProgram::Location location;
         // Texture subtype
         TextureObject::Target target;
-        // Shared pointer to the texture object
-        std::shared_ptr<const TextureObject> texture;
+        // Unit the texture is bound to. Set in the program when the uniforms are extracted, only the texture is bound per draw
+        GLint textureUnit;
+    };
+
+    // Location of an active uniform, to find it by name
+    struct UniformName
+    {
+        std::size_t hash;
+        std::string name;
+        ShaderProgram::Location location;
+    };
+
+    // Uniforms of the shader program, shared by all the copies. Only modified while extracting them
+    struct UniformLayout
+    {
+        // The list of data properties
+        std::vector<DataUniform> dataUniforms;
+        // The list of texture properties
+        std::vector<TextureUniform> textureUniforms;
+
+        // Index of the data property in the data list, indexed by location. -1 if the location is not a data property
+        std::vector<int> locationDataIndex;
+        // Index of the texture property in the texture list, indexed by location. -1 if the location is not a texture property
+        std::vector<int> locationTextureIndex;
+
+        // Location of each active uniform, sorted by the hash of the name
+        std::vector<UniformName> uniformNames;
+    };
+
+    // Values of the uniforms, shared by the copies until one of them is modified
+    struct UniformValues
+    {
+        // Buffers that store the values for data properties
+        std::vector<int> intDataValues;
+        std::vector<unsigned int> uintDataValues;
+        std::vector<float> floatDataValues;
+        std::vector<double> doubleDataValues;
+
+        // Texture of each texture property, in the same order as the list
+        std::vector<std::shared_ptr<const TextureObject>> textures;
+    };
+
+    // Uniforms modified by a copy while the values are shared. Copies of the copy share it until they modify a uniform
+    struct UniformOverrides
+    {
+        // Values of the modified uniforms only. Textures are in the same order as the list
+        UniformValues values;
+
+        // Index in the override buffers of each data property, or -1 if it is read from the shared values
+        std::vector<int> dataIndices;
+        // If each texture property is overridden
+        std::vector<unsigned char> textureOverridden;
     };
 
 private:
     // Get a data uniform
-    DataUniform& GetDataUniform(ShaderProgram::Location location);
     const DataUniform& GetDataUniform(ShaderProgram::Location location) const;
 
-    // Get a texture uniform
-    TextureUniform& GetTextureUniform(ShaderProgram::Location location);
-    const TextureUniform& GetTextureUniform(ShaderProgram::Location location) const;
+    // Get the index of a texture uniform, that must exist
+    int GetTextureUniformIndex(ShaderProgram::Location location) const;
+
+    // Get the overrides to modify them, creating them or copying them if they are shared with other collections
+    UniformOverrides& DetachOverrides();
+
+    // Pointer to the values of a data property, in the overrides or in the shared values
+    template<typename T>
+    const T* GetDataPointer(const DataUniform& uniform) const;
+    // Same, to modify them. If the values are shared, the uniform is copied to the overrides first
+    template<typename T>
+    T* GetMutableDataPointer(const DataUniform& uniform);
+
+    // Texture of a texture property, in the overrides or in the shared values
+    const std::shared_ptr<const TextureObject>& GetTexture(int uniformIndex) const;
+    void SetTexture(int uniformIndex, const std::shared_ptr<const TextureObject>& texture);
+
+    // Index of the uniform with this location in the data or texture list. -1 if there is none
+    int FindDataUniformIndex(ShaderProgram::Location location) const;
+    int FindTextureUniformIndex(ShaderProgram::Location location) const;
+
+    // Map a location to an index in one of the lists, growing it as needed
+    static void SetLocationIndex(std::vector<int>& locationIndices, ShaderProgram::Location location, int index);
+
+    // Add the name of an active uniform to the table used by GetUniformLocation
+    void AddUniformName(const char* name, ShaderProgram::Location location);
+
+    // Hash used for the name table
+    static std::size_t HashUniformName(const char* name);
 
     // Read all the uniforms in the shader and store them as properties
-    // Can skip by name those in the filteredUniforms
-    void ExtractUniforms(const NameSet& filteredUniforms = NameSet());
+    // Can skip by name those in the filteredUniforms. Values are copied from previousUniforms, if provided
+    void ExtractUniforms(const NameSet& filteredUniforms = NameSet(), const ShaderUniformCollection* previousUniforms = nullptr);
+
+    // Copy the value of a uniform from another collection, if it has a uniform with the same name, type and size
+    void CopyUniformValue(const ShaderUniformCollection& source, const char* name);
+    template<typename T>
+    void CopyDataValues(const ShaderUniformCollection& source, const DataUniform& sourceUniform, const DataUniform& uniform);
 
     // Check if an OpenGL type is a data type and, if so, return the data type and dimension
     static bool IsDataUniform(GLenum glType, Data::Type& type, UniformDimension& dimension);
@@ -139,13 +262,15 @@ private:
     void UseUniform(const DataUniform& uniform) const;
     template<typename T>
     void UseUniform(const DataUniform& uniform) const;
-    void UseUniform(const TextureUniform& uniform) const;
+    void UseUniform(const TextureUniform& uniform, RenderStateTracker* renderStateTracker) const;
+
+    void SetUniforms(RenderStateTracker* renderStateTracker) const;
 
     // Get the buffer where data values are stored for a certain type
     template<typename T>
-    std::vector<T>& GetDataValues();
+    static std::vector<T>& GetDataValues(UniformValues& values);
     template<typename T>
-    const std::vector<T>& GetDataValues() const;
+    static const std::vector<T>& GetDataValues(const UniformValues& values);
 
     // Get a span of values for a specific uniform
     template<typename T>
@@ -154,6 +279,10 @@ private:
     std::span<const T> GetDataValues(ShaderProgram::Location location) const;
     template<typename T>
     void GetDataValues(ShaderProgram::Location location, std::span<T>& values);
+    template<typename T, int N>
+    void GetDataValues(ShaderProgram::Location location, std::span<glm::vec<N, T>>& values);
+    template<typename T, int C, int R>
+    void GetDataValues(ShaderProgram::Location location, std::span<glm::mat<C, R, T>>& values);
     template<typename T>
     void GetDataValues(ShaderProgram::Location location, std::span<const T>& values) const;
     template<typename T, int N>
@@ -180,21 +309,14 @@ protected:
     std::shared_ptr<ShaderProgram> m_shaderProgram;
 
 private:
-    // The list of data properties
-    std::vector<DataUniform> m_dataUniforms;
-    // The list of texture properties
-    std::vector<TextureUniform> m_textureUniforms;
-
-    // Map to find data properties in the data list
-    std::unordered_map<ShaderProgram::Location, int> m_locationDataIndex;
-    // Map to find texture properties in the texture list
-    std::unordered_map<ShaderProgram::Location, int> m_locationTextureIndex;
-
-    // Buffers that store the values for data properties
-    std::vector<int> m_intDataValues;
-    std::vector<unsigned int> m_uintDataValues;
-    std::vector<float> m_floatDataValues;
-    std::vector<double> m_doubleDataValues;
+    // The uniforms of the shader program, never null
+    std::shared_ptr<UniformLayout> m_layout;
+
+    // The values of the uniforms, never null
+    std::shared_ptr<UniformValues> m_values;
+
+    // The uniforms modified while the values were shared. Null if there are none
+    std::shared_ptr<UniformOverrides> m_overrides;
 };
 
 
@@ -301,21 +423,80 @@ void ShaderUniformCollection::SetUniformValues(ShaderProgram::Location location,
 }
 
 template<typename T>
-inline std::vector<T>& ShaderUniformCollection::GetDataValues()
+UniformHandle<T> ShaderUniformCollection::GetUniformHandle(const char* name) const
+{
+    return UniformHandle<T>(GetUniformLocation(name));
+}
+
+template<typename T>
+inline T ShaderUniformCollection::GetUniformValue(UniformHandle<T> handle) const
+{
+    assert(handle.IsValid());
+    return GetUniformValue<T>(handle.GetLocation());
+}
+
+template<typename T>
+inline void ShaderUniformCollection::SetUniformValue(UniformHandle<T> handle, const T& value)
+{
+    if (handle.IsValid())
+    {
+        SetUniformValue(handle.GetLocation(), value);
+    }
+}
+
+template<typename T>
+inline std::vector<T>& ShaderUniformCollection::GetDataValues(UniformValues& values)
+{
+    return const_cast<std::vector<T>&>(GetDataValues<T>(const_cast<const UniformValues&>(values)));
+}
+
+template<> inline const std::vector<int>& ShaderUniformCollection::GetDataValues(const UniformValues& values) { return values.intDataValues; }
+template<> inline const std::vector<unsigned int>& ShaderUniformCollection::GetDataValues(const UniformValues& values) { return values.uintDataValues; }
+template<> inline const std::vector<float>& ShaderUniformCollection::GetDataValues(const UniformValues& values) { return values.floatDataValues; }
+template<> inline const std::vector<double>& ShaderUniformCollection::GetDataValues(const UniformValues& values) { return values.doubleDataValues; }
+
+template<typename T>
+const T* ShaderUniformCollection::GetDataPointer(const DataUniform& uniform) const
 {
-    return const_cast<std::vector<T>&>(const_cast<const ShaderUniformCollection*>(this)->GetDataValues<T>());
+    if (m_overrides)
+    {
+        int overrideIndex = m_overrides->dataIndices[&uniform - m_layout->dataUniforms.data()];
+        if (overrideIndex >= 0)
+        {
+            return &GetDataValues<T>(m_overrides->values)[overrideIndex];
+        }
+    }
+    return &GetDataValues<T>(*m_values)[uniform.index];
 }
 
-template<> inline const std::vector<int>& ShaderUniformCollection::GetDataValues() const { return m_intDataValues; }
-template<> inline const std::vector<unsigned int>& ShaderUniformCollection::GetDataValues() const { return m_uintDataValues; }
-template<> inline const std::vector<float>& ShaderUniformCollection::GetDataValues() const { return m_floatDataValues; }
-template<> inline const std::vector<double>& ShaderUniformCollection::GetDataValues() const { return m_doubleDataValues; }
+template<typename T>
+T* ShaderUniformCollection::GetMutableDataPointer(const DataUniform& uniform)
+{
+    // Values only used by this collection are modified in place
+    if (!m_overrides && m_values.use_count() == 1)
+    {
+        return &GetDataValues<T>(*m_values)[uniform.index];
+    }
+
+    UniformOverrides& overrides = DetachOverrides();
+    int& overrideIndex = overrides.dataIndices[&uniform - m_layout->dataUniforms.data()];
+    std::vector<T>& overrideValues = GetDataValues<T>(overrides.values);
+    if (overrideIndex < 0)
+    {
+        // Start from the shared value, the caller may modify only part of it
+        const T* sharedValues = &GetDataValues<T>(*m_values)[uniform.index];
+        overrideIndex = static_cast<int>(overrideValues.size());
+        overrideValues.insert(overrideValues.end(), sharedValues, sharedValues + GetDataUniformSize(uniform));
+    }
+    return &overrideValues[overrideIndex];
+}
 
 template<typename T>
 inline std::span<T> ShaderUniformCollection::GetDataValues(ShaderProgram::Location location)
 {
-    std::span<const T> values = const_cast<const ShaderUniformCollection*>(this)->GetDataValues<T>(location);
-    return std::span<T>(const_cast<T*>(values.data()), values.size());
+    std::span<T> values;
+    GetDataValues(location, values);
+    return values;
 }
 
 template<typename T>
@@ -329,9 +510,32 @@ std::span<const T> ShaderUniformCollection::GetDataValues(ShaderProgram::Locatio
 template<typename T>
 void ShaderUniformCollection::GetDataValues(ShaderProgram::Location location, std::span<T>& values)
 {
-    std::span<const T> v;
-    const_cast<const ShaderUniformCollection*>(this)->GetDataValues(location, v);
-    values = std::span<T>(const_cast<T*>(v.data()), v.size());
+    const DataUniform& uniform = GetDataUniform(location);
+    assert(uniform.type == Data::GetType<T>());
+    assert(IsScalar(uniform.dimension));
+    values = std::span(GetMutableDataPointer<T>(uniform), uniform.count);
+}
+
+template<typename T, int N>
+void ShaderUniformCollection::GetDataValues(ShaderProgram::Location location, std::span<glm::vec<N, T>>& values)
+{
+    const DataUniform& uniform = GetDataUniform(location);
+    assert(uniform.type == Data::GetType<T>());
+    assert(IsVector(uniform.dimension));
+    assert(IsVectorSize(uniform.dimension, N));
+    auto dataPtr = reinterpret_cast<glm::vec<N, T>*>(GetMutableDataPointer<T>(uniform));
+    values = std::span(dataPtr, uniform.count);
+}
+
+template<typename T, int C, int R>
+void ShaderUniformCollection::GetDataValues(ShaderProgram::Location location, std::span<glm::mat<C, R, T>>& values)
+{
+    const DataUniform& uniform = GetDataUniform(location);
+    assert(uniform.type == Data::GetType<T>());
+    assert(IsMatrix(uniform.dimension));
+    assert(IsMatrixSize(uniform.dimension, C, R));
+    auto dataPtr = reinterpret_cast<glm::mat<C, R, T>*>(GetMutableDataPointer<T>(uniform));
+    values = std::span(dataPtr, uniform.count);
 }
 
 template<typename T>
@@ -340,9 +544,7 @@ void ShaderUniformCollection::GetDataValues(ShaderProgram::Location location, st
     const DataUniform& uniform = GetDataUniform(location);
     assert(uniform.type == Data::GetType<T>());
     assert(IsScalar(uniform.dimension));
-    const std::vector<T>& allValues = GetDataValues<T>();
-    auto dataPtr = &allValues[uniform.index];
-    values = std::span(dataPtr, uniform.count);
+    values = std::span(GetDataPointer<T>(uniform), uniform.count);
 }
 
 template<typename T, int N>
@@ -352,8 +554,7 @@ void ShaderUniformCollection::GetDataValues(ShaderProgram::Location location, st
     assert(uniform.type == Data::GetType<T>());
     assert(IsVector(uniform.dimension));
     assert(IsVectorSize(uniform.dimension, N));
-    const std::vector<T>& allValues = GetDataValues<T>();
-    auto dataPtr = reinterpret_cast<const glm::vec<N, T>*>(&allValues[uniform.index]);
+    auto dataPtr = reinterpret_cast<const glm::vec<N, T>*>(GetDataPointer<T>(uniform));
     values = std::span(dataPtr, uniform.count);
 }
 
@@ -364,8 +565,7 @@ void ShaderUniformCollection::GetDataValues(ShaderProgram::Location location, st
     assert(uniform.type == Data::GetType<T>());
     assert(IsMatrix(uniform.dimension));
     assert(IsMatrixSize(uniform.dimension, C, R));
-    const std::vector<T>& allValues = GetDataValues<T>();
-    auto dataPtr = reinterpret_cast<const glm::mat<C, R, T>*>(&allValues[uniform.index]);
+    auto dataPtr = reinterpret_cast<const glm::mat<C, R, T>*>(GetDataPointer<T>(uniform));
     values = std::span(dataPtr, uniform.count);
 }
 
@@ -380,23 +580,28 @@ T* ShaderUniformCollection::GetDataUniformPointer(const char* name)
 template<typename T>
 T* ShaderUniformCollection::GetDataUniformPointer(ShaderProgram::Location location)
 {
-    const DataUniform& uniform = GetDataUniform(location);
-    std::vector<T>& allValues = GetDataValues<T>();
-    return &allValues[uniform.index];
+    return GetMutableDataPointer<T>(GetDataUniform(location));
 }
 
 template<typename T>
 void ShaderUniformCollection::AddUniform(const DataUniform& uniform)
 {
-    m_locationDataIndex.insert(std::make_pair(uniform.location, static_cast<int>(m_dataUniforms.size())));
-    m_dataUniforms.push_back(uniform);
+    SetLocationIndex(m_layout->locationDataIndex, uniform.location, static_cast<int>(m_layout->dataUniforms.size()));
+    m_layout->dataUniforms.push_back(uniform);
 
-    std::vector<T>& values = GetDataValues<T>();
-    m_dataUniforms.back().index = static_cast<int>(values.size());
+    std::vector<T>& values = GetDataValues<T>(*m_values);
+    m_layout->dataUniforms.back().index = static_cast<int>(values.size());
     int size = GetDataUniformSize(uniform);
     values.insert(values.end(), size, T());
 }
 
+template<typename T>
+void ShaderUniformCollection::CopyDataValues(const ShaderUniformCollection& source, const DataUniform& sourceUniform, const DataUniform& uniform)
+{
+    const T* sourceValues = source.GetDataPointer<T>(sourceUniform);
+    std::copy(sourceValues, sourceValues + GetDataUniformSize(uniform), GetMutableDataPointer<T>(uniform));
+}
+
 template<>
 void ShaderUniformCollection::UseUniform<float>(const DataUniform& uniform) const;
 
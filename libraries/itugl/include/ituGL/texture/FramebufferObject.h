@@ -50,6 +50,7 @@ enum class FramebufferObject::Target : GLenum
 enum class FramebufferObject::Attachment : GLenum
 {
     Depth = GL_DEPTH_ATTACHMENT,
+    DepthStencil = GL_DEPTH_STENCIL_ATTACHMENT,
     Color0 = GL_COLOR_ATTACHMENT0,
     Color1 = GL_COLOR_ATTACHMENT1,
     Color2 = GL_COLOR_ATTACHMENT2,
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <ituGL/texture/TextureObject.h>
+#include <ituGL/core/Data.h>
+
+// Array of 2D textures with the same size and format. Each layer is sampled with its index as the third coordinate
+class Texture2DArrayObject : public TextureObjectBase<TextureObject::Texture2DArray>
+{
+public:
+    Texture2DArrayObject();
+
+    // Initialize all the layers of the texture2D array with a specific format
+    void SetImage(GLint level,
+        GLsizei width, GLsizei height, GLsizei layerCount,
+        Format format, InternalFormat internalFormat);
+
+    // Copy data to one layer. The image must have been initialized with SetImage
+    template <typename T>
+    void SetLayerImage(GLint level, GLint layer,
+        GLsizei width, GLsizei height,
+        Format format, InternalFormat internalFormat,
+        std::span<const T> data, Data::Type type = Data::Type::None);
+};
+
+// Set layer image with data in bytes
+template <>
+void Texture2DArrayObject::SetLayerImage<std::byte>(GLint level, GLint layer, GLsizei width, GLsizei height, Format format, InternalFormat internalFormat, std::span<const std::byte> data, Data::Type type);
+
+// Template method to set layer image with any kind of data
+template <typename T>
+inline void Texture2DArrayObject::SetLayerImage(GLint level, GLint layer, GLsizei width, GLsizei height,
+    Format format, InternalFormat internalFormat, std::span<const T> data, Data::Type type)
+{
+    if (type == Data::Type::None)
+    {
+        type = Data::GetType<T>();
+    }
+    SetLayerImage(level, layer, width, height, format, internalFormat, Data::GetBytes(data), type);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class DearImGui;
+
+// Counts the heap allocations made with the global operator new, per thread and per tagged scope
+// The library replaces the global operators when built with ITUGL_ALLOCATION_TRACKER, otherwise nothing is counted
+// Tracking starts disabled. While disabled, the only overhead is checking a flag in each allocation
+class AllocationTracker
+{
+public:
+    // Tags the allocations of this thread until destroyed. Scopes can be nested, the innermost tag is used
+    // Tags are compared by address, so they must be string literals or live until the end of the program
+    class Scope
+    {
+    public:
+        Scope(const char* tag);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        void operator = (const Scope&) = delete;
+
+    private:
+        const char* m_previousTag;
+    };
+
+    struct Counters
+    {
+        unsigned int allocationCount = 0;
+        size_t allocatedBytes = 0;
+        unsigned int freeCount = 0;
+    };
+
+    struct SiteReport
+    {
+        const char* tag = nullptr;
+        Counters counters;
+    };
+
+    // Allocations made during one frame
+    struct Report
+    {
+        unsigned int frameIndex = 0;
+        Counters total;
+        // One for each thread that allocated memory since the tracker was enabled, in order of the first allocation
+        std::vector<Counters> threads;
+        // Sites with the most allocations first
+        std::vector<SiteReport> sites;
+    };
+
+    // Check that frames stop allocating memory after a warm-up. Only frames ended while enabled are counted
+    struct SteadyState
+    {
+        unsigned int warmupFrameCount = 0;
+        // Frames since the check started, including the warm-up
+        unsigned int frameCount = 0;
+        // Frames after the warm-up that allocated memory, and their allocations
+        unsigned int allocatingFrameCount = 0;
+        unsigned int allocationCount = 0;
+        // Report of the last of those frames, to find where they allocate
+        Report lastAllocatingReport;
+
+        inline bool IsWarmingUp() const { return frameCount <= warmupFrameCount; }
+        inline bool IsSteady() const { return !IsWarmingUp() && allocatingFrameCount == 0; }
+    };
+
+public:
+    static AllocationTracker& GetInstance();
+
+    bool IsEnabled() const;
+    void SetEnabled(bool enabled);
+
+    // Move the counters to the report of the frame, and reset them
+    void EndFrame();
+
+    // Report of the last frame ended
+    inline const Report& GetReport() const { return m_report; }
+
+    // Start checking the steady state again, after something that is expected to allocate, like loading assets
+    void StartSteadyState(unsigned int warmupFrameCount = 60);
+    inline const SteadyState& GetSteadyState() const { return m_steadyState; }
+
+    // Show the steady state check and the last report
+    void DrawGUI(DearImGui& imGui);
+
+    // Write the steady state check and the last report as text. Returns false if the file could not be written
+    bool SaveReport(const char* path) const;
+
+private:
+    AllocationTracker();
+
+private:
+    Report m_report;
+    unsigned int m_frameIndex;
+
+    SteadyState m_steadyState;
+
+    // Number of sites shown in the report
+    unsigned int m_maxSiteCount;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 class Window;
+class FramePacket;
 
 class DearImGui
 {
@@ -26,6 +27,8 @@ public:
 
     void BeginFrame();
     void EndFrame();
+    // Copy the draw data to the packet, to draw it when the packet is replayed
+    void EndFrame(FramePacket& framePacket);
 
     Window UseWindow(const char* name);
 };
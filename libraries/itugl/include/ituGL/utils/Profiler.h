@@ -0,0 +1,142 @@
+#pragma once
+
+#include <ituGL/core/QueryObject.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+class DearImGui;
+
+// Measures CPU and GPU time of named sections of the frame
+// GPU times are read with a latency of a few frames, to avoid stalling the pipeline
+class Profiler
+{
+public:
+    // Helper object that begins a section when created and ends it when destroyed
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, const char* name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        void operator = (const Scope&) = delete;
+
+    private:
+        Profiler& m_profiler;
+    };
+
+    // Last times of the sections and history of the frame times
+    // Copied to show them in a thread that doesn't own the profiler, as the profiler issues OpenGL queries
+    struct Results
+    {
+        struct Section
+        {
+            std::string name;
+            int parentIndex;
+            float cpuTime;
+            float gpuTime;
+        };
+        std::vector<Section> sections;
+
+        std::vector<float> cpuHistory;
+        std::vector<float> gpuHistory;
+        unsigned int historyIndex = 0;
+
+        inline float GetFrameCpuTime() const { return sections.empty() ? 0.0f : sections[0].cpuTime; }
+        inline float GetFrameGpuTime() const { return sections.empty() ? 0.0f : sections[0].gpuTime; }
+    };
+
+public:
+    Profiler(unsigned int frameLatency = 3);
+
+    // Mark the start and the end of the frame. Sections can only be used between them
+    void BeginFrame();
+    void EndFrame();
+
+    // Start and end a named section. Sections can be nested and used more than once per frame
+    // Sections with the same name under different parents are measured separately
+    void BeginSection(const char* name);
+    void EndSection();
+
+    // Enable or disable GPU timer queries. CPU times are always measured
+    inline bool IsGpuTimingEnabled() const { return m_gpuTimingEnabled; }
+    inline void SetGpuTimingEnabled(bool enabled) { m_gpuTimingEnabled = enabled; }
+
+    // Times in milliseconds of the whole frame. GPU time corresponds to a previous frame
+    float GetFrameCpuTime() const;
+    float GetFrameGpuTime() const;
+
+    // Times in milliseconds of all the sections with this name, 0 if none was found
+    float GetCpuTime(const char* name) const;
+    float GetGpuTime(const char* name) const;
+
+    // Copy the last times, reusing the memory of the results
+    void GetResults(Results& results) const;
+
+    // Show the last times of every section
+    void DrawGUI(DearImGui& imGui);
+    // Same with copied results. Returns true if gpuTimingEnabled was changed, to apply it in the thread of the profiler
+    static bool DrawGUI(DearImGui& imGui, const Results& results, bool& gpuTimingEnabled);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Section
+    {
+        std::string name;
+        int parentIndex;
+        // Last resolved times in milliseconds
+        float cpuTime;
+        float gpuTime;
+        // Time accumulated during the current frame
+        float cpuAccumulated;
+    };
+
+    struct OpenSection
+    {
+        int sectionIndex;
+        Clock::time_point cpuStart;
+        int beginQuery;
+    };
+
+    struct GpuRecord
+    {
+        int sectionIndex;
+        int beginQuery;
+        int endQuery;
+    };
+
+    // Queries issued during one frame, resolved when the slot is reused
+    struct FrameSlot
+    {
+        std::vector<QueryObject> queries;
+        unsigned int usedQueries = 0;
+        std::vector<GpuRecord> records;
+    };
+
+    int FindOrAddSection(const char* name, int parentIndex);
+
+    static void DrawSectionGUI(const Results& results, int sectionIndex, int depth);
+
+    // Record a GPU timestamp in the current slot and return the query index
+    int RecordTimestamp();
+
+    void ResolveSlot(FrameSlot& slot);
+
+private:
+    std::vector<Section> m_sections;
+
+    std::vector<OpenSection> m_openSections;
+
+    std::vector<FrameSlot> m_frameSlots;
+    unsigned int m_currentSlot;
+
+    bool m_gpuTimingEnabled;
+    bool m_inFrame;
+
+    // Frame times history, for plotting
+    std::vector<float> m_cpuHistory;
+    std::vector<float> m_gpuHistory;
+    unsigned int m_historyIndex;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+class DearImGui;
+
+// Chooses a quality level to keep the frame time close to a target budget
+// Level 0 is the highest quality, GetLevelCount() - 1 the lowest
+// Uses hysteresis: quality drops quickly when over budget, and rises slowly when there is headroom
+class QualityGovernor
+{
+public:
+    QualityGovernor(int levelCount, float targetFrameTime = 8.3f);
+
+    inline bool IsEnabled() const { return m_enabled; }
+    inline void SetEnabled(bool enabled) { m_enabled = enabled; }
+
+    inline int GetLevelCount() const { return m_levelCount; }
+    inline int GetLevel() const { return m_level; }
+    void SetLevel(int level);
+
+    // Target frame time, in milliseconds
+    inline float GetTargetFrameTime() const { return m_targetFrameTime; }
+    inline void SetTargetFrameTime(float targetFrameTime) { m_targetFrameTime = targetFrameTime; }
+
+    // Smoothed frame time used for the decisions, in milliseconds
+    inline float GetFilteredFrameTime() const { return m_filteredFrameTime; }
+
+    // Feed the measured CPU and GPU frame times. Returns true if the level changed
+    bool Update(float cpuFrameTime, float gpuFrameTime);
+
+    void DrawGUI(DearImGui& imGui);
+
+private:
+    int m_levelCount;
+    int m_level;
+    bool m_enabled;
+
+    float m_targetFrameTime;
+    float m_filteredFrameTime;
+
+    // Frame time is over budget above target * m_upperThreshold, and has headroom below target * m_lowerThreshold
+    float m_upperThreshold;
+    float m_lowerThreshold;
+
+    // Weight of the new sample in the exponential moving average
+    float m_smoothing;
+
+    // Consecutive frames required before lowering or raising the quality
+    int m_framesToLower;
+    int m_framesToRaise;
+    // Frames ignored after a change, while the new settings settle
+    int m_cooldownFrames;
+
+    int m_overBudgetFrames;
+    int m_underBudgetFrames;
+    int m_cooldown;
+};
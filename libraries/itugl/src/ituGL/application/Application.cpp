@@ -1,15 +1,22 @@
 #include <ituGL/application/Application.h>
 
+#include <ituGL/utils/AllocationTracker.h>
+
 // For breaking execution in debug when an unexpected condition is found
 #include <cassert>
 // For accurate application time
 #include <chrono>
+#include <cmath>
 // For error messages
 #include <iostream>
 
 // DeviceGL and main Window are constructed in the correct order because they were declared like that!
 Application::Application(int width, int height, const char* title)
-    : m_mainWindow(width, height, title), m_currentTime(0), m_deltaTime(0), m_exitCode(0)
+    : m_mainWindow(width, height, title), m_currentTime(0), m_deltaTime(0)
+    , m_fixedAccumulator(0), m_fixedTimeStep(1.0f / 60.0f), m_maxFixedSteps(5), m_fixedAlpha(0), m_pendingFixedAlpha(0)
+    , m_fixedUpdateThreaded(false)
+    , m_renderThreadEnabled(false), m_maxQueuedFrames(2), m_frameIndex(0), m_mainThreadFrameTime(0)
+    , m_exitCode(0)
 {
     // If the main window is not valid, exit with error
     if (!m_mainWindow.IsValid())
@@ -44,6 +51,13 @@ int Application::Run()
     {
         Initialize();
 
+        // From now on, the render thread owns the context
+        if (m_renderThreadEnabled)
+        {
+            m_device.ReleaseContext();
+            m_renderThread = std::make_unique<RenderThread>(m_mainWindow, m_maxQueuedFrames);
+        }
+
         // current time when the application started
         auto startTime = std::chrono::steady_clock::now();
 
@@ -51,18 +65,55 @@ int Application::Run()
         while (IsRunning())
         {
             // set current time relative to start time
-            std::chrono::duration<float> duration = std::chrono::steady_clock::now() - startTime;
+            auto frameStart = std::chrono::steady_clock::now();
+            std::chrono::duration<float> duration = frameStart - startTime;
             UpdateTime(duration.count());
 
-            Update();
+            // Simulation runs in fixed steps, independent of the frame rate
+            RunFixedSteps();
+
+            GetFramePacket().Begin(m_frameIndex++);
+
+            {
+                AllocationTracker::Scope allocationScope("Update");
+                Update();
+            }
+
+            {
+                AllocationTracker::Scope allocationScope("Render");
+                Render();
+            }
+            m_mainThreadFrameTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
 
-            Render();
+            // Replay the frame and swap buffers, here or in the render thread, and poll events at the end of the frame
+            if (m_renderThread)
+            {
+                m_renderThread->Submit();
+            }
+            else
+            {
+                auto replayStart = std::chrono::steady_clock::now();
+                m_framePacket.Execute();
+                m_mainWindow.SwapBuffers();
+                auto replayEnd = std::chrono::steady_clock::now();
 
-            // Swap buffers and poll events at the end of the frame
-            m_mainWindow.SwapBuffers();
+                m_inlineFrameStats.pipelineDepth = 1;
+                m_inlineFrameStats.latency = std::chrono::duration<float, std::milli>(replayEnd - m_framePacket.GetBeginTime()).count();
+                m_inlineFrameStats.replayTime = std::chrono::duration<float, std::milli>(replayEnd - replayStart).count();
+                ++m_inlineFrameStats.presentedFrameCount;
+            }
             m_device.PollEvents();
         }
 
+        // Present the frames in flight, and take back the context
+        if (m_renderThread)
+        {
+            m_renderThread.reset();
+            m_device.MakeContextCurrent(m_mainWindow);
+        }
+
+        WaitFixedSteps();
+
         Cleanup();
     }
 
@@ -74,6 +125,14 @@ void Application::Initialize()
 {
 }
 
+void Application::FixedUpdate()
+{
+}
+
+void Application::PublishSimulation()
+{
+}
+
 void Application::Update()
 {
     if (m_mainWindow.IsKeyPressed(GLFW_KEY_ESCAPE))
@@ -116,6 +175,88 @@ void Application::UpdateTime(float newCurrentTime)
     m_currentTime = newCurrentTime;
 }
 
+void Application::SetRenderThreadEnabled(bool enabled, unsigned int maxQueuedFrames)
+{
+    // The context can't change threads in the middle of the loop
+    assert(!m_renderThread);
+    m_renderThreadEnabled = enabled;
+    m_maxQueuedFrames = maxQueuedFrames;
+}
+
+RenderThread::Stats Application::GetRenderThreadStats() const
+{
+    return m_renderThread ? m_renderThread->GetStats() : m_inlineFrameStats;
+}
+
+void Application::SetFixedUpdateThreaded(bool threaded)
+{
+    // Steps already running finish with the previous mode
+    WaitFixedSteps();
+    m_fixedUpdateThreaded = threaded;
+}
+
+void Application::RunFixedSteps()
+{
+    // Steps of the previous frame must finish before publishing them
+    WaitFixedSteps();
+
+    m_fixedAccumulator += m_deltaTime;
+    unsigned int stepCount = static_cast<unsigned int>(m_fixedAccumulator / m_fixedTimeStep);
+    if (stepCount > m_maxFixedSteps)
+    {
+        // Too far behind: drop the time that doesn't fit, instead of taking longer and longer to catch up
+        m_fixedUpdateStats.droppedStepCount += stepCount - m_maxFixedSteps;
+        stepCount = m_maxFixedSteps;
+        m_fixedAccumulator = std::fmod(m_fixedAccumulator, m_fixedTimeStep);
+    }
+    else
+    {
+        m_fixedAccumulator -= stepCount * m_fixedTimeStep;
+    }
+    float stepAlpha = m_fixedAccumulator / m_fixedTimeStep;
+
+    if (m_fixedUpdateThreaded)
+    {
+        // Publish the steps of the previous frame, and start the new ones
+        m_fixedAlpha = m_pendingFixedAlpha;
+        m_fixedUpdateStats.stepCount = m_runningFixedUpdateStats.stepCount;
+        m_fixedUpdateStats.stepTime = m_runningFixedUpdateStats.stepTime;
+        PublishSimulation();
+
+        m_pendingFixedAlpha = stepAlpha;
+        JobSystem::GetInstance().Run([this, stepCount]() { RunFixedSteps(stepCount); }, &m_fixedUpdateCounter);
+    }
+    else
+    {
+        RunFixedSteps(stepCount);
+
+        m_fixedAlpha = stepAlpha;
+        m_fixedUpdateStats.stepCount = m_runningFixedUpdateStats.stepCount;
+        m_fixedUpdateStats.stepTime = m_runningFixedUpdateStats.stepTime;
+        PublishSimulation();
+    }
+}
+
+void Application::WaitFixedSteps()
+{
+    JobSystem::GetInstance().Wait(m_fixedUpdateCounter);
+}
+
+void Application::RunFixedSteps(unsigned int stepCount)
+{
+    AllocationTracker::Scope allocationScope("FixedUpdate");
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int step = 0; step < stepCount; ++step)
+    {
+        FixedUpdate();
+    }
+
+    std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+    m_runningFixedUpdateStats.stepCount = stepCount;
+    m_runningFixedUpdateStats.stepTime = duration.count();
+}
+
 bool Application::IsRunning() const
 {
     // Run while the window is valid and it has not been requested to close
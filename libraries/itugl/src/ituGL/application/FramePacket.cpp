@@ -0,0 +1,49 @@
+#include <ituGL/application/FramePacket.h>
+
+FramePacket::FramePacket()
+    : m_firstCommand(nullptr)
+    , m_lastCommand(nullptr)
+    , m_commandCount(0)
+    , m_frameIndex(0)
+    , m_beginTime(std::chrono::steady_clock::now())
+{
+}
+
+FramePacket::~FramePacket()
+{
+    Clear();
+}
+
+void FramePacket::Begin(unsigned int frameIndex)
+{
+    Clear();
+    m_frameIndex = frameIndex;
+    m_beginTime = std::chrono::steady_clock::now();
+}
+
+void FramePacket::Execute() const
+{
+    for (Command* command = m_firstCommand; command; command = command->next)
+    {
+        command->execute(*command);
+    }
+}
+
+void FramePacket::Clear()
+{
+    Command* command = m_firstCommand;
+    while (command)
+    {
+        // Not readable after the command is destroyed
+        Command* next = command->next;
+        if (command->destroy)
+        {
+            command->destroy(*command);
+        }
+        command = next;
+    }
+    m_firstCommand = nullptr;
+    m_lastCommand = nullptr;
+    m_commandCount = 0;
+    m_arena.Reset();
+}
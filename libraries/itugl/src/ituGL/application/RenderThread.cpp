@@ -0,0 +1,116 @@
+#include <ituGL/application/RenderThread.h>
+
+#include <ituGL/core/DeviceGL.h>
+#include <ituGL/core/JobSystem.h>
+#include <ituGL/application/Window.h>
+#include <cassert>
+
+static float GetMilliseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<float, std::milli>(duration).count();
+}
+
+RenderThread::RenderThread(Window& window, unsigned int maxQueuedFrames)
+    : m_window(window)
+    , m_maxQueuedFrames(maxQueuedFrames)
+    , m_submittedCount(0)
+    , m_takenCount(0)
+    , m_replaying(false)
+    , m_stop(false)
+{
+    assert(maxQueuedFrames > 0);
+    for (unsigned int packetIndex = 0; packetIndex < maxQueuedFrames + 2; ++packetIndex)
+    {
+        m_packets.push_back(std::make_unique<FramePacket>());
+    }
+    m_thread = std::thread(&RenderThread::ThreadLoop, this);
+}
+
+RenderThread::~RenderThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_submitCondition.notify_one();
+    m_thread.join();
+}
+
+void RenderThread::Submit()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // The previous submit already waited for this slot
+    assert(m_submittedCount - m_takenCount < m_maxQueuedFrames);
+    ++m_submittedCount;
+    m_stats.pipelineDepth = static_cast<unsigned int>(m_submittedCount - m_takenCount) + (m_replaying ? 1 : 0);
+    lock.unlock();
+    m_submitCondition.notify_one();
+
+    // Wait for the slot of the next frame now, before its input is polled, and not after it is recorded
+    // Otherwise the input would be one frame older when presented, and the render thread would not be busier
+    auto start = std::chrono::steady_clock::now();
+    lock.lock();
+    m_presentCondition.wait(lock, [this]() { return m_submittedCount - m_takenCount < m_maxQueuedFrames; });
+    m_stats.submitWaitTime = GetMilliseconds(std::chrono::steady_clock::now() - start);
+}
+
+void RenderThread::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_presentCondition.wait(lock, [this]() { return m_submittedCount == m_takenCount && !m_replaying; });
+}
+
+RenderThread::Stats RenderThread::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void RenderThread::ThreadLoop()
+{
+    DeviceGL& device = DeviceGL::GetInstance();
+    device.MakeContextCurrent(m_window);
+
+    // The jobs of the frame, like recording command lists, don't share a queue with the ones of the main thread
+    JobSystem& jobSystem = JobSystem::GetInstance();
+    jobSystem.RegisterThread();
+
+    while (true)
+    {
+        FramePacket* framePacket;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_submitCondition.wait(lock, [this]() { return m_stop || m_submittedCount > m_takenCount; });
+
+            // Frames already submitted are presented before stopping
+            if (m_submittedCount == m_takenCount)
+            {
+                break;
+            }
+            // The main thread records at most maxQueuedFrames packets ahead, so it does not reach this one until it is presented
+            framePacket = m_packets[m_takenCount % m_packets.size()].get();
+            ++m_takenCount;
+            m_replaying = true;
+        }
+        // A slot in the queue is free now
+        m_presentCondition.notify_all();
+
+        auto start = std::chrono::steady_clock::now();
+        framePacket->Execute();
+        m_window.SwapBuffers();
+        auto end = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_replaying = false;
+            m_stats.replayTime = GetMilliseconds(end - start);
+            m_stats.latency = GetMilliseconds(end - framePacket->GetBeginTime());
+            ++m_stats.presentedFrameCount;
+        }
+        m_presentCondition.notify_all();
+    }
+
+    jobSystem.UnregisterThread();
+    device.ReleaseContext();
+}
@@ -3,15 +3,21 @@
 #include <ituGL/geometry/VertexFormat.h>
 #include <ituGL/shader/Material.h>
 #include <ituGL/asset/Texture2DLoader.h>
+#include <ituGL/core/JobSystem.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <glm/common.hpp>
 #include <iostream>
 #include <bit>
+#include <cmath>
+#include <algorithm>
 
 ModelLoader::ModelLoader(std::shared_ptr<Material> referenceMaterial)
     : m_referenceMaterial(referenceMaterial)
     , m_createMaterials(false)
+    , m_useTextureArrays(false)
+    , m_maxTextureArrayLayers(0)
 {
     m_textureLoader.SetGenerateMipmap(true);
 }
@@ -49,6 +55,81 @@ const Texture2DLoader& ModelLoader::GetTexture2DLoader() const
     return m_textureLoader;
 }
 
+bool ModelLoader::GetUseTextureArrays() const
+{
+    return m_useTextureArrays;
+}
+
+void ModelLoader::SetUseTextureArrays(bool useTextureArrays)
+{
+    m_useTextureArrays = useTextureArrays;
+}
+
+void ModelLoader::BuildTextureArrays()
+{
+    for (TextureArray& textureArray : m_textureArrays)
+    {
+        GLsizei layerCount = static_cast<GLsizei>(textureArray.layerPaths.size());
+        if (layerCount == textureArray.builtLayerCount)
+        {
+            continue;
+        }
+
+        // Layers added after the last build need new storage, so all the layers are uploaded again
+        Texture2DArrayObject& texture = *textureArray.texture;
+        texture.Bind();
+        texture.SetImage(0, textureArray.width, textureArray.height, layerCount, textureArray.format, textureArray.internalFormat);
+
+        // Images are decoded in parallel, and uploaded from this thread, that owns the context
+        struct LayerData
+        {
+            std::span<const std::byte> data;
+            int width, height;
+            Data::Type dataType;
+        };
+        std::vector<LayerData> layers(layerCount);
+        bool flipVertical = m_textureLoader.GetFlipVertical();
+        JobSystem::GetInstance().ParallelFor(0, layers.size(), 1, [&](size_t begin, size_t end)
+            {
+                for (size_t layer = begin; layer < end; ++layer)
+                {
+                    LayerData& layerData = layers[layer];
+                    layerData.data = TextureLoaderUtils::LoadTexture2DData(textureArray.layerPaths[layer].c_str(), layerData.width, layerData.height, layerData.dataType,
+                        textureArray.format, textureArray.internalFormat, flipVertical);
+                }
+            });
+
+        for (GLsizei layer = 0; layer < layerCount; ++layer)
+        {
+            const LayerData& layerData = layers[layer];
+            assert(!layerData.data.empty());
+            if (!layerData.data.empty())
+            {
+                assert(layerData.width == textureArray.width && layerData.height == textureArray.height);
+                texture.SetLayerImage<std::byte>(0, layer, layerData.width, layerData.height, textureArray.format, textureArray.internalFormat, layerData.data, layerData.dataType);
+                TextureLoaderUtils::FreeTexture2DData(layerData.data);
+            }
+        }
+
+        // Same sampling as the textures loaded separately
+        texture.SetParameter(TextureObject::ParameterEnum::MinFilter, GL_LINEAR);
+        texture.SetParameter(TextureObject::ParameterEnum::MagFilter, GL_LINEAR);
+        if (m_textureLoader.GetGenerateMipmap())
+        {
+            // Mipmaps are generated for each layer separately, so layers don't bleed into each other
+            texture.GenerateMipmap();
+            texture.SetParameter(TextureObject::ParameterEnum::MinFilter, GL_LINEAR_MIPMAP_LINEAR);
+            texture.SetParameter(TextureObject::ParameterFloat::MinLod, 0.0f);
+            float maxLod = 1.0f + std::floor(std::log2(static_cast<float>(std::max(textureArray.width, textureArray.height))));
+            texture.SetParameter(TextureObject::ParameterFloat::MaxLod, maxLod);
+        }
+
+        Texture2DArrayObject::Unbind();
+
+        textureArray.builtLayerCount = layerCount;
+    }
+}
+
 bool ModelLoader::SetMaterialAttribute(VertexAttribute::Semantic semantic, const char* attributeName)
 {
     bool found = false;
@@ -93,14 +174,19 @@ Model ModelLoader::Load(const char* path)
         for (unsigned int meshIndex = 0; meshIndex < scene->mNumMeshes; ++meshIndex)
         {
             aiMesh& meshData = *scene->mMeshes[meshIndex];
-            GenerateSubmesh(mesh, meshData);
 
             std::shared_ptr<Material> material = m_referenceMaterial;
+            glm::vec3 textureLayers(0.0f);
             if (m_createMaterials)
             {
                 // Create a new material with the material data
-                material = GenerateMaterial(*scene->mMaterials[meshData.mMaterialIndex]);
+                material = GenerateMaterial(*scene->mMaterials[meshData.mMaterialIndex], textureLayers);
             }
+
+            // The layers are vertex data, so they don't make materials with the same arrays different
+            bool addTextureLayers = m_createMaterials && m_useTextureArrays && m_materialAttributeMap.contains(VertexAttribute::Semantic::TextureLayers);
+            GenerateSubmesh(mesh, meshData, addTextureLayers ? &textureLayers : nullptr);
+
             model.AddMaterial(material);
         }
     }
@@ -108,12 +194,12 @@ Model ModelLoader::Load(const char* path)
     return model;
 }
 
-void ModelLoader::GenerateSubmesh(Mesh& mesh, const aiMesh& meshData)
+void ModelLoader::GenerateSubmesh(Mesh& mesh, const aiMesh& meshData, const glm::vec3* textureLayers)
 {
     // Collect vertex data
     VertexFormat vertexFormat;
     bool interleaved = true;
-    std::vector<GLubyte> vertexData = CollectVertexData(meshData, vertexFormat, interleaved);
+    std::vector<GLubyte> vertexData = CollectVertexData(meshData, vertexFormat, interleaved, textureLayers);
     int vboIndex = mesh.AddVertexData<GLubyte>(vertexData);
 
     // Collect element data
@@ -123,6 +209,16 @@ void ModelLoader::GenerateSubmesh(Mesh& mesh, const aiMesh& meshData)
     std::vector<GLubyte> elementData = CollectElementData(meshData, elementType, primitives, elementCounts);
     int eboIndex = mesh.AddElementData<GLubyte>(elementData);
 
+    // Bounding box of the vertices, shared by all the submeshes
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    for (unsigned int vertexIndex = 0; vertexIndex < meshData.mNumVertices; ++vertexIndex)
+    {
+        const aiVector3D& vertex = meshData.mVertices[vertexIndex];
+        glm::vec3 position(vertex.x, vertex.y, vertex.z);
+        boundsMin = vertexIndex == 0 ? position : glm::min(boundsMin, position);
+        boundsMax = vertexIndex == 0 ? position : glm::max(boundsMax, position);
+    }
+
     // Add submeshes
     int start = 0;
     assert(primitives.size() == elementCounts.size());
@@ -130,15 +226,18 @@ void ModelLoader::GenerateSubmesh(Mesh& mesh, const aiMesh& meshData)
     {
         Drawcall::Primitive primitive = primitives[i];
         int end = elementCounts[i];
-        mesh.AddSubmesh(primitive, start, end - start, elementType, eboIndex, vboIndex, vertexFormat.LayoutBegin(static_cast<int>(vertexData.size()), interleaved), vertexFormat.LayoutEnd(), m_materialAttributeMap);
+        unsigned int submeshIndex = mesh.AddSubmesh(primitive, start, end - start, elementType, eboIndex, vboIndex, vertexFormat.LayoutBegin(static_cast<int>(vertexData.size()), interleaved), vertexFormat.LayoutEnd(), m_materialAttributeMap);
+        mesh.SetSubmeshBounds(submeshIndex, boundsMin, boundsMax);
         start = end;
     }
 }
 
-std::shared_ptr<Material> ModelLoader::GenerateMaterial(const aiMaterial& materialData)
+std::shared_ptr<Material> ModelLoader::GenerateMaterial(const aiMaterial& materialData, glm::vec3& textureLayers)
 {
-    std::shared_ptr<Material> material = std::make_shared<Material>(*m_referenceMaterial);
+    // Read all the values first, to find a generated material with the same ones
+    MaterialValues values;
     float value;
+    std::shared_ptr<const TextureObject> texture;
     for (auto& materialPropertyPair : m_materialPropertyMap)
     {
         aiColor3D color;
@@ -149,44 +248,81 @@ std::shared_ptr<Material> ModelLoader::GenerateMaterial(const aiMaterial& materi
         case MaterialProperty::AmbientColor:
             if (materialData.Get(AI_MATKEY_COLOR_AMBIENT, color) == aiReturn_SUCCESS)
             {
-                material->SetUniformValue(location, glm::vec3(color.r, color.g, color.b));
+                values.vectorValues.emplace_back(location, glm::vec3(color.r, color.g, color.b));
             }
             break;
         case MaterialProperty::DiffuseColor:
             if (materialData.Get(AI_MATKEY_COLOR_DIFFUSE, color) == aiReturn_SUCCESS)
             {
-                material->SetUniformValue(location, glm::vec3(color.r, color.g, color.b));
+                values.vectorValues.emplace_back(location, glm::vec3(color.r, color.g, color.b));
             }
             break;
         case MaterialProperty::SpecularColor:
             if (materialData.Get(AI_MATKEY_COLOR_SPECULAR, color) == aiReturn_SUCCESS)
             {
-                material->SetUniformValue(location, glm::vec3(color.r, color.g, color.b));
+                values.vectorValues.emplace_back(location, glm::vec3(color.r, color.g, color.b));
             }
             break;
         case MaterialProperty::SpecularExponent:
             if (materialData.Get(AI_MATKEY_SHININESS, value) == aiReturn_SUCCESS)
             {
-                material->SetUniformValue(location, value);
+                values.floatValues.emplace_back(location, value);
             }
             break;
         case MaterialProperty::DiffuseTexture:
-            LoadTexture(materialData, aiTextureType_DIFFUSE, *material, location, TextureObject::FormatRGBA, TextureObject::InternalFormatSRGBA8);
+            texture = LoadTexture(materialData, aiTextureType_DIFFUSE, TextureObject::FormatRGBA, TextureObject::InternalFormatSRGBA8, textureLayers.x);
+            if (texture)
+            {
+                values.textureValues.emplace_back(location, texture);
+            }
             break;
         case MaterialProperty::NormalTexture:
-            LoadTexture(materialData, aiTextureType_NORMALS, *material, location, TextureObject::FormatRGB, TextureObject::InternalFormatRGB8);
+            texture = LoadTexture(materialData, aiTextureType_NORMALS, TextureObject::FormatRGB, TextureObject::InternalFormatRGB8, textureLayers.y);
+            if (texture)
+            {
+                values.textureValues.emplace_back(location, texture);
+            }
             break;
         case MaterialProperty::SpecularTexture:
-            LoadTexture(materialData, aiTextureType_SHININESS, *material, location, TextureObject::FormatRGB, TextureObject::InternalFormatSRGB8);
+            texture = LoadTexture(materialData, aiTextureType_SHININESS, TextureObject::FormatRGB, TextureObject::InternalFormatSRGB8, textureLayers.z);
+            if (texture)
+            {
+                values.textureValues.emplace_back(location, texture);
+            }
             break;
         }
     }
+
+    auto itMaterial = std::find_if(m_generatedMaterials.begin(), m_generatedMaterials.end(),
+        [&](const auto& generatedMaterial) { return generatedMaterial.first == values; });
+    if (itMaterial != m_generatedMaterials.end())
+    {
+        return itMaterial->second;
+    }
+
+    // Submaterials read the values of the reference material, and only store the uniforms they set themselves
+    std::shared_ptr<Material> material = std::make_shared<Material>(std::shared_ptr<const Material>(m_referenceMaterial));
+    for (const auto& [location, vectorValue] : values.vectorValues)
+    {
+        material->SetUniformValue(location, vectorValue);
+    }
+    for (const auto& [location, floatValue] : values.floatValues)
+    {
+        material->SetUniformValue(location, floatValue);
+    }
+    for (const auto& [location, textureValue] : values.textureValues)
+    {
+        material->SetUniformValue(location, textureValue);
+    }
+
+    m_generatedMaterials.emplace_back(std::move(values), material);
     return material;
 }
 
-void ModelLoader::LoadTexture(const aiMaterial& materialData, int textureTypeValue, Material& material, ShaderProgram::Location location,
-    TextureObject::Format format, TextureObject::InternalFormat internalFormat) const
+std::shared_ptr<const TextureObject> ModelLoader::LoadTexture(const aiMaterial& materialData, int textureTypeValue,
+    TextureObject::Format format, TextureObject::InternalFormat internalFormat, float& layer)
 {
+    std::shared_ptr<const TextureObject> texture;
     aiTextureType textureType = static_cast<aiTextureType>(textureTypeValue);
     if (materialData.GetTextureCount(textureType) > 0)
     {
@@ -195,15 +331,73 @@ void ModelLoader::LoadTexture(const aiMaterial& materialData, int textureTypeVal
         if (materialData.GetTexture(textureType, 0, &texturePath) == aiReturn_SUCCESS)
         {
             texturePath = m_baseFolder + texturePath.C_Str();
-            m_textureLoader.SetFormat(format);
-            m_textureLoader.SetInternalFormat(internalFormat);
-            std::shared_ptr<Texture2DObject> texture = m_textureLoader.LoadShared(texturePath.C_Str());
-            material.SetUniformValue(location, texture);
+            if (m_useTextureArrays)
+            {
+                int arrayLayer = 0;
+                texture = AddTextureArrayLayer(texturePath.C_Str(), format, internalFormat, arrayLayer);
+                layer = static_cast<float>(arrayLayer);
+            }
+            else
+            {
+                m_textureLoader.SetFormat(format);
+                m_textureLoader.SetInternalFormat(internalFormat);
+                texture = m_textureLoader.LoadShared(texturePath.C_Str());
+            }
+        }
+    }
+    return texture;
+}
+
+std::shared_ptr<Texture2DArrayObject> ModelLoader::AddTextureArrayLayer(const std::string& path,
+    TextureObject::Format format, TextureObject::InternalFormat internalFormat, int& layer)
+{
+    // Textures shared by several materials use the same layer
+    auto key = std::make_tuple(path, format, internalFormat);
+    auto itFind = m_textureArrayLayers.find(key);
+    if (itFind != m_textureArrayLayers.end())
+    {
+        layer = itFind->second.second;
+        return m_textureArrays[itFind->second.first].texture;
+    }
+
+    // Only the size is read now, the data is loaded in BuildTextureArrays
+    int width, height;
+    if (!TextureLoaderUtils::GetTexture2DSize(path.c_str(), width, height))
+    {
+        return nullptr;
+    }
+
+    if (m_maxTextureArrayLayers == 0)
+    {
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &m_maxTextureArrayLayers);
+    }
+
+    // Find an array with the same size and format that is not full
+    size_t arrayIndex = 0;
+    for (; arrayIndex < m_textureArrays.size(); ++arrayIndex)
+    {
+        const TextureArray& textureArray = m_textureArrays[arrayIndex];
+        if (textureArray.width == width && textureArray.height == height &&
+            textureArray.format == format && textureArray.internalFormat == internalFormat &&
+            textureArray.layerPaths.size() < static_cast<size_t>(m_maxTextureArrayLayers))
+        {
+            break;
         }
     }
+    if (arrayIndex == m_textureArrays.size())
+    {
+        m_textureArrays.push_back(TextureArray{ std::make_shared<Texture2DArrayObject>(), width, height, format, internalFormat, {}, 0 });
+    }
+
+    TextureArray& textureArray = m_textureArrays[arrayIndex];
+    layer = static_cast<int>(textureArray.layerPaths.size());
+    textureArray.layerPaths.push_back(path);
+    m_textureArrayLayers[key] = std::make_pair(arrayIndex, layer);
+
+    return textureArray.texture;
 }
 
-std::vector<GLubyte> ModelLoader::CollectVertexData(const aiMesh& meshData, VertexFormat& vertexFormat, bool interleaved)
+std::vector<GLubyte> ModelLoader::CollectVertexData(const aiMesh& meshData, VertexFormat& vertexFormat, bool interleaved, const glm::vec3* textureLayers)
 {
     vertexFormat.Clear();
 
@@ -232,6 +426,10 @@ std::vector<GLubyte> ModelLoader::CollectVertexData(const aiMesh& meshData, Vert
     {
         vertexFormat.AddVertexAttribute<float>(meshData.mNumUVComponents[uvChannel], static_cast<VertexAttribute::Semantic>(uvSemantic + uvChannel));
     }
+    if (textureLayers)
+    {
+        vertexFormat.AddVertexAttribute<float>(3, VertexAttribute::Semantic::TextureLayers);
+    }
 
     std::vector<GLubyte> vertexData;
     vertexData.resize(vertexFormat.GetSize() * meshData.mNumVertices);
@@ -246,6 +444,11 @@ std::vector<GLubyte> ModelLoader::CollectVertexData(const aiMesh& meshData, Vert
         void* dstBuffer = &vertexData[it->GetOffset()];
         int srcStride = 0;
         const void* srcBuffer = GetVertexDataPointer(meshData, attribute.GetSemantic(), srcStride);
+        if (attribute.GetSemantic() == VertexAttribute::Semantic::TextureLayers)
+        {
+            // Same value for all the vertices, with stride 0
+            srcBuffer = textureLayers;
+        }
         assert(srcBuffer);
         CopyBuffer(dstBuffer, dstStride, srcBuffer, srcStride, meshData.mNumVertices, attribute.GetSize());
     }
@@ -351,6 +554,8 @@ const void* ModelLoader::GetVertexDataPointer(const aiMesh& meshData, VertexAttr
             stride = sizeof(*meshData.mColors[0]);
         }
         break;
+    case VertexAttribute::Semantic::TextureLayers:
+        // Not in the mesh data, it comes from the material
     case VertexAttribute::Semantic::Unknown:
         // Do nothing
         break;
@@ -1,7 +1,6 @@
 #include <ituGL/asset/ShaderLoader.h>
 
 #include <fstream>
-#include <sstream>
 #include <vector>
 #include <array>
 #include <cassert>
@@ -25,34 +24,70 @@ bool ShaderLoader::IsValid(std::span<const char*> paths)
 Shader ShaderLoader::Load(const char* path)
 {
     Shader shader(m_type);
-    std::ifstream file(path);
-    assert(file.is_open());
-    std::stringstream stringStream;
-    stringStream << file.rdbuf() << '\0';
-    shader.SetSource(stringStream.str().c_str());
+    std::string source = ReadFile(path);
+    shader.SetSource(source.c_str());
     Compile(shader);
     return shader;
 }
 
 Shader ShaderLoader::Load(std::span<const char*> paths)
+{
+    return Load(paths, nullptr);
+}
+
+Shader ShaderLoader::Load(std::span<const char*> paths, const char* injectedSource)
+{
+    std::vector<std::string> sources = ReadSources(paths, injectedSource);
+    return LoadFromSources(sources);
+}
+
+Shader ShaderLoader::LoadFromSources(std::span<const std::string> sources, bool async)
 {
     Shader shader(m_type);
-    std::vector<std::stringstream> stringStreams(paths.size());
-    std::vector<std::string> sourceCodeStrings(paths.size());
-    std::vector<const char*> sourceCode(paths.size());
-    for (int i = 0; i < paths.size(); ++i)
+    std::vector<const char*> sourceCode;
+    for (const std::string& source : sources)
     {
-        std::ifstream file(paths[i]);
-        assert(file.is_open());
-        stringStreams[i] << file.rdbuf() << '\0';
-        sourceCodeStrings[i] = stringStreams[i].str();
-        sourceCode[i] = sourceCodeStrings[i].c_str();
+        sourceCode.push_back(source.c_str());
     }
     shader.SetSource(sourceCode);
-    Compile(shader);
+    if (async)
+    {
+        shader.CompileAsync();
+    }
+    else
+    {
+        Compile(shader);
+    }
     return shader;
 }
 
+std::vector<std::string> ShaderLoader::ReadSources(std::span<const char*> paths, const char* injectedSource)
+{
+    std::vector<std::string> sources;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        sources.push_back(ReadFile(paths[i]));
+
+        // Injected code goes after the #version directive
+        if (i == 0 && injectedSource)
+        {
+            sources.push_back(injectedSource);
+        }
+    }
+    return sources;
+}
+
+std::string ShaderLoader::ReadFile(const char* path)
+{
+    // Read the whole file at once, directly into the string
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    assert(file.is_open());
+    std::string source(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(source.data(), source.size());
+    return source;
+}
+
 Shader* ShaderLoader::LoadNew(std::span<const char*> paths)
 {
     Shader* shader = nullptr;
@@ -0,0 +1,235 @@
+#include <ituGL/asset/ShaderProgramCache.h>
+
+#include <ituGL/asset/ShaderLoader.h>
+#include <ituGL/shader/ShaderProgram.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+// Written at the start of each file, followed by the binary format and the binary
+static constexpr std::uint32_t s_binaryMagic = 0x42505449; // "ITPB"
+
+// 64-bit FNV-1a, continuing from a previous hash
+static std::uint64_t HashBytes(std::uint64_t hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static std::uint64_t HashString(std::uint64_t hash, const std::string& string)
+{
+    // Include the terminator, so the boundaries between strings are part of the hash
+    return HashBytes(hash, string.c_str(), string.size() + 1);
+}
+
+ShaderProgramCache::ShaderProgramCache(const char* directory)
+    : m_directory(directory ? directory : "")
+    , m_driverInitialized(false)
+    , m_binariesSupported(false)
+    , m_loadedCount(0)
+    , m_compiledCount(0)
+    , m_buildTime(0.0f)
+{
+    if (IsEnabled())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+    }
+}
+
+bool ShaderProgramCache::Build(ShaderProgram& shaderProgram, std::span<const char*> vertexShaderPaths, std::span<const char*> fragmentShaderPaths,
+    const char* injectedSource)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::uint64_t key = 0;
+    bool linked = BeginBuild(shaderProgram, vertexShaderPaths, fragmentShaderPaths, injectedSource, false, key);
+    if (!linked)
+    {
+        linked = shaderProgram.IsLinked();
+        if (linked && key != 0)
+        {
+            StoreBinary(shaderProgram, key);
+        }
+    }
+
+    std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+    m_buildTime += duration.count();
+
+    return linked;
+}
+
+void ShaderProgramCache::BuildAsync(ShaderProgram& shaderProgram, std::span<const char*> vertexShaderPaths, std::span<const char*> fragmentShaderPaths,
+    const char* injectedSource)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::uint64_t key = 0;
+    if (!BeginBuild(shaderProgram, vertexShaderPaths, fragmentShaderPaths, injectedSource, true, key) && key != 0)
+    {
+        m_pendingKeys[&shaderProgram] = key;
+    }
+
+    // Only the submission is measured here, the driver compiles in the background
+    std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+    m_buildTime += duration.count();
+}
+
+bool ShaderProgramCache::CompleteBuild(ShaderProgram& shaderProgram)
+{
+    bool linked = shaderProgram.IsLinked();
+
+    auto itFind = m_pendingKeys.find(&shaderProgram);
+    if (itFind != m_pendingKeys.end())
+    {
+        if (linked)
+        {
+            StoreBinary(shaderProgram, itFind->second);
+        }
+        m_pendingKeys.erase(itFind);
+    }
+
+    return linked;
+}
+
+bool ShaderProgramCache::BeginBuild(ShaderProgram& shaderProgram, std::span<const char*> vertexShaderPaths, std::span<const char*> fragmentShaderPaths,
+    const char* injectedSource, bool async, std::uint64_t& key)
+{
+    InitializeDriver();
+
+    std::vector<std::string> vertexSources = ShaderLoader::ReadSources(vertexShaderPaths, injectedSource);
+    std::vector<std::string> fragmentSources = ShaderLoader::ReadSources(fragmentShaderPaths, injectedSource);
+
+    bool useBinaries = IsEnabled() && m_binariesSupported;
+    key = useBinaries ? ComputeKey(vertexSources, fragmentSources) : 0;
+
+    if (useBinaries && LoadBinary(shaderProgram, key))
+    {
+        ++m_loadedCount;
+        return true;
+    }
+
+    Shader vertexShader = ShaderLoader(Shader::VertexShader).LoadFromSources(vertexSources, async);
+    Shader fragmentShader = ShaderLoader(Shader::FragmentShader).LoadFromSources(fragmentSources, async);
+
+    if (useBinaries)
+    {
+        shaderProgram.SetBinaryRetrievableHint(true);
+    }
+    if (async)
+    {
+        shaderProgram.BuildAsync(vertexShader, fragmentShader);
+    }
+    else
+    {
+        shaderProgram.Build(vertexShader, fragmentShader);
+    }
+    ++m_compiledCount;
+
+    return false;
+}
+
+void ShaderProgramCache::InitializeDriver()
+{
+    if (m_driverInitialized)
+    {
+        return;
+    }
+    m_driverInitialized = true;
+
+    const char* vendor = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+    const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    m_driver = std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    m_binariesSupported = formatCount > 0;
+}
+
+std::uint64_t ShaderProgramCache::ComputeKey(std::span<const std::string> vertexSources, std::span<const std::string> fragmentSources) const
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    hash = HashString(hash, m_driver);
+
+    // Stage tags, so moving a file from one stage to the other changes the key
+    hash = HashString(hash, "vertex");
+    for (const std::string& source : vertexSources)
+    {
+        hash = HashString(hash, source);
+    }
+    hash = HashString(hash, "fragment");
+    for (const std::string& source : fragmentSources)
+    {
+        hash = HashString(hash, source);
+    }
+    return hash;
+}
+
+std::string ShaderProgramCache::GetPath(std::uint64_t key) const
+{
+    char fileName[32];
+    std::snprintf(fileName, sizeof(fileName), "%016llx.bin", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(m_directory) / fileName).string();
+}
+
+bool ShaderProgramCache::LoadBinary(ShaderProgram& shaderProgram, std::uint64_t key) const
+{
+    std::ifstream file(GetPath(key), std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    std::streamoff fileSize = file.tellg();
+    std::streamoff headerSize = sizeof(std::uint32_t) * 2;
+    if (fileSize <= headerSize)
+    {
+        return false;
+    }
+    file.seekg(0);
+
+    std::uint32_t magic = 0;
+    std::uint32_t format = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    if (magic != s_binaryMagic)
+    {
+        return false;
+    }
+
+    std::vector<char> binary(static_cast<size_t>(fileSize - headerSize));
+    file.read(binary.data(), binary.size());
+    if (!file)
+    {
+        return false;
+    }
+
+    // The driver can still reject it, for example after an update that keeps the same version string
+    return shaderProgram.LoadBinary(static_cast<GLenum>(format), binary);
+}
+
+void ShaderProgramCache::StoreBinary(const ShaderProgram& shaderProgram, std::uint64_t key) const
+{
+    GLenum format = 0;
+    std::vector<char> binary;
+    if (!shaderProgram.GetBinary(format, binary))
+    {
+        return;
+    }
+
+    std::ofstream file(GetPath(key), std::ios::binary | std::ios::trunc);
+    if (file.is_open())
+    {
+        std::uint32_t magic = s_binaryMagic;
+        std::uint32_t binaryFormat = static_cast<std::uint32_t>(format);
+        file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        file.write(reinterpret_cast<const char*>(&binaryFormat), sizeof(binaryFormat));
+        file.write(binary.data(), binary.size());
+    }
+}
@@ -2,6 +2,7 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include <algorithm>
 
 std::span<const std::byte> TextureLoaderUtils::LoadTexture2DData(const char* path, int& width, int& height, Data::Type& dataType, TextureObject::Format format, TextureObject::InternalFormat internalFormat, bool flipVertical)
 {
@@ -10,9 +11,6 @@ std::span<const std::byte> TextureLoaderUtils::LoadTexture2DData(const char* pat
     int componentCount = TextureObject::GetComponentCount(format);
     int originalComponentCount;
 
-    // Set flip vertical on load if needed
-    stbi_set_flip_vertically_on_load(flipVertical ? 1 : 0);
-
     if (IsHDR(internalFormat))
     {
         float* data = stbi_loadf(path, &width, &height, &originalComponentCount, componentCount);
@@ -27,6 +25,18 @@ std::span<const std::byte> TextureLoaderUtils::LoadTexture2DData(const char* pat
         dataSpan = Data::GetBytes(dataSpanByte);
         dataType = Data::Type::UByte;
     }
+
+    // Flipped here instead of with the global flag of stb_image, so images can be loaded from several threads
+    if (flipVertical && !dataSpan.empty())
+    {
+        std::byte* bytes = const_cast<std::byte*>(dataSpan.data());
+        size_t rowSize = dataSpan.size() / height;
+        for (int row = 0; row < height / 2; ++row)
+        {
+            std::swap_ranges(bytes + row * rowSize, bytes + (row + 1) * rowSize, bytes + (height - 1 - row) * rowSize);
+        }
+    }
+
     return dataSpan;
 }
 
@@ -36,6 +46,12 @@ void TextureLoaderUtils::FreeTexture2DData(std::span<const std::byte> data)
     stbi_image_free(const_cast<void*>(dataPtr));
 }
 
+bool TextureLoaderUtils::GetTexture2DSize(const char* path, int& width, int& height)
+{
+    int componentCount;
+    return stbi_info(path, &width, &height, &componentCount) != 0;
+}
+
 bool TextureLoaderUtils::IsHDR(TextureObject::InternalFormat internalFormat)
 {
     switch (internalFormat)
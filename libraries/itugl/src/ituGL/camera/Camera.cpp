@@ -68,3 +68,12 @@ void Camera::ExtractVectors(glm::vec3& right, glm::vec3& up, glm::vec3& forward)
     up = transposed[1];
     forward = transposed[2];
 }
+
+void Camera::ExtractNearFar(float& near, float& far) const
+{
+    // Depth terms of glm::perspective: [2][2] = -(far + near) / (far - near), [3][2] = -2 * far * near / (far - near)
+    float depthScale = m_projMatrix[2][2];
+    float depthOffset = m_projMatrix[3][2];
+    near = depthOffset / (depthScale - 1.0f);
+    far = depthOffset / (depthScale + 1.0f);
+}
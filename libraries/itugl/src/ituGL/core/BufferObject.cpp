@@ -63,3 +63,18 @@ void BufferObject::UpdateData(std::span<const std::byte> data, size_t offset)
     Target target = GetTarget();
     glBufferSubData(target, offset, data.size_bytes(), data.data());
 }
+
+// Get buffer Target and read the buffer data
+void BufferObject::GetData(std::span<std::byte> data, size_t offset) const
+{
+    assert(IsBound());
+    Target target = GetTarget();
+    glGetBufferSubData(target, offset, data.size_bytes(), data.data());
+}
+
+// Bind the buffer handle to the binding point of the indexed target
+void BufferObject::BindBase(Target indexedTarget, GLuint index) const
+{
+    assert(indexedTarget == ShaderStorageBuffer);
+    glBindBufferBase(indexedTarget, index, GetHandle());
+}
@@ -3,10 +3,11 @@
 #include <ituGL/application/Window.h>
 #include <GLFW/glfw3.h>
 #include <cassert>
+#include <cstring>
 
 DeviceGL* DeviceGL::m_instance = nullptr;
 
-DeviceGL::DeviceGL() : m_contextLoaded(false)
+DeviceGL::DeviceGL() : m_contextLoaded(false), m_parallelShaderCompileSupported(false), m_computeSupported(false)
 {
     m_instance = this;
 
@@ -27,6 +28,7 @@ void DeviceGL::SetCurrentWindow(Window& window)
 {
     GLFWwindow* glfwWindow = window.GetInternalWindow();
     glfwMakeContextCurrent(glfwWindow);
+    m_contextThread = std::this_thread::get_id();
 
     // Load required GL libraries and initialize the context
     m_contextLoaded = gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
@@ -35,6 +37,63 @@ void DeviceGL::SetCurrentWindow(Window& window)
     {
         // Set callback to be called when the window is resized
         glfwSetFramebufferSizeCallback(glfwWindow, FrameBufferResized);
+
+        InitializeParallelShaderCompile();
+
+        // Set by the loader with the version of the context that was created
+        m_computeSupported = GLAD_GL_VERSION_4_3 != 0;
+    }
+}
+
+void DeviceGL::MakeContextCurrent(Window& window)
+{
+    assert(m_contextLoaded);
+    glfwMakeContextCurrent(window.GetInternalWindow());
+    m_contextThread = std::this_thread::get_id();
+}
+
+void DeviceGL::ReleaseContext()
+{
+    glfwMakeContextCurrent(nullptr);
+    m_contextThread = std::thread::id();
+}
+
+// Check if the context supports an extension
+bool DeviceGL::IsExtensionSupported(const char* name) const
+{
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; ++i)
+    {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Let the driver use as many threads as it wants to compile shaders, if supported
+void DeviceGL::InitializeParallelShaderCompile()
+{
+    using MaxShaderCompilerThreadsFunction = void (APIENTRYP)(GLuint count);
+    MaxShaderCompilerThreadsFunction maxShaderCompilerThreads = nullptr;
+
+    if (IsExtensionSupported("GL_KHR_parallel_shader_compile"))
+    {
+        maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsFunction>(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    }
+    else if (IsExtensionSupported("GL_ARB_parallel_shader_compile"))
+    {
+        maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsFunction>(glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
+    }
+
+    m_parallelShaderCompileSupported = maxShaderCompilerThreads != nullptr;
+    if (m_parallelShaderCompileSupported)
+    {
+        // 0xFFFFFFFF lets the implementation choose the number of threads
+        maxShaderCompilerThreads(0xFFFFFFFF);
     }
 }
 
@@ -53,7 +112,8 @@ void DeviceGL::PollEvents()
 // Callback called when the framebuffer changes size
 void DeviceGL::FrameBufferResized(GLFWwindow* window, GLsizei width, GLsizei height)
 {
-    if (m_instance)
+    // Events are polled in the main thread. If the context is in another thread, the recorded frames set the viewport
+    if (m_instance && m_instance->m_contextThread == std::this_thread::get_id())
     {
         // Adjust the viewport when the framebuffer is resized
         m_instance->SetViewport(0, 0, width, height);
@@ -0,0 +1,73 @@
+#include <ituGL/core/FrameArena.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t initialCapacity)
+    : m_currentBlock(0)
+    , m_offset(0)
+{
+    if (initialCapacity > 0)
+    {
+        AddBlock(initialCapacity);
+    }
+    m_stats.heapAllocationCount = 0;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    // Alignment must be a power of 2
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    // Look for space in the current block, and then in the next ones
+    while (m_currentBlock < m_blocks.size())
+    {
+        Block& block = m_blocks[m_currentBlock];
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block.data.get()) + m_offset;
+        size_t padding = (alignment - address % alignment) % alignment;
+        if (m_offset + padding + size <= block.size)
+        {
+            m_offset += padding + size;
+            m_stats.usedSize += padding + size;
+            m_stats.allocationCount++;
+            return block.data.get() + m_offset - size;
+        }
+
+        m_currentBlock++;
+        m_offset = 0;
+    }
+
+    // The new block is at least as big as all the others together, so a frame does not add many blocks
+    AddBlock(std::max(size + alignment, m_stats.capacity));
+    return Allocate(size, alignment);
+}
+
+void FrameArena::Reset()
+{
+    // Merge the blocks, so the next frames fit in one
+    if (m_blocks.size() > 1)
+    {
+        size_t capacity = m_stats.capacity;
+        m_blocks.clear();
+        m_stats.capacity = 0;
+        AddBlock(capacity);
+        m_stats.heapAllocationCount = 1;
+    }
+    else
+    {
+        m_stats.heapAllocationCount = 0;
+    }
+
+    m_currentBlock = 0;
+    m_offset = 0;
+    m_stats.usedSize = 0;
+    m_stats.allocationCount = 0;
+}
+
+void FrameArena::AddBlock(size_t size)
+{
+    m_blocks.push_back(Block{ std::make_unique<std::byte[]>(size), size });
+    m_stats.capacity += size;
+    m_stats.heapAllocationCount++;
+}
@@ -0,0 +1,306 @@
+#include <ituGL/core/JobSystem.h>
+
+#include <cassert>
+
+// Worker of the current thread, if it belongs to a system
+static thread_local const JobSystem* s_currentSystem = nullptr;
+static thread_local unsigned int s_currentWorkerIndex = 0;
+
+JobSystem::JobSystem(unsigned int workerCount)
+    : m_queuedJobCount(0)
+    , m_stop(false)
+    , m_statsStart(std::chrono::steady_clock::now().time_since_epoch().count())
+{
+    if (workerCount == 0)
+    {
+        // Threads outside the system don't steal, so the jobs left in their queues need a thread to run them
+        workerCount = std::max(std::thread::hardware_concurrency(), 2u);
+    }
+
+    for (unsigned int workerIndex = 0; workerIndex < workerCount + MAX_REGISTERED_THREADS; ++workerIndex)
+    {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->jobCount = 0;
+        worker->stealCount = 0;
+        worker->busyNanoseconds = 0;
+        worker->registered = false;
+        m_workers.push_back(std::move(worker));
+    }
+
+    // Worker 0 is for the threads outside the system, and the registered threads go after the threads of the system
+    m_threadCount = workerCount - 1;
+    for (unsigned int workerIndex = 1; workerIndex < workerCount; ++workerIndex)
+    {
+        m_threads.emplace_back(&JobSystem::WorkerLoop, this, workerIndex);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wakeCondition.notify_all();
+
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+    assert(m_queuedJobCount == 0);
+}
+
+JobSystem& JobSystem::GetInstance()
+{
+    static JobSystem instance;
+    return instance;
+}
+
+void JobSystem::Run(Function function, Counter* counter)
+{
+    if (counter)
+    {
+        counter->m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    Push(Job{ std::move(function), counter });
+}
+
+void JobSystem::Run(Function function, Counter& dependency, Counter* counter)
+{
+    if (counter)
+    {
+        counter->m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+        // The count only gets to zero while the mutex is locked, so the job is either added here or queued now
+        std::lock_guard<std::mutex> lock(dependency.m_mutex);
+        if (!dependency.IsDone())
+        {
+            dependency.m_continuations.emplace_back(std::move(function), counter);
+            return;
+        }
+    }
+    Push(Job{ std::move(function), counter });
+}
+
+void JobSystem::Wait(Counter& counter)
+{
+    // Help with the queued jobs instead of blocking. They may be unrelated to the counter
+    unsigned int workerIndex = GetCurrentWorkerIndex();
+    while (!counter.IsDone())
+    {
+        if (!TryRunJob(workerIndex))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // Wait until the thread that finished the last job releases the counter
+    std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::RegisterThread()
+{
+    assert(s_currentSystem != this);
+    for (unsigned int workerIndex = m_threadCount + 1; workerIndex < m_workers.size(); ++workerIndex)
+    {
+        bool registered = false;
+        if (m_workers[workerIndex]->registered.compare_exchange_strong(registered, true))
+        {
+            s_currentSystem = this;
+            s_currentWorkerIndex = workerIndex;
+            return;
+        }
+    }
+    assert(false && "Too many registered threads");
+}
+
+void JobSystem::UnregisterThread()
+{
+    assert(s_currentSystem == this && !IsSystemThread(s_currentWorkerIndex));
+
+    // Jobs still queued are stolen by the threads of the system
+    m_workers[s_currentWorkerIndex]->registered = false;
+    s_currentSystem = nullptr;
+    s_currentWorkerIndex = 0;
+}
+
+JobSystem::WorkerStats JobSystem::GetWorkerStats(unsigned int workerIndex) const
+{
+    assert(workerIndex < m_workers.size());
+    const Worker& worker = *m_workers[workerIndex];
+
+    WorkerStats stats;
+    stats.jobCount = worker.jobCount;
+    stats.stealCount = worker.stealCount;
+    stats.busyTime = worker.busyNanoseconds * 1e-6f;
+
+    std::chrono::steady_clock::time_point statsStart(std::chrono::steady_clock::duration(m_statsStart.load()));
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - statsStart;
+    stats.utilization = elapsed.count() > 0.0f ? std::min(stats.busyTime / elapsed.count(), 1.0f) : 0.0f;
+    return stats;
+}
+
+void JobSystem::ResetStats()
+{
+    for (std::unique_ptr<Worker>& worker : m_workers)
+    {
+        worker->jobCount = 0;
+        worker->stealCount = 0;
+        worker->busyNanoseconds = 0;
+    }
+    m_statsStart = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+void JobSystem::WorkerLoop(unsigned int workerIndex)
+{
+    s_currentSystem = this;
+    s_currentWorkerIndex = workerIndex;
+
+    while (true)
+    {
+        if (TryRunJob(workerIndex))
+        {
+            continue;
+        }
+
+        // Sleep until there are jobs queued
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeCondition.wait(lock, [this]() { return m_stop || m_queuedJobCount > 0; });
+        if (m_stop)
+        {
+            break;
+        }
+    }
+}
+
+unsigned int JobSystem::GetCurrentWorkerIndex() const
+{
+    return s_currentSystem == this ? s_currentWorkerIndex : 0;
+}
+
+void JobSystem::Push(Job job)
+{
+    Worker& worker = *m_workers[GetCurrentWorkerIndex()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.jobs.PushBack(std::move(job));
+    }
+    m_queuedJobCount.fetch_add(1);
+
+    // Lock before notifying, so a worker that just found the queues empty doesn't miss it
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeCondition.notify_one();
+}
+
+bool JobSystem::TryRunJob(unsigned int workerIndex)
+{
+    Job job;
+    bool found = false;
+    bool stolen = false;
+
+    // Newest job of the own queue first, as its data is more likely in cache
+    {
+        Worker& worker = *m_workers[workerIndex];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.jobs.IsEmpty())
+        {
+            job = worker.jobs.PopBack();
+            found = true;
+        }
+    }
+
+    // Oldest job of the other queues, starting with the next worker so thieves spread out
+    // Threads outside the system only steal if there are no threads in the system to run the jobs
+    bool steal = IsSystemThread(workerIndex) || m_threadCount == 0;
+    unsigned int workerCount = GetWorkerCount();
+    for (unsigned int offset = 1; steal && !found && offset < workerCount; ++offset)
+    {
+        Worker& victim = *m_workers[(workerIndex + offset) % workerCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.IsEmpty())
+        {
+            job = victim.jobs.PopFront();
+            found = stolen = true;
+        }
+    }
+
+    if (!found)
+    {
+        return false;
+    }
+    m_queuedJobCount.fetch_sub(1);
+
+    auto start = std::chrono::steady_clock::now();
+    job.function();
+    std::chrono::nanoseconds duration = std::chrono::steady_clock::now() - start;
+
+    Worker& worker = *m_workers[workerIndex];
+    worker.jobCount.fetch_add(1, std::memory_order_relaxed);
+    worker.busyNanoseconds.fetch_add(duration.count(), std::memory_order_relaxed);
+    if (stolen)
+    {
+        worker.stealCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (job.counter)
+    {
+        FinishJob(*job.counter);
+    }
+    return true;
+}
+
+void JobSystem::FinishJob(Counter& counter)
+{
+    std::vector<std::pair<Function, Counter*>> continuations;
+    {
+        std::lock_guard<std::mutex> lock(counter.m_mutex);
+        if (counter.m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            continuations.swap(counter.m_continuations);
+        }
+    }
+
+    // The counter may be gone now, only the local copy is used
+    for (auto& continuation : continuations)
+    {
+        Push(Job{ std::move(continuation.first), continuation.second });
+    }
+}
+
+void JobSystem::JobQueue::PushBack(Job job)
+{
+    // Full, move the jobs in order to a bigger ring
+    if (m_count == m_jobs.size())
+    {
+        std::vector<Job> jobs(std::max<size_t>(2 * m_jobs.size(), 16));
+        for (size_t jobIndex = 0; jobIndex < m_count; ++jobIndex)
+        {
+            jobs[jobIndex] = std::move(m_jobs[(m_first + jobIndex) % m_jobs.size()]);
+        }
+        m_jobs = std::move(jobs);
+        m_first = 0;
+    }
+
+    m_jobs[(m_first + m_count) % m_jobs.size()] = std::move(job);
+    ++m_count;
+}
+
+JobSystem::Job JobSystem::JobQueue::PopBack()
+{
+    assert(m_count > 0);
+    --m_count;
+    return std::move(m_jobs[(m_first + m_count) % m_jobs.size()]);
+}
+
+JobSystem::Job JobSystem::JobQueue::PopFront()
+{
+    assert(m_count > 0);
+    Job job = std::move(m_jobs[m_first]);
+    m_first = (m_first + 1) % m_jobs.size();
+    --m_count;
+    return job;
+}
@@ -0,0 +1,74 @@
+#include <ituGL/core/QueryObject.h>
+
+#include <cassert>
+#include <utility>
+
+QueryObject::QueryObject(Target target) : Object(NullHandle), m_target(target)
+{
+    Handle& handle = GetHandle();
+    glGenQueries(1, &handle);
+}
+
+QueryObject::~QueryObject()
+{
+    Handle& handle = GetHandle();
+    if (handle != NullHandle)
+    {
+        glDeleteQueries(1, &handle);
+    }
+}
+
+QueryObject::QueryObject(QueryObject&& queryObject) noexcept : Object(std::move(queryObject)), m_target(queryObject.m_target)
+{
+}
+
+QueryObject& QueryObject::operator = (QueryObject&& queryObject) noexcept
+{
+    Object::operator=(std::move(queryObject));
+    m_target = queryObject.m_target;
+    return *this;
+}
+
+void QueryObject::Bind() const
+{
+    Begin();
+}
+
+void QueryObject::Begin() const
+{
+    assert(m_target != Target::Timestamp);
+    glBeginQuery(static_cast<GLenum>(m_target), GetHandle());
+}
+
+void QueryObject::End() const
+{
+    assert(m_target != Target::Timestamp);
+    glEndQuery(static_cast<GLenum>(m_target));
+}
+
+void QueryObject::QueryCounter() const
+{
+    assert(m_target == Target::Timestamp);
+    glQueryCounter(GetHandle(), GL_TIMESTAMP);
+}
+
+bool QueryObject::IsResultAvailable() const
+{
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(GetHandle(), GL_QUERY_RESULT_AVAILABLE, &available);
+    return available != GL_FALSE;
+}
+
+GLuint64 QueryObject::GetResult() const
+{
+    GLuint64 result = 0;
+    glGetQueryObjectui64v(GetHandle(), GL_QUERY_RESULT, &result);
+    return result;
+}
+
+bool QueryObject::IsAnyActive(Target target)
+{
+    GLint handle = NullHandle;
+    glGetQueryiv(static_cast<GLenum>(target), GL_CURRENT_QUERY, &handle);
+    return handle != NullHandle;
+}
@@ -0,0 +1,6 @@
+#include <ituGL/core/ShaderStorageBufferObject.h>
+
+ShaderStorageBufferObject::ShaderStorageBufferObject()
+{
+    // Nothing to do here, it is done by the base class
+}
@@ -0,0 +1,18 @@
+#include <ituGL/geometry/DrawIndirectBufferObject.h>
+
+DrawIndirectBufferObject::DrawIndirectBufferObject()
+{
+    // Nothing to do here, it is done by the base class
+}
+
+// Call the base implementation with the span converted to bytes
+void DrawIndirectBufferObject::AllocateData(std::span<const ElementsCommand> commands, Usage usage)
+{
+    AllocateData(Data::GetBytes(commands), usage);
+}
+
+// Call the base implementation with the span converted to bytes
+void DrawIndirectBufferObject::GetData(std::span<ElementsCommand> commands, size_t offsetBytes) const
+{
+    GetData(Data::GetBytes(commands), offsetBytes);
+}
@@ -42,3 +42,44 @@ void Drawcall::Draw() const
         glDrawElements(primitive, m_count, static_cast<GLenum>(m_eboType), basePointer + m_first);
     }
 }
+
+// Same as Draw, with the instanced version of each call
+void Drawcall::DrawInstanced(GLsizei instanceCount) const
+{
+    assert(IsValid());
+    assert(VertexArrayObject::IsAnyBound());
+    assert(instanceCount >= 0);
+
+    GLenum primitive = static_cast<GLenum>(m_primitive);
+    if (m_eboType == Data::Type::None)
+    {
+        glDrawArraysInstanced(primitive, m_first, m_count, instanceCount);
+    }
+    else
+    {
+        assert(ElementBufferObject::IsSupportedType(m_eboType));
+        const char* basePointer = nullptr; // Actual element pointer is in VAO
+        glDrawElementsInstanced(primitive, m_count, static_cast<GLenum>(m_eboType), basePointer + m_first, instanceCount);
+    }
+}
+
+DrawIndirectBufferObject::ElementsCommand Drawcall::GetElementsCommand(GLuint instanceCount, GLuint baseInstance) const
+{
+    assert(IsValid());
+    assert(ElementBufferObject::IsSupportedType(m_eboType));
+
+    // The first element is stored as an offset in bytes, the command counts elements
+    GLuint firstIndex = static_cast<GLuint>(m_first) / Data::GetTypeSize(m_eboType);
+    return DrawIndirectBufferObject::ElementsCommand{ static_cast<GLuint>(m_count), instanceCount, firstIndex, 0, baseInstance };
+}
+
+void Drawcall::MultiDrawIndirect(GLintptr offset, GLsizei drawCount) const
+{
+    assert(IsValid());
+    assert(VertexArrayObject::IsAnyBound());
+    assert(ElementBufferObject::IsSupportedType(m_eboType));
+
+    // Actual commands are in the bound draw indirect buffer, tightly packed
+    const char* basePointer = nullptr;
+    glMultiDrawElementsIndirect(static_cast<GLenum>(m_primitive), static_cast<GLenum>(m_eboType), basePointer + offset, drawCount, 0);
+}
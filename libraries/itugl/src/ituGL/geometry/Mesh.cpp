@@ -26,6 +26,7 @@ unsigned int Mesh::AddSubmesh(unsigned int vaoIndex, const Drawcall& drawcall)
     Submesh& submesh = m_submeshes.emplace_back();
     submesh.vaoIndex = vaoIndex;
     submesh.drawcall = drawcall;
+    submesh.hasBounds = false;
     return submeshIndex;
 }
 
@@ -35,6 +36,22 @@ unsigned int Mesh::AddSubmesh(unsigned int vaoIndex,
     return AddSubmesh(vaoIndex, Drawcall(primitive, count, eboType, first));
 }
 
+bool Mesh::GetSubmeshBounds(unsigned int submeshIndex, glm::vec3& boundsMin, glm::vec3& boundsMax) const
+{
+    const Submesh& submesh = GetSubmesh(submeshIndex);
+    boundsMin = submesh.boundsMin;
+    boundsMax = submesh.boundsMax;
+    return submesh.hasBounds;
+}
+
+void Mesh::SetSubmeshBounds(unsigned int submeshIndex, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    Submesh& submesh = GetSubmesh(submeshIndex);
+    submesh.hasBounds = true;
+    submesh.boundsMin = boundsMin;
+    submesh.boundsMax = boundsMax;
+}
+
 // Bind the VAO and render the drawcall of the submesh
 void Mesh::DrawSubmesh(int submeshIndex) const
 {
@@ -39,6 +39,11 @@ const Material& Model::GetMaterial(unsigned int index) const
     return *m_materials[index];
 }
 
+std::shared_ptr<const Material> Model::GetSharedMaterial(unsigned int index) const
+{
+    return m_materials[index];
+}
+
 void Model::SetMaterial(unsigned int index, std::shared_ptr<Material> material)
 {
     m_materials[index] = material;
@@ -81,3 +81,10 @@ void VertexArrayObject::SetAttribute(GLuint location, const VertexAttribute& att
     // Finally, we enable the VertexAttribute in this location
     glEnableVertexAttribArray(location);
 }
+
+void VertexArrayObject::SetAttributeDivisor(GLuint location, GLuint divisor)
+{
+    assert(IsBound());
+
+    glVertexAttribDivisor(location, divisor);
+}
@@ -0,0 +1,121 @@
+#include <ituGL/renderer/CommandList.h>
+
+#include <ituGL/renderer/Renderer.h>
+#include <ituGL/geometry/VertexArrayObject.h>
+#include <ituGL/geometry/Drawcall.h>
+#include <cassert>
+
+CommandList::CommandList() : m_lastVAO(nullptr)
+{
+}
+
+void CommandList::UseMaterial(const Material& material, Material::OverrideFlags overrideFlags)
+{
+    Command command{};
+    command.type = CommandType::UseMaterial;
+    command.flags = static_cast<unsigned char>(overrideFlags);
+    command.material = &material;
+    m_commands.push_back(command);
+}
+
+void CommandList::UpdateTransforms(const Material& material, unsigned int worldMatrixIndex)
+{
+    Command command{};
+    command.type = CommandType::UpdateTransforms;
+    command.index = worldMatrixIndex;
+    command.material = &material;
+    m_commands.push_back(command);
+}
+
+void CommandList::SetWorldMatrix(ShaderProgram::Location location, unsigned int worldMatrixIndex)
+{
+    Command command{};
+    command.type = CommandType::SetWorldMatrix;
+    command.index = worldMatrixIndex;
+    command.location = location;
+    m_commands.push_back(command);
+}
+
+void CommandList::BindVertexArray(const VertexArrayObject& vao)
+{
+    if (m_lastVAO == &vao)
+    {
+        return;
+    }
+
+    Command command{};
+    command.type = CommandType::BindVertexArray;
+    command.vao = &vao;
+    m_commands.push_back(command);
+    m_lastVAO = &vao;
+}
+
+void CommandList::Draw(const Drawcall& drawcall)
+{
+    Command command{};
+    command.type = CommandType::Draw;
+    command.drawcall = &drawcall;
+    m_commands.push_back(command);
+}
+
+void CommandList::DrawLightPasses(const Drawcall& drawcall)
+{
+    Command command{};
+    command.type = CommandType::DrawLightPasses;
+    command.drawcall = &drawcall;
+    m_commands.push_back(command);
+}
+
+void CommandList::Execute(Renderer& renderer) const
+{
+    // Program of the last material used, for the light passes
+    const Material* currentMaterial = nullptr;
+
+    for (const Command& command : m_commands)
+    {
+        switch (command.type)
+        {
+        case CommandType::UseMaterial:
+            command.material->Use(renderer.GetRenderStateTracker(), static_cast<Material::OverrideFlags>(command.flags));
+            currentMaterial = command.material;
+            break;
+        case CommandType::UpdateTransforms:
+            renderer.UpdateTransforms(command.material->GetShaderProgramReference(), command.index);
+            break;
+        case CommandType::SetWorldMatrix:
+            glUniformMatrix4fv(command.location, 1, GL_FALSE, &renderer.GetWorldMatrix(command.index)[0][0]);
+            break;
+        case CommandType::BindVertexArray:
+            command.vao->Bind();
+            break;
+        case CommandType::Draw:
+            command.drawcall->Draw();
+            break;
+        case CommandType::DrawLightPasses:
+        {
+            assert(currentMaterial);
+            const ShaderProgram& shaderProgram = currentMaterial->GetShaderProgramReference();
+
+            // The lights function advances the light index by the lights it consumed
+            bool firstPass = true;
+            unsigned int lightIndex = 0;
+            while (renderer.UpdateLights(shaderProgram, renderer.GetLights(), lightIndex))
+            {
+                renderer.SetLightingRenderStates(firstPass);
+                command.drawcall->Draw();
+                firstPass = false;
+            }
+            break;
+        }
+        default:
+            assert(false);
+            break;
+        }
+    }
+}
+
+void CommandList::Clear()
+{
+    m_commands.clear();
+    m_lastVAO = nullptr;
+}
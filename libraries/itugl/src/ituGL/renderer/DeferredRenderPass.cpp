@@ -1,61 +1,350 @@
 #include <ituGL/renderer/DeferredRenderPass.h>
 
 #include <ituGL/renderer/Renderer.h>
-#include <ituGL/geometry/VertexFormat.h>
+#include <ituGL/geometry/VertexAttribute.h>
 #include <ituGL/lighting/Light.h>
 #include <ituGL/camera/Camera.h>
 #include <ituGL/shader/Material.h>
-#include <ituGL/texture/Texture2DObject.h>
-#include <glm/gtx/transform.hpp>
+#include <ituGL/asset/ShaderLoader.h>
+#include <glm/trigonometric.hpp>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+
+// Resolution of the volume meshes
+static constexpr unsigned int s_sphereRings = 8;
+static constexpr unsigned int s_sphereSegments = 12;
+static constexpr unsigned int s_coneSegments = 12;
+
+// Wider spot lights use the sphere, that covers fewer pixels than a very flat cone
+static constexpr float s_maxConeAngle = 1.3f;
 
 DeferredRenderPass::DeferredRenderPass(std::shared_ptr<Material> material, std::shared_ptr<const FramebufferObject> framebuffer)
     : RenderPass(framebuffer), m_material(material)
+    , m_stencilViewProjMatrixLocation(-1)
+    , m_stencilTestEnabled(true)
 {
+    SetName("Deferred");
+
     InitializeMeshes();
+
+    // Same fragment shader as the depth pre-pass, the volumes only write the stencil
+    Shader vertexShader = ShaderLoader(Shader::VertexShader).Load("shaders/renderer/light_volume.vert");
+    Shader fragmentShader = ShaderLoader(Shader::FragmentShader).Load("shaders/renderer/depth_prepass.frag");
+    m_stencilShaderProgram.Build(vertexShader, fragmentShader);
+
+    m_stencilViewProjMatrixLocation = m_stencilShaderProgram.GetUniformLocation("ViewProjMatrix");
 }
 
 void DeferredRenderPass::Render()
 {
     Renderer& renderer = GetRenderer();
+    DeviceGL& device = renderer.GetDevice();
+    RenderStateTracker& renderStateTracker = renderer.GetRenderStateTracker();
 
-    renderer.GetDevice().Clear(true, Color(0.0f, 0.0f, 0.0f, 1.0f), false, 1.0f);
+    m_stats = Stats();
 
     const Camera& camera = renderer.GetCurrentCamera();
-
-    assert(m_material);
-    m_material->Use();
-    std::shared_ptr<const ShaderProgram> shaderProgram = m_material->GetShaderProgram();
+    const glm::mat4& viewProjMatrix = camera.GetViewProjectionMatrix();
 
     // Our fullscreen triangle is directly in clip coordinates.
     // Use the inverse view proj matrix to cancel view projection from the camera
-    glm::mat4 fullscreenMatrix = glm::inverse(camera.GetViewProjectionMatrix());
+    AddLightInstances(renderer.GetLights(), glm::inverse(viewProjMatrix));
+
+    // The material provides the program and the G-buffer textures. Blending, depth and stencil are set for each volume
+    assert(m_material);
+    m_material->Use(renderStateTracker, static_cast<Material::OverrideFlags>(Material::OverrideBlend | Material::OverrideDepthTest | Material::OverrideStencilTest));
+
+    // Each instance has its own volume matrix, so the world matrix is not used
+    renderer.UpdateTransforms(m_material->GetShaderProgramReference(), glm::mat4(1.0f), true);
+
+    // Add the light of each volume to the target
+    RenderState::BlendState additiveBlend;
+    additiveBlend.enabled = true;
+    additiveBlend.equations = { GL_FUNC_ADD, GL_FUNC_ADD };
+    additiveBlend.params = { GL_ONE, GL_ONE, GL_ONE, GL_ONE };
+    additiveBlend.color = { 0.0f, 0.0f, 0.0f, 0.0f };
+    renderStateTracker.ApplyBlend(additiveBlend);
+
+    // Every pixel with a surface is shaded. The shader discards the background
+    renderStateTracker.ApplyDepth(RenderState::DepthState{ GL_ALWAYS, false });
+    DrawVolume(Volume::Fullscreen, viewProjMatrix);
+
+    // Depth clamp keeps the back faces beyond the far plane, that would leave holes in the volumes
+    device.EnableFeature(GL_DEPTH_CLAMP);
+    device.SetFeatureEnabled(GL_STENCIL_TEST, m_stencilTestEnabled);
+
+    DrawVolume(Volume::Sphere, viewProjMatrix);
+    DrawVolume(Volume::Cone, viewProjMatrix);
+
+    device.DisableFeature(GL_STENCIL_TEST);
+    device.DisableFeature(GL_DEPTH_CLAMP);
+}
+
+void DeferredRenderPass::DrawVolume(Volume volume, const glm::mat4& viewProjMatrix)
+{
+    VolumeBatch& batch = GetVolumeBatch(volume);
+    GLsizei instanceCount = static_cast<GLsizei>(batch.instances.size());
+    if (instanceCount == 0)
+    {
+        return;
+    }
+
+    Renderer& renderer = GetRenderer();
+    DeviceGL& device = renderer.GetDevice();
+    RenderStateTracker& renderStateTracker = renderer.GetRenderStateTracker();
+
+    batch.vao.Bind();
+
+    if (volume == Volume::Fullscreen)
+    {
+        batch.drawcall.DrawInstanced(instanceCount);
+        m_stats.drawCount++;
+        return;
+    }
 
-    bool first = true;
-    unsigned int lightIndex = 0;
-    const auto& lights = renderer.GetLights();
-    while (renderer.UpdateLights(shaderProgram, lights, lightIndex))
+    if (m_stencilTestEnabled)
     {
-        const Light* light = lightIndex <= lights.size() ? lights[lightIndex - 1] : nullptr;
-        assert(first || light);
+        // Count the faces behind the surface of each pixel: back faces add one and front faces subtract one
+        // Pixels whose surface is inside any of the volumes end with a value different from 0, even if the camera is inside
+        device.Clear(false, Color(), false, 1.0, true, 0);
+
+        RenderState::StencilState markStencil;
+        markStencil.functions = { GL_ALWAYS, GL_ALWAYS };
+        markStencil.refValues = { 0, 0 };
+        markStencil.masks = { 0xFF, 0xFF };
+        markStencil.stencilFail = { GL_KEEP, GL_KEEP };
+        markStencil.depthFail = { GL_DECR_WRAP, GL_INCR_WRAP };
+        markStencil.depthPass = { GL_KEEP, GL_KEEP };
+        renderStateTracker.ApplyStencil(markStencil);
+        renderStateTracker.ApplyDepth(RenderState::DepthState{ GL_LESS, false });
 
-        const Mesh* mesh = &renderer.GetFullscreenMesh();
-        glm::mat4 worldMatrix = fullscreenMatrix;
+        m_stencilShaderProgram.Use();
+        m_stencilShaderProgram.SetUniform(m_stencilViewProjMatrixLocation, viewProjMatrix);
 
-        // TODO: select different meshes depending on the type
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        device.DisableFeature(GL_CULL_FACE);
+        batch.drawcall.DrawInstanced(instanceCount);
+        m_stats.drawCount++;
+        device.EnableFeature(GL_CULL_FACE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
-        // Set the render states for the first and additional lights
-        renderer.SetLightingRenderStates(first);
+        // Shade the marked pixels. The depth test is already done by the stencil
+        RenderState::StencilState testStencil = markStencil;
+        testStencil.functions = { GL_NOTEQUAL, GL_NOTEQUAL };
+        testStencil.depthFail = { GL_KEEP, GL_KEEP };
+        renderStateTracker.ApplyStencil(testStencil);
+        renderStateTracker.ApplyDepth(RenderState::DepthState{ GL_ALWAYS, false });
 
-        renderer.UpdateTransforms(shaderProgram, fullscreenMatrix, first);
-        mesh->DrawSubmesh(0);
-        first = false;
+        m_material->GetShaderProgramReference().Use();
+    }
+    else
+    {
+        // Only the surfaces in front of the back faces can be inside the volume
+        renderStateTracker.ApplyDepth(RenderState::DepthState{ GL_GEQUAL, false });
     }
 
-    //TODO: temp hack
-    renderer.GetDevice().EnableFeature(GL_DEPTH_TEST);
+    // Back faces, so each pixel is shaded once per volume, also when the camera is inside
+    glCullFace(GL_FRONT);
+    batch.drawcall.DrawInstanced(instanceCount);
+    m_stats.drawCount++;
+    glCullFace(GL_BACK);
+}
+
+void DeferredRenderPass::AddLightInstances(std::span<const Light* const> lights, const glm::mat4& fullscreenMatrix)
+{
+    for (VolumeBatch& batch : m_volumeBatches)
+    {
+        batch.instances.clear();
+    }
+
+    // The indirect light is added once per pixel, with the first light that covers the whole screen
+    bool indirect = true;
+
+    for (const Light* light : lights)
+    {
+        glm::vec3 position = light->GetPosition();
+        glm::vec4 attenuation = light->GetAttenuation();
+        float range = attenuation.y;
+
+        if (light->GetType() == Light::Type::Directional || range <= 0.0f)
+        {
+            AddLightInstance(Volume::Fullscreen, fullscreenMatrix, light, indirect);
+            indirect = false;
+        }
+        else if (light->GetType() == Light::Type::Spot && attenuation.w > 0.0f && attenuation.w < s_maxConeAngle)
+        {
+            // Unit cone opening along the light direction, scaled to the range and angle
+            glm::vec3 direction = light->GetDirection();
+            glm::vec3 up = std::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            glm::vec3 right = glm::normalize(glm::cross(up, direction));
+            up = glm::cross(direction, right);
+
+            float radius = range * std::tan(attenuation.w);
+            glm::mat4 volumeMatrix(glm::vec4(right * radius, 0.0f), glm::vec4(up * radius, 0.0f), glm::vec4(direction * range, 0.0f), glm::vec4(position, 1.0f));
+            AddLightInstance(Volume::Cone, volumeMatrix, light, false);
+        }
+        else
+        {
+            glm::mat4 volumeMatrix(range);
+            volumeMatrix[3] = glm::vec4(position, 1.0f);
+            AddLightInstance(Volume::Sphere, volumeMatrix, light, false);
+        }
+    }
+
+    // Without any, a black light adds the indirect light
+    if (indirect)
+    {
+        AddLightInstance(Volume::Fullscreen, fullscreenMatrix, nullptr, true);
+    }
+
+    for (unsigned int volumeIndex = 0; volumeIndex < VolumeCount; ++volumeIndex)
+    {
+        VolumeBatch& batch = m_volumeBatches[volumeIndex];
+        m_stats.instanceCounts[volumeIndex] = static_cast<unsigned int>(batch.instances.size());
+
+        if (!batch.instances.empty())
+        {
+            // Allocating again orphans the contents of the previous frame, so the upload doesn't wait for its draws
+            batch.instanceVbo.Bind();
+            batch.instanceVbo.AllocateData(std::span<const LightInstance>(batch.instances), BufferObject::StreamDraw);
+        }
+    }
+    VertexBufferObject::Unbind();
+}
+
+void DeferredRenderPass::AddLightInstance(Volume volume, const glm::mat4& volumeMatrix, const Light* light, bool indirect)
+{
+    LightInstance& instance = GetVolumeBatch(volume).instances.emplace_back();
+    instance.volumeMatrix = volumeMatrix;
+    if (light)
+    {
+        instance.color = glm::vec4(light->GetColor() * light->GetIntensity(), indirect ? 1.0f : 0.0f);
+        instance.position = glm::vec4(light->GetPosition(), 1.0f);
+        instance.direction = glm::vec4(light->GetDirection(), 0.0f);
+        instance.attenuation = light->GetAttenuation();
+    }
+    else
+    {
+        instance.color = glm::vec4(0.0f, 0.0f, 0.0f, indirect ? 1.0f : 0.0f);
+        instance.position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        instance.direction = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+        instance.attenuation = glm::vec4(-1.0f);
+    }
 }
 
 void DeferredRenderPass::InitializeMeshes()
 {
-    //TODO: Create meshes for spot and point lights
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned short> indices;
+
+    // Large triangle covering the entire screen, in clip coordinates
+    vertices.emplace_back(-1.0f, -1.0f, 0.0f);
+    vertices.emplace_back(3.0f, -1.0f, 0.0f);
+    vertices.emplace_back(-1.0f, 3.0f, 0.0f);
+    InitializeVolume(Volume::Fullscreen, vertices, indices);
+
+    // The flat faces of the volumes must contain the curved surface, so the vertices are pushed out
+    // by the distance from the center to the middle of the faces
+    const float pi = std::numbers::pi_v<float>;
+
+    // Unit sphere, in rings from top to bottom. Front faces are counter-clockwise seen from outside
+    vertices.clear();
+    indices.clear();
+    float sphereScale = 1.0f / (std::cos(pi / (2 * s_sphereRings)) * std::cos(pi / s_sphereSegments));
+    for (unsigned int ring = 0; ring <= s_sphereRings; ++ring)
+    {
+        float theta = pi * ring / s_sphereRings;
+        for (unsigned int segment = 0; segment < s_sphereSegments; ++segment)
+        {
+            float phi = 2 * pi * segment / s_sphereSegments;
+            vertices.push_back(sphereScale * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    }
+    for (unsigned int ring = 0; ring < s_sphereRings; ++ring)
+    {
+        for (unsigned int segment = 0; segment < s_sphereSegments; ++segment)
+        {
+            unsigned short topRight = static_cast<unsigned short>(ring * s_sphereSegments + segment);
+            unsigned short topLeft = static_cast<unsigned short>(ring * s_sphereSegments + (segment + 1) % s_sphereSegments);
+            unsigned short bottomRight = static_cast<unsigned short>(topRight + s_sphereSegments);
+            unsigned short bottomLeft = static_cast<unsigned short>(topLeft + s_sphereSegments);
+
+            // The triangles that touch the poles are degenerate
+            if (ring > 0)
+            {
+                indices.insert(indices.end(), { topRight, topLeft, bottomLeft });
+            }
+            if (ring < s_sphereRings - 1)
+            {
+                indices.insert(indices.end(), { topRight, bottomLeft, bottomRight });
+            }
+        }
+    }
+    InitializeVolume(Volume::Sphere, vertices, indices);
+
+    // Unit cone with the apex in the origin, opening along Z, with a base of radius 1 at Z = 1
+    vertices.clear();
+    indices.clear();
+    float coneScale = 1.0f / std::cos(pi / s_coneSegments);
+    vertices.emplace_back(0.0f, 0.0f, 0.0f);
+    vertices.emplace_back(0.0f, 0.0f, 1.0f);
+    for (unsigned int segment = 0; segment < s_coneSegments; ++segment)
+    {
+        float phi = 2 * pi * segment / s_coneSegments;
+        vertices.emplace_back(coneScale * std::cos(phi), coneScale * std::sin(phi), 1.0f);
+    }
+    for (unsigned int segment = 0; segment < s_coneSegments; ++segment)
+    {
+        unsigned short current = static_cast<unsigned short>(2 + segment);
+        unsigned short next = static_cast<unsigned short>(2 + (segment + 1) % s_coneSegments);
+        indices.insert(indices.end(), { 0, next, current });
+        indices.insert(indices.end(), { 1, current, next });
+    }
+    InitializeVolume(Volume::Cone, vertices, indices);
+}
+
+void DeferredRenderPass::InitializeVolume(Volume volume, std::span<const glm::vec3> vertices, std::span<const unsigned short> indices)
+{
+    VolumeBatch& batch = GetVolumeBatch(volume);
+
+    batch.vao.Bind();
+
+    batch.vbo.Bind();
+    batch.vbo.AllocateData(vertices);
+    batch.vao.SetAttribute(0, VertexAttribute(Data::Type::Float, 3), 0);
+
+    if (indices.empty())
+    {
+        batch.drawcall = Drawcall(Drawcall::Primitive::Triangles, static_cast<GLsizei>(vertices.size()));
+    }
+    else
+    {
+        batch.ebo.Bind();
+        batch.ebo.AllocateData(indices);
+        batch.drawcall = Drawcall(Drawcall::Primitive::Triangles, static_cast<GLsizei>(indices.size()), Data::Type::UShort);
+    }
+
+    // The instance attributes advance once per instance. The buffer is allocated when the instances are added
+    batch.instanceVbo.Bind();
+    VertexAttribute vec4Attribute(Data::Type::Float, 4);
+    GLsizei stride = sizeof(LightInstance);
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        GLint offset = static_cast<GLint>(offsetof(LightInstance, volumeMatrix) + column * sizeof(glm::vec4));
+        batch.vao.SetAttribute(1 + column, vec4Attribute, offset, stride);
+    }
+    batch.vao.SetAttribute(5, vec4Attribute, static_cast<GLint>(offsetof(LightInstance, color)), stride);
+    batch.vao.SetAttribute(6, vec4Attribute, static_cast<GLint>(offsetof(LightInstance, position)), stride);
+    batch.vao.SetAttribute(7, vec4Attribute, static_cast<GLint>(offsetof(LightInstance, direction)), stride);
+    batch.vao.SetAttribute(8, vec4Attribute, static_cast<GLint>(offsetof(LightInstance, attenuation)), stride);
+    for (GLuint location = 1; location <= 8; ++location)
+    {
+        batch.vao.SetAttributeDivisor(location, 1);
+    }
+
+    VertexArrayObject::Unbind();
+    VertexBufferObject::Unbind();
+    ElementBufferObject::Unbind();
 }
@@ -0,0 +1,231 @@
+#include <ituGL/renderer/DepthPrepassRenderPass.h>
+
+#include <ituGL/camera/Camera.h>
+#include <ituGL/geometry/VertexArrayObject.h>
+#include <ituGL/renderer/Renderer.h>
+#include <ituGL/asset/ShaderLoader.h>
+#include <cassert>
+
+DepthPrepassRenderPass::ViewState::ViewState()
+    : enabled(false)
+    , overdraw(0.0f)
+    , queries{ {
+        QueryObject(QueryObject::Target::SamplesPassed),
+        QueryObject(QueryObject::Target::SamplesPassed),
+        QueryObject(QueryObject::Target::SamplesPassed) } }
+    , pendingQueries{ false, false, false }
+    , queryPixelCounts{ 0.0f, 0.0f, 0.0f }
+    , currentQuery(0)
+    , queryActive(false)
+    , lastUsedFrame(0)
+{
+}
+
+DepthPrepassRenderPass::DepthPrepassRenderPass(int drawcallCollectionIndex, unsigned int maxUnusedFrames)
+    : m_drawcallCollectionIndex(drawcallCollectionIndex)
+    , m_mode(Mode::Auto)
+    , m_enableThreshold(1.5f)
+    , m_disableThreshold(1.2f)
+    , m_clipPlane(0.0f)
+    , m_active(false)
+    , m_currentView(nullptr)
+    , m_maxUnusedFrames(maxUnusedFrames)
+    , m_lastRemoveFrame(0)
+    , m_worldMatrixLocation(-1)
+    , m_viewProjMatrixLocation(-1)
+    , m_clipPlaneLocation(-1)
+{
+    SetName("DepthPrepass");
+
+    // Load shaders and build shader program
+    Shader vertexShader = ShaderLoader(Shader::VertexShader).Load("shaders/renderer/depth_prepass.vert");
+    Shader fragmentShader = ShaderLoader(Shader::FragmentShader).Load("shaders/renderer/depth_prepass.frag");
+    m_shaderProgram.Build(vertexShader, fragmentShader);
+
+    // Get uniform locations
+    m_worldMatrixLocation = m_shaderProgram.GetUniformLocation("WorldMatrix");
+    m_viewProjMatrixLocation = m_shaderProgram.GetUniformLocation("ViewProjMatrix");
+    m_clipPlaneLocation = m_shaderProgram.GetUniformLocation("ClipPlane");
+}
+
+void DepthPrepassRenderPass::GetOverdrawThresholds(float& enableThreshold, float& disableThreshold) const
+{
+    enableThreshold = m_enableThreshold;
+    disableThreshold = m_disableThreshold;
+}
+
+void DepthPrepassRenderPass::SetOverdrawThresholds(float enableThreshold, float disableThreshold)
+{
+    // Different thresholds, to avoid switching every frame
+    assert(enableThreshold >= disableThreshold);
+    m_enableThreshold = enableThreshold;
+    m_disableThreshold = disableThreshold;
+}
+
+float DepthPrepassRenderPass::GetOverdraw() const
+{
+    return m_currentView ? m_currentView->overdraw : 0.0f;
+}
+
+void DepthPrepassRenderPass::Render()
+{
+    Renderer& renderer = GetRenderer();
+
+    RemoveUnusedViews();
+
+    ViewState& view = GetCurrentView();
+    m_currentView = &view;
+
+    ReadQueries(view);
+
+    switch (m_mode)
+    {
+    case Mode::Off:
+        view.enabled = false;
+        break;
+    case Mode::On:
+        view.enabled = true;
+        break;
+    case Mode::Auto:
+        if (view.overdraw > m_enableThreshold)
+        {
+            view.enabled = true;
+        }
+        else if (view.overdraw < m_disableThreshold)
+        {
+            view.enabled = false;
+        }
+        break;
+    }
+
+    const auto& drawcallCollection = renderer.GetDrawcalls(m_drawcallCollectionIndex);
+    m_active = view.enabled && !drawcallCollection.empty();
+    if (!m_active)
+    {
+        return;
+    }
+
+    // With the pre-pass enabled, its samples are the fragments that the color pass would have shaded without it
+    BeginQuery(view);
+
+    m_shaderProgram.Use();
+    m_shaderProgram.SetUniform(m_viewProjMatrixLocation, renderer.GetCurrentCamera().GetViewProjectionMatrix());
+    m_shaderProgram.SetUniform(m_clipPlaneLocation, m_clipPlane);
+
+    // Only depth is written
+    RenderStateTracker& renderStateTracker = renderer.GetRenderStateTracker();
+    RenderState::BlendState blend = {};
+    blend.enabled = false;
+    renderStateTracker.ApplyBlend(blend);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    renderStateTracker.ApplyDepth(RenderState::DepthState{ GL_LESS, true });
+
+    renderer.RecordCommandLists(drawcallCollection, [this](CommandList& commandList, const Renderer::DrawcallInfo& drawcallInfo)
+        {
+            commandList.SetWorldMatrix(m_worldMatrixLocation, drawcallInfo.GetWorldMatrixIndex());
+
+            // Position is always in location 0, so the VAO of the material can be used
+            commandList.BindVertexArray(drawcallInfo.GetVAO());
+            commandList.Draw(drawcallInfo.GetDrawcall());
+        });
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    EndQuery(view);
+}
+
+void DepthPrepassRenderPass::BeginColorPass()
+{
+    assert(m_currentView);
+
+    if (m_active)
+    {
+        // Only the closest fragment of each pixel passes, depth is already written
+        GetRenderer().GetRenderStateTracker().ApplyDepth(RenderState::DepthState{ GL_EQUAL, false });
+    }
+    else
+    {
+        BeginQuery(*m_currentView);
+    }
+}
+
+void DepthPrepassRenderPass::EndColorPass()
+{
+    assert(m_currentView);
+
+    if (m_active)
+    {
+        // Restore default values
+        GetRenderer().GetRenderStateTracker().ApplyDepth(RenderState::DepthState{ GL_LESS, true });
+    }
+    else
+    {
+        EndQuery(*m_currentView);
+    }
+}
+
+DepthPrepassRenderPass::ViewState& DepthPrepassRenderPass::GetCurrentView()
+{
+    const Renderer& renderer = GetRenderer();
+    ViewState& view = m_views[&renderer.GetCurrentCamera()];
+    view.lastUsedFrame = renderer.GetFrameIndex();
+    return view;
+}
+
+void DepthPrepassRenderPass::RemoveUnusedViews()
+{
+    // Once per frame, before the first view
+    unsigned int frameIndex = GetRenderer().GetFrameIndex();
+    if (frameIndex == m_lastRemoveFrame)
+    {
+        return;
+    }
+    m_lastRemoveFrame = frameIndex;
+
+    // Also the views of destroyed cameras
+    std::erase_if(m_views, [this, frameIndex](const auto& pair) { return frameIndex - pair.second.lastUsedFrame >= m_maxUnusedFrames; });
+    m_currentView = nullptr;
+}
+
+void DepthPrepassRenderPass::BeginQuery(ViewState& view)
+{
+    view.currentQuery = (view.currentQuery + 1) % view.queries.size();
+
+    // Skip this measurement instead of waiting for the GPU
+    view.queryActive = !view.pendingQueries[view.currentQuery];
+    if (view.queryActive)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        view.queryPixelCounts[view.currentQuery] = static_cast<float>(viewport[2]) * static_cast<float>(viewport[3]);
+
+        view.queries[view.currentQuery].Begin();
+    }
+}
+
+void DepthPrepassRenderPass::EndQuery(ViewState& view)
+{
+    if (view.queryActive)
+    {
+        view.queries[view.currentQuery].End();
+        view.pendingQueries[view.currentQuery] = true;
+        view.queryActive = false;
+    }
+}
+
+void DepthPrepassRenderPass::ReadQueries(ViewState& view)
+{
+    // From the oldest to the newest, so the last result read is the most recent
+    unsigned int queryCount = static_cast<unsigned int>(view.queries.size());
+    for (unsigned int i = 1; i <= queryCount; ++i)
+    {
+        unsigned int queryIndex = (view.currentQuery + i) % queryCount;
+        if (view.pendingQueries[queryIndex] && view.queries[queryIndex].IsResultAvailable())
+        {
+            float pixelCount = view.queryPixelCounts[queryIndex];
+            float samples = static_cast<float>(view.queries[queryIndex].GetResult());
+            view.overdraw = pixelCount > 0.0f ? samples / pixelCount : 0.0f;
+            view.pendingQueries[queryIndex] = false;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#include <ituGL/renderer/DrawList.h>
+
+#include <ituGL/renderer/Renderer.h>
+#include <ituGL/geometry/Model.h>
+#include <cassert>
+
+void DrawList::Clear()
+{
+    m_models.clear();
+    m_directionalLights.clear();
+    m_pointLights.clear();
+    m_spotLights.clear();
+}
+
+void DrawList::AddModel(std::shared_ptr<const Model> model, const glm::mat4& worldMatrix)
+{
+    assert(model);
+    m_models.push_back(ModelEntry{ std::move(model), worldMatrix });
+}
+
+void DrawList::AddLight(const Light& light)
+{
+    switch (light.GetType())
+    {
+    case Light::Type::Directional:
+        m_directionalLights.push_back(static_cast<const DirectionalLight&>(light));
+        break;
+    case Light::Type::Point:
+        m_pointLights.push_back(static_cast<const PointLight&>(light));
+        break;
+    case Light::Type::Spot:
+        m_spotLights.push_back(static_cast<const SpotLight&>(light));
+        break;
+    }
+}
+
+unsigned int DrawList::GetLightCount() const
+{
+    return static_cast<unsigned int>(m_directionalLights.size() + m_pointLights.size() + m_spotLights.size());
+}
+
+void DrawList::Submit(Renderer& renderer) const
+{
+    // The renderer keeps pointers to the lights
+    for (const DirectionalLight& light : m_directionalLights)
+    {
+        renderer.AddLight(light);
+    }
+    for (const PointLight& light : m_pointLights)
+    {
+        renderer.AddLight(light);
+    }
+    for (const SpotLight& light : m_spotLights)
+    {
+        renderer.AddLight(light);
+    }
+
+    for (const ModelEntry& entry : m_models)
+    {
+        renderer.AddModel(*entry.model, entry.worldMatrix);
+    }
+}
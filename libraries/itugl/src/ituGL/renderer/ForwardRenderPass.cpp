@@ -4,6 +4,7 @@
 #include <ituGL/shader/Material.h>
 #include <ituGL/geometry/VertexArrayObject.h>
 #include <ituGL/renderer/Renderer.h>
+#include <ituGL/renderer/DepthPrepassRenderPass.h>
 
 ForwardRenderPass::ForwardRenderPass()
     : ForwardRenderPass(0)
@@ -11,38 +12,55 @@ ForwardRenderPass::ForwardRenderPass()
 }
 
 ForwardRenderPass::ForwardRenderPass(int drawcallCollectionIndex)
+    : ForwardRenderPass(drawcallCollectionIndex, nullptr)
+{
+}
+
+ForwardRenderPass::ForwardRenderPass(int drawcallCollectionIndex, DepthPrepassRenderPass* depthPrepass)
     : m_drawcallCollectionIndex(drawcallCollectionIndex)
+    , m_depthPrepass(depthPrepass)
 {
+    SetName("Forward");
 }
 
 void ForwardRenderPass::Render()
 {
     Renderer& renderer = GetRenderer();
 
-    const Camera& camera = renderer.GetCurrentCamera();
-    const auto& lights = renderer.GetLights();
     const auto& drawcallCollection = renderer.GetDrawcalls(m_drawcallCollectionIndex);
 
-    // for all drawcalls
-    for (const Renderer::DrawcallInfo& drawcallInfo : drawcallCollection)
+    // With the depth pre-pass, the depth states are set by the pre-pass instead of the materials
+    Material::OverrideFlags materialOverride = Material::NoOverride;
+    if (m_depthPrepass)
     {
-        // Prepare drawcall states
-        renderer.PrepareDrawcall(drawcallInfo);
-
-        std::shared_ptr<const ShaderProgram> shaderProgram = drawcallInfo.GetMaterial().GetShaderProgram();
+        m_depthPrepass->BeginColorPass();
+        if (m_depthPrepass->IsActive())
+        {
+            materialOverride = Material::OverrideDepthTest;
+        }
+    }
 
-        //for all lights
-        bool first = true;
-        unsigned int lightIndex = 0;
-        while (renderer.UpdateLights(shaderProgram, lights, lightIndex))
+    // Record the drawcalls in parallel, then execute them in order
+    renderer.RecordCommandLists(drawcallCollection, [&](CommandList& commandList, const Renderer::DrawcallInfo& drawcallInfo)
         {
-            // Set the renderstates
-            renderer.SetLightingRenderStates(first);
+            const Material& material = drawcallInfo.GetMaterial();
 
-            // Draw
-            drawcallInfo.GetDrawcall().Draw();
+            // Prepare drawcall states
+            commandList.UseMaterial(material, materialOverride);
+            commandList.UpdateTransforms(material, drawcallInfo.GetWorldMatrixIndex());
+            commandList.BindVertexArray(drawcallInfo.GetVAO());
 
-            first = false;
-        }
+            if (!renderer.HasUpdateLightsFunction(material.GetShaderProgramReference()))
+            {
+                return;
+            }
+
+            // One draw per light pass. The lights function of the program decides how many passes there are
+            commandList.DrawLightPasses(drawcallInfo.GetDrawcall());
+        });
+
+    if (m_depthPrepass)
+    {
+        m_depthPrepass->EndColorPass();
     }
 }
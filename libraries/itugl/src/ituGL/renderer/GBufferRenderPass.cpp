@@ -10,17 +10,26 @@
 GBufferRenderPass::GBufferRenderPass(int width, int height, int drawcallCollectionIndex)
     : m_drawcallCollectionIndex(drawcallCollectionIndex)
 {
+    SetName("GBuffer");
+
     InitTextures(width, height);
     InitFramebuffer();
 }
 
+GBufferRenderPass::GBufferRenderPass(std::shared_ptr<const FramebufferObject> targetFramebuffer, int drawcallCollectionIndex)
+    : RenderPass(targetFramebuffer), m_drawcallCollectionIndex(drawcallCollectionIndex)
+{
+    SetName("GBuffer");
+}
+
 void GBufferRenderPass::InitFramebuffer()
 {
     std::shared_ptr<FramebufferObject> targetFramebuffer = std::make_shared<FramebufferObject>();
 
     targetFramebuffer->Bind();
 
-    targetFramebuffer->SetTexture(FramebufferObject::Target::Draw, FramebufferObject::Attachment::Depth, *m_depthTexture);
+    // Depth and stencil, so the deferred pass can mark the pixels inside the light volumes
+    targetFramebuffer->SetTexture(FramebufferObject::Target::Draw, FramebufferObject::Attachment::DepthStencil, *m_depthTexture);
 
     // Set the albedo texture as color attachment 0
     targetFramebuffer->SetTexture(FramebufferObject::Target::Draw, FramebufferObject::Attachment::Color0, *m_albedoTexture);
@@ -49,7 +58,7 @@ void GBufferRenderPass::InitTextures(int width, int height)
     // Depth: Set the min and magfilter as nearest
     m_depthTexture = std::make_shared<Texture2DObject>();
     m_depthTexture->Bind();
-    m_depthTexture->SetImage(0, width, height, TextureObject::FormatDepth, TextureObject::InternalFormatDepth);
+    m_depthTexture->SetImage(0, width, height, TextureObject::FormatDepthStencil, TextureObject::InternalFormatDepth24Stencil8);
     m_depthTexture->SetParameter(TextureObject::ParameterEnum::MinFilter, GL_NEAREST);
     m_depthTexture->SetParameter(TextureObject::ParameterEnum::MagFilter, GL_NEAREST);
 
@@ -85,7 +94,11 @@ void GBufferRenderPass::Render()
     const auto& lights = renderer.GetLights();
     const auto& drawcallCollection = renderer.GetDrawcalls(m_drawcallCollectionIndex);
 
-    renderer.GetDevice().Clear(true, Color(0.0f, 0.0f, 0.0f, 1.0f), true, 1.0f);
+    // External targets are cleared by their owner
+    if (m_depthTexture)
+    {
+        renderer.GetDevice().Clear(true, Color(0.0f, 0.0f, 0.0f, 1.0f), true, 1.0f, true, 0);
+    }
 
     bool wasSRGB = renderer.GetDevice().IsFeatureEnabled(GL_FRAMEBUFFER_SRGB);
     renderer.GetDevice().EnableFeature(GL_FRAMEBUFFER_SRGB);
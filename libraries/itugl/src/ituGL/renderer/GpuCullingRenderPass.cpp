@@ -0,0 +1,403 @@
+#include <ituGL/renderer/GpuCullingRenderPass.h>
+
+#include <ituGL/renderer/Renderer.h>
+#include <ituGL/geometry/Model.h>
+#include <ituGL/geometry/Mesh.h>
+#include <ituGL/geometry/VertexAttribute.h>
+#include <ituGL/camera/Camera.h>
+#include <ituGL/shader/Material.h>
+#include <ituGL/texture/Texture2DObject.h>
+#include <ituGL/asset/ShaderLoader.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <cassert>
+#include <chrono>
+#include <limits>
+
+// Bounds used for submeshes without bounds, so the instance is never culled
+static constexpr float s_unboundedExtent = 1.0e9f;
+
+// Texture unit of the depth pyramid in the compute shader
+static constexpr GLint s_hiZTextureUnit = 0;
+
+// Milliseconds elapsed since start
+static float GetElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+    return duration.count();
+}
+
+GpuCullingRenderPass::GpuCullingRenderPass(std::shared_ptr<Model> model, Mode mode)
+    : m_model(model), m_mode(mode)
+    , m_buffersDirty(true)
+    , m_instanceCountLocation(-1), m_submeshCountLocation(-1), m_chunkCountLocation(-1), m_frustumPlanesLocation(-1)
+    , m_hiZEnabledLocation(-1), m_hiZTextureLocation(-1), m_hiZLevelCountLocation(-1), m_hiZViewProjMatrixLocation(-1)
+    , m_hiZLevelCount(0), m_hiZViewProjMatrix(1.0f)
+{
+    assert(m_model);
+
+    SetName("GpuCulling");
+
+    InitializeVertexArrays();
+}
+
+void GpuCullingRenderPass::SetMode(Mode mode)
+{
+    if (mode != m_mode)
+    {
+        m_mode = mode;
+        m_buffersDirty = true;
+    }
+}
+
+void GpuCullingRenderPass::SetInstances(std::span<const glm::mat4> worldMatrices)
+{
+    const Mesh& mesh = m_model->GetMesh();
+
+    // Local bounds of the whole model, from the bounds of its submeshes
+    glm::vec3 localMin(std::numeric_limits<float>::max());
+    glm::vec3 localMax(std::numeric_limits<float>::lowest());
+    bool bounded = true;
+    for (unsigned int submeshIndex = 0; submeshIndex < mesh.GetSubmeshCount(); ++submeshIndex)
+    {
+        glm::vec3 boundsMin, boundsMax;
+        if (!mesh.GetSubmeshBounds(submeshIndex, boundsMin, boundsMax))
+        {
+            bounded = false;
+            break;
+        }
+        localMin = glm::min(localMin, boundsMin);
+        localMax = glm::max(localMax, boundsMax);
+    }
+
+    m_instances.resize(worldMatrices.size());
+    for (size_t instanceIndex = 0; instanceIndex < worldMatrices.size(); ++instanceIndex)
+    {
+        Instance& instance = m_instances[instanceIndex];
+        const glm::mat4& worldMatrix = worldMatrices[instanceIndex];
+        instance.worldMatrix = worldMatrix;
+
+        if (!bounded)
+        {
+            instance.boundsMin = glm::vec4(glm::vec3(-s_unboundedExtent), 1.0f);
+            instance.boundsMax = glm::vec4(glm::vec3(s_unboundedExtent), 1.0f);
+            continue;
+        }
+
+        // World space box containing the 8 transformed corners
+        glm::vec3 worldMin(std::numeric_limits<float>::max());
+        glm::vec3 worldMax(std::numeric_limits<float>::lowest());
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec3 localCorner((corner & 1) ? localMax.x : localMin.x, (corner & 2) ? localMax.y : localMin.y, (corner & 4) ? localMax.z : localMin.z);
+            glm::vec3 worldCorner(worldMatrix * glm::vec4(localCorner, 1.0f));
+            worldMin = glm::min(worldMin, worldCorner);
+            worldMax = glm::max(worldMax, worldCorner);
+        }
+        instance.boundsMin = glm::vec4(worldMin, 1.0f);
+        instance.boundsMax = glm::vec4(worldMax, 1.0f);
+    }
+
+    m_buffersDirty = true;
+}
+
+void GpuCullingRenderPass::SetHiZ(std::shared_ptr<const Texture2DObject> hiZTexture, int levelCount, const glm::mat4& viewProjMatrix)
+{
+    m_hiZTexture = hiZTexture;
+    m_hiZLevelCount = levelCount;
+    m_hiZViewProjMatrix = viewProjMatrix;
+}
+
+void GpuCullingRenderPass::Render()
+{
+    Renderer& renderer = GetRenderer();
+
+    m_stats = Stats();
+    m_stats.instanceCount = GetInstanceCount();
+    if (m_instances.empty())
+    {
+        return;
+    }
+
+    // Fall back to the CPU if the context can't run compute shaders
+    if (m_mode != Mode::Cpu && !renderer.GetDevice().IsComputeSupported())
+    {
+        SetMode(Mode::Cpu);
+    }
+
+    const Camera& camera = renderer.GetCurrentCamera();
+    FrustumPlanes frustumPlanes = SceneBvh::GetFrustumPlanes(camera.GetViewProjectionMatrix());
+
+    if (m_buffersDirty)
+    {
+        InitializeBuffers();
+        m_buffersDirty = false;
+    }
+
+    if (m_mode == Mode::Cpu)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        CullInstances(frustumPlanes, m_visibleMatrices, m_chunkVisibleCounts);
+        m_stats.visibleCount = static_cast<unsigned int>(m_visibleMatrices.size());
+
+        // Allocating again orphans the contents of the previous frame, so the upload doesn't wait for its draws
+        if (!m_visibleMatrices.empty())
+        {
+            m_visibleBuffer.Bind();
+            m_visibleBuffer.AllocateData(std::span<const glm::mat4>(m_visibleMatrices), BufferObject::StreamDraw);
+            VertexBufferObject::Unbind();
+        }
+
+        m_stats.cpuTime = GetElapsedMilliseconds(start);
+
+        if (m_stats.visibleCount > 0)
+        {
+            DrawSubmeshes(false);
+        }
+    }
+    else
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        DispatchCulling(frustumPlanes);
+
+        if (m_mode == Mode::GpuValidation)
+        {
+            ValidateCulling(frustumPlanes);
+        }
+
+        m_stats.cpuTime = GetElapsedMilliseconds(start);
+
+        DrawSubmeshes(true);
+    }
+}
+
+void GpuCullingRenderPass::CullInstances(const FrustumPlanes& frustumPlanes, std::vector<glm::mat4>& visibleMatrices, std::vector<unsigned int>& chunkVisibleCounts) const
+{
+    visibleMatrices.clear();
+    chunkVisibleCounts.assign(GetChunkCount(), 0);
+
+    for (size_t instanceIndex = 0; instanceIndex < m_instances.size(); ++instanceIndex)
+    {
+        const Instance& instance = m_instances[instanceIndex];
+        if (SceneBvh::IsInFrustum(frustumPlanes, glm::vec3(instance.boundsMin), glm::vec3(instance.boundsMax)))
+        {
+            visibleMatrices.push_back(instance.worldMatrix);
+            chunkVisibleCounts[instanceIndex / ChunkSize]++;
+        }
+    }
+}
+
+void GpuCullingRenderPass::DispatchCulling(const FrustumPlanes& frustumPlanes)
+{
+    Renderer& renderer = GetRenderer();
+    RenderStateTracker& renderStateTracker = renderer.GetRenderStateTracker();
+
+    unsigned int chunkCount = GetChunkCount();
+    bool hiZEnabled = m_hiZTexture && m_hiZLevelCount > 0;
+
+    m_cullingProgram.Use();
+    m_cullingProgram.SetUniform(m_instanceCountLocation, static_cast<int>(m_instances.size()));
+    m_cullingProgram.SetUniform(m_submeshCountLocation, static_cast<int>(m_model->GetMesh().GetSubmeshCount()));
+    m_cullingProgram.SetUniform(m_chunkCountLocation, static_cast<int>(chunkCount));
+    m_cullingProgram.SetUniforms(m_frustumPlanesLocation, std::span<const glm::vec4>(frustumPlanes));
+    m_cullingProgram.SetUniform(m_hiZEnabledLocation, hiZEnabled ? 1 : 0);
+    if (hiZEnabled)
+    {
+        // Bound through the tracker, so the materials drawn later bind their own textures again
+        renderStateTracker.BindTexture(s_hiZTextureUnit, *m_hiZTexture);
+        m_cullingProgram.SetUniform(m_hiZTextureLocation, s_hiZTextureUnit);
+        m_cullingProgram.SetUniform(m_hiZLevelCountLocation, m_hiZLevelCount);
+        m_cullingProgram.SetUniform(m_hiZViewProjMatrixLocation, m_hiZViewProjMatrix);
+    }
+
+    m_instanceBuffer->BindBase(0);
+    m_visibleBuffer.BindBase(BufferObject::ShaderStorageBuffer, 1);
+    m_commandBuffer->BindBase(BufferObject::ShaderStorageBuffer, 2);
+
+    glDispatchCompute(chunkCount, 1, 1);
+
+    // The draws read the commands and the instance attributes written by the compute shader
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GpuCullingRenderPass::ValidateCulling(const FrustumPlanes& frustumPlanes)
+{
+    unsigned int chunkCount = GetChunkCount();
+
+    // Every submesh gets the same counts, so the commands of the first one are enough
+    std::vector<DrawIndirectBufferObject::ElementsCommand> commands(chunkCount);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    m_commandBuffer->Bind();
+    m_commandBuffer->GetData(std::span<DrawIndirectBufferObject::ElementsCommand>(commands));
+    DrawIndirectBufferObject::Unbind();
+
+    CullInstances(frustumPlanes, m_visibleMatrices, m_chunkVisibleCounts);
+
+    // The Hi-Z test can only remove instances that pass the frustum test
+    bool hiZEnabled = m_hiZTexture && m_hiZLevelCount > 0;
+    for (unsigned int chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+    {
+        unsigned int gpuCount = commands[chunkIndex].instanceCount;
+        unsigned int cpuCount = m_chunkVisibleCounts[chunkIndex];
+        if (gpuCount > cpuCount || (!hiZEnabled && gpuCount != cpuCount))
+        {
+            m_stats.validationErrorCount++;
+        }
+        else
+        {
+            m_stats.occludedCount += cpuCount - gpuCount;
+        }
+        m_stats.visibleCount += gpuCount;
+    }
+}
+
+void GpuCullingRenderPass::DrawSubmeshes(bool indirect)
+{
+    Renderer& renderer = GetRenderer();
+    RenderStateTracker& renderStateTracker = renderer.GetRenderStateTracker();
+    const Mesh& mesh = m_model->GetMesh();
+
+    std::span<const Light* const> lights = renderer.GetLights();
+
+    unsigned int chunkCount = GetChunkCount();
+
+    if (indirect)
+    {
+        m_commandBuffer->Bind();
+    }
+
+    for (unsigned int submeshIndex = 0; submeshIndex < mesh.GetSubmeshCount(); ++submeshIndex)
+    {
+        const Material& material = m_model->GetMaterial(submeshIndex);
+        const ShaderProgram& shaderProgram = material.GetShaderProgramReference();
+
+        // Same as the forward pass, materials without lights function are not drawn
+        if (!renderer.HasUpdateLightsFunction(shaderProgram))
+        {
+            continue;
+        }
+
+        material.Use(renderStateTracker);
+
+        // The world matrix of each instance is an attribute
+        renderer.UpdateTransforms(shaderProgram, glm::mat4(1.0f), true);
+
+        const Drawcall& drawcall = mesh.GetSubmeshDrawcall(submeshIndex);
+        mesh.GetSubmeshVertexArray(submeshIndex).Bind();
+
+        // Same light passes as the forward pass, decided by the lights function
+        bool firstPass = true;
+        unsigned int lightIndex = 0;
+        while (renderer.UpdateLights(shaderProgram, lights, lightIndex))
+        {
+            renderer.SetLightingRenderStates(firstPass);
+            firstPass = false;
+
+            if (indirect)
+            {
+                GLintptr offset = submeshIndex * chunkCount * sizeof(DrawIndirectBufferObject::ElementsCommand);
+                drawcall.MultiDrawIndirect(offset, static_cast<GLsizei>(chunkCount));
+            }
+            else
+            {
+                drawcall.DrawInstanced(static_cast<GLsizei>(m_visibleMatrices.size()));
+            }
+            m_stats.drawCount++;
+        }
+    }
+
+    VertexArrayObject::Unbind();
+    if (indirect)
+    {
+        DrawIndirectBufferObject::Unbind();
+    }
+}
+
+void GpuCullingRenderPass::InitializeVertexArrays()
+{
+    Mesh& mesh = m_model->GetMesh();
+
+    // The world matrix of each instance takes 4 locations, one per column, and advances once per instance
+    VertexAttribute vec4Attribute(Data::Type::Float, 4);
+    GLsizei stride = sizeof(glm::mat4);
+    for (unsigned int submeshIndex = 0; submeshIndex < mesh.GetSubmeshCount(); ++submeshIndex)
+    {
+        VertexArrayObject& vao = mesh.GetSubmeshVertexArray(submeshIndex);
+        vao.Bind();
+        m_visibleBuffer.Bind();
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            vao.SetAttribute(5 + column, vec4Attribute, static_cast<GLint>(column * sizeof(glm::vec4)), stride);
+            vao.SetAttributeDivisor(5 + column, 1);
+        }
+    }
+
+    VertexArrayObject::Unbind();
+    VertexBufferObject::Unbind();
+}
+
+void GpuCullingRenderPass::InitializeComputeShader()
+{
+    Shader computeShader = ShaderLoader(Shader::ComputeShader).Load("shaders/renderer/gpu_culling.comp");
+    m_cullingProgram.Build(computeShader);
+
+    m_instanceCountLocation = m_cullingProgram.GetUniformLocation("InstanceCount");
+    m_submeshCountLocation = m_cullingProgram.GetUniformLocation("SubmeshCount");
+    m_chunkCountLocation = m_cullingProgram.GetUniformLocation("ChunkCount");
+    m_frustumPlanesLocation = m_cullingProgram.GetUniformLocation("FrustumPlanes");
+    m_hiZEnabledLocation = m_cullingProgram.GetUniformLocation("HiZEnabled");
+    m_hiZTextureLocation = m_cullingProgram.GetUniformLocation("HiZTexture");
+    m_hiZLevelCountLocation = m_cullingProgram.GetUniformLocation("HiZLevelCount");
+    m_hiZViewProjMatrixLocation = m_cullingProgram.GetUniformLocation("HiZViewProjMatrix");
+}
+
+void GpuCullingRenderPass::InitializeBuffers()
+{
+    if (m_mode == Mode::Cpu)
+    {
+        // The visible instances are uploaded every frame
+        return;
+    }
+
+    // Built on first use, GL 4.3 may not be available in CPU mode
+    if (!m_instanceBuffer)
+    {
+        InitializeComputeShader();
+        m_instanceBuffer = std::make_unique<ShaderStorageBufferObject>();
+        m_commandBuffer = std::make_unique<DrawIndirectBufferObject>();
+    }
+
+    unsigned int chunkCount = GetChunkCount();
+
+    m_instanceBuffer->Bind();
+    m_instanceBuffer->AllocateData(std::span<const Instance>(m_instances));
+    ShaderStorageBufferObject::Unbind();
+
+    // Room for a full chunk each, only written by the GPU
+    m_visibleBuffer.Bind();
+    m_visibleBuffer.AllocateData(chunkCount * ChunkSize * sizeof(glm::mat4), BufferObject::DynamicCopy);
+    VertexBufferObject::Unbind();
+
+    // Each chunk draws from its own range of the visible buffer. The compute shader writes the instance counts
+    const Mesh& mesh = m_model->GetMesh();
+    std::vector<DrawIndirectBufferObject::ElementsCommand> commands;
+    commands.reserve(mesh.GetSubmeshCount() * chunkCount);
+    for (unsigned int submeshIndex = 0; submeshIndex < mesh.GetSubmeshCount(); ++submeshIndex)
+    {
+        const Drawcall& drawcall = mesh.GetSubmeshDrawcall(submeshIndex);
+        for (unsigned int chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+        {
+            commands.push_back(drawcall.GetElementsCommand(0, chunkIndex * ChunkSize));
+        }
+    }
+    m_commandBuffer->Bind();
+    m_commandBuffer->AllocateData(std::span<const DrawIndirectBufferObject::ElementsCommand>(commands), BufferObject::DynamicCopy);
+    DrawIndirectBufferObject::Unbind();
+}
+
+unsigned int GpuCullingRenderPass::GetChunkCount() const
+{
+    return (GetInstanceCount() + ChunkSize - 1) / ChunkSize;
+}
@@ -0,0 +1,478 @@
+#include <ituGL/renderer/OcclusionCuller.h>
+
+#include <ituGL/core/JobSystem.h>
+#include <glm/common.hpp>
+#include <glm/vec4.hpp>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE2 1
+#else
+#define OCCLUSION_CULLER_SSE2 0
+#endif
+
+// Milliseconds elapsed since start
+static float GetElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+    return duration.count();
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height, int tileWidth, int tileHeight)
+    : m_width(width), m_height(height)
+    , m_tileWidth(tileWidth), m_tileHeight(tileHeight)
+    , m_tileCountX(0), m_tileCountY(0)
+    , m_enabled(true)
+    , m_viewProjMatrix(1.0f)
+    , m_rasterized(false)
+{
+    // Rows and tiles are processed in groups of 4 pixels
+    assert(width > 0 && width % 4 == 0);
+    assert(height > 0);
+    assert(tileWidth > 0 && tileWidth % 4 == 0);
+    assert(tileHeight > 0);
+
+    m_tileCountX = (m_width + m_tileWidth - 1) / m_tileWidth;
+    m_tileCountY = (m_height + m_tileHeight - 1) / m_tileHeight;
+    m_tileTriangles.resize(m_tileCountX * m_tileCountY);
+
+    // Allocate all the levels of the pyramid, down to 1x1
+    glm::ivec2 levelSize(m_width, m_height);
+    while (true)
+    {
+        m_levelSizes.push_back(levelSize);
+        m_levels.emplace_back(levelSize.x * levelSize.y, 1.0f);
+        m_closestLevels.emplace_back(m_levels.size() > 1 ? levelSize.x * levelSize.y : 0, 1.0f);
+        if (levelSize.x == 1 && levelSize.y == 1)
+        {
+            break;
+        }
+        levelSize = glm::max(levelSize / 2, glm::ivec2(1));
+    }
+}
+
+void OcclusionCuller::Begin(const glm::mat4& viewProjMatrix)
+{
+    m_viewProjMatrix = viewProjMatrix;
+    m_occluders.clear();
+    m_rasterized = false;
+    m_stats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(std::shared_ptr<const Occluder> occluder, const glm::mat4& worldMatrix)
+{
+    assert(occluder);
+    assert(occluder->indices.size() % 3 == 0);
+    m_occluders.push_back(OccluderInstance{ occluder, worldMatrix });
+}
+
+void OcclusionCuller::Rasterize()
+{
+    // Nothing to test against when disabled
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    SetupTriangles();
+
+    // Tiles don't share pixels, so they can be rasterized at the same time. One job per tile, as their cost varies a lot
+    int tileCount = m_tileCountX * m_tileCountY;
+    JobSystem::GetInstance().ParallelFor(0, tileCount, 1, [this](size_t begin, size_t end)
+        {
+            for (size_t tileIndex = begin; tileIndex < end; ++tileIndex)
+            {
+                RasterizeTile(static_cast<int>(tileIndex));
+            }
+        });
+
+    BuildPyramid();
+
+    m_rasterized = true;
+    m_stats.rasterizeTime += GetElapsedMilliseconds(start);
+}
+
+bool OcclusionCuller::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& worldMatrix)
+{
+    if (!m_enabled || !m_rasterized)
+    {
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ++m_stats.testedCount;
+
+    glm::mat4 worldViewProjMatrix = m_viewProjMatrix * worldMatrix;
+
+    // Project the 8 corners, and count how many are outside of each clip plane
+    int outsideCounts[6] = {};
+    bool crossesNearPlane = false;
+    glm::vec3 screenMin(1.0f);
+    glm::vec3 screenMax(-1.0f);
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+        glm::vec4 clip = worldViewProjMatrix * glm::vec4(corner, 1.0f);
+
+        outsideCounts[0] += clip.x < -clip.w;
+        outsideCounts[1] += clip.x > clip.w;
+        outsideCounts[2] += clip.y < -clip.w;
+        outsideCounts[3] += clip.y > clip.w;
+        outsideCounts[4] += clip.z < -clip.w;
+        outsideCounts[5] += clip.z > clip.w;
+
+        if (clip.z < -clip.w || clip.w <= 0.0f)
+        {
+            crossesNearPlane = true;
+        }
+        else
+        {
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screenMin = glm::min(screenMin, ndc);
+            screenMax = glm::max(screenMax, ndc);
+        }
+    }
+
+    for (int outsideCount : outsideCounts)
+    {
+        if (outsideCount == 8)
+        {
+            ++m_stats.frustumRejectedCount;
+            m_stats.testTime += GetElapsedMilliseconds(start);
+            return false;
+        }
+    }
+
+    // Too close to the camera to know its size on the screen
+    if (crossesNearPlane)
+    {
+        m_stats.testTime += GetElapsedMilliseconds(start);
+        return true;
+    }
+
+    // Pixel rectangle covered by the box, and its closest depth
+    float minDepth = screenMin.z * 0.5f + 0.5f;
+    glm::ivec2 pixelMin = glm::clamp(glm::ivec2(glm::floor((glm::vec2(screenMin) * 0.5f + 0.5f) * glm::vec2(m_width, m_height))), glm::ivec2(0), glm::ivec2(m_width - 1, m_height - 1));
+    glm::ivec2 pixelMax = glm::clamp(glm::ivec2(glm::floor((glm::vec2(screenMax) * 0.5f + 0.5f) * glm::vec2(m_width, m_height))), glm::ivec2(0), glm::ivec2(m_width - 1, m_height - 1));
+
+    // Find the level where the rectangle covers at most 4 texels in each direction
+    int level = 0;
+    int lastLevel = static_cast<int>(m_levels.size()) - 1;
+    while (level < lastLevel && std::max((pixelMax.x >> level) - (pixelMin.x >> level), (pixelMax.y >> level) - (pixelMin.y >> level)) > 3)
+    {
+        ++level;
+    }
+
+    // Accepted if the box is in front of the closest occluder of a coarser region that contains it, at most 2x2 texels
+    int coarseLevel = std::max(std::min(level + 2, lastLevel), 1);
+    const glm::ivec2& coarseSize = m_levelSizes[coarseLevel];
+    glm::ivec2 coarseMin = glm::min(pixelMin >> coarseLevel, coarseSize - 1);
+    glm::ivec2 coarseMax = glm::min(pixelMax >> coarseLevel, coarseSize - 1);
+    const std::vector<float>& closestDepths = m_closestLevels[coarseLevel];
+    float closest = 1.0f;
+    for (int y = coarseMin.y; y <= coarseMax.y; ++y)
+    {
+        for (int x = coarseMin.x; x <= coarseMax.x; ++x)
+        {
+            closest = std::min(closest, closestDepths[y * coarseSize.x + x]);
+        }
+    }
+    if (minDepth <= closest)
+    {
+        ++m_stats.trivialAcceptedCount;
+        m_stats.testTime += GetElapsedMilliseconds(start);
+        return true;
+    }
+
+    // The last texel of a level also covers the extra texel of an odd previous level
+    const glm::ivec2& levelSize = m_levelSizes[level];
+    glm::ivec2 texelMin = glm::min(pixelMin >> level, levelSize - 1);
+    glm::ivec2 texelMax = glm::min(pixelMax >> level, levelSize - 1);
+
+    // Visible if any part of the box is closer than the farthest occluder depth of a texel
+    const std::vector<float>& depths = m_levels[level];
+    bool visible = false;
+    for (int y = texelMin.y; y <= texelMax.y && !visible; ++y)
+    {
+        for (int x = texelMin.x; x <= texelMax.x; ++x)
+        {
+            if (minDepth <= depths[y * levelSize.x + x])
+            {
+                visible = true;
+                break;
+            }
+        }
+    }
+
+    if (!visible)
+    {
+        ++m_stats.occlusionRejectedCount;
+    }
+
+    m_stats.testTime += GetElapsedMilliseconds(start);
+    return visible;
+}
+
+void OcclusionCuller::SetupTriangles()
+{
+    m_triangles.clear();
+    for (std::vector<unsigned int>& tileTriangles : m_tileTriangles)
+    {
+        tileTriangles.clear();
+    }
+
+    for (const OccluderInstance& instance : m_occluders)
+    {
+        const Occluder& occluder = *instance.occluder;
+        glm::mat4 worldViewProjMatrix = m_viewProjMatrix * instance.worldMatrix;
+
+        m_clipVertices.resize(occluder.vertices.size());
+        for (size_t i = 0; i < occluder.vertices.size(); ++i)
+        {
+            m_clipVertices[i] = worldViewProjMatrix * glm::vec4(occluder.vertices[i], 1.0f);
+        }
+
+        for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+        {
+            glm::vec4 triangle[3] = { m_clipVertices[occluder.indices[i]], m_clipVertices[occluder.indices[i + 1]], m_clipVertices[occluder.indices[i + 2]] };
+
+            // Distance to the near plane, positive in front of it
+            float distances[3];
+            int insideCount = 0;
+            for (int j = 0; j < 3; ++j)
+            {
+                distances[j] = triangle[j].z + triangle[j].w;
+                insideCount += distances[j] >= 0.0f;
+            }
+
+            if (insideCount == 3)
+            {
+                AddClippedTriangle(triangle);
+            }
+            else if (insideCount > 0)
+            {
+                // Clip the triangle against the near plane. The result has 3 or 4 vertices
+                glm::vec4 polygon[4];
+                int polygonSize = 0;
+                for (int j = 0; j < 3; ++j)
+                {
+                    int next = (j + 1) % 3;
+                    if (distances[j] >= 0.0f)
+                    {
+                        polygon[polygonSize++] = triangle[j];
+                    }
+                    if ((distances[j] >= 0.0f) != (distances[next] >= 0.0f))
+                    {
+                        float t = distances[j] / (distances[j] - distances[next]);
+                        polygon[polygonSize++] = glm::mix(triangle[j], triangle[next], t);
+                    }
+                }
+
+                glm::vec4 first[3] = { polygon[0], polygon[1], polygon[2] };
+                AddClippedTriangle(first);
+                if (polygonSize == 4)
+                {
+                    glm::vec4 second[3] = { polygon[0], polygon[2], polygon[3] };
+                    AddClippedTriangle(second);
+                }
+            }
+        }
+    }
+}
+
+void OcclusionCuller::AddClippedTriangle(const glm::vec4 clipVertices[3])
+{
+    Triangle triangle;
+    for (int i = 0; i < 3; ++i)
+    {
+        glm::vec3 ndc = glm::vec3(clipVertices[i]) / clipVertices[i].w;
+        triangle.vertices[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // Same as the renderer, back faces are culled. Screen space keeps the orientation of NDC
+    const glm::vec3& v0 = triangle.vertices[0];
+    const glm::vec3& v1 = triangle.vertices[1];
+    const glm::vec3& v2 = triangle.vertices[2];
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (area <= 0.0f)
+    {
+        return;
+    }
+
+    m_triangles.push_back(triangle);
+    BinTriangle(static_cast<unsigned int>(m_triangles.size() - 1));
+}
+
+void OcclusionCuller::BinTriangle(unsigned int triangleIndex)
+{
+    const Triangle& triangle = m_triangles[triangleIndex];
+
+    glm::vec2 boundsMin = glm::min(glm::min(glm::vec2(triangle.vertices[0]), glm::vec2(triangle.vertices[1])), glm::vec2(triangle.vertices[2]));
+    glm::vec2 boundsMax = glm::max(glm::max(glm::vec2(triangle.vertices[0]), glm::vec2(triangle.vertices[1])), glm::vec2(triangle.vertices[2]));
+
+    // Outside of the screen
+    if (boundsMax.x < 0.0f || boundsMax.y < 0.0f || boundsMin.x >= m_width || boundsMin.y >= m_height)
+    {
+        return;
+    }
+
+    int tileMinX = std::max(static_cast<int>(boundsMin.x) / m_tileWidth, 0);
+    int tileMinY = std::max(static_cast<int>(boundsMin.y) / m_tileHeight, 0);
+    int tileMaxX = std::min(static_cast<int>(boundsMax.x) / m_tileWidth, m_tileCountX - 1);
+    int tileMaxY = std::min(static_cast<int>(boundsMax.y) / m_tileHeight, m_tileCountY - 1);
+
+    for (int tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+    {
+        for (int tileX = tileMinX; tileX <= tileMaxX; ++tileX)
+        {
+            m_tileTriangles[tileY * m_tileCountX + tileX].push_back(triangleIndex);
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeTile(int tileIndex)
+{
+    int tileMinX = (tileIndex % m_tileCountX) * m_tileWidth;
+    int tileMinY = (tileIndex / m_tileCountX) * m_tileHeight;
+    int tileMaxX = std::min(tileMinX + m_tileWidth, m_width);
+    int tileMaxY = std::min(tileMinY + m_tileHeight, m_height);
+
+    // Clear the tile to the far plane
+    std::vector<float>& depths = m_levels[0];
+    for (int y = tileMinY; y < tileMaxY; ++y)
+    {
+        std::fill(depths.begin() + y * m_width + tileMinX, depths.begin() + y * m_width + tileMaxX, 1.0f);
+    }
+
+    for (unsigned int triangleIndex : m_tileTriangles[tileIndex])
+    {
+        RasterizeTriangle(m_triangles[triangleIndex], tileMinX, tileMinY, tileMaxX, tileMaxY);
+    }
+}
+
+void OcclusionCuller::RasterizeTriangle(const Triangle& triangle, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY)
+{
+    const glm::vec3& v0 = triangle.vertices[0];
+    const glm::vec3& v1 = triangle.vertices[1];
+    const glm::vec3& v2 = triangle.vertices[2];
+
+    // Pixels covered by the triangle inside the tile. minX is aligned to groups of 4 pixels
+    int minX = std::max(static_cast<int>(std::floor(std::min({ v0.x, v1.x, v2.x }))), tileMinX) & ~3;
+    int minY = std::max(static_cast<int>(std::floor(std::min({ v0.y, v1.y, v2.y }))), tileMinY);
+    int maxX = std::min(static_cast<int>(std::ceil(std::max({ v0.x, v1.x, v2.x }))), tileMaxX - 1);
+    int maxY = std::min(static_cast<int>(std::ceil(std::max({ v0.y, v1.y, v2.y }))), tileMaxY - 1);
+    if (minX > maxX || minY > maxY)
+    {
+        return;
+    }
+
+    // Edge functions E(x, y) = a * x + b * y + c, positive inside. Edge i is opposite to vertex i
+    float a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = v1.x * v2.y - v1.y * v2.x;
+    float a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = v2.x * v0.y - v2.y * v0.x;
+    float a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = v0.x * v1.y - v0.y * v1.x;
+
+    // Depth is linear in screen space: z = v0.z + (v1.z - v0.z) * E1 / area + (v2.z - v0.z) * E2 / area
+    float invArea = 1.0f / (c0 + c1 + c2);
+    float dz1 = (v1.z - v0.z) * invArea;
+    float dz2 = (v2.z - v0.z) * invArea;
+    float za = dz1 * a1 + dz2 * a2;
+    float zb = dz1 * b1 + dz2 * b2;
+    float zc = v0.z + dz1 * c1 + dz2 * c2;
+
+    float* depths = m_levels[0].data();
+
+#if OCCLUSION_CULLER_SSE2
+    // 4 pixels at a time. Tiles have a width multiple of 4, so the groups never cross to another tile
+    __m128 zero = _mm_setzero_ps();
+    __m128 offsetX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 a0v = _mm_set1_ps(a0), a1v = _mm_set1_ps(a1), a2v = _mm_set1_ps(a2);
+    __m128 zav = _mm_set1_ps(za);
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float pixelY = y + 0.5f;
+        __m128 row0 = _mm_set1_ps(b0 * pixelY + c0);
+        __m128 row1 = _mm_set1_ps(b1 * pixelY + c1);
+        __m128 row2 = _mm_set1_ps(b2 * pixelY + c2);
+        __m128 rowZ = _mm_set1_ps(zb * pixelY + zc);
+
+        float* rowDepths = depths + y * m_width;
+        for (int x = minX; x <= maxX; x += 4)
+        {
+            __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsetX);
+
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0v, pixelX), row0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1v, pixelX), row1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2v, pixelX), row2);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            if (_mm_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(zav, pixelX), rowZ);
+            __m128 previous = _mm_loadu_ps(rowDepths + x);
+            __m128 closest = _mm_min_ps(previous, z);
+            _mm_storeu_ps(rowDepths + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, previous)));
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float pixelY = y + 0.5f;
+        float* rowDepths = depths + y * m_width;
+        for (int x = minX; x <= maxX; ++x)
+        {
+            float pixelX = x + 0.5f;
+            if (a0 * pixelX + b0 * pixelY + c0 >= 0.0f && a1 * pixelX + b1 * pixelY + c1 >= 0.0f && a2 * pixelX + b2 * pixelY + c2 >= 0.0f)
+            {
+                rowDepths[x] = std::min(rowDepths[x], za * pixelX + zb * pixelY + zc);
+            }
+        }
+    }
+#endif
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+    for (size_t level = 1; level < m_levels.size(); ++level)
+    {
+        const std::vector<float>& source = m_levels[level - 1];
+        const std::vector<float>& closestSource = level > 1 ? m_closestLevels[level - 1] : m_levels[0];
+        const glm::ivec2& sourceSize = m_levelSizes[level - 1];
+        std::vector<float>& destination = m_levels[level];
+        std::vector<float>& closestDestination = m_closestLevels[level];
+        const glm::ivec2& size = m_levelSizes[level];
+
+        for (int y = 0; y < size.y; ++y)
+        {
+            // The last row and column also take the extra texel of an odd source
+            int sourceMinY = std::min(y * 2, sourceSize.y - 1);
+            int sourceMaxY = (y == size.y - 1) ? sourceSize.y - 1 : y * 2 + 1;
+            for (int x = 0; x < size.x; ++x)
+            {
+                int sourceMinX = std::min(x * 2, sourceSize.x - 1);
+                int sourceMaxX = (x == size.x - 1) ? sourceSize.x - 1 : x * 2 + 1;
+
+                float farthest = 0.0f;
+                float closest = 1.0f;
+                for (int sourceY = sourceMinY; sourceY <= sourceMaxY; ++sourceY)
+                {
+                    for (int sourceX = sourceMinX; sourceX <= sourceMaxX; ++sourceX)
+                    {
+                        farthest = std::max(farthest, source[sourceY * sourceSize.x + sourceX]);
+                        closest = std::min(closest, closestSource[sourceY * sourceSize.x + sourceX]);
+                    }
+                }
+                destination[y * size.x + x] = farthest;
+                closestDestination[y * size.x + x] = closest;
+            }
+        }
+    }
+}
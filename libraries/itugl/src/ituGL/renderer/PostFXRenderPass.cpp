@@ -7,6 +7,7 @@
 PostFXRenderPass::PostFXRenderPass(std::shared_ptr<Material> material, std::shared_ptr<const FramebufferObject> framebuffer)
     : RenderPass(framebuffer), m_material(material)
 {
+    SetName("PostFX");
 }
 
 void PostFXRenderPass::Render()
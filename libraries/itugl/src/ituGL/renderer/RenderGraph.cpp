@@ -0,0 +1,467 @@
+#include <ituGL/renderer/RenderGraph.h>
+
+#include <ituGL/texture/Texture2DObject.h>
+#include <ituGL/texture/FramebufferObject.h>
+#include <ituGL/utils/Profiler.h>
+#include <ituGL/utils/DearImGui.h>
+#include <imgui.h>
+#include <algorithm>
+#include <cassert>
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph& renderGraph, unsigned int passIndex)
+    : m_renderGraph(renderGraph)
+    , m_passIndex(passIndex)
+{
+}
+
+RenderGraph::ResourceHandle RenderGraph::PassBuilder::CreateTexture(const char* name, const TextureDesc& desc)
+{
+    assert(desc.width > 0 && desc.height > 0);
+
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = false;
+    resource.needed = false;
+    resource.firstPass = resource.lastPass = -1;
+    resource.written = false;
+    m_renderGraph.m_resources.push_back(resource);
+    return static_cast<ResourceHandle>(m_renderGraph.m_resources.size() - 1);
+}
+
+void RenderGraph::PassBuilder::Read(ResourceHandle resource)
+{
+    assert(resource >= 0 && resource < static_cast<ResourceHandle>(m_renderGraph.m_resources.size()));
+
+    Pass& pass = m_renderGraph.m_passes[m_passIndex];
+    assert(pass.readCount < MaxPassReads);
+    pass.reads[pass.readCount++] = resource;
+}
+
+void RenderGraph::PassBuilder::WriteColor(ResourceHandle resource, bool clear, const Color& clearColor)
+{
+    assert(resource >= 0 && resource < static_cast<ResourceHandle>(m_renderGraph.m_resources.size()));
+
+    Pass& pass = m_renderGraph.m_passes[m_passIndex];
+    assert(!pass.backbuffer);
+    assert(pass.colorAttachmentCount < RenderTargetPool::MaxColorAttachments);
+
+    Attachment& attachment = pass.colorAttachments[pass.colorAttachmentCount++];
+    attachment.resource = resource;
+    attachment.clear = clear;
+    attachment.clearColor = clearColor;
+}
+
+void RenderGraph::PassBuilder::WriteDepth(ResourceHandle resource, bool clear, float clearDepth)
+{
+    assert(resource >= 0 && resource < static_cast<ResourceHandle>(m_renderGraph.m_resources.size()));
+
+    Pass& pass = m_renderGraph.m_passes[m_passIndex];
+    assert(!pass.backbuffer);
+
+    Attachment& attachment = pass.depthAttachment;
+    attachment.resource = resource;
+    attachment.clear = clear;
+    attachment.clearDepth = clearDepth;
+}
+
+void RenderGraph::PassBuilder::WriteBackbuffer(bool clearColor, bool clearDepth, const Color& color, float depth)
+{
+    Pass& pass = m_renderGraph.m_passes[m_passIndex];
+    assert(pass.colorAttachmentCount == 0 && pass.depthAttachment.resource == InvalidResource);
+
+    pass.backbuffer = true;
+    pass.clearBackbufferColor = clearColor;
+    pass.clearBackbufferDepth = clearDepth;
+    pass.backbufferClearColor = color;
+    pass.backbufferClearDepth = depth;
+}
+
+void RenderGraph::PassBuilder::SetSideEffect()
+{
+    m_renderGraph.m_passes[m_passIndex].sideEffect = true;
+}
+
+RenderGraph::RenderGraph()
+    : m_backbufferWidth(0)
+    , m_backbufferHeight(0)
+    , m_profiler(nullptr)
+{
+}
+
+void RenderGraph::Reset(int backbufferWidth, int backbufferHeight)
+{
+    m_passes.clear();
+    m_resources.clear();
+    m_currentFramebuffer = nullptr;
+
+    m_backbufferWidth = backbufferWidth;
+    m_backbufferHeight = backbufferHeight;
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportTexture(const char* name, std::shared_ptr<Texture2DObject> texture, const TextureDesc& desc)
+{
+    assert(texture);
+
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.texture = texture;
+    resource.imported = true;
+    resource.needed = false;
+    resource.firstPass = resource.lastPass = -1;
+    resource.written = false;
+    m_resources.push_back(resource);
+    return static_cast<ResourceHandle>(m_resources.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name, ExecuteFunction execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    pass.readCount = 0;
+    pass.colorAttachmentCount = 0;
+    pass.backbuffer = false;
+    pass.clearBackbufferColor = false;
+    pass.clearBackbufferDepth = false;
+    pass.backbufferClearDepth = 1.0f;
+    pass.sideEffect = false;
+    pass.culled = false;
+    pass.width = 0;
+    pass.height = 0;
+    m_passes.push_back(std::move(pass));
+
+    return PassBuilder(*this, static_cast<unsigned int>(m_passes.size() - 1));
+}
+
+template<typename F>
+void RenderGraph::ForEachAttachment(const Pass& pass, F function) const
+{
+    for (unsigned int i = 0; i < pass.colorAttachmentCount; ++i)
+    {
+        function(pass.colorAttachments[i]);
+    }
+    if (pass.depthAttachment.resource != InvalidResource)
+    {
+        function(pass.depthAttachment);
+    }
+}
+
+void RenderGraph::Compile()
+{
+    m_stats = Stats();
+    m_stats.passCount = static_cast<unsigned int>(m_passes.size());
+
+    for (Resource& resource : m_resources)
+    {
+        resource.needed = false;
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+        resource.written = false;
+    }
+
+    // Walk the passes backwards. A pass is needed if it writes contents that a later needed pass uses
+    for (int passIndex = static_cast<int>(m_passes.size()) - 1; passIndex >= 0; --passIndex)
+    {
+        Pass& pass = m_passes[passIndex];
+
+        bool needed = pass.sideEffect || pass.backbuffer;
+        ForEachAttachment(pass, [&](const Attachment& attachment)
+            {
+                const Resource& resource = m_resources[attachment.resource];
+                needed |= resource.needed || resource.imported;
+            });
+
+        pass.culled = !needed;
+        if (pass.culled)
+        {
+            m_stats.culledPassCount++;
+            continue;
+        }
+
+        // Cleared textures do not need the contents of the previous passes. Otherwise, the pass builds on them
+        ForEachAttachment(pass, [&](const Attachment& attachment)
+            {
+                m_resources[attachment.resource].needed = !attachment.clear;
+            });
+        for (unsigned int i = 0; i < pass.readCount; ++i)
+        {
+            m_resources[pass.reads[i]].needed = true;
+        }
+    }
+
+    // Lifetime of each resource, from the first to the last pass that uses it
+    for (int passIndex = 0; passIndex < static_cast<int>(m_passes.size()); ++passIndex)
+    {
+        const Pass& pass = m_passes[passIndex];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        auto usePass = [&](ResourceHandle resourceHandle)
+        {
+            Resource& resource = m_resources[resourceHandle];
+            if (resource.firstPass < 0)
+            {
+                resource.firstPass = passIndex;
+            }
+            resource.lastPass = passIndex;
+        };
+        ForEachAttachment(pass, [&](const Attachment& attachment) { usePass(attachment.resource); });
+        for (unsigned int i = 0; i < pass.readCount; ++i)
+        {
+            usePass(pass.reads[i]);
+        }
+    }
+
+    // Take the textures from the pool when their lifetime starts, and give them back when it ends,
+    // so the next resources with the same description reuse them
+    for (int passIndex = 0; passIndex < static_cast<int>(m_passes.size()); ++passIndex)
+    {
+        Pass& pass = m_passes[passIndex];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        for (Resource& resource : m_resources)
+        {
+            if (resource.firstPass == passIndex && !resource.imported)
+            {
+                resource.texture = m_pool.AcquireTexture(resource.desc);
+                m_stats.textureCount++;
+            }
+        }
+
+        if (pass.backbuffer)
+        {
+            pass.framebuffer = FramebufferObject::GetDefault();
+            pass.width = m_backbufferWidth;
+            pass.height = m_backbufferHeight;
+        }
+        else if (pass.colorAttachmentCount > 0 || pass.depthAttachment.resource != InvalidResource)
+        {
+            std::array<const Texture2DObject*, RenderTargetPool::MaxColorAttachments> colorTextures;
+            for (unsigned int i = 0; i < pass.colorAttachmentCount; ++i)
+            {
+                colorTextures[i] = m_resources[pass.colorAttachments[i].resource].texture.get();
+            }
+            ResourceHandle depthResource = pass.depthAttachment.resource;
+            const Texture2DObject* depthTexture = depthResource != InvalidResource ? m_resources[depthResource].texture.get() : nullptr;
+            pass.framebuffer = m_pool.GetFramebuffer(std::span<const Texture2DObject* const>(colorTextures.data(), pass.colorAttachmentCount),
+                depthTexture, depthTexture && IsDepthStencil(depthResource));
+
+            // All the attachments must have the same size
+            ForEachAttachment(pass, [&](const Attachment& attachment)
+                {
+                    const TextureDesc& desc = m_resources[attachment.resource].desc;
+                    assert(pass.width == 0 || (pass.width == desc.width && pass.height == desc.height));
+                    pass.width = desc.width;
+                    pass.height = desc.height;
+                });
+        }
+
+        for (Resource& resource : m_resources)
+        {
+            if (resource.lastPass == passIndex && !resource.imported)
+            {
+                m_pool.ReleaseTexture(*resource.texture);
+            }
+        }
+    }
+
+    // Different textures of the pool used this frame
+    for (unsigned int i = 0; i < m_resources.size(); ++i)
+    {
+        const Resource& resource = m_resources[i];
+        if (resource.imported || !resource.texture)
+        {
+            continue;
+        }
+        auto itFirst = std::find_if(m_resources.begin(), m_resources.begin() + i,
+            [&resource](const Resource& other) { return !other.imported && other.texture == resource.texture; });
+        if (itFirst == m_resources.begin() + i)
+        {
+            m_stats.pooledTextureCount++;
+        }
+    }
+}
+
+void RenderGraph::Execute()
+{
+    // Unknown at the start of the frame, so the first pass always binds its framebuffer
+    const FramebufferObject* boundFramebuffer = nullptr;
+
+    for (Pass& pass : m_passes)
+    {
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        if (m_profiler)
+        {
+            m_profiler->BeginSection(pass.name);
+        }
+
+        // Passes without attachments keep the framebuffer of the previous pass
+        if (pass.framebuffer)
+        {
+            m_currentFramebuffer = pass.framebuffer;
+            if (m_currentFramebuffer.get() != boundFramebuffer)
+            {
+                m_currentFramebuffer->Bind();
+                glViewport(0, 0, pass.width, pass.height);
+                boundFramebuffer = m_currentFramebuffer.get();
+                m_stats.framebufferBindCount++;
+            }
+            ClearAttachments(pass);
+        }
+
+        pass.execute(*this);
+
+        if (m_profiler)
+        {
+            m_profiler->EndSection();
+        }
+    }
+
+    m_currentFramebuffer = nullptr;
+    m_pool.EndFrame();
+}
+
+void RenderGraph::ClearAttachments(Pass& pass)
+{
+    if (pass.backbuffer)
+    {
+        GLbitfield mask = 0;
+        if (pass.clearBackbufferColor)
+        {
+            const Color& color = pass.backbufferClearColor;
+            glClearColor(color.GetRed(), color.GetGreen(), color.GetBlue(), color.GetAlpha());
+            mask |= GL_COLOR_BUFFER_BIT;
+        }
+        if (pass.clearBackbufferDepth)
+        {
+            glClearDepth(pass.backbufferClearDepth);
+            mask |= GL_DEPTH_BUFFER_BIT;
+        }
+        if (mask)
+        {
+            glClear(mask);
+            m_stats.clearCount++;
+        }
+        return;
+    }
+
+    // Each attachment is cleared separately, only the first time it is written
+    for (unsigned int i = 0; i < pass.colorAttachmentCount; ++i)
+    {
+        const Attachment& attachment = pass.colorAttachments[i];
+        Resource& resource = m_resources[attachment.resource];
+        if (attachment.clear && !resource.written)
+        {
+            const Color& color = attachment.clearColor;
+            GLfloat clearColor[4] = { color.GetRed(), color.GetGreen(), color.GetBlue(), color.GetAlpha() };
+            glClearBufferfv(GL_COLOR, i, clearColor);
+            m_stats.clearCount++;
+        }
+        resource.written = true;
+    }
+
+    const Attachment& depthAttachment = pass.depthAttachment;
+    if (depthAttachment.resource != InvalidResource)
+    {
+        Resource& resource = m_resources[depthAttachment.resource];
+        if (depthAttachment.clear && !resource.written)
+        {
+            if (IsDepthStencil(depthAttachment.resource))
+            {
+                glClearBufferfi(GL_DEPTH_STENCIL, 0, depthAttachment.clearDepth, 0);
+            }
+            else
+            {
+                glClearBufferfv(GL_DEPTH, 0, &depthAttachment.clearDepth);
+            }
+            m_stats.clearCount++;
+        }
+        resource.written = true;
+    }
+}
+
+std::shared_ptr<Texture2DObject> RenderGraph::GetTexture(ResourceHandle resource) const
+{
+    assert(resource >= 0 && resource < static_cast<ResourceHandle>(m_resources.size()));
+    return m_resources[resource].texture;
+}
+
+const RenderGraph::TextureDesc& RenderGraph::GetTextureDesc(ResourceHandle resource) const
+{
+    assert(resource >= 0 && resource < static_cast<ResourceHandle>(m_resources.size()));
+    return m_resources[resource].desc;
+}
+
+std::shared_ptr<const FramebufferObject> RenderGraph::GetFramebuffer(ResourceHandle colorResource, ResourceHandle depthResource)
+{
+    return GetFramebuffer(std::span<const ResourceHandle>(&colorResource, 1), depthResource);
+}
+
+std::shared_ptr<const FramebufferObject> RenderGraph::GetFramebuffer(std::span<const ResourceHandle> colorResources, ResourceHandle depthResource)
+{
+    assert(colorResources.size() <= RenderTargetPool::MaxColorAttachments);
+
+    std::array<const Texture2DObject*, RenderTargetPool::MaxColorAttachments> colorTextures;
+    for (unsigned int i = 0; i < colorResources.size(); ++i)
+    {
+        colorTextures[i] = GetTexture(colorResources[i]).get();
+    }
+    const Texture2DObject* depthTexture = depthResource != InvalidResource ? GetTexture(depthResource).get() : nullptr;
+    return m_pool.GetFramebuffer(std::span<const Texture2DObject* const>(colorTextures.data(), colorResources.size()),
+        depthTexture, depthTexture && IsDepthStencil(depthResource));
+}
+
+bool RenderGraph::IsDepthStencil(ResourceHandle resource) const
+{
+    return GetTextureDesc(resource).format == TextureObject::FormatDepthStencil;
+}
+
+void RenderGraph::GetResults(Results& results) const
+{
+    results.stats = m_stats;
+    results.poolStats = m_pool.GetStats();
+
+    results.passes.clear();
+    for (const Pass& pass : m_passes)
+    {
+        results.passes.emplace_back(pass.name, pass.culled);
+    }
+}
+
+void RenderGraph::DrawGUI(DearImGui& imGui) const
+{
+    Results results;
+    GetResults(results);
+    DrawGUI(imGui, results);
+}
+
+void RenderGraph::DrawGUI(DearImGui& imGui, const Results& results)
+{
+    if (auto window = imGui.UseWindow("Render graph"))
+    {
+        const Stats& stats = results.stats;
+        ImGui::Text("Passes: %u (%u culled)", stats.passCount, stats.culledPassCount);
+        ImGui::Text("Textures: %u in %u pooled textures", stats.textureCount, stats.pooledTextureCount);
+        ImGui::Text("Framebuffer binds: %u, clears: %u", stats.framebufferBindCount, stats.clearCount);
+
+        const RenderTargetPool::Stats& poolStats = results.poolStats;
+        ImGui::Text("Pool: %u textures, %u framebuffers", poolStats.textureCount, poolStats.framebufferCount);
+
+        ImGui::Separator();
+        for (const auto& [name, culled] : results.passes)
+        {
+            ImGui::Text("%-16s %s", name, culled ? "culled" : "");
+        }
+    }
+}
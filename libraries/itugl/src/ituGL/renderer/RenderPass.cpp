@@ -6,6 +6,8 @@
 RenderPass::RenderPass(std::shared_ptr<const FramebufferObject> targetFramebuffer)
     : m_renderer(nullptr)
     , m_targetFramebuffer(targetFramebuffer)
+    , m_name("RenderPass")
+    , m_enabled(true)
 {
 }
 
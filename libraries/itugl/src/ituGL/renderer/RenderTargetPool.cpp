@@ -0,0 +1,154 @@
+#include <ituGL/renderer/RenderTargetPool.h>
+
+#include <ituGL/texture/Texture2DObject.h>
+#include <ituGL/texture/FramebufferObject.h>
+#include <algorithm>
+#include <cassert>
+
+RenderTargetPool::RenderTargetPool(unsigned int maxUnusedFrames)
+    : m_frameIndex(0)
+    , m_maxUnusedFrames(maxUnusedFrames)
+{
+}
+
+std::shared_ptr<Texture2DObject> RenderTargetPool::AcquireTexture(const TextureDesc& desc)
+{
+    assert(desc.width > 0 && desc.height > 0);
+
+    for (PooledTexture& pooledTexture : m_textures)
+    {
+        if (!pooledTexture.acquired && pooledTexture.desc == desc)
+        {
+            pooledTexture.acquired = true;
+            pooledTexture.lastUsedFrame = m_frameIndex;
+            return pooledTexture.texture;
+        }
+    }
+
+    std::shared_ptr<Texture2DObject> texture = std::make_shared<Texture2DObject>();
+    texture->Bind();
+    texture->SetImage(0, desc.width, desc.height, desc.format, desc.internalFormat);
+
+    // Without mipmaps, so the default minification filter would leave the texture incomplete
+    GLenum filter = IsDepthFormat(desc.format) ? GL_NEAREST : GL_LINEAR;
+    texture->SetParameter(TextureObject::ParameterEnum::MinFilter, filter);
+    texture->SetParameter(TextureObject::ParameterEnum::MagFilter, filter);
+    texture->SetParameter(TextureObject::ParameterEnum::WrapS, GL_CLAMP_TO_EDGE);
+    texture->SetParameter(TextureObject::ParameterEnum::WrapT, GL_CLAMP_TO_EDGE);
+    Texture2DObject::Unbind();
+
+    m_textures.push_back(PooledTexture{ texture, desc, true, m_frameIndex });
+    m_stats.textureCount = static_cast<unsigned int>(m_textures.size());
+    m_stats.createdTextureCount++;
+
+    return texture;
+}
+
+void RenderTargetPool::ReleaseTexture(const Texture2DObject& texture)
+{
+    auto itTexture = std::find_if(m_textures.begin(), m_textures.end(),
+        [&texture](const PooledTexture& pooledTexture) { return pooledTexture.texture.get() == &texture; });
+    assert(itTexture != m_textures.end() && itTexture->acquired);
+    itTexture->acquired = false;
+}
+
+std::shared_ptr<const FramebufferObject> RenderTargetPool::GetFramebuffer(std::span<const Texture2DObject* const> colorTextures, const Texture2DObject* depthTexture, bool depthStencil)
+{
+    assert(colorTextures.size() <= MaxColorAttachments);
+
+    for (PooledFramebuffer& pooledFramebuffer : m_framebuffers)
+    {
+        if (pooledFramebuffer.depthTexture == depthTexture && pooledFramebuffer.colorTextureCount == colorTextures.size()
+            && std::equal(colorTextures.begin(), colorTextures.end(), pooledFramebuffer.colorTextures.begin()))
+        {
+            pooledFramebuffer.lastUsedFrame = m_frameIndex;
+            return pooledFramebuffer.framebuffer;
+        }
+    }
+
+    PooledFramebuffer pooledFramebuffer;
+    pooledFramebuffer.framebuffer = std::make_shared<FramebufferObject>();
+    pooledFramebuffer.colorTextures.fill(nullptr);
+    std::copy(colorTextures.begin(), colorTextures.end(), pooledFramebuffer.colorTextures.begin());
+    pooledFramebuffer.colorTextureCount = static_cast<unsigned int>(colorTextures.size());
+    pooledFramebuffer.depthTexture = depthTexture;
+    pooledFramebuffer.lastUsedFrame = m_frameIndex;
+
+    FramebufferObject& framebuffer = *pooledFramebuffer.framebuffer;
+    framebuffer.Bind();
+
+    std::array<FramebufferObject::Attachment, MaxColorAttachments> drawBuffers;
+    for (unsigned int i = 0; i < colorTextures.size(); ++i)
+    {
+        drawBuffers[i] = static_cast<FramebufferObject::Attachment>(static_cast<GLenum>(FramebufferObject::Attachment::Color0) + i);
+        framebuffer.SetTexture(FramebufferObject::Target::Both, drawBuffers[i], *colorTextures[i], 0);
+    }
+    if (depthTexture)
+    {
+        FramebufferObject::Attachment depthAttachment = depthStencil ? FramebufferObject::Attachment::DepthStencil : FramebufferObject::Attachment::Depth;
+        framebuffer.SetTexture(FramebufferObject::Target::Both, depthAttachment, *depthTexture, 0);
+    }
+
+    // Depth only framebuffers have no draw buffers
+    if (colorTextures.empty())
+    {
+        glDrawBuffer(GL_NONE);
+    }
+    else
+    {
+        framebuffer.SetDrawBuffers(std::span<const FramebufferObject::Attachment>(drawBuffers.data(), colorTextures.size()));
+    }
+
+    FramebufferObject::Unbind();
+
+    m_framebuffers.push_back(pooledFramebuffer);
+    m_stats.framebufferCount = static_cast<unsigned int>(m_framebuffers.size());
+
+    return pooledFramebuffer.framebuffer;
+}
+
+void RenderTargetPool::EndFrame()
+{
+    // Framebuffers go first, they can have expired textures attached
+    for (const PooledTexture& pooledTexture : m_textures)
+    {
+        if (!pooledTexture.acquired && IsExpired(pooledTexture.lastUsedFrame))
+        {
+            RemoveFramebuffers(pooledTexture.texture.get());
+        }
+    }
+    std::erase_if(m_framebuffers, [this](const PooledFramebuffer& pooledFramebuffer) { return IsExpired(pooledFramebuffer.lastUsedFrame); });
+    std::erase_if(m_textures, [this](const PooledTexture& pooledTexture) { return !pooledTexture.acquired && IsExpired(pooledTexture.lastUsedFrame); });
+
+    m_frameIndex++;
+
+    m_stats.textureCount = static_cast<unsigned int>(m_textures.size());
+    m_stats.createdTextureCount = 0;
+    m_stats.framebufferCount = static_cast<unsigned int>(m_framebuffers.size());
+}
+
+void RenderTargetPool::Clear()
+{
+    m_framebuffers.clear();
+    m_textures.clear();
+    m_stats = Stats();
+}
+
+bool RenderTargetPool::IsDepthFormat(TextureObject::Format format)
+{
+    return format == TextureObject::FormatDepth || format == TextureObject::FormatDepthStencil;
+}
+
+bool RenderTargetPool::IsExpired(unsigned int lastUsedFrame) const
+{
+    return m_frameIndex - lastUsedFrame >= m_maxUnusedFrames;
+}
+
+void RenderTargetPool::RemoveFramebuffers(const Texture2DObject* texture)
+{
+    std::erase_if(m_framebuffers, [texture](const PooledFramebuffer& pooledFramebuffer)
+        {
+            return pooledFramebuffer.depthTexture == texture
+                || std::find(pooledFramebuffer.colorTextures.begin(), pooledFramebuffer.colorTextures.end(), texture) != pooledFramebuffer.colorTextures.end();
+        });
+}
@@ -9,6 +9,9 @@
 #include <ituGL/camera/Camera.h>
 #include <ituGL/texture/FramebufferObject.h>
 #include <ituGL/renderer/RenderPass.h>
+#include <ituGL/renderer/OcclusionCuller.h>
+#include <ituGL/utils/Profiler.h>
+#include <ituGL/utils/AllocationTracker.h>
 #include <span>
 #include <algorithm>
 #include <cassert>
@@ -18,20 +21,10 @@ Renderer::DrawcallInfo::DrawcallInfo(const Material& material, unsigned int worl
 {
 }
 
-Renderer::DrawcallCollection::DrawcallCollection(const DrawcallSupportedFunction& isSupported) : m_isSupported(isSupported)
+Renderer::DrawcallCollection::DrawcallCollection(Material::PassMask passMask) : m_passMask(passMask)
 {
 }
 
-bool Renderer::DrawcallCollection::IsSupported(const DrawcallInfo& drawcallInfo) const
-{
-    return !m_isSupported || m_isSupported(drawcallInfo);
-}
-
-void Renderer::DrawcallCollection::SetSupportedFunction(const DrawcallSupportedFunction& isSupported)
-{
-    m_isSupported = isSupported;
-}
-
 void Renderer::DrawcallCollection::AddDrawcall(const DrawcallInfo& drawcallInfo)
 {
     if (IsSupported(drawcallInfo))
@@ -45,13 +38,24 @@ void Renderer::DrawcallCollection::Clear()
     m_drawcallInfos.clear();
 }
 
+void Renderer::DrawcallCollection::SetArena(FrameArena& arena)
+{
+    size_t capacity = m_drawcallInfos.capacity();
+    m_drawcallInfos = FrameArena::Vector<DrawcallInfo>(&arena);
+    m_drawcallInfos.reserve(capacity);
+}
+
 
 Renderer::Renderer(DeviceGL& device)
     : m_device(device)
     , m_currentCamera(nullptr)
     , m_defaultFramebuffer(FramebufferObject::GetDefault())
     , m_currentFramebuffer(m_defaultFramebuffer)
+    , m_frameIndex(0)
     , m_drawcallCollections(1)
+    , m_profiler(nullptr)
+    , m_occlusionCuller(nullptr)
+    , m_commandListSize(64)
 {
     InitializeFullscreenMesh();
 
@@ -59,7 +63,6 @@ Renderer::Renderer(DeviceGL& device)
     device.EnableFeature(GL_DEPTH_TEST);
     device.EnableFeature(GL_CULL_FACE);
     device.EnableFeature(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-    device.SetVSyncEnabled(true);
 }
 
 bool Renderer::HasCamera() const
@@ -97,24 +100,82 @@ void Renderer::SetCurrentFramebuffer(std::shared_ptr<const FramebufferObject> fr
     }
 }
 
+void Renderer::SyncCurrentFramebuffer(std::shared_ptr<const FramebufferObject> framebuffer)
+{
+    assert(framebuffer);
+    m_currentFramebuffer = framebuffer;
+}
+
 const Mesh& Renderer::GetFullscreenMesh() const
 {
     return m_fullscreenMesh;
 }
 
-void Renderer::Render()
+void Renderer::BeginFrame()
 {
-    assert(m_currentCamera);
+    // Destroy the elements while the memory of the arena is still valid
+    Reset();
+
+    // The containers point to the released memory, so they are recreated
+    // Reserve the capacity reached in the previous frame, so the containers do not grow during the frame
+    size_t lightCapacity = m_lights.capacity();
+    size_t worldMatrixCapacity = m_worldMatrices.capacity();
+    m_frameArena.Reset();
+    ++m_frameIndex;
 
-    for (auto& pass : m_passes)
+    m_lights = FrameArena::Vector<const Light*>(&m_frameArena);
+    m_lights.reserve(lightCapacity);
+
+    m_worldMatrices = FrameArena::Vector<glm::mat4>(&m_frameArena);
+    m_worldMatrices.reserve(worldMatrixCapacity);
+
+    for (DrawcallCollection& collection : m_drawcallCollections)
     {
-        SetCurrentFramebuffer(pass->GetTargetFramebuffer());
-        pass->Render();
+        collection.SetArena(m_frameArena);
+    }
+}
+
+void Renderer::Render(int firstPassIndex)
+{
+    assert(firstPassIndex >= 0 && firstPassIndex <= static_cast<int>(m_passes.size()));
+
+    for (int passIndex = firstPassIndex; passIndex < static_cast<int>(m_passes.size()); ++passIndex)
+    {
+        RenderSinglePass(passIndex);
     }
 
     Reset();
 }
 
+void Renderer::RenderSinglePass(int passIndex)
+{
+    assert(m_currentCamera);
+
+    RenderPass& pass = *m_passes[passIndex];
+    if (!pass.IsEnabled())
+    {
+        return;
+    }
+
+    AllocationTracker::Scope allocationScope("Renderer::Render");
+
+    if (m_profiler)
+    {
+        m_profiler->BeginSection(pass.GetName());
+    }
+
+    SetCurrentFramebuffer(pass.GetTargetFramebuffer());
+    pass.Render();
+
+    // Passes can set states and bind textures without the tracker, so they are unknown for the next one
+    m_renderStateTracker.Invalidate();
+
+    if (m_profiler)
+    {
+        m_profiler->EndSection();
+    }
+}
+
 void Renderer::Reset()
 {
     m_worldMatrices.clear();
@@ -143,29 +204,54 @@ void Renderer::RegisterShaderProgram(std::shared_ptr<const ShaderProgram> shader
 {
     assert(shaderProgramPtr);
 
+    unsigned int id = shaderProgramPtr->GetId();
+    assert(id != ShaderProgram::InvalidId);
+    if (id >= m_shaderProgramFunctions.size())
+    {
+        m_shaderProgramFunctions.resize(id + 1);
+    }
+
+    // Keep the program alive, so its id is not used by another one while registered
+    ShaderProgramFunctions& functions = m_shaderProgramFunctions[id];
+    if (functions.shaderProgram != shaderProgramPtr)
+    {
+        functions = ShaderProgramFunctions();
+        functions.shaderProgram = shaderProgramPtr;
+    }
+
     if (updateTransformFunction)
     {
-        m_updateTransformsFunctions[shaderProgramPtr] = updateTransformFunction;
+        functions.updateTransforms = updateTransformFunction;
     }
 
     if (updateLightsFunction)
     {
-        m_updateLightsFunctions[shaderProgramPtr] = updateLightsFunction;
+        functions.updateLights = updateLightsFunction;
     }
 }
 
-void Renderer::UpdateTransforms(std::shared_ptr<const ShaderProgram> shaderProgramPtr, unsigned int worldMatrixIndex, bool cameraChanged) const
+const Renderer::ShaderProgramFunctions* Renderer::FindShaderProgramFunctions(const ShaderProgram& shaderProgram) const
+{
+    unsigned int id = shaderProgram.GetId();
+    if (id < m_shaderProgramFunctions.size() && m_shaderProgramFunctions[id].shaderProgram.get() == &shaderProgram)
+    {
+        return &m_shaderProgramFunctions[id];
+    }
+    return nullptr;
+}
+
+void Renderer::UpdateTransforms(const ShaderProgram& shaderProgram, unsigned int worldMatrixIndex, bool cameraChanged) const
 {
     const glm::mat4& worldMatrix = m_worldMatrices[worldMatrixIndex];
-    UpdateTransforms(shaderProgramPtr, worldMatrix);
+    UpdateTransforms(shaderProgram, worldMatrix, cameraChanged);
 }
 
-void Renderer::UpdateTransforms(std::shared_ptr<const ShaderProgram> shaderProgramPtr, const glm::mat4& worldMatrix, bool cameraChanged) const
+void Renderer::UpdateTransforms(const ShaderProgram& shaderProgram, const glm::mat4& worldMatrix, bool cameraChanged) const
 {
-    const auto& itFind = m_updateTransformsFunctions.find(shaderProgramPtr);
-    if (itFind != m_updateTransformsFunctions.end())
+    const ShaderProgramFunctions* functions = FindShaderProgramFunctions(shaderProgram);
+    if (functions && functions->updateTransforms)
     {
-        itFind->second(*shaderProgramPtr, worldMatrix, *m_currentCamera, cameraChanged);
+        functions->updateTransforms(shaderProgram, worldMatrix, *m_currentCamera, cameraChanged);
     }
 }
 
@@ -205,16 +291,22 @@ Renderer::UpdateLightsFunction Renderer::GetDefaultUpdateLightsFunction(const Sh
     };
 }
 
-bool Renderer::UpdateLights(std::shared_ptr<const ShaderProgram> shaderProgramPtr, std::span<const Light* const> lights, unsigned int& lightIndex) const
+bool Renderer::UpdateLights(const ShaderProgram& shaderProgram, std::span<const Light* const> lights, unsigned int& lightIndex) const
 {
-    const auto& itFind = m_updateLightsFunctions.find(shaderProgramPtr);
-    if (itFind != m_updateLightsFunctions.end())
+    const ShaderProgramFunctions* functions = FindShaderProgramFunctions(shaderProgram);
+    if (functions && functions->updateLights)
     {
-        return itFind->second(*shaderProgramPtr, lights, lightIndex);
+        return functions->updateLights(shaderProgram, lights, lightIndex);
     }
     return false;
 }
 
+bool Renderer::HasUpdateLightsFunction(const ShaderProgram& shaderProgram) const
+{
+    const ShaderProgramFunctions* functions = FindShaderProgramFunctions(shaderProgram);
+    return functions && functions->updateLights;
+}
+
 std::span<const Light* const> Renderer::GetLights() const
 {
     return m_lights;
@@ -238,6 +330,14 @@ void Renderer::AddModel(const Model& model, const glm::mat4& worldMatrix)
     const Mesh& mesh = model.GetMesh();
     for (unsigned int submeshIndex = 0; submeshIndex < mesh.GetSubmeshCount(); ++submeshIndex)
     {
+        // Skip the submesh if its bounds are hidden. Submeshes without bounds are always drawn
+        glm::vec3 boundsMin, boundsMax;
+        if (m_occlusionCuller && mesh.GetSubmeshBounds(submeshIndex, boundsMin, boundsMax)
+            && !m_occlusionCuller->IsVisible(boundsMin, boundsMax, worldMatrix))
+        {
+            continue;
+        }
+
         DrawcallInfo drawcallInfo(model.GetMaterial(submeshIndex), worldMatrixIndex,
             mesh.GetSubmeshVertexArray(submeshIndex), mesh.GetSubmeshDrawcall(submeshIndex));
 
@@ -248,16 +348,16 @@ void Renderer::AddModel(const Model& model, const glm::mat4& worldMatrix)
     }
 }
 
-unsigned int Renderer::AddDrawcallCollection(const DrawcallSupportedFunction& drawcallSupportedFunction)
+unsigned int Renderer::AddDrawcallCollection(Material::PassMask passMask)
 {
     unsigned int index = static_cast<unsigned int>(m_drawcallCollections.size());
-    m_drawcallCollections.push_back(DrawcallCollection(drawcallSupportedFunction));
+    m_drawcallCollections.push_back(DrawcallCollection(passMask));
     return index;
 }
 
-void Renderer::SetDrawcallCollectionSupportedFunction(unsigned int index, const DrawcallSupportedFunction& drawcallSupportedFunction)
+void Renderer::SetDrawcallCollectionPassMask(unsigned int index, Material::PassMask passMask)
 {
-    m_drawcallCollections[index].SetSupportedFunction(drawcallSupportedFunction);
+    m_drawcallCollections[index].SetPassMask(passMask);
 }
 
 void Renderer::SortDrawcallCollection(unsigned int index, const DrawcallSortFunction& drawcallSortFunction)
@@ -285,12 +385,12 @@ bool Renderer::IsFrontToBack(const DrawcallInfo& a, const DrawcallInfo& b) const
 
 void Renderer::PrepareDrawcall(const DrawcallInfo& drawcallInfo, Material::OverrideFlags materialOverride)
 {
-    std::shared_ptr<const ShaderProgram> shaderProgram = drawcallInfo.GetMaterial().GetShaderProgram();
+    const ShaderProgram& shaderProgram = drawcallInfo.GetMaterial().GetShaderProgramReference();
 
     // TODO: Room for optimization here, caching current material, current worldMatrixIndex and current VAO
 
-    // Setup material
-    drawcallInfo.GetMaterial().Use(materialOverride);
+    // Setup material. Only the render states that differ from the previous drawcall are set
+    drawcallInfo.GetMaterial().Use(m_renderStateTracker, materialOverride);
 
     // Setup world matrix
     // Setup camera
@@ -305,9 +405,17 @@ void Renderer::SetLightingRenderStates(bool firstPass)
     // Set the render states for the first and additional lights
     if (!firstPass)
     {
-        m_device.SetFeatureEnabled(GL_BLEND, true);
-        glDepthFunc(firstPass ? GL_LESS : GL_EQUAL);
-        glBlendFunc(GL_ONE, GL_ONE);
+        // Add the light to the pixels written by the first pass
+        RenderState::BlendState additiveBlend;
+        additiveBlend.enabled = true;
+        additiveBlend.equations = { GL_FUNC_ADD, GL_FUNC_ADD };
+        additiveBlend.params = { GL_ONE, GL_ONE, GL_ONE, GL_ONE };
+        additiveBlend.color = { 0.0f, 0.0f, 0.0f, 0.0f };
+        m_renderStateTracker.ApplyBlend(additiveBlend);
+
+        RenderState::DepthState depth = m_renderStateTracker.GetDepth();
+        depth.function = GL_EQUAL;
+        m_renderStateTracker.ApplyDepth(depth);
     }
 }
 
@@ -328,3 +436,44 @@ const glm::mat4& Renderer::GetWorldMatrix(const DrawcallInfo& drawcallInfo) cons
 {
     return m_worldMatrices[drawcallInfo.GetWorldMatrixIndex()];
 }
+
+const glm::mat4& Renderer::GetWorldMatrix(unsigned int worldMatrixIndex) const
+{
+    return m_worldMatrices[worldMatrixIndex];
+}
+
+void Renderer::PrepareCommandLists(size_t listCount)
+{
+    if (m_commandLists.size() < listCount)
+    {
+        m_commandLists.resize(listCount);
+    }
+
+    for (size_t listIndex = 0; listIndex < listCount; ++listIndex)
+    {
+        m_commandLists[listIndex].commandList.Clear();
+    }
+}
+
+void Renderer::ExecuteCommandLists(size_t listCount)
+{
+    m_commandListStats.recordTimes.resize(JobSystem::GetInstance().GetWorkerCount(), 0.0f);
+
+    // Lists are executed in the order of the drawcalls, whatever thread recorded them
+    for (size_t listIndex = 0; listIndex < listCount; ++listIndex)
+    {
+        const RecordedCommandList& recordedList = m_commandLists[listIndex];
+        recordedList.commandList.Execute(*this);
+
+        m_commandListStats.listCount++;
+        m_commandListStats.commandCount += recordedList.commandList.GetCommandCount();
+        m_commandListStats.recordTimes[recordedList.workerIndex] += recordedList.recordTime;
+    }
+}
+
+void Renderer::ResetCommandListStats()
+{
+    m_commandListStats.listCount = 0;
+    m_commandListStats.commandCount = 0;
+    std::fill(m_commandListStats.recordTimes.begin(), m_commandListStats.recordTimes.end(), 0.0f);
+}
@@ -0,0 +1,210 @@
+#include <ituGL/renderer/SceneCopyRenderPass.h>
+
+#include <ituGL/renderer/Renderer.h>
+#include <ituGL/geometry/Mesh.h>
+#include <ituGL/asset/ShaderLoader.h>
+#include <ituGL/texture/Texture2DObject.h>
+#include <ituGL/texture/FramebufferObject.h>
+#include <ituGL/utils/Profiler.h>
+#include <algorithm>
+#include <cassert>
+
+SceneCopyRenderPass::SceneCopyRenderPass(int downsample)
+    : m_sourceWidth(0), m_sourceHeight(0)
+    , m_downsample(downsample)
+    , m_width(0), m_height(0)
+    , m_depthCopySourceLocation(-1)
+    , m_depthCopyDownsampleLocation(-1)
+    , m_depthReduceSourceLocation(-1)
+{
+    assert(downsample > 0);
+
+    SetName("SceneCopy");
+
+    m_colorTexture = std::make_shared<Texture2DObject>();
+    m_colorFramebuffer = std::make_shared<FramebufferObject>();
+    m_depthPyramidTexture = std::make_shared<Texture2DObject>();
+
+    InitializeShaders();
+}
+
+void SceneCopyRenderPass::SetSource(std::shared_ptr<const FramebufferObject> sourceFramebuffer, std::shared_ptr<const Texture2DObject> sourceDepthTexture)
+{
+    assert(sourceFramebuffer);
+    assert(sourceDepthTexture);
+
+    m_sourceFramebuffer = sourceFramebuffer;
+    m_sourceDepthTexture = sourceDepthTexture;
+}
+
+void SceneCopyRenderPass::Resize(int sourceWidth, int sourceHeight)
+{
+    if (sourceWidth != m_sourceWidth || sourceHeight != m_sourceHeight)
+    {
+        m_sourceWidth = sourceWidth;
+        m_sourceHeight = sourceHeight;
+        InitializeTextures();
+    }
+}
+
+void SceneCopyRenderPass::SetDownsample(int downsample)
+{
+    assert(downsample > 0);
+    if (downsample != m_downsample)
+    {
+        m_downsample = downsample;
+        InitializeTextures();
+    }
+}
+
+void SceneCopyRenderPass::Render()
+{
+    assert(m_width > 0 && m_height > 0);
+    assert(m_sourceFramebuffer && m_sourceDepthTexture);
+
+    DeviceGL& device = GetRenderer().GetDevice();
+    Profiler* profiler = GetRenderer().GetProfiler();
+
+    // Color and depth are timed separately, to see the cost of each copy
+    if (profiler)
+    {
+        profiler->BeginSection("Color");
+    }
+    CopyColor();
+
+    // The pyramid is built with fullscreen triangles, no depth test or blending
+    if (profiler)
+    {
+        profiler->EndSection();
+        profiler->BeginSection("DepthPyramid");
+    }
+    device.DisableFeature(GL_DEPTH_TEST);
+    device.DisableFeature(GL_BLEND);
+    BuildDepthPyramid();
+    device.EnableFeature(GL_DEPTH_TEST);
+    if (profiler)
+    {
+        profiler->EndSection();
+    }
+
+    // Restore the source framebuffer, so the next passes keep rendering the scene
+    m_sourceFramebuffer->Bind();
+    glViewport(0, 0, m_sourceWidth, m_sourceHeight);
+}
+
+void SceneCopyRenderPass::InitializeTextures()
+{
+    if (m_sourceWidth <= 0 || m_sourceHeight <= 0)
+    {
+        return;
+    }
+
+    m_width = std::max(1, m_sourceWidth / m_downsample);
+    m_height = std::max(1, m_sourceHeight / m_downsample);
+
+    // Color copy, sRGB to keep the values linear when sampled
+    m_colorTexture->Bind();
+    m_colorTexture->SetImage(0, m_width, m_height, TextureObject::FormatRGBA, TextureObject::InternalFormatSRGBA8);
+    m_colorTexture->SetParameter(TextureObject::ParameterEnum::MinFilter, GL_LINEAR);
+    m_colorTexture->SetParameter(TextureObject::ParameterEnum::MagFilter, GL_LINEAR);
+    m_colorTexture->SetParameter(TextureObject::ParameterEnum::WrapS, GL_CLAMP_TO_EDGE);
+    m_colorTexture->SetParameter(TextureObject::ParameterEnum::WrapT, GL_CLAMP_TO_EDGE);
+
+    m_colorFramebuffer->Bind();
+    m_colorFramebuffer->SetTexture(FramebufferObject::Target::Both, FramebufferObject::Attachment::Color0, *m_colorTexture);
+
+    // Depth pyramid, closest and farthest depth per texel, down to 1x1
+    int levelCount = 1;
+    while ((std::max(m_width, m_height) >> levelCount) > 0)
+    {
+        ++levelCount;
+    }
+
+    m_depthPyramidTexture->Bind();
+    int levelWidth = m_width;
+    int levelHeight = m_height;
+    for (int level = 0; level < levelCount; ++level)
+    {
+        m_depthPyramidTexture->SetImage(level, levelWidth, levelHeight, TextureObject::FormatRG, TextureObject::InternalFormatRG32F);
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterEnum::MinFilter, GL_NEAREST_MIPMAP_NEAREST);
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterEnum::MagFilter, GL_NEAREST);
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterEnum::WrapS, GL_CLAMP_TO_EDGE);
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterEnum::WrapT, GL_CLAMP_TO_EDGE);
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterInt::BaseLevel, 0);
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterInt::MaxLevel, levelCount - 1);
+
+    m_depthPyramidFramebuffers.resize(levelCount);
+    for (int level = 0; level < levelCount; ++level)
+    {
+        if (!m_depthPyramidFramebuffers[level])
+        {
+            m_depthPyramidFramebuffers[level] = std::make_shared<FramebufferObject>();
+        }
+        m_depthPyramidFramebuffers[level]->Bind();
+        m_depthPyramidFramebuffers[level]->SetTexture(FramebufferObject::Target::Both, FramebufferObject::Attachment::Color0, *m_depthPyramidTexture, level);
+    }
+
+    Texture2DObject::Unbind();
+    FramebufferObject::Unbind();
+}
+
+void SceneCopyRenderPass::InitializeShaders()
+{
+    Shader vertexShader = ShaderLoader(Shader::VertexShader).Load("shaders/renderer/fullscreen.vert");
+
+    Shader depthCopyShader = ShaderLoader(Shader::FragmentShader).Load("shaders/renderer/depth_copy.frag");
+    m_depthCopyProgram.Build(vertexShader, depthCopyShader);
+    m_depthCopySourceLocation = m_depthCopyProgram.GetUniformLocation("SourceTexture");
+    m_depthCopyDownsampleLocation = m_depthCopyProgram.GetUniformLocation("Downsample");
+
+    Shader depthReduceShader = ShaderLoader(Shader::FragmentShader).Load("shaders/renderer/depth_reduce.frag");
+    m_depthReduceProgram.Build(vertexShader, depthReduceShader);
+    m_depthReduceSourceLocation = m_depthReduceProgram.GetUniformLocation("SourceTexture");
+}
+
+void SceneCopyRenderPass::CopyColor()
+{
+    m_sourceFramebuffer->Bind(FramebufferObject::Target::Read);
+    m_colorFramebuffer->Bind(FramebufferObject::Target::Draw);
+    glBlitFramebuffer(0, 0, m_sourceWidth, m_sourceHeight, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+}
+
+void SceneCopyRenderPass::BuildDepthPyramid()
+{
+    const Mesh& fullscreenMesh = GetRenderer().GetFullscreenMesh();
+
+    // Level 0 takes the closest and farthest depth of the source texels it covers
+    m_depthCopyProgram.Use();
+    m_depthCopyProgram.SetTexture(m_depthCopySourceLocation, 0, *m_sourceDepthTexture);
+    m_depthCopyProgram.SetUniform(m_depthCopyDownsampleLocation, m_downsample);
+
+    int levelWidth = m_width;
+    int levelHeight = m_height;
+    m_depthPyramidFramebuffers[0]->Bind();
+    glViewport(0, 0, levelWidth, levelHeight);
+    fullscreenMesh.DrawSubmesh(0);
+
+    // Each level reads the previous one. Limiting the texture levels avoids reading and writing the same level
+    m_depthReduceProgram.Use();
+    m_depthReduceProgram.SetTexture(m_depthReduceSourceLocation, 0, *m_depthPyramidTexture);
+
+    int levelCount = GetDepthPyramidLevelCount();
+    for (int level = 1; level < levelCount; ++level)
+    {
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+
+        m_depthPyramidTexture->SetParameter(TextureObject::ParameterInt::BaseLevel, level - 1);
+        m_depthPyramidTexture->SetParameter(TextureObject::ParameterInt::MaxLevel, level - 1);
+
+        m_depthPyramidFramebuffers[level]->Bind();
+        glViewport(0, 0, levelWidth, levelHeight);
+        fullscreenMesh.DrawSubmesh(0);
+    }
+
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterInt::BaseLevel, 0);
+    m_depthPyramidTexture->SetParameter(TextureObject::ParameterInt::MaxLevel, levelCount - 1);
+}
@@ -12,6 +12,8 @@ SkyboxRenderPass::SkyboxRenderPass(std::shared_ptr<TextureCubemapObject> texture
     , m_invViewProjMatrixLocation(-1)
     , m_skyboxTextureLocation(-1)
 {
+    SetName("Skybox");
+
     // Load shaders and build shader program
     Shader vertexShader = ShaderLoader(Shader::VertexShader).Load("shaders/renderer/skybox.vert");
     Shader fragmentShader = ShaderLoader(Shader::FragmentShader).Load("shaders/renderer/skybox.frag");
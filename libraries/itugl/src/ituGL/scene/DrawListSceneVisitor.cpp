@@ -0,0 +1,22 @@
+#include <ituGL/scene/DrawListSceneVisitor.h>
+
+#include <ituGL/renderer/DrawList.h>
+#include <ituGL/scene/SceneLight.h>
+#include <ituGL/scene/SceneModel.h>
+#include <ituGL/scene/Transform.h>
+#include <cassert>
+
+DrawListSceneVisitor::DrawListSceneVisitor(DrawList& drawList) : m_drawList(drawList)
+{
+}
+
+void DrawListSceneVisitor::VisitLight(SceneLight& sceneLight)
+{
+    m_drawList.AddLight(*sceneLight.GetLight());
+}
+
+void DrawListSceneVisitor::VisitModel(SceneModel& sceneModel)
+{
+    assert(sceneModel.GetTransform());
+    m_drawList.AddModel(sceneModel.GetModel(), sceneModel.GetTransform()->GetTransformMatrix());
+}
@@ -1,72 +1,412 @@
 #include <ituGL/scene/Scene.h>
 
 #include <ituGL/scene/SceneNode.h>
+#include <ituGL/scene/SceneModel.h>
+#include <ituGL/scene/SceneLight.h>
+#include <ituGL/scene/SceneCamera.h>
 #include <ituGL/scene/SceneVisitor.h>
+#include <ituGL/scene/Transform.h>
+#include <algorithm>
 #include <cassert>
 
-Scene::Scene()
+Scene::Scene() : m_changeLogPosition(0), m_bvhCompactRatio(0.25f)
 {
 }
 
 Scene::~Scene()
 {
-    for (auto& pair : m_nodes)
+    for (auto& pair : m_names)
     {
-        pair.second->SetOwnerScene(nullptr);
+        GetSceneNode(pair.second)->SetOwnerScene(nullptr);
     }
 }
 
 std::shared_ptr<SceneNode> Scene::GetSceneNode(const std::string& name) const
 {
-    auto it = m_nodes.find(name);
-    if (it != m_nodes.end())
+    auto it = m_names.find(name);
+    if (it != m_names.end())
     {
-        return it->second;
+        return GetSceneNode(it->second);
     }
     return nullptr;
 }
 
-bool Scene::AddSceneNode(std::shared_ptr<SceneNode> node)
+std::shared_ptr<SceneNode> Scene::GetSceneNode(Handle handle) const
+{
+    if (!IsValid(handle))
+    {
+        return nullptr;
+    }
+
+    const Slot& slot = m_slots[handle.index];
+    switch (slot.type)
+    {
+    case NodeType::Model:
+        return m_models[slot.denseIndex];
+    case NodeType::Light:
+        return m_lights[slot.denseIndex];
+    case NodeType::Camera:
+        return m_cameras[slot.denseIndex];
+    default:
+        return m_otherNodes[slot.denseIndex];
+    }
+}
+
+Scene::Handle Scene::GetHandle(const std::string& name) const
+{
+    auto it = m_names.find(name);
+    return it != m_names.end() ? it->second : InvalidHandle;
+}
+
+bool Scene::IsValid(Handle handle) const
+{
+    // Free slots have odd generations
+    return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation && (handle.generation & 1) == 0;
+}
+
+Scene::Handle Scene::AddSceneNode(std::shared_ptr<SceneNode> node)
 {
     assert(node);
-    assert(m_nodes.find(node->GetName()) == m_nodes.end());
-    m_nodes[node->GetName()] = node;
+    assert(m_names.find(node->GetName()) == m_names.end());
+
+    unsigned int slotIndex;
+    if (!m_freeSlots.empty())
+    {
+        slotIndex = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        ++m_slots[slotIndex].generation;
+    }
+    else
+    {
+        slotIndex = static_cast<unsigned int>(m_slots.size());
+        m_slots.push_back(Slot{ 0, NodeType::Other, 0 });
+    }
+    Slot& slot = m_slots[slotIndex];
+
+    // The type is checked once here, so the arrays can be iterated without casts
+    if (std::shared_ptr<SceneModel> model = std::dynamic_pointer_cast<SceneModel>(node))
+    {
+        slot.type = NodeType::Model;
+        slot.denseIndex = static_cast<unsigned int>(m_models.size());
+        m_models.push_back(model);
+        m_modelSlots.push_back(slotIndex);
+        // The leaf is created in the next update
+        m_modelBounds.push_back(ModelBounds{ SceneBvh::NullProxy, 0, 0, true });
+        m_invalidModels.push_back(slotIndex);
+    }
+    else if (std::shared_ptr<SceneLight> light = std::dynamic_pointer_cast<SceneLight>(node))
+    {
+        slot.type = NodeType::Light;
+        slot.denseIndex = static_cast<unsigned int>(m_lights.size());
+        m_lights.push_back(light);
+        m_lightSlots.push_back(slotIndex);
+    }
+    else if (std::shared_ptr<SceneCamera> camera = std::dynamic_pointer_cast<SceneCamera>(node))
+    {
+        slot.type = NodeType::Camera;
+        slot.denseIndex = static_cast<unsigned int>(m_cameras.size());
+        m_cameras.push_back(camera);
+        m_cameraSlots.push_back(slotIndex);
+    }
+    else
+    {
+        slot.type = NodeType::Other;
+        slot.denseIndex = static_cast<unsigned int>(m_otherNodes.size());
+        m_otherNodes.push_back(node);
+        m_otherSlots.push_back(slotIndex);
+    }
+
+    Handle handle = GetSlotHandle(slotIndex);
+    m_names[node->GetName()] = handle;
     node->SetOwnerScene(this);
-    return true;
+    return handle;
 }
 
 bool Scene::RemoveSceneNode(std::shared_ptr<SceneNode> node)
 {
-    assert(m_nodes.find(node->GetName()) == m_nodes.end() || m_nodes.find(node->GetName())->second == node);
+    assert(m_names.find(node->GetName()) == m_names.end() || GetSceneNode(node->GetName()) == node);
     return RemoveSceneNode(node->GetName());
 }
 
 bool Scene::RemoveSceneNode(const std::string& name)
 {
-    auto it = m_nodes.find(name);
-    if (it != m_nodes.end())
+    auto it = m_names.find(name);
+    return it != m_names.end() && RemoveSceneNode(it->second);
+}
+
+bool Scene::RemoveSceneNode(Handle handle)
+{
+    std::shared_ptr<SceneNode> node = GetSceneNode(handle);
+    if (!node)
+    {
+        return false;
+    }
+    assert(node->GetOwnerScene() == this);
+    node->SetOwnerScene(nullptr);
+    m_names.erase(node->GetName());
+
+    Slot& slot = m_slots[handle.index];
+    switch (slot.type)
+    {
+    case NodeType::Model:
+        if (m_modelBounds[slot.denseIndex].proxy != SceneBvh::NullProxy)
+        {
+            m_bvh.DestroyProxy(m_modelBounds[slot.denseIndex].proxy);
+            RemoveTransformModel(m_modelBounds[slot.denseIndex].transformIndex, handle.index);
+        }
+        m_modelBounds[slot.denseIndex] = m_modelBounds.back();
+        m_modelBounds.pop_back();
+        RemoveDense(m_models, m_modelSlots, slot.denseIndex);
+        break;
+    case NodeType::Light:
+        RemoveDense(m_lights, m_lightSlots, slot.denseIndex);
+        break;
+    case NodeType::Camera:
+        RemoveDense(m_cameras, m_cameraSlots, slot.denseIndex);
+        break;
+    default:
+        RemoveDense(m_otherNodes, m_otherSlots, slot.denseIndex);
+        break;
+    }
+
+    ++slot.generation;
+    m_freeSlots.push_back(handle.index);
+    return true;
+}
+
+template<typename T>
+void Scene::RemoveDense(std::vector<std::shared_ptr<T>>& nodes, std::vector<unsigned int>& slotIndices, unsigned int denseIndex)
+{
+    // Move the last node to the gap, and fix its slot
+    nodes[denseIndex] = std::move(nodes.back());
+    nodes.pop_back();
+    slotIndices[denseIndex] = slotIndices.back();
+    slotIndices.pop_back();
+    if (denseIndex < slotIndices.size())
+    {
+        m_slots[slotIndices[denseIndex]].denseIndex = denseIndex;
+    }
+}
+
+void Scene::RenameSceneNode(const std::string& oldName, const std::string& newName)
+{
+    auto it = m_names.find(oldName);
+    assert(it != m_names.end());
+    assert(m_names.find(newName) == m_names.end());
+    Handle handle = it->second;
+    m_names.erase(it);
+    m_names[newName] = handle;
+}
+
+void Scene::InvalidateBounds(const SceneNode& node)
+{
+    Handle handle = GetHandle(node.GetName());
+    assert(IsValid(handle));
+    const Slot& slot = m_slots[handle.index];
+    if (slot.type == NodeType::Model && !m_modelBounds[slot.denseIndex].invalid)
     {
-        assert(it->second);
-        assert(it->second->GetOwnerScene() == this);
-        it->second->SetOwnerScene(nullptr);
-        m_nodes.erase(it);
-        return true;
+        m_modelBounds[slot.denseIndex].invalid = true;
+        m_invalidModels.push_back(handle.index);
     }
-    return false;
 }
 
 void Scene::AcceptVisitor(SceneVisitor& visitor)
 {
-    for (auto& pair : m_nodes)
+    for (auto& camera : m_cameras)
+    {
+        camera->AcceptVisitor(visitor);
+    }
+    for (auto& light : m_lights)
     {
-        pair.second->AcceptVisitor(visitor);
+        light->AcceptVisitor(visitor);
+    }
+    for (auto& model : m_models)
+    {
+        model->AcceptVisitor(visitor);
+    }
+    for (auto& node : m_otherNodes)
+    {
+        node->AcceptVisitor(visitor);
     }
 }
 
 void Scene::AcceptVisitor(SceneVisitor& visitor) const
 {
-    for (auto& pair : m_nodes)
+    for (auto& camera : m_cameras)
+    {
+        camera->AcceptVisitor(visitor);
+    }
+    for (auto& light : m_lights)
+    {
+        light->AcceptVisitor(visitor);
+    }
+    for (auto& model : m_models)
+    {
+        model->AcceptVisitor(visitor);
+    }
+    for (auto& node : m_otherNodes)
+    {
+        node->AcceptVisitor(visitor);
+    }
+}
+
+void Scene::AcceptVisitor(SceneVisitor& visitor, const glm::mat4& viewProjMatrix)
+{
+    for (auto& camera : m_cameras)
+    {
+        camera->AcceptVisitor(visitor);
+    }
+    for (auto& light : m_lights)
+    {
+        light->AcceptVisitor(visitor);
+    }
+
+    UpdateBounds();
+    m_bvh.QueryFrustum(SceneBvh::GetFrustumPlanes(viewProjMatrix), [&](unsigned int slotIndex)
+        {
+            m_models[m_slots[slotIndex].denseIndex]->AcceptVisitor(visitor);
+        });
+
+    for (auto& node : m_otherNodes)
+    {
+        node->AcceptVisitor(visitor);
+    }
+}
+
+void Scene::UpdateBounds()
+{
+    TransformStore& transformStore = TransformStore::GetInstance();
+
+    // Also computes the transforms that changed, so the models find their new versions
+    size_t changeLogEnd = transformStore.GetChangeLogEnd();
+    if (m_invalidModels.empty() && changeLogEnd == m_changeLogPosition)
+    {
+        return;
+    }
+
+    // First the invalid models, the only ones that can change transform and move to another list
+    for (unsigned int slotIndex : m_invalidModels)
+    {
+        const Slot& slot = m_slots[slotIndex];
+        if ((slot.generation & 1) == 0 && slot.type == NodeType::Model && m_modelBounds[slot.denseIndex].invalid)
+        {
+            RefitModel(slot.denseIndex);
+        }
+    }
+    m_invalidModels.clear();
+
+    // Then the models of the transforms computed since the last update
+    bool logComplete = transformStore.ReadChangeLog(m_changeLogPosition, [&](TransformStore::Index transformIndex)
+        {
+            if (transformIndex < m_transformModels.size())
+            {
+                for (unsigned int slotIndex : m_transformModels[transformIndex])
+                {
+                    RefitModel(m_slots[slotIndex].denseIndex);
+                }
+            }
+        });
+    if (!logComplete)
+    {
+        // The changes were trimmed before this scene read them
+        for (unsigned int modelIndex = 0; modelIndex < m_models.size(); ++modelIndex)
+        {
+            RefitModel(modelIndex);
+        }
+    }
+    m_changeLogPosition = changeLogEnd;
+
+    // Reinserted leaves take any free node, and the queries get slower as the nodes spread in memory
+    if (m_bvh.GetUnorderedCount() > m_bvh.GetProxyCount() * m_bvhCompactRatio)
+    {
+        m_bvh.Compact();
+    }
+}
+
+void Scene::RefitModel(unsigned int denseIndex)
+{
+    const SceneModel& model = *m_models[denseIndex];
+    ModelBounds& modelBounds = m_modelBounds[denseIndex];
+
+    // Only the models that moved, or changed transform, compute their bounds again
+    std::shared_ptr<const Transform> transform = model.GetTransform();
+    unsigned int transformIndex = transform->GetIndex();
+    unsigned int transformVersion = transform->GetVersion();
+    if (!modelBounds.invalid
+        && modelBounds.transformIndex == transformIndex && modelBounds.transformVersion == transformVersion)
+    {
+        return;
+    }
+
+    unsigned int slotIndex = m_modelSlots[denseIndex];
+    if (modelBounds.proxy == SceneBvh::NullProxy || modelBounds.transformIndex != transformIndex)
+    {
+        if (modelBounds.proxy != SceneBvh::NullProxy)
+        {
+            RemoveTransformModel(modelBounds.transformIndex, slotIndex);
+        }
+        if (transformIndex >= m_transformModels.size())
+        {
+            m_transformModels.resize(transformIndex + 1);
+        }
+        m_transformModels[transformIndex].push_back(slotIndex);
+    }
+    modelBounds.transformIndex = transformIndex;
+    modelBounds.transformVersion = transformVersion;
+    modelBounds.invalid = false;
+
+    glm::vec3 boundsMin, boundsMax;
+    model.GetWorldBounds(boundsMin, boundsMax);
+    if (modelBounds.proxy == SceneBvh::NullProxy)
+    {
+        modelBounds.proxy = m_bvh.CreateProxy(boundsMin, boundsMax, slotIndex);
+    }
+    else
+    {
+        m_bvh.MoveProxy(modelBounds.proxy, boundsMin, boundsMax);
+    }
+}
+
+void Scene::RemoveTransformModel(unsigned int transformIndex, unsigned int slotIndex)
+{
+    std::vector<unsigned int>& slotIndices = m_transformModels[transformIndex];
+    auto it = std::find(slotIndices.begin(), slotIndices.end(), slotIndex);
+    assert(it != slotIndices.end());
+    *it = slotIndices.back();
+    slotIndices.pop_back();
+}
+
+void Scene::FindModels(const glm::mat4& viewProjMatrix, std::vector<Handle>& handles)
+{
+    UpdateBounds();
+    m_bvh.QueryFrustum(SceneBvh::GetFrustumPlanes(viewProjMatrix), [&](unsigned int slotIndex)
+        {
+            handles.push_back(GetSlotHandle(slotIndex));
+        });
+}
+
+void Scene::FindModels(const SphereBounds& sphere, std::vector<Handle>& handles)
+{
+    UpdateBounds();
+    m_bvh.QuerySphere(sphere.GetCenter(), sphere.GetRadius(), [&](unsigned int slotIndex)
+        {
+            handles.push_back(GetSlotHandle(slotIndex));
+        });
+}
+
+void Scene::FindModels(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<Handle>& handles)
+{
+    UpdateBounds();
+
+    std::vector<std::pair<float, unsigned int>> hits;
+    m_bvh.QueryRay(origin, direction, maxDistance, [&](unsigned int slotIndex, float distance)
+        {
+            hits.emplace_back(distance, slotIndex);
+        });
+
+    std::sort(hits.begin(), hits.end());
+    for (const auto& hit : hits)
     {
-        pair.second->AcceptVisitor(visitor);
+        handles.push_back(GetSlotHandle(hit.second));
     }
 }
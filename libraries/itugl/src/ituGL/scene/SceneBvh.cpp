@@ -0,0 +1,344 @@
+#include <ituGL/scene/SceneBvh.h>
+
+#include <cassert>
+#include <utility>
+
+SceneBvh::SceneBvh()
+    : m_root(NullProxy)
+    , m_freeList(NullProxy)
+    , m_proxyCount(0)
+    , m_unorderedCount(0)
+    , m_margin(0.1f)
+{
+}
+
+SceneBvh::Proxy SceneBvh::CreateProxy(const glm::vec3& boundsMin, const glm::vec3& boundsMax, unsigned int userData)
+{
+    Proxy proxy;
+    if (!m_freeProxies.empty())
+    {
+        proxy = m_freeProxies.back();
+        m_freeProxies.pop_back();
+    }
+    else
+    {
+        proxy = static_cast<Proxy>(m_proxyNodes.size());
+        m_proxyNodes.push_back(NullProxy);
+    }
+
+    Proxy leaf = AllocateNode();
+    Node& node = m_nodes[leaf];
+    node.boundsMin = boundsMin - glm::vec3(m_margin);
+    node.boundsMax = boundsMax + glm::vec3(m_margin);
+    node.height = 0;
+    node.userData = userData;
+    node.proxy = proxy;
+    m_proxyNodes[proxy] = leaf;
+
+    InsertLeaf(leaf);
+    ++m_proxyCount;
+    return proxy;
+}
+
+void SceneBvh::DestroyProxy(Proxy proxy)
+{
+    Proxy leaf = m_proxyNodes[proxy];
+    assert(m_nodes[leaf].IsLeaf());
+    RemoveLeaf(leaf);
+    FreeNode(leaf);
+
+    m_proxyNodes[proxy] = NullProxy;
+    m_freeProxies.push_back(proxy);
+    --m_proxyCount;
+}
+
+bool SceneBvh::MoveProxy(Proxy proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    Proxy leaf = m_proxyNodes[proxy];
+    Node& node = m_nodes[leaf];
+    assert(node.IsLeaf());
+
+    // Still inside the fat bounds, nothing to do
+    if (glm::all(glm::lessThanEqual(node.boundsMin, boundsMin)) && glm::all(glm::lessThanEqual(boundsMax, node.boundsMax)))
+    {
+        return false;
+    }
+
+    RemoveLeaf(leaf);
+    node.boundsMin = boundsMin - glm::vec3(m_margin);
+    node.boundsMax = boundsMax + glm::vec3(m_margin);
+    InsertLeaf(leaf);
+    return true;
+}
+
+void SceneBvh::Compact()
+{
+    std::vector<Node> nodes;
+    nodes.reserve(m_proxyCount > 0 ? 2 * m_proxyCount - 1 : 0);
+
+    // Parents go before their children, and the first child right after its parent
+    // Each entry is the old index of a node, and the new index of its parent
+    std::vector<std::pair<Proxy, Proxy>> stack;
+    stack.reserve(64);
+    if (m_root != NullProxy)
+    {
+        stack.emplace_back(m_root, NullProxy);
+    }
+    while (!stack.empty())
+    {
+        auto [oldIndex, parent] = stack.back();
+        stack.pop_back();
+
+        Proxy newIndex = static_cast<Proxy>(nodes.size());
+        nodes.push_back(m_nodes[oldIndex]);
+        Node& node = nodes.back();
+        node.parent = parent;
+
+        if (parent != NullProxy)
+        {
+            // The old index is still in the parent until its children are placed
+            Node& parentNode = nodes[parent];
+            (parentNode.child1 == oldIndex ? parentNode.child1 : parentNode.child2) = newIndex;
+        }
+
+        if (node.IsLeaf())
+        {
+            m_proxyNodes[node.proxy] = newIndex;
+        }
+        else
+        {
+            stack.emplace_back(node.child2, newIndex);
+            stack.emplace_back(node.child1, newIndex);
+        }
+    }
+
+    m_nodes = std::move(nodes);
+    m_root = m_nodes.empty() ? NullProxy : 0;
+    m_freeList = NullProxy;
+    m_unorderedCount = 0;
+}
+
+int SceneBvh::GetHeight() const
+{
+    return m_root != NullProxy ? m_nodes[m_root].height : 0;
+}
+
+SceneBvh::FrustumPlanes SceneBvh::GetFrustumPlanes(const glm::mat4& viewProjMatrix)
+{
+    // Rows of the matrix combined, for clip space -w <= x, y, z <= w
+    glm::vec4 row0(viewProjMatrix[0][0], viewProjMatrix[1][0], viewProjMatrix[2][0], viewProjMatrix[3][0]);
+    glm::vec4 row1(viewProjMatrix[0][1], viewProjMatrix[1][1], viewProjMatrix[2][1], viewProjMatrix[3][1]);
+    glm::vec4 row2(viewProjMatrix[0][2], viewProjMatrix[1][2], viewProjMatrix[2][2], viewProjMatrix[3][2]);
+    glm::vec4 row3(viewProjMatrix[0][3], viewProjMatrix[1][3], viewProjMatrix[2][3], viewProjMatrix[3][3]);
+
+    FrustumPlanes planes = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+    for (glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
+SceneBvh::Proxy SceneBvh::AllocateNode()
+{
+    if (m_freeList == NullProxy)
+    {
+        m_nodes.emplace_back();
+        m_nodes.back().parent = NullProxy;
+        m_freeList = static_cast<Proxy>(m_nodes.size() - 1);
+    }
+
+    Proxy node = m_freeList;
+    m_freeList = m_nodes[node].parent;
+    m_nodes[node].parent = NullProxy;
+    m_nodes[node].child1 = NullProxy;
+    m_nodes[node].child2 = NullProxy;
+    m_nodes[node].height = 0;
+    m_nodes[node].userData = 0;
+    m_nodes[node].proxy = NullProxy;
+    return node;
+}
+
+void SceneBvh::FreeNode(Proxy node)
+{
+    m_nodes[node].parent = m_freeList;
+    m_nodes[node].height = -1;
+    m_freeList = node;
+}
+
+void SceneBvh::InsertLeaf(Proxy leaf)
+{
+    ++m_unorderedCount;
+
+    if (m_root == NullProxy)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = NullProxy;
+        return;
+    }
+
+    // Go down choosing the child that increases the surface area the least
+    const glm::vec3 leafMin = m_nodes[leaf].boundsMin;
+    const glm::vec3 leafMax = m_nodes[leaf].boundsMax;
+    Proxy sibling = m_root;
+    while (!m_nodes[sibling].IsLeaf())
+    {
+        const Node& node = m_nodes[sibling];
+        float area = GetSurfaceArea(node.boundsMin, node.boundsMax);
+        float combinedArea = GetSurfaceArea(glm::min(node.boundsMin, leafMin), glm::max(node.boundsMax, leafMax));
+
+        // Cost of making a new parent for this node and the leaf, and minimum cost pushed down to the children
+        float cost = 2.0f * combinedArea;
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        auto getChildCost = [&](Proxy child)
+        {
+            const Node& childNode = m_nodes[child];
+            float childArea = GetSurfaceArea(glm::min(childNode.boundsMin, leafMin), glm::max(childNode.boundsMax, leafMax));
+            if (!childNode.IsLeaf())
+            {
+                childArea -= GetSurfaceArea(childNode.boundsMin, childNode.boundsMax);
+            }
+            return childArea + inheritanceCost;
+        };
+        float cost1 = getChildCost(node.child1);
+        float cost2 = getChildCost(node.child2);
+
+        if (cost < cost1 && cost < cost2)
+        {
+            break;
+        }
+        sibling = cost1 < cost2 ? node.child1 : node.child2;
+    }
+
+    // New parent for the sibling and the leaf
+    Proxy oldParent = m_nodes[sibling].parent;
+    Proxy newParent = AllocateNode();
+    m_nodes[newParent].parent = oldParent;
+    m_nodes[newParent].child1 = sibling;
+    m_nodes[newParent].child2 = leaf;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    if (oldParent != NullProxy)
+    {
+        Node& oldParentNode = m_nodes[oldParent];
+        (oldParentNode.child1 == sibling ? oldParentNode.child1 : oldParentNode.child2) = newParent;
+    }
+    else
+    {
+        m_root = newParent;
+    }
+
+    // Fix bounds and heights going up
+    for (Proxy node = newParent; node != NullProxy; node = m_nodes[node].parent)
+    {
+        node = Balance(node);
+        UpdateNode(node);
+    }
+}
+
+void SceneBvh::RemoveLeaf(Proxy leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = NullProxy;
+        return;
+    }
+
+    // The sibling takes the place of the parent
+    Proxy parent = m_nodes[leaf].parent;
+    Proxy grandParent = m_nodes[parent].parent;
+    Proxy sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+    m_nodes[sibling].parent = grandParent;
+    FreeNode(parent);
+
+    if (grandParent != NullProxy)
+    {
+        Node& grandParentNode = m_nodes[grandParent];
+        (grandParentNode.child1 == parent ? grandParentNode.child1 : grandParentNode.child2) = sibling;
+
+        for (Proxy node = grandParent; node != NullProxy; node = m_nodes[node].parent)
+        {
+            node = Balance(node);
+            UpdateNode(node);
+        }
+    }
+    else
+    {
+        m_root = sibling;
+    }
+}
+
+SceneBvh::Proxy SceneBvh::Balance(Proxy a)
+{
+    Node& nodeA = m_nodes[a];
+    if (nodeA.IsLeaf() || nodeA.height < 2)
+    {
+        return a;
+    }
+
+    Proxy b = nodeA.child1;
+    Proxy c = nodeA.child2;
+    int balance = m_nodes[c].height - m_nodes[b].height;
+    if (balance >= -1 && balance <= 1)
+    {
+        return a;
+    }
+
+    // The higher child moves up, and A takes its place. A gets the lower grandchild, the child keeps the higher one
+    // With C higher: A(B, C(F, G)) becomes C(A(B, G), F), if F is the higher grandchild
+    Proxy up = balance > 0 ? c : b;
+    Node& upNode = m_nodes[up];
+    Proxy f = upNode.child1;
+    Proxy g = upNode.child2;
+
+    upNode.child1 = a;
+    upNode.parent = nodeA.parent;
+    nodeA.parent = up;
+
+    if (upNode.parent != NullProxy)
+    {
+        Node& parentNode = m_nodes[upNode.parent];
+        (parentNode.child1 == a ? parentNode.child1 : parentNode.child2) = up;
+    }
+    else
+    {
+        m_root = up;
+    }
+
+    if (m_nodes[f].height < m_nodes[g].height)
+    {
+        std::swap(f, g);
+    }
+    upNode.child2 = f;
+    (balance > 0 ? nodeA.child2 : nodeA.child1) = g;
+    m_nodes[g].parent = a;
+
+    UpdateNode(a);
+    UpdateNode(up);
+    return up;
+}
+
+void SceneBvh::UpdateNode(Proxy node)
+{
+    Node& parentNode = m_nodes[node];
+    if (parentNode.IsLeaf())
+    {
+        return;
+    }
+
+    const Node& node1 = m_nodes[parentNode.child1];
+    const Node& node2 = m_nodes[parentNode.child2];
+    parentNode.boundsMin = glm::min(node1.boundsMin, node2.boundsMin);
+    parentNode.boundsMax = glm::max(node1.boundsMax, node2.boundsMax);
+    parentNode.height = 1 + std::max(node1.height, node2.height);
+}
+
+float SceneBvh::GetSurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    // Half of the area is enough to compare
+    glm::vec3 size = boundsMax - boundsMin;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
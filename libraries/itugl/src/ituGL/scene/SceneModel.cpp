@@ -5,6 +5,7 @@
 #include <ituGL/scene/Transform.h>
 #include <ituGL/scene/SceneVisitor.h>
 #include <cassert>
+#include <limits>
 
 SceneModel::SceneModel(const std::string& name, std::shared_ptr<Model> model) : SceneNode(name), m_model(model)
 {
@@ -22,6 +23,7 @@ std::shared_ptr<Model> SceneModel::GetModel() const
 void SceneModel::SetModel(std::shared_ptr<Model> model)
 {
     m_model = model;
+    InvalidateSceneBounds();
 }
 
 /*glm::mat4 SceneModel::GetWorldMatrix() const
@@ -60,6 +62,44 @@ BoxBounds SceneModel::GetBoxBounds() const
     return BoxBounds(m_transform->GetTranslation(), m_transform->GetRotationMatrix(), m_transform->GetScale() /* * m_model->GetSize()*/);
 }
 
+void SceneModel::GetWorldBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const
+{
+    assert(m_transform);
+    assert(m_model);
+
+    // Local bounds of the whole mesh
+    glm::vec3 localMin(std::numeric_limits<float>::max());
+    glm::vec3 localMax(-std::numeric_limits<float>::max());
+    const Mesh& mesh = m_model->GetMesh();
+    for (unsigned int submeshIndex = 0; submeshIndex < mesh.GetSubmeshCount(); ++submeshIndex)
+    {
+        glm::vec3 submeshMin, submeshMax;
+        if (!mesh.GetSubmeshBounds(submeshIndex, submeshMin, submeshMax))
+        {
+            submeshMin = glm::vec3(-1.0f);
+            submeshMax = glm::vec3(1.0f);
+        }
+        localMin = glm::min(localMin, submeshMin);
+        localMax = glm::max(localMax, submeshMax);
+    }
+    if (localMin.x > localMax.x)
+    {
+        localMin = glm::vec3(-1.0f);
+        localMax = glm::vec3(1.0f);
+    }
+
+    // Transform the center, and project the extents on the world axes
+    glm::mat4 worldMatrix = m_transform->GetTransformMatrix();
+    glm::vec3 center = glm::vec3(worldMatrix * glm::vec4(0.5f * (localMin + localMax), 1.0f));
+    glm::vec3 extents = 0.5f * (localMax - localMin);
+    glm::vec3 worldExtents = glm::abs(glm::vec3(worldMatrix[0])) * extents.x
+        + glm::abs(glm::vec3(worldMatrix[1])) * extents.y
+        + glm::abs(glm::vec3(worldMatrix[2])) * extents.z;
+
+    boundsMin = center - worldExtents;
+    boundsMax = center + worldExtents;
+}
+
 void SceneModel::AcceptVisitor(SceneVisitor& visitor)
 {
     visitor.VisitModel(*this);
@@ -22,18 +22,13 @@ const std::string& SceneNode::GetName() const
 
 void SceneNode::Rename(const std::string& name)
 {
-    std::shared_ptr<SceneNode> sceneNode;
+    // The node keeps its handle in the scene, only the name index changes
     if (m_scene)
     {
-        sceneNode = m_scene->GetSceneNode(m_name);
-        assert(sceneNode.get() == this);
-        m_scene->RemoveSceneNode(m_name);
+        assert(m_scene->GetSceneNode(m_name).get() == this);
+        m_scene->RenameSceneNode(m_name, name);
     }
     m_name = name;
-    if (m_scene)
-    {
-        m_scene->AddSceneNode(sceneNode);
-    }
 }
 
 std::shared_ptr<Transform> SceneNode::GetTransform()
@@ -49,6 +44,7 @@ std::shared_ptr<const Transform> SceneNode::GetTransform() const
 void SceneNode::SetTransform(std::shared_ptr<Transform> transform)
 {
     m_transform = transform;
+    InvalidateSceneBounds();
 }
 
 Scene* SceneNode::GetOwnerScene() const
@@ -61,6 +57,14 @@ void SceneNode::SetOwnerScene(Scene* scene)
     m_scene = scene;
 }
 
+void SceneNode::InvalidateSceneBounds()
+{
+    if (m_scene)
+    {
+        m_scene->InvalidateBounds(*this);
+    }
+}
+
 SphereBounds SceneNode::GetSphereBounds() const
 {
     return SphereBounds(glm::vec3(m_transform->GetTranslation()), 0.0f); // use world translation?
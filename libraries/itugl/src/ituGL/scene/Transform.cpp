@@ -2,44 +2,56 @@
 
 #include <glm/ext/matrix_transform.hpp>
 
-Transform::Transform() : m_translation(0, 0, 0), m_rotation(0, 0, 0), m_scale(1, 1, 1), m_matrix(1.0f), m_dirty(false)
+Transform::Transform() : m_index(GetStore().Add())
 {
 }
 
+Transform::~Transform()
+{
+    GetStore().Remove(m_index);
+}
+
+Transform::Transform(const Transform& transform) : Transform()
+{
+    *this = transform;
+}
+
+Transform& Transform::operator = (const Transform& transform)
+{
+    SetTranslation(transform.GetTranslation());
+    SetRotation(transform.GetRotation());
+    SetScale(transform.GetScale());
+    SetParent(transform.m_parent);
+    return *this;
+}
+
+void Transform::SetParent(std::shared_ptr<Transform> parent)
+{
+    m_parent = parent;
+    GetStore().SetParent(m_index, parent ? parent->m_index : TransformStore::NoParent);
+}
+
 glm::mat4 Transform::GetTranslationMatrix() const
 {
-    return glm::translate(glm::identity<glm::mat4>(), m_translation);
+    return glm::translate(glm::identity<glm::mat4>(), GetTranslation());
 }
 
 glm::mat4 Transform::GetRotationMatrix() const
 {
-    glm::mat4 matrix = glm::identity<glm::mat4>();
-    matrix = glm::rotate(matrix, m_rotation.y, glm::vec3(0, 1, 0));
-    matrix = glm::rotate(matrix, m_rotation.x, glm::vec3(1, 0, 0));
-    matrix = glm::rotate(matrix, m_rotation.z, glm::vec3(0, 0, 1));
-    return matrix;
+    return TransformStore::ComposeMatrix(glm::vec3(0.0f), GetRotation(), glm::vec3(1.0f));
 }
 
 glm::mat4 Transform::GetScaleMatrix() const
 {
-    return glm::scale(glm::identity<glm::mat4>(), m_scale);
+    return glm::scale(glm::identity<glm::mat4>(), GetScale());
 }
 
 glm::mat4 Transform::GetTransformMatrix() const
 {
-    if (IsDirty())
-    {
-        m_matrix = GetTranslationMatrix() * GetRotationMatrix() * GetScaleMatrix();
-        if (m_parent)
-        {
-            m_matrix = m_parent->GetTransformMatrix() * m_matrix;
-        }
-        m_dirty = false;
-    }
-    return m_matrix;
+    return GetStore().GetWorldMatrix(m_index);
 }
 
 bool Transform::IsDirty() const
 {
-    return m_dirty || (m_parent && m_parent->IsDirty());
+    return GetStore().IsDirty(m_index);
 }
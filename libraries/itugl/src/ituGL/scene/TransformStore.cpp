@@ -0,0 +1,291 @@
+#include <ituGL/scene/TransformStore.h>
+
+#include <ituGL/core/JobSystem.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+TransformStore::TransformStore()
+    : m_orderDirty(false)
+    , m_anyDirty(false)
+    , m_updateCount(0)
+    , m_changeLogBase(0)
+    , m_dirtyPropagated(true)
+    , m_parallelThreshold(4096)
+{
+}
+
+TransformStore& TransformStore::GetInstance()
+{
+    static TransformStore instance;
+    return instance;
+}
+
+TransformStore::Index TransformStore::Add()
+{
+    Index index;
+    if (!m_freeIndices.empty())
+    {
+        index = m_freeIndices.back();
+        m_freeIndices.pop_back();
+    }
+    else
+    {
+        index = static_cast<Index>(m_used.size());
+        m_translations.emplace_back();
+        m_rotations.emplace_back();
+        m_scales.emplace_back();
+        m_parents.emplace_back();
+        m_worldMatrices.emplace_back();
+        m_versions.emplace_back();
+        m_dirty.emplace_back();
+        m_used.emplace_back();
+    }
+
+    m_translations[index] = glm::vec3(0.0f);
+    m_rotations[index] = glm::vec3(0.0f);
+    m_scales[index] = glm::vec3(1.0f);
+    m_parents[index] = NoParent;
+    m_worldMatrices[index] = glm::mat4(1.0f);
+    ++m_versions[index];
+    m_dirty[index] = false;
+    m_used[index] = true;
+
+    m_orderDirty = true;
+    return index;
+}
+
+void TransformStore::Remove(Index index)
+{
+    assert(m_used[index]);
+    m_used[index] = false;
+    m_dirty[index] = false;
+    m_freeIndices.push_back(index);
+    m_orderDirty = true;
+}
+
+void TransformStore::SetTranslation(Index index, const glm::vec3& translation)
+{
+    m_translations[index] = translation;
+    m_dirty[index] = true;
+    m_anyDirty = true;
+    m_dirtyPropagated = false;
+}
+
+void TransformStore::SetRotation(Index index, const glm::vec3& rotation)
+{
+    m_rotations[index] = rotation;
+    m_dirty[index] = true;
+    m_anyDirty = true;
+    m_dirtyPropagated = false;
+}
+
+void TransformStore::SetScale(Index index, const glm::vec3& scale)
+{
+    m_scales[index] = scale;
+    m_dirty[index] = true;
+    m_anyDirty = true;
+    m_dirtyPropagated = false;
+}
+
+void TransformStore::SetParent(Index index, Index parent)
+{
+    assert(parent == NoParent || m_used[parent]);
+    m_parents[index] = parent;
+    m_dirty[index] = true;
+    m_anyDirty = true;
+    m_dirtyPropagated = false;
+    m_orderDirty = true;
+}
+
+const glm::mat4& TransformStore::GetWorldMatrix(Index index)
+{
+    if (m_anyDirty)
+    {
+        UpdateWorldMatrices();
+    }
+    return m_worldMatrices[index];
+}
+
+unsigned int TransformStore::GetVersion(Index index)
+{
+    if (m_anyDirty)
+    {
+        UpdateWorldMatrices();
+    }
+    return m_versions[index];
+}
+
+unsigned int TransformStore::GetUpdateCount()
+{
+    if (m_anyDirty)
+    {
+        UpdateWorldMatrices();
+    }
+    return m_updateCount;
+}
+
+size_t TransformStore::GetChangeLogEnd()
+{
+    if (m_anyDirty)
+    {
+        UpdateWorldMatrices();
+    }
+    return m_changeLogBase + m_changeLog.size();
+}
+
+void TransformStore::UpdateWorldMatrices()
+{
+    if (m_orderDirty)
+    {
+        SortByDepth();
+    }
+
+    // Transforms in the same level don't depend on each other, so big levels are split in ranges for the job system
+    JobSystem& jobSystem = JobSystem::GetInstance();
+    for (size_t level = 0; level + 1 < m_levelOffsets.size(); ++level)
+    {
+        size_t levelBegin = m_levelOffsets[level];
+        size_t levelEnd = m_levelOffsets[level + 1];
+        if (levelEnd - levelBegin < m_parallelThreshold)
+        {
+            UpdateWorldMatrices(levelBegin, levelEnd);
+            continue;
+        }
+
+        size_t grainSize = std::max(m_parallelThreshold / 2, 1u);
+        jobSystem.ParallelFor(levelBegin, levelEnd, grainSize, [this](size_t begin, size_t end) { UpdateWorldMatrices(begin, end); });
+    }
+
+    // Readers that are behind the trimmed part check all their transforms, so the log doesn't grow without limit
+    if (m_changeLog.size() > GetCount())
+    {
+        m_changeLogBase += m_changeLog.size();
+        m_changeLog.clear();
+    }
+
+    // Flags are only cleared at the end, because children read the flags of their parents
+    for (Index index : m_order)
+    {
+        if (m_dirty[index])
+        {
+            m_changeLog.push_back(index);
+            m_dirty[index] = false;
+        }
+    }
+    if (m_anyDirty)
+    {
+        ++m_updateCount;
+    }
+    m_anyDirty = false;
+    m_dirtyPropagated = true;
+}
+
+void TransformStore::PropagateDirtyFlags()
+{
+    if (m_orderDirty)
+    {
+        SortByDepth();
+    }
+
+    // Roots are skipped, they have no parent to take the flag from
+    size_t firstChild = m_levelOffsets.size() > 1 ? m_levelOffsets[1] : m_order.size();
+    for (size_t position = firstChild; position < m_order.size(); ++position)
+    {
+        Index index = m_order[position];
+        m_dirty[index] |= m_dirty[m_parents[index]];
+    }
+    m_dirtyPropagated = true;
+}
+
+void TransformStore::UpdateWorldMatrices(size_t begin, size_t end)
+{
+    for (size_t position = begin; position < end; ++position)
+    {
+        Index index = m_order[position];
+        Index parent = m_parents[index];
+
+        // Dirty flags propagate down, as parents are always updated before. Already done if IsDirty was called
+        if (parent != NoParent && m_dirty[parent])
+        {
+            m_dirty[index] = true;
+        }
+
+        if (m_dirty[index])
+        {
+            glm::mat4 matrix = ComposeMatrix(m_translations[index], m_rotations[index], m_scales[index]);
+            m_worldMatrices[index] = parent != NoParent ? m_worldMatrices[parent] * matrix : matrix;
+            ++m_versions[index];
+        }
+    }
+}
+
+void TransformStore::SortByDepth()
+{
+    // Depth of each transform, computed going up until a parent with known depth
+    std::vector<unsigned int> depths(m_used.size(), ~0u);
+    std::vector<Index> path;
+    unsigned int maxDepth = 0;
+    for (Index index = 0; index < m_used.size(); ++index)
+    {
+        if (!m_used[index])
+        {
+            continue;
+        }
+
+        Index current = index;
+        while (current != NoParent && depths[current] == ~0u)
+        {
+            path.push_back(current);
+            current = m_parents[current];
+        }
+        unsigned int depth = current == NoParent ? 0 : depths[current] + 1;
+        for (auto itPath = path.rbegin(); itPath != path.rend(); ++itPath, ++depth)
+        {
+            depths[*itPath] = depth;
+        }
+        path.clear();
+        maxDepth = std::max(maxDepth, depths[index]);
+    }
+
+    // Counting sort by depth, keeping the index order inside each level
+    m_levelOffsets.assign(maxDepth + 2, 0);
+    for (Index index = 0; index < m_used.size(); ++index)
+    {
+        if (m_used[index])
+        {
+            ++m_levelOffsets[depths[index] + 1];
+        }
+    }
+    for (size_t level = 1; level < m_levelOffsets.size(); ++level)
+    {
+        m_levelOffsets[level] += m_levelOffsets[level - 1];
+    }
+
+    m_order.resize(m_levelOffsets.back());
+    std::vector<size_t> positions(m_levelOffsets.begin(), m_levelOffsets.end() - 1);
+    for (Index index = 0; index < m_used.size(); ++index)
+    {
+        if (m_used[index])
+        {
+            m_order[positions[depths[index]]++] = index;
+        }
+    }
+
+    m_orderDirty = false;
+}
+
+glm::mat4 TransformStore::ComposeMatrix(const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale)
+{
+    // Same result as the product of the 3 matrices, expanded so there are only 3 sin and 3 cos
+    float sx = std::sin(rotation.x), cx = std::cos(rotation.x);
+    float sy = std::sin(rotation.y), cy = std::cos(rotation.y);
+    float sz = std::sin(rotation.z), cz = std::cos(rotation.z);
+
+    glm::mat4 matrix;
+    matrix[0] = glm::vec4(cy * cz + sy * sx * sz, cx * sz, -sy * cz + cy * sx * sz, 0.0f) * scale.x;
+    matrix[1] = glm::vec4(-cy * sz + sy * sx * cz, cx * cz, sy * sz + cy * sx * cz, 0.0f) * scale.y;
+    matrix[2] = glm::vec4(sy * cx, -sx, cy * cx, 0.0f) * scale.z;
+    matrix[3] = glm::vec4(translation, 1.0f);
+    return matrix;
+}
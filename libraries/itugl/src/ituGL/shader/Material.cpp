@@ -1,13 +1,14 @@
 #include <ituGL/shader/Material.h>
-#include <ituGL/core/DeviceGL.h>
+#include <ituGL/shader/RenderStateTracker.h>
 #include <cassert>
 
-Material::Material() : Material(nullptr)
+Material::Material() : Material(std::shared_ptr<ShaderProgram>())
 {
 }
 
 Material::Material(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms)
     : ShaderUniformCollection(shaderProgram, filteredUniforms)
+    , m_passMask(PassOpaque | PassShadow | PassReflection | PassDepthPrepass)
     , m_depthTestFunction(TestFunction::Less)
     , m_depthWrite(true)
     , m_stencilTestFunctions{ TestFunction::Never, TestFunction::Never }
@@ -18,9 +19,25 @@ Material::Material(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet&
     , m_stencilDepthPass{ StencilOperation::Keep, StencilOperation::Keep }
     , m_blendEquations{ BlendEquation::None }
     , m_blendParams{ BlendParam::One, BlendParam::Zero, BlendParam::One, BlendParam::Zero }
+    , m_renderState(nullptr)
 {
 }
 
+Material::Material(std::shared_ptr<const Material> parent) : Material(*parent)
+{
+    m_parent = parent;
+}
+
+std::vector<std::shared_ptr<const Material>> Material::GetParentChain() const
+{
+    std::vector<std::shared_ptr<const Material>> parentChain;
+    for (std::shared_ptr<const Material> parent = m_parent; parent; parent = parent->m_parent)
+    {
+        parentChain.push_back(parent);
+    }
+    return parentChain;
+}
+
 void Material::SetShaderSetupFunction(ShaderSetupFunction shaderSetupFunction)
 {
     m_shaderSetupFunction = shaderSetupFunction;
@@ -33,6 +50,7 @@ Material::TestFunction Material::GetDepthTestFunction() const
 
 void Material::SetDepthTestFunction(TestFunction function)
 {
+    m_renderState = nullptr;
     m_depthTestFunction = function;
 }
 
@@ -43,6 +61,7 @@ bool Material::GetDepthWrite() const
 
 void Material::SetDepthWrite(bool depthWrite)
 {
+    m_renderState = nullptr;
     m_depthWrite = depthWrite;
 }
 
@@ -61,6 +80,7 @@ Material::TestFunction Material::GetStencilFrontTestFunction(int &refValue, unsi
 
 void Material::SetStencilFrontTestFunction(TestFunction function, int refValue, unsigned int mask)
 {
+    m_renderState = nullptr;
     m_stencilTestFunctions[0] = function;
     m_stencilRefValues[0] = refValue;
     m_stencilMasks[0] = mask;
@@ -75,6 +95,7 @@ Material::TestFunction Material::GetStencilBackTestFunction(int& refValue, unsig
 
 void Material::SetStencilBackTestFunction(TestFunction function, int refValue, unsigned int mask)
 {
+    m_renderState = nullptr;
     m_stencilTestFunctions[1] = function;
     m_stencilRefValues[1] = refValue;
     m_stencilMasks[1] = mask;
@@ -95,6 +116,7 @@ void Material::GetStencilFrontOperations(StencilOperation& stencilFail, StencilO
 
 void Material::SetStencilFrontOperations(StencilOperation stencilFail, StencilOperation depthFail, StencilOperation depthPass)
 {
+    m_renderState = nullptr;
     m_stencilFail[0] = stencilFail;
     m_stencilDepthFail[0] = depthFail;
     m_stencilDepthPass[0] = depthPass;
@@ -109,6 +131,7 @@ void Material::GetStencilBackOperations(StencilOperation& stencilFail, StencilOp
 
 void Material::SetStencilBackOperations(StencilOperation stencilFail, StencilOperation depthFail, StencilOperation depthPass)
 {
+    m_renderState = nullptr;
     m_stencilFail[1] = stencilFail;
     m_stencilDepthFail[1] = depthFail;
     m_stencilDepthPass[1] = depthPass;
@@ -136,6 +159,7 @@ void Material::SetBlendEquation(BlendEquation blendEquation)
 
 void Material::SetBlendEquation(BlendEquation blendEquationColor, BlendEquation blendEquationAlpha)
 {
+    m_renderState = nullptr;
     m_blendEquations[0] = blendEquationColor;
     m_blendEquations[1] = blendEquationAlpha;
 }
@@ -172,6 +196,7 @@ void Material::SetBlendParams(BlendParam source, BlendParam dest, Color blendCol
 
 void Material::SetBlendParams(BlendParam sourceColor, BlendParam destColor, BlendParam sourceAlpha, BlendParam destAlpha)
 {
+    m_renderState = nullptr;
     m_blendParams[0] = sourceColor;
     m_blendParams[1] = destColor;
     m_blendParams[2] = sourceAlpha;
@@ -193,140 +218,80 @@ void Material::SetBlendColor(Color blendColor)
         || m_blendParams[3] == BlendParam::ConstantColor || m_blendParams[3] == BlendParam::ConstantAlpha);
 
     m_blendColor = blendColor;
+    m_renderState = nullptr;
 }
 
-void Material::Use(OverrideFlags overrideFlags) const
+const RenderState& Material::GetRenderState() const
 {
-    assert(m_shaderProgram);
-
-    // Set the shader program as the one currently in use
-    m_shaderProgram->Use();
-
-    // Set the value of all the uniforms stored as properties
-    SetUniforms();
-
-    if (m_shaderSetupFunction)
-    {
-        // if needed, do extra set up for the shader
-        m_shaderSetupFunction(*m_shaderProgram);
-    }
-
-    // If not skipped, set the depth settings
-    if ((overrideFlags & OverrideFlags::OverrideDepthTest) == 0)
-    {
-        UseDepthTest();
-    }
-
-    // If not skipped, set the stencil settings
-    if ((overrideFlags & OverrideFlags::OverrideStencilTest) == 0)
+    if (!m_renderState)
     {
-        UseStencilTest();
-    }
-
-    // If not skipped, set the blend settings
-    if ((overrideFlags & OverrideFlags::OverrideBlend) == 0)
-    {
-        UseBlend();
-    }
-}
+        RenderState::DepthState depth;
+        depth.function = static_cast<GLenum>(m_depthTestFunction);
+        depth.write = m_depthWrite;
 
-void Material::UseDepthTest() const
-{
-    // Depth function
-    glDepthFunc(static_cast<GLenum>(m_depthTestFunction));
-
-    // Depth write
-    glDepthMask(m_depthWrite ? GL_TRUE : GL_FALSE);
-}
-
-void Material::UseStencilTest() const
-{
-    // Stencil operations
-    if (m_stencilFail[0] == m_stencilFail[1] && m_stencilDepthFail[0] == m_stencilDepthFail[1] && m_stencilDepthPass[0] == m_stencilDepthPass[1])
-    {
-        // Same for front and back
-        glStencilOp(static_cast<GLenum>(m_stencilFail[0]), static_cast<GLenum>(m_stencilDepthFail[0]), static_cast<GLenum>(m_stencilDepthPass[0]));
-    }
-    else
-    {
-        // Separate functions for front and back
-        glStencilOpSeparate(GL_FRONT, static_cast<GLenum>(m_stencilFail[0]), static_cast<GLenum>(m_stencilDepthFail[0]), static_cast<GLenum>(m_stencilDepthPass[0]));
-        glStencilOpSeparate(GL_BACK, static_cast<GLenum>(m_stencilFail[1]), static_cast<GLenum>(m_stencilDepthFail[1]), static_cast<GLenum>(m_stencilDepthPass[1]));
-    }
-
-    // Stencil functions
-    if (m_stencilTestFunctions[0] == m_stencilTestFunctions[1] && m_stencilRefValues[0] == m_stencilRefValues[1] && m_stencilMasks[0] == m_stencilMasks[1])
-    {
-        // Same for front and back
-        glStencilFunc(static_cast<GLenum>(m_stencilTestFunctions[0]), m_stencilRefValues[0], m_stencilMasks[0]);
-    }
-    else
-    {
-        // Separate functions for front and back
-        glStencilFuncSeparate(GL_FRONT, static_cast<GLenum>(m_stencilTestFunctions[0]), m_stencilRefValues[0], m_stencilMasks[0]);
-        glStencilFuncSeparate(GL_BACK, static_cast<GLenum>(m_stencilTestFunctions[1]), m_stencilRefValues[1], m_stencilMasks[1]);
-    }
-}
-
-void Material::UseBlend() const
-{
-    // If the blend equation is None for color and alpha, do nothing
-    bool blending = HasBlend();
-    DeviceGL::GetInstance().SetFeatureEnabled(GL_BLEND, blending);
-    if (blending)
-    {
-        std::array<BlendParam, 4> blendParams = m_blendParams;
-
-        // Set blend equation
-        if (m_blendEquations[0] == m_blendEquations[1])
+        RenderState::StencilState stencil;
+        for (int i = 0; i < 2; ++i)
         {
-            // Set the same blend equation for color and alpha
-            glBlendEquation(static_cast<GLenum>(m_blendEquations[0]));
+            stencil.functions[i] = static_cast<GLenum>(m_stencilTestFunctions[i]);
+            stencil.refValues[i] = m_stencilRefValues[i];
+            stencil.masks[i] = m_stencilMasks[i];
+            stencil.stencilFail[i] = static_cast<GLenum>(m_stencilFail[i]);
+            stencil.depthFail[i] = static_cast<GLenum>(m_stencilDepthFail[i]);
+            stencil.depthPass[i] = static_cast<GLenum>(m_stencilDepthPass[i]);
         }
-        else
-        {
-            GLenum blendEquationColor = static_cast<GLenum>(m_blendEquations[0]);
-            GLenum blendEquationAlpha = static_cast<GLenum>(m_blendEquations[1]);
 
+        // If the blend equation is None for color and alpha, blending is disabled
+        RenderState::BlendState blend;
+        blend.enabled = HasBlend();
+        blend.equations = { static_cast<GLenum>(m_blendEquations[0]), static_cast<GLenum>(m_blendEquations[1]) };
+        blend.params = { static_cast<GLenum>(m_blendParams[0]), static_cast<GLenum>(m_blendParams[1]),
+            static_cast<GLenum>(m_blendParams[2]), static_cast<GLenum>(m_blendParams[3]) };
+        blend.color = { m_blendColor.GetRed(), m_blendColor.GetGreen(), m_blendColor.GetBlue(), m_blendColor.GetAlpha() };
+        if (blend.enabled)
+        {
             // Because there is no "None" equation, we replace it with (Source * 1 + Dest * 0)
             if (m_blendEquations[0] == BlendEquation::None)
             {
-                blendEquationColor = GL_FUNC_ADD;
-                blendParams[0] = BlendParam::One;
-                blendParams[1] = BlendParam::Zero;
+                blend.equations[0] = GL_FUNC_ADD;
+                blend.params[0] = GL_ONE;
+                blend.params[1] = GL_ZERO;
             }
             if (m_blendEquations[1] == BlendEquation::None)
             {
-                blendEquationAlpha = GL_FUNC_ADD;
-                blendParams[2] = BlendParam::One;
-                blendParams[3] = BlendParam::Zero;
+                blend.equations[1] = GL_FUNC_ADD;
+                blend.params[2] = GL_ONE;
+                blend.params[3] = GL_ZERO;
             }
-
-            // Set separate blend equation for color and alpha
-            glBlendEquationSeparate(blendEquationColor, blendEquationAlpha);
         }
 
-        // Set blend params
-        if (blendParams[0] == blendParams[2] && blendParams[1] == blendParams[3])
-        {
-            // Set the same blend params for color and alpha
-            glBlendFunc(static_cast<GLenum>(blendParams[0]), static_cast<GLenum>(blendParams[1]));
-        }
-        else
-        {
-            // Set separate blend params for color and alpha
-            glBlendFuncSeparate(
-                static_cast<GLenum>(blendParams[0]), static_cast<GLenum>(blendParams[1]),
-                static_cast<GLenum>(blendParams[2]), static_cast<GLenum>(blendParams[3]));
-        }
+        m_renderState = &RenderState::Get(depth, stencil, blend);
+    }
+    return *m_renderState;
+}
 
-        // Set blend color only if one param is using constant color or constant alpha
-        if (blendParams[0] == BlendParam::ConstantColor || blendParams[0] == BlendParam::ConstantAlpha ||
-            blendParams[1] == BlendParam::ConstantColor || blendParams[1] == BlendParam::ConstantAlpha ||
-            blendParams[2] == BlendParam::ConstantColor || blendParams[2] == BlendParam::ConstantAlpha ||
-            blendParams[3] == BlendParam::ConstantColor || blendParams[3] == BlendParam::ConstantAlpha)
-        {
-            glBlendColor(m_blendColor.GetRed(), m_blendColor.GetGreen(), m_blendColor.GetBlue(), m_blendColor.GetAlpha());
-        }
+void Material::Use(OverrideFlags overrideFlags) const
+{
+    // A new tracker doesn't know the current states, so all of them are set
+    RenderStateTracker renderStateTracker;
+    Use(renderStateTracker, overrideFlags);
+}
+
+void Material::Use(RenderStateTracker& renderStateTracker, OverrideFlags overrideFlags) const
+{
+    assert(m_shaderProgram);
+
+    // Set the shader program as the one currently in use
+    m_shaderProgram->Use();
+
+    // Set the value of all the uniforms stored as properties, binding only the textures that changed
+    SetUniforms(renderStateTracker);
+
+    if (m_shaderSetupFunction)
+    {
+        // if needed, do extra set up for the shader
+        m_shaderSetupFunction(*m_shaderProgram);
     }
+
+    // Set the depth, stencil and blend settings that are not skipped
+    renderStateTracker.Apply(GetRenderState(), overrideFlags);
 }
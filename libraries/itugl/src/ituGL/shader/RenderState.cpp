@@ -0,0 +1,95 @@
+#include <ituGL/shader/RenderState.h>
+
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Blocks are never destroyed, so references to them stay valid. There are only a few different ones
+static std::unordered_multimap<std::size_t, std::unique_ptr<RenderState>> s_renderStates;
+
+template<typename T>
+static void HashValue(std::size_t& hash, const T& value)
+{
+    // 64-bit FNV-1a over the bytes of the value
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    for (unsigned char byte : bytes)
+    {
+        hash ^= byte;
+        hash *= 0x100000001b3ull;
+    }
+}
+
+template<typename T, std::size_t N>
+static void HashValue(std::size_t& hash, const std::array<T, N>& values)
+{
+    for (const T& value : values)
+    {
+        HashValue(hash, value);
+    }
+}
+
+bool RenderState::BlendState::UsesColor() const
+{
+    for (GLenum param : params)
+    {
+        if (param == GL_CONSTANT_COLOR || param == GL_ONE_MINUS_CONSTANT_COLOR ||
+            param == GL_CONSTANT_ALPHA || param == GL_ONE_MINUS_CONSTANT_ALPHA)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+RenderState::RenderState(const DepthState& depth, const StencilState& stencil, const BlendState& blend, std::size_t hash)
+    : m_depth(depth), m_stencil(stencil), m_blend(blend), m_hash(hash)
+{
+}
+
+const RenderState& RenderState::Get(const DepthState& depth, const StencilState& stencil, const BlendState& blend)
+{
+    std::size_t hash = ComputeHash(depth, stencil, blend);
+
+    auto range = s_renderStates.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const RenderState& renderState = *it->second;
+        if (renderState.m_depth == depth && renderState.m_stencil == stencil && renderState.m_blend == blend)
+        {
+            return renderState;
+        }
+    }
+
+    auto it = s_renderStates.emplace(hash, std::unique_ptr<RenderState>(new RenderState(depth, stencil, blend, hash)));
+    return *it->second;
+}
+
+unsigned int RenderState::GetBlockCount()
+{
+    return static_cast<unsigned int>(s_renderStates.size());
+}
+
+std::size_t RenderState::ComputeHash(const DepthState& depth, const StencilState& stencil, const BlendState& blend)
+{
+    // Fields are hashed one by one, so padding bytes are not included
+    std::size_t hash = 0xcbf29ce484222325ull;
+
+    HashValue(hash, depth.function);
+    HashValue(hash, depth.write);
+
+    HashValue(hash, stencil.functions);
+    HashValue(hash, stencil.refValues);
+    HashValue(hash, stencil.masks);
+    HashValue(hash, stencil.stencilFail);
+    HashValue(hash, stencil.depthFail);
+    HashValue(hash, stencil.depthPass);
+
+    HashValue(hash, blend.enabled);
+    HashValue(hash, blend.equations);
+    HashValue(hash, blend.params);
+    HashValue(hash, blend.color);
+
+    return hash;
+}
@@ -0,0 +1,281 @@
+#include <ituGL/shader/RenderStateTracker.h>
+
+#include <ituGL/core/DeviceGL.h>
+#include <cassert>
+
+RenderStateTracker* RenderStateTracker::s_firstTracker = nullptr;
+
+RenderStateTracker::RenderStateTracker()
+    : m_currentRenderState(nullptr)
+    , m_depth{}
+    , m_stencil{}
+    , m_blend{}
+    , m_depthValid(false)
+    , m_stencilValid(false)
+    , m_blendValid(false)
+    , m_blendValuesValid(false)
+    , m_activeTextureUnit(-1)
+    , m_transitionCount(0)
+    , m_stateCallCount(0)
+    , m_textureBindCount(0)
+    , m_previousTracker(nullptr)
+    , m_nextTracker(s_firstTracker)
+{
+    if (s_firstTracker)
+    {
+        s_firstTracker->m_previousTracker = this;
+    }
+    s_firstTracker = this;
+}
+
+RenderStateTracker::~RenderStateTracker()
+{
+    if (m_previousTracker)
+    {
+        m_previousTracker->m_nextTracker = m_nextTracker;
+    }
+    else
+    {
+        assert(s_firstTracker == this);
+        s_firstTracker = m_nextTracker;
+    }
+    if (m_nextTracker)
+    {
+        m_nextTracker->m_previousTracker = m_previousTracker;
+    }
+}
+
+void RenderStateTracker::Apply(const RenderState& renderState, Material::OverrideFlags overrideFlags)
+{
+    // Same block, and nothing changed since it was applied
+    if (&renderState == m_currentRenderState)
+    {
+        return;
+    }
+    unsigned int stateCallCount = m_stateCallCount;
+
+    if ((overrideFlags & Material::OverrideDepthTest) == 0)
+    {
+        ApplyDepth(renderState.GetDepth());
+    }
+
+    if ((overrideFlags & Material::OverrideStencilTest) == 0)
+    {
+        ApplyStencil(renderState.GetStencil());
+    }
+
+    if ((overrideFlags & Material::OverrideBlend) == 0)
+    {
+        ApplyBlend(renderState.GetBlend());
+    }
+
+    // Blocks that only differ in overridden states don't count as a transition
+    if (m_stateCallCount != stateCallCount)
+    {
+        ++m_transitionCount;
+    }
+
+    // With overrides, some states of the block were not applied, so it can't be skipped next time
+    m_currentRenderState = overrideFlags == Material::NoOverride ? &renderState : nullptr;
+}
+
+void RenderStateTracker::ApplyDepth(const RenderState::DepthState& depth)
+{
+    m_currentRenderState = nullptr;
+
+    if (!m_depthValid || depth.function != m_depth.function)
+    {
+        glDepthFunc(depth.function);
+        ++m_stateCallCount;
+    }
+
+    if (!m_depthValid || depth.write != m_depth.write)
+    {
+        glDepthMask(depth.write ? GL_TRUE : GL_FALSE);
+        ++m_stateCallCount;
+    }
+
+    m_depth = depth;
+    m_depthValid = true;
+}
+
+void RenderStateTracker::ApplyStencil(const RenderState::StencilState& stencil)
+{
+    m_currentRenderState = nullptr;
+
+    // Stencil operations
+    if (!m_stencilValid || stencil.stencilFail != m_stencil.stencilFail ||
+        stencil.depthFail != m_stencil.depthFail || stencil.depthPass != m_stencil.depthPass)
+    {
+        if (stencil.stencilFail[0] == stencil.stencilFail[1] && stencil.depthFail[0] == stencil.depthFail[1] && stencil.depthPass[0] == stencil.depthPass[1])
+        {
+            // Same for front and back
+            glStencilOp(stencil.stencilFail[0], stencil.depthFail[0], stencil.depthPass[0]);
+            ++m_stateCallCount;
+        }
+        else
+        {
+            // Separate functions for front and back
+            glStencilOpSeparate(GL_FRONT, stencil.stencilFail[0], stencil.depthFail[0], stencil.depthPass[0]);
+            glStencilOpSeparate(GL_BACK, stencil.stencilFail[1], stencil.depthFail[1], stencil.depthPass[1]);
+            m_stateCallCount += 2;
+        }
+    }
+
+    // Stencil functions
+    if (!m_stencilValid || stencil.functions != m_stencil.functions ||
+        stencil.refValues != m_stencil.refValues || stencil.masks != m_stencil.masks)
+    {
+        if (stencil.functions[0] == stencil.functions[1] && stencil.refValues[0] == stencil.refValues[1] && stencil.masks[0] == stencil.masks[1])
+        {
+            // Same for front and back
+            glStencilFunc(stencil.functions[0], stencil.refValues[0], stencil.masks[0]);
+            ++m_stateCallCount;
+        }
+        else
+        {
+            // Separate functions for front and back
+            glStencilFuncSeparate(GL_FRONT, stencil.functions[0], stencil.refValues[0], stencil.masks[0]);
+            glStencilFuncSeparate(GL_BACK, stencil.functions[1], stencil.refValues[1], stencil.masks[1]);
+            m_stateCallCount += 2;
+        }
+    }
+
+    m_stencil = stencil;
+    m_stencilValid = true;
+}
+
+void RenderStateTracker::ApplyBlend(const RenderState::BlendState& blend)
+{
+    m_currentRenderState = nullptr;
+
+    if (!m_blendValid || blend.enabled != m_blend.enabled)
+    {
+        DeviceGL::GetInstance().SetFeatureEnabled(GL_BLEND, blend.enabled);
+        ++m_stateCallCount;
+    }
+
+    // The other values don't matter while blending is disabled, so they are only set when enabled
+    if (blend.enabled)
+    {
+        bool blendValid = m_blendValuesValid;
+
+        if (!blendValid || blend.equations != m_blend.equations)
+        {
+            if (blend.equations[0] == blend.equations[1])
+            {
+                // Set the same blend equation for color and alpha
+                glBlendEquation(blend.equations[0]);
+            }
+            else
+            {
+                // Set separate blend equation for color and alpha
+                glBlendEquationSeparate(blend.equations[0], blend.equations[1]);
+            }
+            ++m_stateCallCount;
+        }
+
+        if (!blendValid || blend.params != m_blend.params)
+        {
+            if (blend.params[0] == blend.params[2] && blend.params[1] == blend.params[3])
+            {
+                // Set the same blend params for color and alpha
+                glBlendFunc(blend.params[0], blend.params[1]);
+            }
+            else
+            {
+                // Set separate blend params for color and alpha
+                glBlendFuncSeparate(blend.params[0], blend.params[1], blend.params[2], blend.params[3]);
+            }
+            ++m_stateCallCount;
+        }
+
+        // Set blend color only if one param is using constant color or constant alpha
+        if (blend.UsesColor() && (!blendValid || !m_blend.UsesColor() || blend.color != m_blend.color))
+        {
+            glBlendColor(blend.color[0], blend.color[1], blend.color[2], blend.color[3]);
+            ++m_stateCallCount;
+        }
+
+        m_blend = blend;
+        m_blendValuesValid = true;
+    }
+    else
+    {
+        // Keep the values set in OpenGL, only the enabled flag changes
+        m_blend.enabled = false;
+    }
+    m_blendValid = true;
+}
+
+void RenderStateTracker::BindTexture(GLint textureUnit, const TextureObject& texture)
+{
+    assert(textureUnit >= 0);
+
+    GLenum target = texture.GetTarget();
+    Object::Handle handle = texture.GetHandle();
+
+    if (static_cast<size_t>(textureUnit) >= m_boundTextures.size())
+    {
+        m_boundTextures.resize(textureUnit + 1, BoundTexture{ 0, 0 });
+    }
+
+    // A unit has one binding per target, but the sampler only reads the target of its type
+    BoundTexture& boundTexture = m_boundTextures[textureUnit];
+    if (boundTexture.handle != 0 && boundTexture.handle == handle && boundTexture.target == target)
+    {
+        return;
+    }
+
+    if (textureUnit != m_activeTextureUnit)
+    {
+        TextureObject::SetActiveTexture(textureUnit);
+        m_activeTextureUnit = textureUnit;
+        ++m_textureBindCount;
+    }
+
+    texture.Bind();
+    ++m_textureBindCount;
+
+    boundTexture.target = target;
+    boundTexture.handle = handle;
+}
+
+void RenderStateTracker::ForgetTexture(Object::Handle handle)
+{
+    for (RenderStateTracker* tracker = s_firstTracker; tracker; tracker = tracker->m_nextTracker)
+    {
+        // Deleting the texture leaves the units where it was bound with no texture, so it is not bound anywhere now
+        for (BoundTexture& boundTexture : tracker->m_boundTextures)
+        {
+            if (boundTexture.handle == handle)
+            {
+                boundTexture.handle = 0;
+            }
+        }
+    }
+}
+
+const RenderState::DepthState& RenderStateTracker::GetDepth() const
+{
+    assert(m_depthValid);
+    return m_depth;
+}
+
+void RenderStateTracker::Invalidate()
+{
+    m_currentRenderState = nullptr;
+    m_depthValid = false;
+    m_stencilValid = false;
+    m_blendValid = false;
+    m_blendValuesValid = false;
+    m_activeTextureUnit = -1;
+    m_boundTextures.clear();
+}
+
+void RenderStateTracker::ResetCounters()
+{
+    m_transitionCount = 0;
+    m_stateCallCount = 0;
+    m_textureBindCount = 0;
+}
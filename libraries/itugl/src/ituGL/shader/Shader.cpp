@@ -62,6 +62,14 @@ bool Shader::Compile()
     return IsCompiled();
 }
 
+// Start compiling the shader source code, without waiting for the result
+void Shader::CompileAsync()
+{
+    assert(IsValid());
+
+    glCompileShader(GetHandle());
+}
+
 // Check if the shader has been successfully compiled
 bool Shader::IsCompiled() const
 {
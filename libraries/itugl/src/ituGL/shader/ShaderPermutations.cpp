@@ -0,0 +1,205 @@
+#include <ituGL/shader/ShaderPermutations.h>
+
+#include <ituGL/shader/ShaderProgram.h>
+#include <ituGL/asset/ShaderLoader.h>
+#include <ituGL/asset/ShaderProgramCache.h>
+#include <array>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+
+ShaderPermutations::ShaderPermutations(const std::vector<const char*>& vertexShaderPaths, const std::vector<const char*>& fragmentShaderPaths)
+    : m_vertexShaderPaths(vertexShaderPaths)
+    , m_fragmentShaderPaths(fragmentShaderPaths)
+    , m_bitCount(0)
+    , m_shaderProgramCache(nullptr)
+{
+    assert(!m_vertexShaderPaths.empty());
+    assert(!m_fragmentShaderPaths.empty());
+}
+
+ShaderPermutations::Feature ShaderPermutations::AddFeature(const char* name, unsigned int bitCount)
+{
+    assert(bitCount > 0);
+    assert(m_bitCount + bitCount <= sizeof(FeatureMask) * 8);
+    // Existing permutations would not have the new define
+    assert(m_shaderPrograms.empty());
+
+    Feature feature = static_cast<Feature>(m_features.size());
+    m_features.push_back(FeatureInfo{ name, m_bitCount, bitCount });
+    m_bitCount += bitCount;
+    return feature;
+}
+
+unsigned int ShaderPermutations::GetFeatureValue(FeatureMask featureMask, Feature feature) const
+{
+    const FeatureInfo& featureInfo = m_features[feature];
+    FeatureMask valueMask = (1u << featureInfo.bitCount) - 1u;
+    return (featureMask >> featureInfo.bitOffset) & valueMask;
+}
+
+ShaderPermutations::FeatureMask ShaderPermutations::SetFeatureValue(FeatureMask featureMask, Feature feature, unsigned int value) const
+{
+    const FeatureInfo& featureInfo = m_features[feature];
+    FeatureMask valueMask = (1u << featureInfo.bitCount) - 1u;
+    assert(value <= valueMask);
+    return (featureMask & ~(valueMask << featureInfo.bitOffset)) | (value << featureInfo.bitOffset);
+}
+
+void ShaderPermutations::SetBuildFunction(const BuildFunction& buildFunction)
+{
+    m_buildFunction = buildFunction;
+}
+
+std::shared_ptr<ShaderProgram> ShaderPermutations::GetShaderProgram(FeatureMask featureMask)
+{
+    auto itFind = m_shaderPrograms.find(featureMask);
+    if (itFind != m_shaderPrograms.end())
+    {
+        return itFind->second;
+    }
+
+    // Still building in the background, so we have to wait for it
+    auto itPending = m_pendingShaderPrograms.find(featureMask);
+    if (itPending != m_pendingShaderPrograms.end())
+    {
+        std::shared_ptr<ShaderProgram> shaderProgram = itPending->second;
+        m_pendingShaderPrograms.erase(itPending);
+        return CompleteShaderProgram(featureMask, shaderProgram);
+    }
+
+    std::shared_ptr<ShaderProgram> shaderProgram = BuildShaderProgram(featureMask);
+    m_shaderPrograms[featureMask] = shaderProgram;
+
+    if (m_buildFunction)
+    {
+        m_buildFunction(shaderProgram, featureMask);
+    }
+
+    return shaderProgram;
+}
+
+void ShaderPermutations::Prebuild(FeatureMask featureMask)
+{
+    if (m_shaderPrograms.find(featureMask) == m_shaderPrograms.end() &&
+        m_pendingShaderPrograms.find(featureMask) == m_pendingShaderPrograms.end())
+    {
+        m_pendingShaderPrograms[featureMask] = BuildShaderProgramAsync(featureMask);
+    }
+}
+
+bool ShaderPermutations::IsShaderProgramReady(FeatureMask featureMask)
+{
+    if (m_shaderPrograms.find(featureMask) != m_shaderPrograms.end())
+    {
+        return true;
+    }
+
+    auto itPending = m_pendingShaderPrograms.find(featureMask);
+    if (itPending == m_pendingShaderPrograms.end())
+    {
+        Prebuild(featureMask);
+        return false;
+    }
+
+    std::shared_ptr<ShaderProgram> shaderProgram = itPending->second;
+    if (!shaderProgram->IsBuildComplete())
+    {
+        return false;
+    }
+
+    m_pendingShaderPrograms.erase(itPending);
+    CompleteShaderProgram(featureMask, shaderProgram);
+    return true;
+}
+
+std::string ShaderPermutations::GetDefines(FeatureMask featureMask) const
+{
+    // Start in a new line, in case the #version file does not end with one
+    std::stringstream defines;
+    defines << '\n';
+    for (Feature feature = 0; feature < static_cast<Feature>(m_features.size()); ++feature)
+    {
+        const FeatureInfo& featureInfo = m_features[feature];
+        unsigned int value = GetFeatureValue(featureMask, feature);
+        if (featureInfo.bitCount > 1)
+        {
+            defines << "#define " << featureInfo.name << ' ' << value << '\n';
+        }
+        else if (value)
+        {
+            defines << "#define " << featureInfo.name << '\n';
+        }
+    }
+    return defines.str();
+}
+
+std::shared_ptr<ShaderProgram> ShaderPermutations::BuildShaderProgram(FeatureMask featureMask) const
+{
+    std::string defines = GetDefines(featureMask);
+
+    if (m_shaderProgramCache)
+    {
+        std::vector<const char*> vertexShaderPaths = m_vertexShaderPaths;
+        std::vector<const char*> fragmentShaderPaths = m_fragmentShaderPaths;
+        std::shared_ptr<ShaderProgram> shaderProgram = std::make_shared<ShaderProgram>();
+        m_shaderProgramCache->Build(*shaderProgram, vertexShaderPaths, fragmentShaderPaths, defines.c_str());
+        return shaderProgram;
+    }
+
+    std::vector<const char*> vertexShaderPaths = m_vertexShaderPaths;
+    Shader vertexShader = ShaderLoader(Shader::VertexShader).Load(vertexShaderPaths, defines.c_str());
+
+    std::vector<const char*> fragmentShaderPaths = m_fragmentShaderPaths;
+    Shader fragmentShader = ShaderLoader(Shader::FragmentShader).Load(fragmentShaderPaths, defines.c_str());
+
+    std::shared_ptr<ShaderProgram> shaderProgram = std::make_shared<ShaderProgram>();
+    shaderProgram->Build(vertexShader, fragmentShader);
+    return shaderProgram;
+}
+
+std::shared_ptr<ShaderProgram> ShaderPermutations::BuildShaderProgramAsync(FeatureMask featureMask) const
+{
+    std::string defines = GetDefines(featureMask);
+
+    std::vector<const char*> vertexShaderPaths = m_vertexShaderPaths;
+    std::vector<const char*> fragmentShaderPaths = m_fragmentShaderPaths;
+    std::shared_ptr<ShaderProgram> shaderProgram = std::make_shared<ShaderProgram>();
+
+    if (m_shaderProgramCache)
+    {
+        m_shaderProgramCache->BuildAsync(*shaderProgram, vertexShaderPaths, fragmentShaderPaths, defines.c_str());
+    }
+    else
+    {
+        std::vector<std::string> vertexSources = ShaderLoader::ReadSources(vertexShaderPaths, defines.c_str());
+        Shader vertexShader = ShaderLoader(Shader::VertexShader).LoadFromSources(vertexSources, true);
+
+        std::vector<std::string> fragmentSources = ShaderLoader::ReadSources(fragmentShaderPaths, defines.c_str());
+        Shader fragmentShader = ShaderLoader(Shader::FragmentShader).LoadFromSources(fragmentSources, true);
+
+        shaderProgram->BuildAsync(vertexShader, fragmentShader);
+    }
+    return shaderProgram;
+}
+
+std::shared_ptr<ShaderProgram> ShaderPermutations::CompleteShaderProgram(FeatureMask featureMask, std::shared_ptr<ShaderProgram> shaderProgram)
+{
+    bool linked = m_shaderProgramCache ? m_shaderProgramCache->CompleteBuild(*shaderProgram) : shaderProgram->IsLinked();
+    if (!linked)
+    {
+        // Compile errors were not checked, but the linker reports them
+        std::array<char, 512> infoLog;
+        shaderProgram->GetLinkingErrors(infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED (permutation " << featureMask << ")\n" << infoLog.data() << std::endl;
+    }
+
+    m_shaderPrograms[featureMask] = shaderProgram;
+
+    if (m_buildFunction)
+    {
+        m_buildFunction(shaderProgram, featureMask);
+    }
+
+    return shaderProgram;
+}
@@ -2,13 +2,21 @@
 
 #include <ituGL/shader/Shader.h>
 #include <ituGL/texture/TextureObject.h>
+#include <ituGL/core/DeviceGL.h>
 #include <cassert>
+#include <mutex>
+#include <utility>
 
 #ifndef NDEBUG
 ShaderProgram::Handle ShaderProgram::s_usedHandle = ShaderProgram::NullHandle;
 #endif
 
-ShaderProgram::ShaderProgram() : Object(NullHandle)
+// Ids of the destroyed programs, to reuse them
+static std::mutex s_idMutex;
+static std::vector<unsigned int> s_freeIds;
+static unsigned int s_idCount = 0;
+
+ShaderProgram::ShaderProgram() : Object(NullHandle), m_id(AcquireId())
 {
     Handle& handle = GetHandle();
     handle = glCreateProgram();
@@ -22,18 +30,52 @@ ShaderProgram::~ShaderProgram()
         glDeleteProgram(handle);
         handle = NullHandle;
     }
+
+    if (m_id != InvalidId)
+    {
+        ReleaseId(m_id);
+        m_id = InvalidId;
+    }
 }
 
 ShaderProgram::ShaderProgram(ShaderProgram&& shaderProgram) noexcept : Object(std::move(shaderProgram))
+    , m_id(std::exchange(shaderProgram.m_id, InvalidId))
 {
 }
 
 ShaderProgram& ShaderProgram::operator = (ShaderProgram&& shaderProgram) noexcept
 {
+    unsigned int id = std::exchange(shaderProgram.m_id, InvalidId);
+
+    // Object assignment destroys the current program, which can release its id
     Object::operator=(std::move(shaderProgram));
+    if (m_id != InvalidId)
+    {
+        ReleaseId(m_id);
+    }
+    m_id = id;
     return *this;
 }
 
+unsigned int ShaderProgram::AcquireId()
+{
+    std::lock_guard<std::mutex> lock(s_idMutex);
+    if (s_freeIds.empty())
+    {
+        return s_idCount++;
+    }
+
+    unsigned int id = s_freeIds.back();
+    s_freeIds.pop_back();
+    return id;
+}
+
+void ShaderProgram::ReleaseId(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(s_idMutex);
+    s_freeIds.push_back(id);
+}
+
 // Bind should not be called for ShaderProgram
 void ShaderProgram::Bind() const
 {
@@ -82,6 +124,34 @@ bool ShaderProgram::Build(const Shader& vertexShader, const Shader& fragmentShad
     return Link();
 }
 
+// Start building a shader program with vertex and fragment shaders, without waiting for the result
+void ShaderProgram::BuildAsync(const Shader& vertexShader, const Shader& fragmentShader)
+{
+    assert(IsValid());
+    assert(vertexShader.IsValid() && fragmentShader.IsValid());
+
+    // AttachShader is not used, because checking the compile status would wait for the compiler
+    glAttachShader(GetHandle(), vertexShader.GetHandle());
+    glAttachShader(GetHandle(), fragmentShader.GetHandle());
+    glLinkProgram(GetHandle());
+}
+
+// Check if compiling and linking have finished, without blocking
+bool ShaderProgram::IsBuildComplete() const
+{
+    assert(IsValid());
+
+    bool complete = true;
+    DeviceGL* device = DeviceGL::GetInstancePointer();
+    if (device && device->IsParallelShaderCompileSupported())
+    {
+        GLint status = GL_FALSE;
+        glGetProgramiv(GetHandle(), GL_COMPLETION_STATUS_KHR, &status);
+        complete = status == GL_TRUE;
+    }
+    return complete;
+}
+
 // Attach a shader to be linked
 void ShaderProgram::AttachShader(const Shader& shader)
 {
@@ -118,6 +188,38 @@ void ShaderProgram::GetLinkingErrors(std::span<char> errors) const
     glGetProgramInfoLog(GetHandle(), static_cast<GLsizei>(errors.size()), nullptr, errors.data());
 }
 
+void ShaderProgram::SetBinaryRetrievableHint(bool retrievable)
+{
+    assert(IsValid());
+    glProgramParameteri(GetHandle(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, retrievable ? GL_TRUE : GL_FALSE);
+}
+
+bool ShaderProgram::GetBinary(GLenum& format, std::vector<char>& binary) const
+{
+    assert(IsValid());
+    assert(IsLinked());
+
+    GLint length = 0;
+    glGetProgramiv(GetHandle(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    binary.resize(length);
+    GLsizei writtenLength = 0;
+    glGetProgramBinary(GetHandle(), length, &writtenLength, &format, binary.data());
+    binary.resize(writtenLength);
+    return writtenLength > 0;
+}
+
+bool ShaderProgram::LoadBinary(GLenum format, std::span<const char> binary)
+{
+    assert(IsValid());
+    glProgramBinary(GetHandle(), format, binary.data(), static_cast<GLsizei>(binary.size()));
+    return IsLinked();
+}
+
 // Set the shader program as the active one to be used for rendering
 void ShaderProgram::Use() const
 {
@@ -401,3 +503,9 @@ void ShaderProgram::SetTexture(Location location, GLint textureUnit, const Textu
     texture.Bind();
     SetUniform(location, textureUnit);
 }
+
+void ShaderProgram::SetTextureUnit(Location location, GLint textureUnit) const
+{
+    assert(IsValid());
+    glProgramUniform1i(GetHandle(), location, textureUnit);
+}
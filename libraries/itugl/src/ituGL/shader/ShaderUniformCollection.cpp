@@ -1,12 +1,21 @@
 #include <ituGL/shader/ShaderUniformCollection.h>
+
+#include <ituGL/shader/RenderStateTracker.h>
 #include <cassert>
 #include <array>
+#include <cstring>
 
-ShaderUniformCollection::ShaderUniformCollection() : m_shaderProgram(nullptr)
+ShaderUniformCollection::ShaderUniformCollection()
+    : m_shaderProgram(nullptr)
+    , m_layout(std::make_shared<UniformLayout>())
+    , m_values(std::make_shared<UniformValues>())
 {
 }
 
-ShaderUniformCollection::ShaderUniformCollection(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms) : m_shaderProgram(shaderProgram)
+ShaderUniformCollection::ShaderUniformCollection(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms)
+    : m_shaderProgram(shaderProgram)
+    , m_layout(std::make_shared<UniformLayout>())
+    , m_values(std::make_shared<UniformValues>())
 {
     ExtractUniforms(filteredUniforms);
 }
@@ -21,11 +30,18 @@ std::shared_ptr<const ShaderProgram> ShaderUniformCollection::GetShaderProgram()
     return m_shaderProgram;
 }
 
-void ShaderUniformCollection::ChangeShader(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms)
+void ShaderUniformCollection::ChangeShader(std::shared_ptr<ShaderProgram> shaderProgram, const NameSet& filteredUniforms, bool keepValues)
 {
+    // Move the current uniforms away, to copy their values after extracting the new ones
+    ShaderUniformCollection previousUniforms;
+    if (keepValues)
+    {
+        previousUniforms = std::move(*this);
+    }
+
     Reset();
     m_shaderProgram = shaderProgram;
-    ExtractUniforms(filteredUniforms);
+    ExtractUniforms(filteredUniforms, keepValues ? &previousUniforms : nullptr);
 }
 
 ShaderProgram::Location ShaderUniformCollection::GetAttributeLocation(const char* name) const
@@ -35,36 +51,128 @@ ShaderProgram::Location ShaderUniformCollection::GetAttributeLocation(const char
 
 ShaderProgram::Location ShaderUniformCollection::GetUniformLocation(const char* name) const
 {
+    std::size_t hash = HashUniformName(name);
+    const std::vector<UniformName>& uniformNames = m_layout->uniformNames;
+    auto itName = std::lower_bound(uniformNames.begin(), uniformNames.end(), hash,
+        [](const UniformName& uniformName, std::size_t hash) { return uniformName.hash < hash; });
+    for (; itName != uniformNames.end() && itName->hash == hash; ++itName)
+    {
+        if (itName->name == name)
+        {
+            return itName->location;
+        }
+    }
+
+    // Not an active uniform name, but it could still be valid, like an element of an array
     return m_shaderProgram->GetUniformLocation(name);
 }
 
-ShaderUniformCollection::DataUniform& ShaderUniformCollection::GetDataUniform(ShaderProgram::Location location)
+int ShaderUniformCollection::FindDataUniformIndex(ShaderProgram::Location location) const
+{
+    const std::vector<int>& locationDataIndex = m_layout->locationDataIndex;
+    return location >= 0 && location < static_cast<int>(locationDataIndex.size()) ? locationDataIndex[location] : -1;
+}
+
+int ShaderUniformCollection::FindTextureUniformIndex(ShaderProgram::Location location) const
+{
+    const std::vector<int>& locationTextureIndex = m_layout->locationTextureIndex;
+    return location >= 0 && location < static_cast<int>(locationTextureIndex.size()) ? locationTextureIndex[location] : -1;
+}
+
+void ShaderUniformCollection::SetLocationIndex(std::vector<int>& locationIndices, ShaderProgram::Location location, int index)
+{
+    assert(location >= 0);
+    if (location >= static_cast<int>(locationIndices.size()))
+    {
+        locationIndices.resize(location + 1, -1);
+    }
+    locationIndices[location] = index;
+}
+
+void ShaderUniformCollection::AddUniformName(const char* name, ShaderProgram::Location location)
 {
-    return const_cast<DataUniform&>(const_cast<const ShaderUniformCollection*>(this)->GetDataUniform(location));
+    UniformName uniformName{ HashUniformName(name), name, location };
+    std::vector<UniformName>& uniformNames = m_layout->uniformNames;
+    auto itName = std::upper_bound(uniformNames.begin(), uniformNames.end(), uniformName.hash,
+        [](std::size_t hash, const UniformName& uniformName) { return hash < uniformName.hash; });
+    uniformNames.insert(itName, std::move(uniformName));
+}
+
+std::size_t ShaderUniformCollection::HashUniformName(const char* name)
+{
+    // FNV-1a
+    std::size_t hash = 0xcbf29ce484222325ull;
+    for (const char* c = name; *c; ++c)
+    {
+        hash ^= static_cast<unsigned char>(*c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
 }
 
 const ShaderUniformCollection::DataUniform& ShaderUniformCollection::GetDataUniform(ShaderProgram::Location location) const
 {
-    int uniformIndex = m_locationDataIndex.at(location);
-    const DataUniform& uniform = m_dataUniforms[uniformIndex];
+    int uniformIndex = FindDataUniformIndex(location);
+    assert(uniformIndex >= 0);
+    const DataUniform& uniform = m_layout->dataUniforms[uniformIndex];
     assert(uniform.location == location);
     return uniform;
 }
 
-ShaderUniformCollection::TextureUniform& ShaderUniformCollection::GetTextureUniform(ShaderProgram::Location location)
+int ShaderUniformCollection::GetTextureUniformIndex(ShaderProgram::Location location) const
 {
-    return const_cast<TextureUniform&>(const_cast<const ShaderUniformCollection*>(this)->GetTextureUniform(location));
+    int uniformIndex = FindTextureUniformIndex(location);
+    assert(uniformIndex >= 0);
+    assert(m_layout->textureUniforms[uniformIndex].location == location);
+    return uniformIndex;
 }
 
-const ShaderUniformCollection::TextureUniform& ShaderUniformCollection::GetTextureUniform(ShaderProgram::Location location) const
+bool ShaderUniformCollection::HasSharedValues() const
 {
-    int uniformIndex = m_locationTextureIndex.at(location);
-    const TextureUniform& uniform = m_textureUniforms[uniformIndex];
-    assert(uniform.location == location);
-    return uniform;
+    return m_values.use_count() > 1 && !m_overrides;
+}
+
+ShaderUniformCollection::UniformOverrides& ShaderUniformCollection::DetachOverrides()
+{
+    if (!m_overrides)
+    {
+        m_overrides = std::make_shared<UniformOverrides>();
+        m_overrides->dataIndices.resize(m_layout->dataUniforms.size(), -1);
+        m_overrides->values.textures.resize(m_layout->textureUniforms.size());
+        m_overrides->textureOverridden.resize(m_layout->textureUniforms.size(), false);
+    }
+    else if (m_overrides.use_count() > 1)
+    {
+        // Other copies keep the current overrides, this one gets its own
+        m_overrides = std::make_shared<UniformOverrides>(*m_overrides);
+    }
+    return *m_overrides;
 }
 
-void ShaderUniformCollection::ExtractUniforms(const NameSet& filteredUniforms)
+const std::shared_ptr<const TextureObject>& ShaderUniformCollection::GetTexture(int uniformIndex) const
+{
+    if (m_overrides && m_overrides->textureOverridden[uniformIndex])
+    {
+        return m_overrides->values.textures[uniformIndex];
+    }
+    return m_values->textures[uniformIndex];
+}
+
+void ShaderUniformCollection::SetTexture(int uniformIndex, const std::shared_ptr<const TextureObject>& texture)
+{
+    // Values only used by this collection are modified in place
+    if (!m_overrides && m_values.use_count() == 1)
+    {
+        m_values->textures[uniformIndex] = texture;
+        return;
+    }
+
+    UniformOverrides& overrides = DetachOverrides();
+    overrides.values.textures[uniformIndex] = texture;
+    overrides.textureOverridden[uniformIndex] = true;
+}
+
+void ShaderUniformCollection::ExtractUniforms(const NameSet& filteredUniforms, const ShaderUniformCollection* previousUniforms)
 {
     assert(m_shaderProgram);
 
@@ -72,6 +180,9 @@ void ShaderUniformCollection::ExtractUniforms(const NameSet& filteredUniforms)
 
     unsigned int uniformCount = shaderProgram.GetUniformCount();
 
+    // Units follow the order of the texture uniforms in the program, filtered or not, so all the collections of the program agree
+    GLint textureUnit = 0;
+
     // Loop over all the uniforms
     for (unsigned int i = 0; i < uniformCount; ++i)
     {
@@ -81,17 +192,30 @@ void ShaderUniformCollection::ExtractUniforms(const NameSet& filteredUniforms)
         char uniformName[256];
         shaderProgram.GetUniformInfo(i, size, glType, std::span(uniformName, sizeof(uniformName)));
 
-        // If the named is in the filtered list, skip
-        if (filteredUniforms.contains(uniformName))
-            continue;
-
-        // Get the uniform location
-        ShaderProgram::Location location = GetUniformLocation(uniformName);
+        // Get the uniform location, once per uniform. Filtered uniforms are also in the name table
+        ShaderProgram::Location location = shaderProgram.GetUniformLocation(uniformName);
         assert(location >= 0);
+        AddUniformName(uniformName, location);
+
+        // Arrays are reported as "name[0]", but are usually searched by the name alone
+        char* arraySuffix = std::strstr(uniformName, "[0]");
+        if (arraySuffix && arraySuffix[3] == '\0')
+        {
+            *arraySuffix = '\0';
+            AddUniformName(uniformName, location);
+            *arraySuffix = '[';
+        }
 
         Data::Type type;
         UniformDimension dimension;
         TextureObject::Target target;
+        bool isTexture = IsTextureUniform(glType, target);
+        GLint uniformTextureUnit = isTexture ? textureUnit++ : -1;
+
+        // If the named is in the filtered list, skip
+        if (filteredUniforms.contains(uniformName))
+            continue;
+
         if (IsDataUniform(glType, type, dimension))
         {
             // If it is a data property, store as data
@@ -102,19 +226,79 @@ void ShaderUniformCollection::ExtractUniforms(const NameSet& filteredUniforms)
             uniform.count = size;
             AddUniform(uniform);
         }
-        else if (IsTextureUniform(glType, target))
+        else if (isTexture)
         {
             // If it is a texture property, store as property
             TextureUniform uniform;
             uniform.location = location;
             uniform.target = target;
+            uniform.textureUnit = uniformTextureUnit;
             AddUniform(uniform);
+
+            // The unit never changes, so it is set once instead of on every draw
+            shaderProgram.SetTextureUnit(location, uniformTextureUnit);
         }
         else
         {
             // Unsupported uniform type
             assert(false);
         }
+
+        if (previousUniforms)
+        {
+            CopyUniformValue(*previousUniforms, uniformName);
+        }
+    }
+}
+
+void ShaderUniformCollection::CopyUniformValue(const ShaderUniformCollection& source, const char* name)
+{
+    if (!source.m_shaderProgram)
+    {
+        return;
+    }
+
+    ShaderProgram::Location sourceLocation = source.GetUniformLocation(name);
+    ShaderProgram::Location location = GetUniformLocation(name);
+
+    int sourceDataIndex = source.FindDataUniformIndex(sourceLocation);
+    int dataIndex = FindDataUniformIndex(location);
+    if (sourceDataIndex >= 0 && dataIndex >= 0)
+    {
+        const DataUniform& sourceUniform = source.m_layout->dataUniforms[sourceDataIndex];
+        const DataUniform& uniform = m_layout->dataUniforms[dataIndex];
+        if (sourceUniform.type == uniform.type && sourceUniform.dimension == uniform.dimension && sourceUniform.count == uniform.count)
+        {
+            switch (uniform.type)
+            {
+            case Data::Type::Int:
+                CopyDataValues<int>(source, sourceUniform, uniform);
+                break;
+            case Data::Type::UInt:
+                CopyDataValues<unsigned int>(source, sourceUniform, uniform);
+                break;
+            case Data::Type::Float:
+                CopyDataValues<float>(source, sourceUniform, uniform);
+                break;
+            case Data::Type::Double:
+                CopyDataValues<double>(source, sourceUniform, uniform);
+                break;
+            default:
+                assert(false);
+            }
+        }
+    }
+
+    int sourceTextureIndex = source.FindTextureUniformIndex(sourceLocation);
+    int textureIndex = FindTextureUniformIndex(location);
+    if (sourceTextureIndex >= 0 && textureIndex >= 0)
+    {
+        const TextureUniform& sourceUniform = source.m_layout->textureUniforms[sourceTextureIndex];
+        const TextureUniform& uniform = m_layout->textureUniforms[textureIndex];
+        if (sourceUniform.target == uniform.target)
+        {
+            SetTexture(textureIndex, source.GetTexture(sourceTextureIndex));
+        }
     }
 }
 
@@ -282,19 +466,30 @@ void ShaderUniformCollection::AddUniform(const DataUniform& uniform)
 
 void ShaderUniformCollection::AddUniform(const TextureUniform& uniform)
 {
-    m_locationTextureIndex.insert(std::make_pair(uniform.location, static_cast<int>(m_textureUniforms.size())));
-    m_textureUniforms.push_back(uniform);
+    SetLocationIndex(m_layout->locationTextureIndex, uniform.location, static_cast<int>(m_layout->textureUniforms.size()));
+    m_layout->textureUniforms.push_back(uniform);
+    m_values->textures.push_back(nullptr);
 }
 
 void ShaderUniformCollection::SetUniforms() const
 {
-    for (const DataUniform& uniform : m_dataUniforms)
+    SetUniforms(nullptr);
+}
+
+void ShaderUniformCollection::SetUniforms(RenderStateTracker& renderStateTracker) const
+{
+    SetUniforms(&renderStateTracker);
+}
+
+void ShaderUniformCollection::SetUniforms(RenderStateTracker* renderStateTracker) const
+{
+    for (const DataUniform& uniform : m_layout->dataUniforms)
     {
         UseUniform(uniform);
     }
-    for (const TextureUniform& uniform : m_textureUniforms)
+    for (const TextureUniform& uniform : m_layout->textureUniforms)
     {
-        UseUniform(uniform);
+        UseUniform(uniform, renderStateTracker);
     }
 }
 
@@ -319,13 +514,24 @@ void ShaderUniformCollection::UseUniform(const DataUniform& uniform) const
     }
 }
 
-void ShaderUniformCollection::UseUniform(const TextureUniform& uniform) const
+void ShaderUniformCollection::UseUniform(const TextureUniform& uniform, RenderStateTracker* renderStateTracker) const
 {
+    int uniformIndex = static_cast<int>(&uniform - m_layout->textureUniforms.data());
+    const std::shared_ptr<const TextureObject>& texture = GetTexture(uniformIndex);
+
     //TODO: default texture
-    if (uniform.texture)
+    if (texture)
     {
-        size_t textureIndex = &uniform - m_textureUniforms.data();
-        m_shaderProgram->SetTexture(uniform.location, static_cast<int>(textureIndex), *uniform.texture);
+        // The program already reads the unit of the uniform, only the texture is bound
+        if (renderStateTracker)
+        {
+            renderStateTracker->BindTexture(uniform.textureUnit, *texture);
+        }
+        else
+        {
+            TextureObject::SetActiveTexture(uniform.textureUnit);
+            texture->Bind();
+        }
     }
 }
 
@@ -382,16 +588,15 @@ void ShaderUniformCollection::UseUniform<float>(const DataUniform& uniform) cons
 template<>
 void ShaderUniformCollection::GetUniformValue(ShaderProgram::Location location, std::shared_ptr<const TextureObject>& value) const
 {
-    const TextureUniform& uniform = GetTextureUniform(location);
-    value = uniform.texture;
+    value = GetTexture(GetTextureUniformIndex(location));
 }
 
 template<>
 void ShaderUniformCollection::SetUniformValue(ShaderProgram::Location location, const std::shared_ptr<const TextureObject>& value)
 {
-    TextureUniform& uniform = GetTextureUniform(location);
-    assert(!value || uniform.target == value->GetTarget());
-    uniform.texture = value;
+    int uniformIndex = GetTextureUniformIndex(location);
+    assert(!value || m_layout->textureUniforms[uniformIndex].target == value->GetTarget());
+    SetTexture(uniformIndex, value);
 }
 
 int ShaderUniformCollection::GetDataUniformSize(const DataUniform& uniform) const
@@ -439,14 +644,11 @@ int ShaderUniformCollection::GetDataUniformSize(const DataUniform& uniform) cons
 void ShaderUniformCollection::Reset()
 {
     m_shaderProgram = nullptr;
-    m_dataUniforms.clear();
-    m_textureUniforms.clear();
-    m_locationDataIndex.clear();
-    m_locationTextureIndex.clear();
-    m_intDataValues.clear();
-    m_uintDataValues.clear();
-    m_floatDataValues.clear();
-    m_doubleDataValues.clear();
+
+    // New blocks, the previous ones can still be used by copies
+    m_layout = std::make_shared<UniformLayout>();
+    m_values = std::make_shared<UniformValues>();
+    m_overrides = nullptr;
 }
 
 #ifndef NDEBUG
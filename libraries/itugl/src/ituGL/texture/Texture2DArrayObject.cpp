@@ -0,0 +1,25 @@
+#include <ituGL/texture/Texture2DArrayObject.h>
+
+#include <cassert>
+
+Texture2DArrayObject::Texture2DArrayObject()
+{
+}
+
+void Texture2DArrayObject::SetImage(GLint level, GLsizei width, GLsizei height, GLsizei layerCount, Format format, InternalFormat internalFormat)
+{
+    assert(IsBound());
+    assert(IsValidFormat(format, internalFormat));
+    assert(layerCount > 0);
+    glTexImage3D(GetTarget(), level, internalFormat, width, height, layerCount, 0, format, GL_UNSIGNED_BYTE, nullptr);
+}
+
+template <>
+void Texture2DArrayObject::SetLayerImage<std::byte>(GLint level, GLint layer, GLsizei width, GLsizei height, Format format, InternalFormat internalFormat, std::span<const std::byte> data, Data::Type type)
+{
+    assert(IsBound());
+    assert(type != Data::Type::None);
+    assert(IsValidFormat(format, internalFormat));
+    assert(data.size_bytes() == width * height * GetDataComponentCount(internalFormat) * Data::GetTypeSize(type));
+    glTexSubImage3D(GetTarget(), level, 0, 0, layer, width, height, 1, format, static_cast<GLenum>(type), data.data());
+}
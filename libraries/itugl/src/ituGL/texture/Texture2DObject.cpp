@@ -13,7 +13,18 @@ void Texture2DObject::SetImage<std::byte>(GLint level, GLsizei width, GLsizei he
     assert(data.empty() || type != Data::Type::None);
     assert(IsValidFormat(format, internalFormat));
     assert(data.empty() || data.size_bytes() == width * height * GetDataComponentCount(internalFormat) * Data::GetTypeSize(type));
-    glTexImage2D(GetTarget(), level, internalFormat, width, height, 0, format, type == Data::Type::None ? GL_BYTE : static_cast<GLenum>(type), data.data());
+    // Without data, the type still has to be valid for the format. Depth stencil only accepts packed types,
+    // even when the type is given, as in SetImage without data, which passes float
+    GLenum dataType = static_cast<GLenum>(type);
+    if (data.empty() && format == FormatDepthStencil)
+    {
+        dataType = GL_UNSIGNED_INT_24_8;
+    }
+    else if (type == Data::Type::None)
+    {
+        dataType = GL_BYTE;
+    }
+    glTexImage2D(GetTarget(), level, internalFormat, width, height, 0, format, dataType, data.data());
 }
 
 void Texture2DObject::SetImage(GLint level, GLsizei width, GLsizei height, Format format, InternalFormat internalFormat)
@@ -1,5 +1,6 @@
 #include <ituGL/texture/TextureObject.h>
 
+#include <ituGL/shader/RenderStateTracker.h>
 #include <cassert>
 
 TextureObject::TextureObject() : Object(NullHandle)
@@ -11,6 +12,10 @@ TextureObject::TextureObject() : Object(NullHandle)
 TextureObject::~TextureObject()
 {
     Handle& handle = GetHandle();
+    if (handle != NullHandle)
+    {
+        RenderStateTracker::ForgetTexture(handle);
+    }
     glDeleteTextures(1, &handle);
 }
 
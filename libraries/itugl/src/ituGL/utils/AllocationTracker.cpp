@@ -0,0 +1,452 @@
+#include <ituGL/utils/AllocationTracker.h>
+
+#include <ituGL/utils/DearImGui.h>
+#include <imgui.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+
+// Counters are in fixed arrays, so recording an allocation never allocates memory
+// Threads after the last slot share it, and sites that do not fit in the table are counted as "Other"
+static constexpr unsigned int s_maxThreadCount = 64;
+static constexpr unsigned int s_maxSiteCount = 256;
+
+struct AtomicCounters
+{
+    std::atomic<unsigned int> allocationCount;
+    std::atomic<size_t> allocatedBytes;
+    std::atomic<unsigned int> freeCount;
+
+    AllocationTracker::Counters Exchange()
+    {
+        AllocationTracker::Counters counters;
+        counters.allocationCount = allocationCount.exchange(0, std::memory_order_relaxed);
+        counters.allocatedBytes = allocatedBytes.exchange(0, std::memory_order_relaxed);
+        counters.freeCount = freeCount.exchange(0, std::memory_order_relaxed);
+        return counters;
+    }
+};
+
+struct Site
+{
+    std::atomic<const char*> tag;
+    AtomicCounters counters;
+};
+
+struct ThreadState
+{
+    // Tag of the innermost scope
+    const char* tag = nullptr;
+    int slot = -1;
+    // Allocations of the tracker itself are not counted
+    unsigned int suppressed = 0;
+};
+
+static const char* const s_untaggedTag = "Untagged";
+static const char* const s_otherTag = "Other";
+
+static std::atomic<bool> s_enabled;
+
+static AtomicCounters s_threads[s_maxThreadCount];
+static std::atomic<unsigned int> s_threadCount;
+
+static Site s_sites[s_maxSiteCount];
+static Site s_otherSite;
+
+static thread_local ThreadState s_threadState;
+
+// Allocations made by the tracker itself are not counted while this exists
+class SuppressScope
+{
+public:
+    SuppressScope() { s_threadState.suppressed++; }
+    ~SuppressScope() { s_threadState.suppressed--; }
+};
+
+#ifdef ITUGL_ALLOCATION_TRACKER
+
+static AtomicCounters& GetThreadCounters()
+{
+    if (s_threadState.slot < 0)
+    {
+        unsigned int slot = s_threadCount.fetch_add(1, std::memory_order_relaxed);
+        s_threadState.slot = static_cast<int>(std::min(slot, s_maxThreadCount - 1));
+    }
+    return s_threads[s_threadState.slot];
+}
+
+static Site& FindSite(const char* tag)
+{
+    // Open addressing by the tag address
+    size_t hash = (reinterpret_cast<std::uintptr_t>(tag) >> 3) % s_maxSiteCount;
+    for (unsigned int probe = 0; probe < s_maxSiteCount; ++probe)
+    {
+        Site& site = s_sites[(hash + probe) % s_maxSiteCount];
+        const char* siteTag = site.tag.load(std::memory_order_acquire);
+        if (!siteTag)
+        {
+            // The slot is free, unless another thread takes it first
+            site.tag.compare_exchange_strong(siteTag, tag, std::memory_order_acq_rel);
+            if (!siteTag || siteTag == tag)
+            {
+                return site;
+            }
+        }
+        else if (siteTag == tag)
+        {
+            return site;
+        }
+    }
+    return s_otherSite;
+}
+
+static void RecordAllocation(size_t size)
+{
+    if (!s_enabled.load(std::memory_order_relaxed) || s_threadState.suppressed)
+    {
+        return;
+    }
+
+    AtomicCounters& threadCounters = GetThreadCounters();
+    threadCounters.allocationCount.fetch_add(1, std::memory_order_relaxed);
+    threadCounters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    Site& site = FindSite(s_threadState.tag ? s_threadState.tag : s_untaggedTag);
+    site.counters.allocationCount.fetch_add(1, std::memory_order_relaxed);
+    site.counters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void RecordFree()
+{
+    if (!s_enabled.load(std::memory_order_relaxed) || s_threadState.suppressed)
+    {
+        return;
+    }
+
+    GetThreadCounters().freeCount.fetch_add(1, std::memory_order_relaxed);
+
+    Site& site = FindSite(s_threadState.tag ? s_threadState.tag : s_untaggedTag);
+    site.counters.freeCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void* Allocate(size_t size)
+{
+    RecordAllocation(size);
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    // Same as the default operator new: call the new handler until the allocation succeeds
+    while (true)
+    {
+        void* pointer = std::malloc(size);
+        if (pointer)
+        {
+            return pointer;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+        {
+            return nullptr;
+        }
+        handler();
+    }
+}
+
+static void Free(void* pointer)
+{
+    if (pointer)
+    {
+        RecordFree();
+        std::free(pointer);
+    }
+}
+
+// Replacements of the global operators. Aligned versions keep the default implementation and are not counted
+void* operator new(size_t size)
+{
+    void* pointer = Allocate(size);
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return Allocate(size);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t& nothrow) noexcept
+{
+    return operator new(size, nothrow);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    Free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    Free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    Free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    Free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    Free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    Free(pointer);
+}
+
+#endif // ITUGL_ALLOCATION_TRACKER
+
+AllocationTracker::Scope::Scope(const char* tag) : m_previousTag(s_threadState.tag)
+{
+    s_threadState.tag = tag;
+}
+
+AllocationTracker::Scope::~Scope()
+{
+    s_threadState.tag = m_previousTag;
+}
+
+AllocationTracker::AllocationTracker() : m_frameIndex(0), m_maxSiteCount(16)
+{
+}
+
+AllocationTracker& AllocationTracker::GetInstance()
+{
+    static AllocationTracker allocationTracker;
+    return allocationTracker;
+}
+
+bool AllocationTracker::IsEnabled() const
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::SetEnabled(bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void AllocationTracker::EndFrame()
+{
+    SuppressScope suppressScope;
+
+    m_report.frameIndex = m_frameIndex++;
+    m_report.total = Counters();
+
+    unsigned int threadCount = std::min(s_threadCount.load(std::memory_order_relaxed), s_maxThreadCount);
+    m_report.threads.resize(threadCount);
+    for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+    {
+        Counters counters = s_threads[threadIndex].Exchange();
+        m_report.threads[threadIndex] = counters;
+        m_report.total.allocationCount += counters.allocationCount;
+        m_report.total.allocatedBytes += counters.allocatedBytes;
+        m_report.total.freeCount += counters.freeCount;
+    }
+
+    // The same literal can have different addresses in different files, so sites are merged by name
+    m_report.sites.clear();
+    auto addSite = [&](const char* tag, const Counters& counters)
+    {
+        if (counters.allocationCount == 0 && counters.freeCount == 0)
+        {
+            return;
+        }
+
+        auto itSite = std::find_if(m_report.sites.begin(), m_report.sites.end(),
+            [tag](const SiteReport& site) { return std::strcmp(site.tag, tag) == 0; });
+        if (itSite == m_report.sites.end())
+        {
+            m_report.sites.push_back(SiteReport{ tag, counters });
+        }
+        else
+        {
+            itSite->counters.allocationCount += counters.allocationCount;
+            itSite->counters.allocatedBytes += counters.allocatedBytes;
+            itSite->counters.freeCount += counters.freeCount;
+        }
+    };
+
+    for (Site& site : s_sites)
+    {
+        if (const char* tag = site.tag.load(std::memory_order_acquire))
+        {
+            addSite(tag, site.counters.Exchange());
+        }
+    }
+    addSite(s_otherTag, s_otherSite.counters.Exchange());
+
+    std::sort(m_report.sites.begin(), m_report.sites.end(), [](const SiteReport& a, const SiteReport& b)
+        {
+            return a.counters.allocationCount > b.counters.allocationCount;
+        });
+    if (m_report.sites.size() > m_maxSiteCount)
+    {
+        m_report.sites.resize(m_maxSiteCount);
+    }
+
+    if (IsEnabled())
+    {
+        m_steadyState.frameCount++;
+        if (!m_steadyState.IsWarmingUp() && m_report.total.allocationCount > 0)
+        {
+            m_steadyState.allocatingFrameCount++;
+            m_steadyState.allocationCount += m_report.total.allocationCount;
+            m_steadyState.lastAllocatingReport = m_report;
+        }
+    }
+}
+
+void AllocationTracker::StartSteadyState(unsigned int warmupFrameCount)
+{
+    SuppressScope suppressScope;
+
+    m_steadyState = SteadyState();
+    m_steadyState.warmupFrameCount = warmupFrameCount;
+}
+
+void AllocationTracker::DrawGUI(DearImGui& imGui)
+{
+    SuppressScope suppressScope;
+
+    if (auto window = imGui.UseWindow("Allocations"))
+    {
+        bool enabled = IsEnabled();
+        if (ImGui::Checkbox("Enabled", &enabled))
+        {
+            SetEnabled(enabled);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Save report"))
+        {
+            SaveReport("allocations.txt");
+        }
+
+#ifndef ITUGL_ALLOCATION_TRACKER
+        ImGui::TextUnformatted("Built without ITUGL_ALLOCATION_TRACKER, nothing is counted");
+#endif
+
+        const SteadyState& steadyState = m_steadyState;
+        if (steadyState.IsWarmingUp())
+        {
+            ImGui::Text("Steady state: warming up, frame %u of %u", steadyState.frameCount, steadyState.warmupFrameCount);
+        }
+        else if (steadyState.IsSteady())
+        {
+            ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Steady state: no allocations in %u frames",
+                steadyState.frameCount - steadyState.warmupFrameCount);
+        }
+        else
+        {
+            ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Steady state: %u of %u frames allocated, %u allocations, last in frame %u",
+                steadyState.allocatingFrameCount, steadyState.frameCount - steadyState.warmupFrameCount,
+                steadyState.allocationCount, steadyState.lastAllocatingReport.frameIndex);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Restart"))
+        {
+            StartSteadyState(steadyState.warmupFrameCount);
+        }
+
+        const Counters& total = m_report.total;
+        ImGui::Text("Frame %u: %u allocations, %.1f KB, %u frees", m_report.frameIndex,
+            total.allocationCount, total.allocatedBytes / 1024.0f, total.freeCount);
+
+        ImGui::Separator();
+        for (unsigned int threadIndex = 0; threadIndex < m_report.threads.size(); ++threadIndex)
+        {
+            const Counters& counters = m_report.threads[threadIndex];
+            ImGui::Text("Thread %u: %u allocations, %.1f KB, %u frees", threadIndex,
+                counters.allocationCount, counters.allocatedBytes / 1024.0f, counters.freeCount);
+        }
+
+        ImGui::Separator();
+        ImGui::Text("%-24s %8s %10s %8s", "Site", "Count", "KB", "Frees");
+        for (const SiteReport& site : m_report.sites)
+        {
+            ImGui::Text("%-24s %8u %10.1f %8u", site.tag, site.counters.allocationCount,
+                site.counters.allocatedBytes / 1024.0f, site.counters.freeCount);
+        }
+    }
+}
+
+bool AllocationTracker::SaveReport(const char* path) const
+{
+    SuppressScope suppressScope;
+
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    const SteadyState& steadyState = m_steadyState;
+    file << "Steady state: " << steadyState.frameCount << " frames, " << steadyState.warmupFrameCount << " of warm-up, "
+        << steadyState.allocatingFrameCount << " allocated, " << steadyState.allocationCount << " allocations";
+    if (steadyState.allocatingFrameCount > 0)
+    {
+        file << ", last in frame " << steadyState.lastAllocatingReport.frameIndex;
+    }
+    file << "\n";
+    for (const SiteReport& site : steadyState.lastAllocatingReport.sites)
+    {
+        file << "  " << site.tag << ": " << site.counters.allocationCount << " allocations\n";
+    }
+
+    const Counters& total = m_report.total;
+    file << "Frame " << m_report.frameIndex << ": " << total.allocationCount << " allocations, "
+        << total.allocatedBytes << " bytes, " << total.freeCount << " frees\n";
+
+    for (unsigned int threadIndex = 0; threadIndex < m_report.threads.size(); ++threadIndex)
+    {
+        const Counters& counters = m_report.threads[threadIndex];
+        file << "Thread " << threadIndex << ": " << counters.allocationCount << " allocations, "
+            << counters.allocatedBytes << " bytes, " << counters.freeCount << " frees\n";
+    }
+
+    for (const SiteReport& site : m_report.sites)
+    {
+        file << site.tag << ": " << site.counters.allocationCount << " allocations, "
+            << site.counters.allocatedBytes << " bytes, " << site.counters.freeCount << " frees\n";
+    }
+
+    return static_cast<bool>(file);
+}
@@ -1,13 +1,32 @@
 #include <ituGL/utils/DearImGui.h>
 
 #include <ituGL/application/Window.h>
+#include <ituGL/application/FramePacket.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
+#include <cstring>
+#include <new>
+
+// Point the vector to a copy of the elements in the arena. The vector must not grow or free it
+template<typename T>
+static void CopyToArena(FrameArena& arena, const ImVector<T>& source, ImVector<T>& destination)
+{
+    if (source.Size > 0)
+    {
+        destination.Data = static_cast<T*>(arena.Allocate(source.Size * sizeof(T), alignof(T)));
+        std::memcpy(destination.Data, source.Data, source.Size * sizeof(T));
+        destination.Size = destination.Capacity = source.Size;
+    }
+}
 
 DearImGui::DearImGui()
 {
     IMGUI_CHECKVERSION();
+
+    // Through the global operator new, so the allocation tracker counts them
+    ImGui::SetAllocatorFunctions([](size_t size, void*) { return ::operator new(size); },
+        [](void* pointer, void*) { ::operator delete(pointer); });
     ImGui::CreateContext();
 
     // Setup Dear ImGui style
@@ -24,6 +43,9 @@ void DearImGui::Initialize(::Window& window)
     // Setup Platform/Renderer bindings
     ImGui_ImplGlfw_InitForOpenGL(window.GetInternalWindow(), true);
     ImGui_ImplOpenGL3_Init("#version 410 core");
+
+    // Created now, with the context, instead of in the first frame, that may be recorded without it
+    ImGui_ImplOpenGL3_CreateDeviceObjects();
 }
 
 void DearImGui::Cleanup()
@@ -45,6 +67,31 @@ void DearImGui::EndFrame()
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void DearImGui::EndFrame(FramePacket& framePacket)
+{
+    ImGui::Render();
+
+    // ImGui reuses its draw lists in the next frame, so the packet gets its own copy, in its arena
+    // The copies are never destroyed, the arena releases their memory when the packet records the next frame
+    FrameArena& arena = framePacket.GetArena();
+    const ImDrawData& drawData = *ImGui::GetDrawData();
+    ImDrawData* drawDataCopy = new (arena.Allocate(sizeof(ImDrawData), alignof(ImDrawData))) ImDrawData(drawData);
+    drawDataCopy->CmdLists = static_cast<ImDrawList**>(arena.Allocate(drawData.CmdListsCount * sizeof(ImDrawList*), alignof(ImDrawList*)));
+    for (int drawListIndex = 0; drawListIndex < drawData.CmdListsCount; ++drawListIndex)
+    {
+        // Only the output buffers, like ImDrawList::CloneOutput
+        const ImDrawList& drawList = *drawData.CmdLists[drawListIndex];
+        ImDrawList* drawListCopy = new (arena.Allocate(sizeof(ImDrawList), alignof(ImDrawList))) ImDrawList(drawList._Data);
+        CopyToArena(arena, drawList.CmdBuffer, drawListCopy->CmdBuffer);
+        CopyToArena(arena, drawList.IdxBuffer, drawListCopy->IdxBuffer);
+        CopyToArena(arena, drawList.VtxBuffer, drawListCopy->VtxBuffer);
+        drawListCopy->Flags = drawList.Flags;
+        drawDataCopy->CmdLists[drawListIndex] = drawListCopy;
+    }
+
+    framePacket.Record([drawDataCopy]() { ImGui_ImplOpenGL3_RenderDrawData(drawDataCopy); });
+}
+
 DearImGui::Window DearImGui::UseWindow(const char* name)
 {
     return name;
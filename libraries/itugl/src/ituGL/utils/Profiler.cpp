@@ -0,0 +1,247 @@
+#include <ituGL/utils/Profiler.h>
+
+#include <ituGL/utils/DearImGui.h>
+#include <imgui.h>
+#include <cassert>
+#include <cstring>
+
+Profiler::Scope::Scope(Profiler& profiler, const char* name) : m_profiler(profiler)
+{
+    m_profiler.BeginSection(name);
+}
+
+Profiler::Scope::~Scope()
+{
+    m_profiler.EndSection();
+}
+
+Profiler::Profiler(unsigned int frameLatency)
+    : m_frameSlots(frameLatency + 1)
+    , m_currentSlot(0)
+    , m_gpuTimingEnabled(true)
+    , m_inFrame(false)
+    , m_cpuHistory(120, 0.0f)
+    , m_gpuHistory(120, 0.0f)
+    , m_historyIndex(0)
+{
+    assert(frameLatency > 0);
+}
+
+void Profiler::BeginFrame()
+{
+    assert(!m_inFrame);
+
+    // Move to the next slot. Its queries were issued frameLatency frames ago, so they should be ready
+    m_currentSlot = (m_currentSlot + 1) % m_frameSlots.size();
+    ResolveSlot(m_frameSlots[m_currentSlot]);
+
+    m_inFrame = true;
+    BeginSection("Frame");
+}
+
+void Profiler::EndFrame()
+{
+    assert(m_inFrame);
+    EndSection();
+    assert(m_openSections.empty());
+    m_inFrame = false;
+
+    // CPU times are available immediately
+    for (Section& section : m_sections)
+    {
+        section.cpuTime = section.cpuAccumulated;
+        section.cpuAccumulated = 0.0f;
+    }
+
+    m_historyIndex = (m_historyIndex + 1) % m_cpuHistory.size();
+    m_cpuHistory[m_historyIndex] = GetFrameCpuTime();
+    m_gpuHistory[m_historyIndex] = GetFrameGpuTime();
+}
+
+void Profiler::BeginSection(const char* name)
+{
+    assert(m_inFrame);
+
+    OpenSection openSection;
+    int parentIndex = m_openSections.empty() ? -1 : m_openSections.back().sectionIndex;
+    openSection.sectionIndex = FindOrAddSection(name, parentIndex);
+    openSection.beginQuery = m_gpuTimingEnabled ? RecordTimestamp() : -1;
+    openSection.cpuStart = Clock::now();
+    m_openSections.push_back(openSection);
+}
+
+void Profiler::EndSection()
+{
+    assert(!m_openSections.empty());
+    const OpenSection& openSection = m_openSections.back();
+
+    std::chrono::duration<float, std::milli> cpuDuration = Clock::now() - openSection.cpuStart;
+    m_sections[openSection.sectionIndex].cpuAccumulated += cpuDuration.count();
+
+    if (openSection.beginQuery >= 0)
+    {
+        GpuRecord record;
+        record.sectionIndex = openSection.sectionIndex;
+        record.beginQuery = openSection.beginQuery;
+        record.endQuery = RecordTimestamp();
+        m_frameSlots[m_currentSlot].records.push_back(record);
+    }
+
+    m_openSections.pop_back();
+}
+
+float Profiler::GetFrameCpuTime() const
+{
+    return m_sections.empty() ? 0.0f : m_sections[0].cpuTime;
+}
+
+float Profiler::GetFrameGpuTime() const
+{
+    return m_sections.empty() ? 0.0f : m_sections[0].gpuTime;
+}
+
+float Profiler::GetCpuTime(const char* name) const
+{
+    float time = 0.0f;
+    for (const Section& section : m_sections)
+    {
+        if (section.name == name)
+        {
+            time += section.cpuTime;
+        }
+    }
+    return time;
+}
+
+float Profiler::GetGpuTime(const char* name) const
+{
+    float time = 0.0f;
+    for (const Section& section : m_sections)
+    {
+        if (section.name == name)
+        {
+            time += section.gpuTime;
+        }
+    }
+    return time;
+}
+
+void Profiler::GetResults(Results& results) const
+{
+    results.sections.resize(m_sections.size());
+    for (size_t index = 0; index < m_sections.size(); ++index)
+    {
+        const Section& section = m_sections[index];
+        results.sections[index].name = section.name;
+        results.sections[index].parentIndex = section.parentIndex;
+        results.sections[index].cpuTime = section.cpuTime;
+        results.sections[index].gpuTime = section.gpuTime;
+    }
+
+    results.cpuHistory = m_cpuHistory;
+    results.gpuHistory = m_gpuHistory;
+    results.historyIndex = m_historyIndex;
+}
+
+void Profiler::DrawGUI(DearImGui& imGui)
+{
+    Results results;
+    GetResults(results);
+    DrawGUI(imGui, results, m_gpuTimingEnabled);
+}
+
+bool Profiler::DrawGUI(DearImGui& imGui, const Results& results, bool& gpuTimingEnabled)
+{
+    bool changed = false;
+    if (auto window = imGui.UseWindow("Profiler"))
+    {
+        changed = ImGui::Checkbox("GPU timing", &gpuTimingEnabled);
+
+        int historySize = static_cast<int>(results.cpuHistory.size());
+        int historyOffset = historySize > 0 ? static_cast<int>(results.historyIndex + 1) % historySize : 0;
+        ImGui::PlotLines("CPU (ms)", results.cpuHistory.data(), historySize, historyOffset, nullptr, 0.0f, 33.3f, ImVec2(0, 40));
+        ImGui::PlotLines("GPU (ms)", results.gpuHistory.data(), historySize, historyOffset, nullptr, 0.0f, 33.3f, ImVec2(0, 40));
+
+        ImGui::Separator();
+        ImGui::Text("%-24s %8s %8s", "Section", "CPU ms", "GPU ms");
+        for (int index = 0; index < static_cast<int>(results.sections.size()); ++index)
+        {
+            if (results.sections[index].parentIndex < 0)
+            {
+                DrawSectionGUI(results, index, 0);
+            }
+        }
+    }
+    return changed;
+}
+
+void Profiler::DrawSectionGUI(const Results& results, int sectionIndex, int depth)
+{
+    const Results::Section& section = results.sections[sectionIndex];
+    ImGui::Text("%*s%-*s %8.3f %8.3f", depth * 2, "", 24 - depth * 2, section.name.c_str(), section.cpuTime, section.gpuTime);
+
+    // Children are always added after their parent
+    for (int index = sectionIndex + 1; index < static_cast<int>(results.sections.size()); ++index)
+    {
+        if (results.sections[index].parentIndex == sectionIndex)
+        {
+            DrawSectionGUI(results, index, depth + 1);
+        }
+    }
+}
+
+int Profiler::FindOrAddSection(const char* name, int parentIndex)
+{
+    // Linear search, there are only a few sections per frame
+    for (int index = 0; index < static_cast<int>(m_sections.size()); ++index)
+    {
+        const Section& section = m_sections[index];
+        if (section.parentIndex == parentIndex && std::strcmp(section.name.c_str(), name) == 0)
+        {
+            return index;
+        }
+    }
+
+    Section section;
+    section.name = name;
+    section.parentIndex = parentIndex;
+    section.cpuTime = 0.0f;
+    section.gpuTime = 0.0f;
+    section.cpuAccumulated = 0.0f;
+    m_sections.push_back(section);
+    return static_cast<int>(m_sections.size()) - 1;
+}
+
+int Profiler::RecordTimestamp()
+{
+    FrameSlot& slot = m_frameSlots[m_currentSlot];
+    if (slot.usedQueries == slot.queries.size())
+    {
+        slot.queries.emplace_back(QueryObject::Target::Timestamp);
+    }
+
+    int queryIndex = static_cast<int>(slot.usedQueries++);
+    slot.queries[queryIndex].QueryCounter();
+    return queryIndex;
+}
+
+void Profiler::ResolveSlot(FrameSlot& slot)
+{
+    if (!slot.records.empty())
+    {
+        for (Section& section : m_sections)
+        {
+            section.gpuTime = 0.0f;
+        }
+
+        for (const GpuRecord& record : slot.records)
+        {
+            GLuint64 beginTime = slot.queries[record.beginQuery].GetResult();
+            GLuint64 endTime = slot.queries[record.endQuery].GetResult();
+            m_sections[record.sectionIndex].gpuTime += static_cast<float>(endTime - beginTime) * 1e-6f;
+        }
+    }
+
+    slot.records.clear();
+    slot.usedQueries = 0;
+}
@@ -0,0 +1,102 @@
+#include <ituGL/utils/QualityGovernor.h>
+
+#include <ituGL/utils/DearImGui.h>
+#include <imgui.h>
+#include <algorithm>
+#include <cassert>
+
+QualityGovernor::QualityGovernor(int levelCount, float targetFrameTime)
+    : m_levelCount(levelCount)
+    , m_level(0)
+    , m_enabled(true)
+    , m_targetFrameTime(targetFrameTime)
+    , m_filteredFrameTime(0.0f)
+    , m_upperThreshold(1.05f)
+    , m_lowerThreshold(0.75f)
+    , m_smoothing(0.1f)
+    , m_framesToLower(10)
+    , m_framesToRaise(90)
+    , m_cooldownFrames(30)
+    , m_overBudgetFrames(0)
+    , m_underBudgetFrames(0)
+    , m_cooldown(0)
+{
+    assert(levelCount > 0);
+}
+
+void QualityGovernor::SetLevel(int level)
+{
+    m_level = std::clamp(level, 0, m_levelCount - 1);
+    m_overBudgetFrames = 0;
+    m_underBudgetFrames = 0;
+    m_cooldown = m_cooldownFrames;
+}
+
+bool QualityGovernor::Update(float cpuFrameTime, float gpuFrameTime)
+{
+    // The slowest of the two processors limits the frame rate
+    float frameTime = std::max(cpuFrameTime, gpuFrameTime);
+    m_filteredFrameTime = m_filteredFrameTime > 0.0f ? m_filteredFrameTime + (frameTime - m_filteredFrameTime) * m_smoothing : frameTime;
+
+    if (!m_enabled)
+    {
+        return false;
+    }
+
+    if (m_cooldown > 0)
+    {
+        --m_cooldown;
+        return false;
+    }
+
+    if (m_filteredFrameTime > m_targetFrameTime * m_upperThreshold)
+    {
+        ++m_overBudgetFrames;
+        m_underBudgetFrames = 0;
+    }
+    else if (m_filteredFrameTime < m_targetFrameTime * m_lowerThreshold)
+    {
+        ++m_underBudgetFrames;
+        m_overBudgetFrames = 0;
+    }
+    else
+    {
+        // Inside the hysteresis band, keep the current level
+        m_overBudgetFrames = 0;
+        m_underBudgetFrames = 0;
+    }
+
+    int level = m_level;
+    if (m_overBudgetFrames >= m_framesToLower)
+    {
+        level = m_level + 1;
+    }
+    else if (m_underBudgetFrames >= m_framesToRaise)
+    {
+        level = m_level - 1;
+    }
+
+    level = std::clamp(level, 0, m_levelCount - 1);
+    if (level == m_level)
+    {
+        return false;
+    }
+
+    SetLevel(level);
+    return true;
+}
+
+void QualityGovernor::DrawGUI(DearImGui& imGui)
+{
+    if (auto window = imGui.UseWindow("Quality Governor"))
+    {
+        ImGui::Checkbox("Enabled", &m_enabled);
+        ImGui::SliderFloat("Target (ms)", &m_targetFrameTime, 2.0f, 33.3f);
+        ImGui::Text("Filtered frame time: %.2f ms", m_filteredFrameTime);
+        ImGui::Text("Level: %d / %d", m_level, m_levelCount - 1);
+        ImGui::SliderFloat("Upper threshold", &m_upperThreshold, 1.0f, 1.5f);
+        ImGui::SliderFloat("Lower threshold", &m_lowerThreshold, 0.5f, 1.0f);
+        ImGui::SliderInt("Frames to lower", &m_framesToLower, 1, 120);
+        ImGui::SliderInt("Frames to raise", &m_framesToRaise, 1, 600);
+    }
+}